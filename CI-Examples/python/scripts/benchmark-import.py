@@ -0,0 +1,23 @@
+#!/usr/bin/env python3
+
+# Measures the time of importing a set of standard library modules. Most of this time is spent
+# on looking up non-existent files in every `sys.path` entry, so it is a good benchmark for path
+# lookups (in particular, for caching of failed lookups, see `immutable` mount option).
+
+import importlib
+import time
+
+MODULES = [
+    'argparse', 'asyncio', 'base64', 'collections', 'concurrent.futures', 'csv', 'dataclasses',
+    'datetime', 'decimal', 'email.message', 'fractions', 'hashlib', 'http.client', 'json',
+    'logging', 'multiprocessing', 'pathlib', 'pickle', 'random', 'shutil', 'socket', 'sqlite3',
+    'statistics', 'subprocess', 'tarfile', 'tempfile', 'textwrap', 'threading', 'typing',
+    'unittest', 'urllib.request', 'uuid', 'xml.etree.ElementTree', 'zipfile',
+]
+
+start = time.perf_counter()
+for module in MODULES:
+    importlib.import_module(module)
+end = time.perf_counter()
+
+print(f'Imported {len(MODULES)} modules in {(end - start) * 1000:.1f} ms')
@@ -48,8 +48,8 @@ static int verify_measurements_callback(const char* mrenclave, const char* mrsig
     return 0;
 }
 
-/* this callback is called in a new thread associated with a client; be careful to make this code
- * thread-local and/or thread-safe */
+/* this callback is called in one of the server's worker threads, possibly concurrently with other
+ * clients; be careful to make this code thread-local and/or thread-safe */
 static int communicate_with_client_callback(struct ra_tls_ctx* ctx) {
     int ret;
 
@@ -52,11 +52,23 @@ struct shim_cp_entry {
     uintptr_t cp_val;
 };
 
+/* Range of pages (relative to the beginning of a memory entry) whose contents are sent. */
+struct shim_mem_run {
+    size_t offset;
+    size_t size;
+};
+
 struct shim_mem_entry {
     struct shim_mem_entry* next;
     void* addr;
     size_t size;
     pal_prot_flags_t prot; /* combination of PAL_PROT_* flags */
+
+    /* If `sparse` is set, only contents of `runs` are sent and the rest of the region is restored
+     * as fresh zero-filled memory. Otherwise the whole region is sent. */
+    bool sparse;
+    size_t runs_cnt;
+    struct shim_mem_run* runs;
 };
 
 struct shim_palhdl_entry {
@@ -344,6 +356,18 @@ struct checkpoint_hdr {
 typedef int (*migrate_func_t)(struct shim_cp_store*, struct shim_process*, struct shim_thread*,
                               struct shim_ipc_ids*, va_list);
 
+/*!
+ * \brief Initialize the pool of pre-created child processes (`libos.prefork_pool_size`).
+ */
+int init_prefork_pool(void);
+
+/*!
+ * \brief Close all idle processes in the prefork pool and stop refilling it.
+ *
+ * Called on process exit.
+ */
+void destroy_prefork_pool(void);
+
 /*!
  * \brief Create child process and migrate state to it.
  *
@@ -120,6 +120,26 @@ struct shim_dentry {
     LISTP_TYPE(shim_dentry) children; /* These children and siblings link */
     LIST_TYPE(shim_dentry) siblings;
 
+    /* For a negative dentry: time (in microseconds) until which the failed lookup is cached and
+     * the filesystem does not have to be asked again, UINT64_MAX if forever, 0 if not cached. See
+     * `immutable` and `negative_ttl_us` in `shim_mount`. Protected by `g_dcache_lock`. */
+    uint64_t negative_until;
+
+    /* Incremented every time a lookup of this dentry finishes, so that a thread waiting for
+     * another thread's lookup (see `unlocked_lookup` in `shim_d_ops`) can tell that it does not
+     * have to repeat it. Protected by `g_dcache_lock`. */
+    uint64_t lookup_seq;
+
+    /* Absolute path and path relative to the mount root, computed on first use (see
+     * `dentry_cached_abs_path`). A dentry is never renamed or moved (`rename` moves the inode to
+     * another dentry instead), so once set, these do not change. Set atomically. */
+    char* cached_abs_path;
+    char* cached_rel_path;
+
+    /* Cached result of `hash_abs_path`, valid if `abs_path_hash_valid` is set. Set atomically. */
+    HASHTYPE abs_path_hash;
+    bool abs_path_hash_valid;
+
     /* Filesystem mounted under this dentry. If set, this dentry is a mountpoint: filesystem
      * operations should use `attached_mount->root` instead of this dentry. Protected by
      * `g_dcache_lock`. */
@@ -167,6 +187,13 @@ struct shim_inode {
     /* Filesystem-specific data */
     void* data;
 
+    /* Pages cached by `shim_fs_cache.c`, and a counter of their invalidations. Protected by the
+     * page cache lock. `cache_disabled` is set (and never cleared) once the file is mapped in a way
+     * that allows modifying it without going through `write()`, see `fs_cache_disable`. */
+    struct fs_cache_page* cache_pages;
+    uint64_t cache_seq;
+    bool cache_disabled;
+
     struct shim_lock lock;
     REFTYPE ref_count;
 };
@@ -175,6 +202,13 @@ typedef int (*readdir_callback_t)(const char* name, void* arg);
 
 /* TODO: Some of these operations could be simplified if they take an `inode` parameter. */
 struct shim_d_ops {
+    /*
+     * If set, `lookup` and `readdir` are called without `g_dcache_lock` (see their description).
+     * Intended for filesystems where these operations are slow (e.g. query the host), so that they
+     * do not block path lookups in other threads.
+     */
+    bool unlocked_lookup;
+
     /*
      * \brief Look up a file.
      *
@@ -183,7 +217,10 @@ struct shim_d_ops {
      * Queries the underlying filesystem for a path described by a dentry (`dent->name` and
      * `dent->parent`). On success, creates an inode and attaches it to the dentry.
      *
-     * The caller should hold `g_dcache_lock`.
+     * The caller should hold `g_dcache_lock`, unless `unlocked_lookup` is set. In the latter case,
+     * the caller holds a reference to the dentry and guarantees that no other thread looks it up
+     * (or creates the file) at the same time; the operation should take `g_dcache_lock` only for
+     * attaching the inode.
      */
     int (*lookup)(struct shim_dentry* dent);
 
@@ -315,7 +352,9 @@ struct shim_d_ops {
      * If the callback returns a negative error code, it's interpreted as a failure and `readdir`
      * stops, returning the same error code.
      *
-     * The caller should hold `g_dcache_lock`.
+     * The caller should hold `g_dcache_lock`, unless `unlocked_lookup` is set. In the latter case,
+     * the caller holds a reference to the dentry, and the operation should not access the dentry
+     * cache.
      */
     int (*readdir)(struct shim_dentry* dent, readdir_callback_t callback, void* arg);
 
@@ -387,11 +426,33 @@ struct shim_mount {
     void* cpdata;
     size_t cpsize;
 
+    /* Caching of failed lookups (see `struct shim_mount_params`). Do not change. */
+    bool immutable;
+    uint64_t negative_ttl_us;
+
     REFTYPE ref_count;
     LIST_TYPE(shim_mount) hlist;
     LIST_TYPE(shim_mount) list;
 };
 
+struct shim_mount_params {
+    /* Filesystem type (currently defined in `mountable_fs` in `shim_fs.c`) */
+    const char* type;
+
+    /* Path to the mountpoint */
+    const char* path;
+
+    /* PAL URI to mount, or NULL if not applicable */
+    const char* uri;
+
+    /* Files in the mount are not created or deleted by the host (or other processes) during
+     * execution, so a failed lookup can be cached for the lifetime of the process */
+    bool immutable;
+
+    /* If not immutable: how long (in microseconds) a failed lookup can be cached, 0 to disable */
+    uint64_t negative_ttl_us;
+};
+
 extern struct shim_dentry* g_dentry_root;
 
 #define F_OK 0
@@ -421,17 +482,15 @@ int init_mount(void);
 /*!
  * \brief Mount a new filesystem.
  *
- * \param type        Filesystem type (currently defined in `mountable_fs` in `shim_fs.c`).
- * \param uri         PAL URI to mount, or NULL if not applicable.
- * \param mount_path  Path to the mountpoint.
+ * \param params  Mount parameters (see `struct shim_mount_params`).
  *
  * Creates a new `shim_mount` structure (mounted filesystem) and attaches to the dentry under
- * `mount_path`. That means (assuming the dentry is called `mount_point`):
+ * `params->path`. That means (assuming the dentry is called `mount_point`):
  *
  * - `mount_point->attached_mount` is the new filesystem,
  * - `mount_point->attached_mount->root` is the dentry of new filesystem's root.
  *
- * Subsequent lookups for `mount_path` and paths starting with `mount_path` will retrieve the new
+ * Subsequent lookups for `params->path` and paths starting with it will retrieve the new
  * filesystem's root, not the mountpoint.
  *
  * As a result, multiple mount operations for the same path will create a chain (mount1 -> root1 ->
@@ -443,7 +502,7 @@ int init_mount(void);
  *
  * TODO: On failure, this function does not clean the synthetic nodes it just created.
  */
-int mount_fs(const char* type, const char* uri, const char* mount_path);
+int mount_fs(struct shim_mount_params* params);
 
 void get_mount(struct shim_mount* mount);
 void put_mount(struct shim_mount* mount);
@@ -543,6 +602,10 @@ int check_permissions(struct shim_dentry* dent, mode_t mask);
  * Note that a path with trailing slash is always treated as a directory, and LOOKUP_FOLLOW /
  * LOOKUP_CREATE do not apply.
  *
+ * For filesystems with `unlocked_lookup`, the function temporarily releases `g_dcache_lock` while
+ * the filesystem is queried. The caller should not hold any other lock taken after
+ * `g_dcache_lock`, and should not rely on the state of dentries examined before the call.
+ *
  * TODO: This function doesn't check any permissions. It should return -EACCES on inaccessible
  * directories.
  */
@@ -623,7 +686,8 @@ int dentry_open(struct shim_handle* hdl, struct shim_dentry* dent, int flags);
  * This function populates the `hdl->dir_info` structure with current dentries in a directory, so
  * that the directory can be listed using `getdents/getdents64` syscalls.
  *
- * The caller should hold `g_dcache_lock` and `hdl->lock`.
+ * The caller should hold `g_dcache_lock` and `hdl->lock`. Both locks might be temporarily released
+ * while the directory is listed (see `path_lookupat`).
  *
  * If the handle is currently populated (i.e. `hdl->dir_info.dents` is not null), this function is a
  * no-op. If you want to refresh the handle with new contents, call `clear_directory_handle` first.
@@ -688,6 +752,28 @@ struct shim_dentry* dentry_up(struct shim_dentry* dent);
  */
 void dentry_gc(struct shim_dentry* dent);
 
+/*!
+ * \brief Get the absolute path of a dentry, without copying it.
+ *
+ * \param      dent      The dentry.
+ * \param[out] out_path  Will be set to the path.
+ * \param[out] out_size  If not NULL, will be set to path size, including null terminator.
+ *
+ * \returns 0 on success, negative error code otherwise.
+ *
+ * Same as `dentry_abs_path`, but the path is computed only once and kept in the dentry. The path
+ * is valid as long as the caller holds a reference to the dentry, and must not be modified or
+ * freed.
+ */
+int dentry_cached_abs_path(struct shim_dentry* dent, const char** out_path, size_t* out_size);
+
+/*!
+ * \brief Get the relative path of a dentry, without copying it.
+ *
+ * Same as `dentry_cached_abs_path`, but for a relative path (see `dentry_rel_path`).
+ */
+int dentry_cached_rel_path(struct shim_dentry* dent, const char** out_path, size_t* out_size);
+
 /*!
  * \brief Compute an absolute path for dentry, allocating memory for it.
  *
@@ -769,6 +855,15 @@ struct shim_dentry* get_new_dentry(struct shim_mount* mount, struct shim_dentry*
  */
 struct shim_dentry* lookup_dcache(struct shim_dentry* parent, const char* name, size_t name_len);
 
+/*!
+ * \brief Get the lock serializing filesystem lookups of a dentry.
+ *
+ * Used for filesystems with `unlocked_lookup`. The locks are shared between dentries (a fixed
+ * number of them is allocated), so the caller should not hold the lock for any other purpose than
+ * a single lookup, and should take it before `g_dcache_lock`.
+ */
+struct shim_lock* get_dentry_lookup_lock(struct shim_dentry* dent);
+
 /*
  * Returns true if `anc` is an ancestor of `dent`. Both dentries need to be within the same mounted
  * filesystem.
@@ -820,10 +915,32 @@ extern struct shim_fs fifo_builtin_fs;
 extern struct shim_fs socket_builtin_fs;
 extern struct shim_fs epoll_builtin_fs;
 extern struct shim_fs eventfd_builtin_fs;
+extern struct shim_fs shm_builtin_fs;
 extern struct shim_fs synthetic_builtin_fs;
 
 struct shim_fs* find_fs(const char* name);
 
+/*!
+ * \brief Open a host shared memory object.
+ *
+ * \param      name     Name of the object, shared by all processes of this instance. If NULL, a new
+ *                      anonymous object is created.
+ * \param      create   Creation mode for a named object (ignored for anonymous objects).
+ * \param      size     If not 0, the object is resized to \p size.
+ * \param[out] out_hdl  On success, contains the new handle (of `TYPE_SHM`).
+ *
+ * Returns -EOPNOTSUPP if the PAL does not support shared memory objects.
+ */
+int open_shm_handle(const char* name, enum pal_create_mode create, size_t size,
+                    struct shim_handle** out_hdl);
+
+/*!
+ * \brief Remove the name of a host shared memory object.
+ *
+ * The object itself is destroyed after all handles and mappings of it are gone.
+ */
+int delete_shm_object(const char* name);
+
 /*!
  * \brief Compute file position for `seek`.
  *
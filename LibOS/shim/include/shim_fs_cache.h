@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Page cache for regular files read from the host.
+ *
+ * Caching is enabled with the `libos.page_cache_size` manifest option, and applies only to files in
+ * mounts marked as `immutable`: their contents are not expected to be modified outside of the
+ * current process, so data read once can be served from LibOS memory afterwards. The cache is
+ * shared by all handles of the same inode, and bounded by a single memory budget for the whole
+ * process (least recently used pages are evicted first).
+ *
+ * Writes done by the process itself have to be reported using `fs_cache_invalidate`. Files that
+ * can be modified through a shared mapping are not cached at all (see `fs_cache_disable`).
+ */
+
+#ifndef SHIM_FS_CACHE_H_
+#define SHIM_FS_CACHE_H_
+
+#include <stdbool.h>
+
+#include "pal.h"
+#include "shim_types.h"
+
+struct shim_inode;
+
+int init_fs_cache(void);
+
+/* Returns true if reads of `inode` should go through `fs_cache_read` */
+bool fs_cache_enabled(struct shim_inode* inode);
+
+/*!
+ * \brief Read file data through the cache.
+ *
+ * \param inode       The inode (a regular file, see `fs_cache_enabled`).
+ * \param pal_handle  PAL handle of the file, used to read missing data.
+ * \param pos         File position to start reading at.
+ * \param buf         Output buffer.
+ * \param count       Number of bytes to read.
+ *
+ * \returns Number of bytes read (less than `count` only at end of file), or negative error code.
+ *
+ * Missing pages are read from the host together with the following ones (readahead, see
+ * `libos.page_cache_readahead`). The caller has to update the file position.
+ */
+ssize_t fs_cache_read(struct shim_inode* inode, PAL_HANDLE pal_handle, file_off_t pos, void* buf,
+                      size_t count);
+
+/* Drops all cached pages of an inode. Should be called when the file is modified (written to or
+ * truncated), and when the inode is freed. */
+void fs_cache_invalidate(struct shim_inode* inode);
+
+/* Drops all cached pages of an inode and stops caching it. Should be called when the file is mapped
+ * with MAP_SHARED through a writable handle: stores to such a mapping (and `msync()`) go directly
+ * to the host file, so the cache would not notice them. */
+void fs_cache_disable(struct shim_inode* inode);
+
+#endif /* SHIM_FS_CACHE_H_ */
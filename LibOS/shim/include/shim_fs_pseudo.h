@@ -15,7 +15,8 @@
  *
  * It can then be mounted by providing the root name ("proc" in the example):
  *
- *     ret = mount_fs("pseudo", "proc", "/proc");
+ *     struct shim_mount_params params = { .type = "pseudo", .path = "/proc", .uri = "proc" };
+ *     ret = mount_fs(&params);
  *
  * See the documentation of `pseudo_node` structure for details.
  *
@@ -46,6 +46,7 @@ enum shim_handle_type {
     /* Special handles: */
     TYPE_EPOLL,      /* epoll handles, see `shim_epoll.c` */
     TYPE_EVENTFD,    /* eventfd handles, used by `eventfd` filesystem */
+    TYPE_SHM,        /* host shared memory objects, used by `shm` filesystem */
 };
 
 struct shim_handle;
@@ -219,6 +220,10 @@ struct shim_handle {
 
         struct shim_epoll_handle epoll;         /* TYPE_EPOLL */
         struct { bool is_semaphore; } eventfd;  /* TYPE_EVENTFD */
+        struct {
+            int shmid;                          /* System V segment ID, -1 for anonymous memory */
+            size_t size;
+        } shm;                                  /* TYPE_SHM */
     } info;
 
     struct shim_dir_handle dir_info;
@@ -36,6 +36,18 @@ enum {
     IPC_MSG_POSIX_LOCK_SET,
     IPC_MSG_POSIX_LOCK_GET,
     IPC_MSG_POSIX_LOCK_CLEAR_PID,
+    IPC_MSG_SYSV_SHM_GET,
+    IPC_MSG_SYSV_SHM_ATTACH,
+    IPC_MSG_SYSV_SHM_CTL,
+    IPC_MSG_SYSV_SHM_INHERIT,
+    IPC_MSG_SYSV_SHM_CLEAR_PID,
+    IPC_MSG_SYSV_SEM_GET,
+    IPC_MSG_SYSV_SEM_OP,
+    IPC_MSG_SYSV_SEM_DONE,
+    IPC_MSG_SYSV_SEM_CANCEL,
+    IPC_MSG_SYSV_SEM_WAKE,
+    IPC_MSG_SYSV_SEM_CTL,
+    IPC_MSG_SYSV_SEM_CLEAR_PID,
     IPC_MSG_CODE_BOUND,
 };
 
@@ -83,6 +95,17 @@ int connect_to_process(IDTYPE dest);
  */
 void remove_outgoing_ipc_connection(IDTYPE dest);
 
+/*!
+ * \brief Check whether a process has exited, as reported by the host.
+ *
+ * \param dest  VMID of the process to check.
+ *
+ * Returns true if the IPC pipe of \p dest was hung up or nobody listens on it anymore. Unlike
+ * the disconnect callbacks of the IPC worker, this does not depend on the IPC worker making
+ * progress, so it can be used by the IPC worker itself.
+ */
+bool is_process_disconnected(IDTYPE dest);
+
 struct ipc_msg_header {
     size_t size;
     uint64_t seq;
@@ -308,4 +331,128 @@ int ipc_posix_lock_set_callback(IDTYPE src, void* data, unsigned long seq);
 int ipc_posix_lock_get_callback(IDTYPE src, void* data, unsigned long seq);
 int ipc_posix_lock_clear_pid_callback(IDTYPE src, void* data, unsigned long seq);
 
+/*
+ * SYSV_SHM_GET: `struct shim_ipc_sysv_shm_get` -> `int`
+ * SYSV_SHM_ATTACH: `struct shim_ipc_sysv_shm_attach` -> `struct shim_ipc_sysv_shm_attach_resp`
+ * SYSV_SHM_CTL: `struct shim_ipc_sysv_shm_ctl` -> `struct shim_ipc_sysv_shm_ctl_resp`
+ * SYSV_SHM_INHERIT: `struct shim_ipc_sysv_shm_inherit` -> `int`
+ * SYSV_SHM_CLEAR_PID: `IDTYPE` -> `int`
+ */
+
+struct shim_ipc_sysv_shm_get {
+    int key;
+    size_t size;
+    int flags;
+    IDTYPE pid;
+    IDTYPE uid;
+    IDTYPE gid;
+};
+
+struct shim_ipc_sysv_shm_attach {
+    int shmid;
+    IDTYPE pid;
+    bool detach;
+};
+
+struct shim_ipc_sysv_shm_attach_resp {
+    int result;
+    size_t size;
+};
+
+struct shim_ipc_sysv_shm_ctl {
+    int shmid;
+    int cmd;
+    IDTYPE pid;
+    struct shmid64_ds buf;
+};
+
+struct shim_ipc_sysv_shm_ctl_resp {
+    int result;
+    struct shmid64_ds buf;
+};
+
+struct shim_ipc_sysv_shm_inherit {
+    IDTYPE parent_pid;
+    IDTYPE child_pid;
+};
+
+int ipc_sysv_shm_get(int key, size_t size, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid);
+int ipc_sysv_shm_attach(int shmid, IDTYPE pid, bool detach, size_t* out_size);
+int ipc_sysv_shm_ctl(int shmid, int cmd, IDTYPE pid, struct shmid64_ds* buf);
+int ipc_sysv_shm_inherit(IDTYPE parent_pid, IDTYPE child_pid);
+int ipc_sysv_shm_clear_pid(IDTYPE pid);
+int ipc_sysv_shm_get_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_shm_attach_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_shm_ctl_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_shm_inherit_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_shm_clear_pid_callback(IDTYPE src, void* data, unsigned long seq);
+
+/*
+ * SYSV_SEM_GET: `struct shim_ipc_sysv_sem_get` -> `int`
+ * SYSV_SEM_OP: `struct shim_ipc_sysv_sem_op` (no response, the result is sent as SYSV_SEM_DONE)
+ * SYSV_SEM_DONE: `struct shim_ipc_sysv_sem_done` (no response)
+ * SYSV_SEM_CANCEL: `uint64_t` -> `int`
+ * SYSV_SEM_WAKE: `int` (no response)
+ * SYSV_SEM_CTL: `struct shim_ipc_sysv_sem_ctl` -> `struct shim_ipc_sysv_sem_ctl_resp`
+ * SYSV_SEM_CLEAR_PID: `IDTYPE` -> `int`
+ */
+
+struct shim_ipc_sysv_sem_get {
+    int key;
+    int nsems;
+    int flags;
+    IDTYPE pid;
+    IDTYPE uid;
+    IDTYPE gid;
+};
+
+struct shim_ipc_sysv_sem_op {
+    int semid;
+    IDTYPE pid;
+    uint64_t id;
+    bool is_undo;
+    size_t nsops;
+    struct sembuf sops[];
+};
+
+struct shim_ipc_sysv_sem_done {
+    uint64_t id;
+    int result;
+};
+
+struct shim_ipc_sysv_sem_ctl {
+    int semid;
+    int semnum;
+    int cmd;
+    IDTYPE pid;
+    int val;
+    struct semid64_ds buf;
+    size_t array_len;
+    unsigned short array[];
+};
+
+struct shim_ipc_sysv_sem_ctl_resp {
+    int result;
+    struct semid64_ds buf;
+    size_t array_len;
+    unsigned short array[];
+};
+
+int ipc_sysv_sem_get(int key, int nsems, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid);
+int ipc_sysv_sem_op(int semid, struct sembuf* sops, size_t nsops, bool is_undo, IDTYPE pid,
+                    uint64_t id);
+int ipc_sysv_sem_done(IDTYPE vmid, uint64_t id, int result);
+int ipc_sysv_sem_cancel(uint64_t id);
+int ipc_sysv_sem_wake(int semid);
+int ipc_sysv_sem_ctl(int semid, int semnum, int cmd, IDTYPE pid, int val, struct semid64_ds* buf,
+                     unsigned short* array, size_t array_len);
+int ipc_sysv_sem_clear_pid(IDTYPE pid);
+int ipc_sysv_sem_get_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_op_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_done_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_cancel_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_wake_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_ctl_callback(IDTYPE src, void* data, unsigned long seq);
+int ipc_sysv_sem_clear_pid_callback(IDTYPE src, void* data, unsigned long seq);
+
 #endif /* SHIM_IPC_H_ */
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * System V IPC objects: shared memory segments and semaphore sets.
+ *
+ * The current implementation keeps all objects in the IPC leader, other processes send their
+ * requests over IPC. Permissions (`shm_perm.mode`, `sem_perm.mode`) are stored and reported, but
+ * not enforced. `IPC_INFO` and the `*_INFO`/`*_STAT` commands are not supported.
+ *
+ * Shared memory: contents of a segment live in a named host shared memory object (see
+ * `open_shm_handle`), which every attaching process maps directly, so accessing attached memory
+ * does not involve the IPC leader at all. Caveats:
+ *
+ * - Segments are only detached by `shmdt`, process exit and `execve`; `munmap` of an attached
+ *   segment does not decrement the number of attaches.
+ * - A segment cannot be attached anymore after `IPC_RMID` (Linux allows it until the last detach).
+ * - Host objects are deleted on `IPC_RMID` and, for segments never removed, on exit of the IPC
+ *   leader. If the leader is killed by the host (e.g. SIGKILL), the files of such segments are left
+ *   in the host's /dev/shm (named "gramine.<instance ID>.sysv_shm.<shmid>").
+ *
+ * Semaphores: values of a set live in a named host shared memory object as well, protected by a
+ * lock stored in the same object. Processes which can map it (i.e. the host memory is shareable,
+ * which is not the case on SGX) perform `semop` directly on the mapped values, so an operation
+ * which does not have to block needs no IPC message. Operations which have to block are sent to the
+ * IPC leader, which queues them and retries them whenever the set changes; a process which changes
+ * a set with queued operations notifies the leader. Without shareable host memory, the values are
+ * kept only in the leader and all operations go through it. Caveats:
+ *
+ * - `SEM_UNDO` adjustments are kept by the process that made them and applied on its exit;
+ *   `SETVAL`/`SETALL` do not reset adjustments of other processes.
+ * - If a process dies while holding the lock of a set (which is held only for the duration of
+ *   a single operation), the leader releases the lock once the process is known to be dead (see
+ *   `shim_sem.c`), but the values of the set may be left inconsistent. Until then, other processes
+ *   send their operations on the set to the leader, which waits for the lock.
+ * - Host objects of sets are deleted on `IPC_RMID` and on exit of the IPC leader, as for shared
+ *   memory segments.
+ */
+
+#ifndef SHIM_SYSV_H_
+#define SHIM_SYSV_H_
+
+#include <linux/sem.h>
+#include <linux/shm.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "shim_types.h"
+
+/* Initialize System V shared memory. */
+int init_sysv_shm(void);
+
+/* Initialize System V semaphores. */
+int init_sysv_sem(void);
+
+/*!
+ * \brief Find or create a shared memory segment.
+ *
+ * \param key    Key of the segment, or `IPC_PRIVATE`.
+ * \param size   Requested size of the segment.
+ * \param flags  `shmget` flags (`IPC_CREAT`, `IPC_EXCL` and permission bits).
+ * \param pid    PID of the calling process.
+ * \param uid    Effective UID of the calling process.
+ * \param gid    Effective GID of the calling process.
+ *
+ * This is the equivalent of `shmget`, returns the segment ID or a negative error code.
+ */
+int sysv_shm_get(int key, size_t size, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid);
+
+/*!
+ * \brief Record an attach or a detach of a shared memory segment.
+ *
+ * \param      shmid     ID of the segment.
+ * \param      pid       PID of the process attaching or detaching the segment.
+ * \param      detach    If true, a previous attach is removed, otherwise a new one is added.
+ * \param[out] out_size  On successful attach, contains the size of the segment. Can be NULL.
+ *
+ * The segment is destroyed when it is marked for removal and its last attach is gone.
+ */
+int sysv_shm_attach(int shmid, IDTYPE pid, bool detach, size_t* out_size);
+
+/*!
+ * \brief Control a shared memory segment.
+ *
+ * \param         shmid  ID of the segment.
+ * \param         cmd    `IPC_STAT`, `IPC_SET` or `IPC_RMID`.
+ * \param         pid    PID of the calling process.
+ * \param[in,out] buf    Input for `IPC_SET`, output for `IPC_STAT`, unused for `IPC_RMID`.
+ */
+int sysv_shm_ctl(int shmid, int cmd, IDTYPE pid, struct shmid64_ds* buf);
+
+/* Copies all attaches of `parent_pid` to `child_pid`. Should be called before a child process is
+ * created, as the child inherits all attached segments of its parent. */
+int sysv_shm_inherit(IDTYPE parent_pid, IDTYPE child_pid);
+
+/* Removes all attaches of a given PID. Should be called before process exit and on `execve`. */
+int sysv_shm_clear_pid(IDTYPE pid);
+
+/* Deletes the host objects of all segments which were not removed yet, so that they do not outlive
+ * this Gramine instance (existing mappings stay valid). Should be called on exit of the IPC leader,
+ * after the IPC worker is terminated; a no-op in other processes. */
+void sysv_shm_delete_host_objects(void);
+
+/*!
+ * \brief Find or create a semaphore set.
+ *
+ * \param key    Key of the set, or `IPC_PRIVATE`.
+ * \param nsems  Number of semaphores in the set.
+ * \param flags  `semget` flags (`IPC_CREAT`, `IPC_EXCL` and permission bits).
+ * \param pid    PID of the calling process.
+ * \param uid    Effective UID of the calling process.
+ * \param gid    Effective GID of the calling process.
+ *
+ * This is the equivalent of `semget`, returns the set ID or a negative error code.
+ */
+int sysv_sem_get(int key, int nsems, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid);
+
+/*!
+ * \brief Perform semaphore operations, or queue them until they can be performed.
+ *
+ * \param semid    ID of the set.
+ * \param sops     Operations to perform atomically.
+ * \param nsops    Number of operations in \p sops.
+ * \param is_undo  If true, these are `SEM_UNDO` adjustments applied on process exit: they never
+ *                 block, values are clamped to the valid range instead.
+ * \param pid      PID of the process performing the operations.
+ * \param vmid     VMID of the process waiting for the result.
+ * \param id       ID of the request, unique in process \p vmid.
+ *
+ * The result is always reported asynchronously, by calling `sysv_sem_request_done` in process
+ * \p vmid (possibly before this function returns). Returns a negative error code only if
+ * the request could not be processed at all.
+ */
+int sysv_sem_op(int semid, struct sembuf* sops, size_t nsops, bool is_undo, IDTYPE pid,
+                IDTYPE vmid, uint64_t id);
+
+/*!
+ * \brief Cancel a queued request.
+ *
+ * \param vmid  VMID of the process waiting for the result.
+ * \param id    ID of the request.
+ *
+ * Returns 1 if the request was cancelled, 0 if it is not queued (i.e. its result was already
+ * reported or is being reported).
+ */
+int sysv_sem_cancel(IDTYPE vmid, uint64_t id);
+
+/* Retries queued requests on set `semid`. Should be called after changing values of a set which has
+ * waiters. */
+int sysv_sem_wake(int semid);
+
+/*!
+ * \brief Control a semaphore set.
+ *
+ * \param         semid      ID of the set.
+ * \param         semnum     Index of the semaphore, used only by commands operating on a single
+ *                           semaphore.
+ * \param         cmd        `semctl` command.
+ * \param         pid        PID of the calling process.
+ * \param         val        Input for `SETVAL`.
+ * \param[in,out] buf        Input for `IPC_SET`, output for `IPC_STAT`.
+ * \param[in,out] array      Input for `SETALL`, output for `GETALL`.
+ * \param         array_len  Number of elements in \p array, must be equal to the size of the set.
+ *
+ * Returns the requested value for `GETVAL`, `GETPID`, `GETNCNT` and `GETZCNT`, 0 for other commands
+ * or a negative error code.
+ */
+int sysv_sem_ctl(int semid, int semnum, int cmd, IDTYPE pid, int val, struct semid64_ds* buf,
+                 unsigned short* array, size_t array_len);
+
+/* Removes all queued requests of a given PID. Should be called before process exit. */
+int sysv_sem_clear_pid(IDTYPE pid);
+
+/* Releases the locks of semaphore sets held by process `vmid`, which disconnected from the IPC
+ * leader (most likely because it died). Called only in the IPC leader. */
+void sysv_sem_disconnect_callback(IDTYPE vmid);
+
+/* Same as `sysv_shm_delete_host_objects`, for semaphore sets. */
+void sysv_sem_delete_host_objects(void);
+
+/* Reports the result of request `id` made by this process (see `sysv_sem_op`). */
+void sysv_sem_request_done(uint64_t id, int result);
+
+/* Applies `SEM_UNDO` adjustments of this process. Should be called before process exit. */
+int sysv_sem_undo_all(void);
+
+#endif /* SHIM_SYSV_H_ */
@@ -51,6 +51,9 @@ long shim_do_sched_yield(void);
 long shim_do_msync(unsigned long start, size_t len, int flags);
 long shim_do_mincore(void* start, size_t len, unsigned char* vec);
 long shim_do_madvise(unsigned long start, size_t len_in, int behavior);
+long shim_do_shmget(int key, size_t size, int shmflg);
+void* shim_do_shmat(int shmid, const void* shmaddr, int shmflg);
+long shim_do_shmctl(int shmid, int cmd, struct shmid64_ds* buf);
 long shim_do_dup(unsigned int fd);
 long shim_do_dup2(unsigned int oldfd, unsigned int newfd);
 long shim_do_pause(void);
@@ -88,6 +91,10 @@ long shim_do_waitid(int which, pid_t id, siginfo_t* infop, int options, struct _
 long shim_do_wait4(pid_t pid, int* stat_addr, int options, struct __kernel_rusage* ru);
 long shim_do_kill(pid_t pid, int sig);
 long shim_do_uname(struct new_utsname* buf);
+long shim_do_semget(int key, int nsems, int semflg);
+long shim_do_semop(int semid, struct sembuf* sops, size_t nsops);
+long shim_do_semctl(int semid, int semnum, int cmd, unsigned long arg);
+long shim_do_shmdt(const void* shmaddr);
 long shim_do_fcntl(int fd, int cmd, unsigned long arg);
 long shim_do_fsync(int fd);
 long shim_do_fdatasync(int fd);
@@ -156,6 +163,8 @@ long shim_do_sched_getaffinity(pid_t pid, unsigned int cpumask_size, unsigned lo
 long shim_do_set_tid_address(int* tidptr);
 long shim_do_epoll_create(int size);
 long shim_do_getdents64(int fd, struct linux_dirent64* buf, size_t count);
+long shim_do_semtimedop(int semid, struct sembuf* sops, size_t nsops,
+                        const struct __kernel_timespec* timeout);
 long shim_do_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout_ms);
 long shim_do_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
 long shim_do_clock_gettime(clockid_t which_clock, struct timespec* tp);
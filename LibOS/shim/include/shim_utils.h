@@ -39,6 +39,7 @@ int load_elf_object(struct shim_handle* file, struct link_map** out_map);
 int load_elf_interp(struct link_map* exec_map);
 noreturn void execute_elf_object(struct link_map* exec_map, void* argp, elf_auxv_t* auxp);
 void remove_loaded_elf_objects(void);
+bool is_in_cached_elf_object(void* addr, size_t length);
 int init_brk_from_executable(struct link_map* exec_map);
 int register_library(const char* name, unsigned long load_address);
 
@@ -44,9 +44,9 @@ shim_fp shim_table[LIBOS_SYSCALL_BOUND] = {
     [__NR_msync]                  = (shim_fp)shim_do_msync,
     [__NR_mincore]                = (shim_fp)shim_do_mincore,
     [__NR_madvise]                = (shim_fp)shim_do_madvise,
-    [__NR_shmget]                 = (shim_fp)0, // shim_do_shmget
-    [__NR_shmat]                  = (shim_fp)0, // shim_do_shmat
-    [__NR_shmctl]                 = (shim_fp)0, // shim_do_shmctl
+    [__NR_shmget]                 = (shim_fp)shim_do_shmget,
+    [__NR_shmat]                  = (shim_fp)shim_do_shmat,
+    [__NR_shmctl]                 = (shim_fp)shim_do_shmctl,
     [__NR_dup]                    = (shim_fp)shim_do_dup,
     [__NR_dup2]                   = (shim_fp)shim_do_dup2,
     [__NR_pause]                  = (shim_fp)shim_do_pause,
@@ -79,10 +79,10 @@ shim_fp shim_table[LIBOS_SYSCALL_BOUND] = {
     [__NR_wait4]                  = (shim_fp)shim_do_wait4,
     [__NR_kill]                   = (shim_fp)shim_do_kill,
     [__NR_uname]                  = (shim_fp)shim_do_uname,
-    [__NR_semget]                 = (shim_fp)0, // shim_do_semget,
-    [__NR_semop]                  = (shim_fp)0, // shim_do_semop,
-    [__NR_semctl]                 = (shim_fp)0, // shim_do_semctl,
-    [__NR_shmdt]                  = (shim_fp)0, // shim_do_shmdt
+    [__NR_semget]                 = (shim_fp)shim_do_semget,
+    [__NR_semop]                  = (shim_fp)shim_do_semop,
+    [__NR_semctl]                 = (shim_fp)shim_do_semctl,
+    [__NR_shmdt]                  = (shim_fp)shim_do_shmdt,
     [__NR_msgget]                 = (shim_fp)0, // shim_do_msgget,
     [__NR_msgsnd]                 = (shim_fp)0, // shim_do_msgsnd,
     [__NR_msgrcv]                 = (shim_fp)0, // shim_do_msgrcv,
@@ -235,7 +235,7 @@ shim_fp shim_table[LIBOS_SYSCALL_BOUND] = {
     [__NR_getdents64]             = (shim_fp)shim_do_getdents64,
     [__NR_set_tid_address]        = (shim_fp)shim_do_set_tid_address,
     [__NR_restart_syscall]        = (shim_fp)0, // shim_do_restart_syscall
-    [__NR_semtimedop]             = (shim_fp)0, // shim_do_semtimedop,
+    [__NR_semtimedop]             = (shim_fp)shim_do_semtimedop,
     [__NR_fadvise64]              = (shim_fp)0, // shim_do_fadvise64
     [__NR_timer_create]           = (shim_fp)0, // shim_do_timer_create
     [__NR_timer_settime]          = (shim_fp)0, // shim_do_timer_settime
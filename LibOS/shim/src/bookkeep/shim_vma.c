@@ -1176,13 +1176,13 @@ static bool madvise_dontneed_visitor(struct shim_vma* vma, void* visitor_arg) {
     }
 
     if (vma->file) {
-        if (vma->flags & VMA_TAINTED) {
-            /* Resetting writable file-backed mappings is not yet implemented. */
+        if ((vma->flags & (VMA_TAINTED | MAP_PRIVATE)) == (VMA_TAINTED | MAP_PRIVATE)) {
+            /* Resetting writable private file-backed mappings is not yet implemented. */
             ctx->error = -ENOSYS;
             return false;
         }
         /* MADV_DONTNEED resets file-based mappings to the original state, which is a no-op for
-         * non-tainted mappings. */
+         * shared mappings (including shared anonymous memory) and for non-tainted mappings. */
         return true;
     }
 
@@ -1241,18 +1241,22 @@ BEGIN_CP_FUNC(vma) {
          * should be either anonymous memory or tainted private file-backed memory. In other cases,
          * we re-map this vma during checkpoint restore in child (see function below).
          *
-         * FIXME: In case of anonymous memory, we always checkpoint memory and ignore MAP_SHARED
-         *        flag. VMA content in parent and child may diverge.
+         * Shared anonymous memory is backed by a host shared memory object (`TYPE_SHM` handle) if
+         * the PAL supports it, so it is re-mapped like shared file-backed memory. Otherwise it has
+         * no file and is copied like private memory, so VMA content in parent and child may
+         * diverge.
          */
         if (!(vma->flags & VMA_UNMAPPED) && (!vma->file ||
                     (vma->flags & (VMA_TAINTED | MAP_PRIVATE)) == (VMA_TAINTED | MAP_PRIVATE))) {
             remap_from_file = false;
 
             if (!vma->file) {
-                /* Send anonymous memory region. */
+                /* Send anonymous memory region. Large reservations are usually barely touched, so
+                 * only populated non-zero pages are sent. */
                 struct shim_mem_entry* mem;
                 DO_CP_SIZE(memory, vma->addr, vma->length, &mem);
                 mem->prot = LINUX_PROT_TO_PAL(vma->prot, /*map_flags=*/0);
+                DO_CP(memory_runs, mem, NULL);
             } else {
                 /* Send file-backed memory region. */
                 uint64_t file_size = 0;
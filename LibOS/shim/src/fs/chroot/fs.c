@@ -21,6 +21,7 @@
 #include "perm.h"
 #include "shim_flags_conv.h"
 #include "shim_fs.h"
+#include "shim_fs_cache.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
@@ -92,9 +93,10 @@ static int chroot_dentry_uri(struct shim_dentry* dent, mode_t type, char** out_u
             BUG();
     }
 
-    char* rel_path;
+    /* The relative path is cached in the dentry, so this does not walk the parents every time */
+    const char* rel_path;
     size_t rel_path_size;
-    ret = dentry_rel_path(dent, &rel_path, &rel_path_size);
+    ret = dentry_cached_rel_path(dent, &rel_path, &rel_path_size);
     if (ret < 0)
         return ret;
 
@@ -107,10 +109,9 @@ static int chroot_dentry_uri(struct shim_dentry* dent, mode_t type, char** out_u
     /* Allocate buffer for "<prefix:><root>/<rel_path>" (if `rel_path` is empty, we don't need the
      * space for `/`, but overallocating 1 byte doesn't hurt us, and keeps the code simple) */
     char* uri = malloc(prefix_len + root_len + 1 + rel_path_size);
-    if (!uri) {
-        ret = -ENOMEM;
-        goto out;
-    }
+    if (!uri)
+        return -ENOMEM;
+
     memcpy(uri, prefix, prefix_len);
     memcpy(uri + prefix_len, root, root_len);
     if (rel_path_size == 1) {
@@ -122,11 +123,7 @@ static int chroot_dentry_uri(struct shim_dentry* dent, mode_t type, char** out_u
         memcpy(uri + prefix_len + root_len + 1, rel_path, rel_path_size);
     }
     *out_uri = uri;
-    ret = 0;
-
-out:
-    free(rel_path);
-    return ret;
+    return 0;
 }
 
 static int chroot_setup_dentry(struct shim_dentry* dent, mode_t type, mode_t perm,
@@ -142,9 +139,8 @@ static int chroot_setup_dentry(struct shim_dentry* dent, mode_t type, mode_t per
     return 0;
 }
 
+/* Called without `g_dcache_lock` (see `unlocked_lookup`), takes it only to set up the inode */
 static int chroot_lookup(struct shim_dentry* dent) {
-    assert(locked(&g_dcache_lock));
-
     int ret;
 
     /*
@@ -194,7 +190,9 @@ static int chroot_lookup(struct shim_dentry* dent) {
 
     file_off_t size = (type == S_IFREG ? pal_attr.pending_size : 0);
 
+    lock(&g_dcache_lock);
     ret = chroot_setup_dentry(dent, type, perm, size);
+    unlock(&g_dcache_lock);
 out:
     free(uri);
     return ret;
@@ -318,10 +316,18 @@ static ssize_t chroot_read(struct shim_handle* hdl, void* buf, size_t count) {
     }
 
     size_t actual_count = count;
-    ret = DkStreamRead(hdl->pal_handle, pos, &actual_count, buf, /*source=*/NULL, /*size=*/0);
-    if (ret < 0) {
-        ret = pal_to_unix_errno(ret);
-        goto out;
+    if (fs_cache_enabled(inode)) {
+        ret = fs_cache_read(inode, hdl->pal_handle, pos, buf, count);
+        if (ret < 0)
+            goto out;
+        actual_count = ret;
+    } else {
+        ret = DkStreamRead(hdl->pal_handle, pos, &actual_count, buf, /*source=*/NULL,
+                           /*size=*/0);
+        if (ret < 0) {
+            ret = pal_to_unix_errno(ret);
+            goto out;
+        }
     }
     assert(actual_count <= count);
     if (inode->type == S_IFREG) {
@@ -357,6 +363,8 @@ static ssize_t chroot_write(struct shim_handle* hdl, const void* buf, size_t cou
 
     size_t actual_count = count;
     ret = DkStreamWrite(hdl->pal_handle, pos, &actual_count, (void*)buf, /*dest=*/NULL);
+    if (fs_cache_enabled(inode))
+        fs_cache_invalidate(inode);
     if (ret < 0) {
         ret = pal_to_unix_errno(ret);
         goto out;
@@ -387,6 +395,11 @@ static int chroot_mmap(struct shim_handle* hdl, void** addr, size_t size, int pr
     if (flags & MAP_ANONYMOUS)
         return -EINVAL;
 
+    /* Also a read-only shared mapping can be made writable later with `mprotect()`, so check the
+     * access mode of the handle rather than `prot` */
+    if ((flags & MAP_SHARED) && (hdl->acc_mode & MAY_WRITE) && fs_cache_enabled(hdl->inode))
+        fs_cache_disable(hdl->inode);
+
     int ret = DkStreamMap(hdl->pal_handle, addr, pal_prot, offset, size);
     return pal_to_unix_errno(ret);
 }
@@ -398,6 +411,8 @@ static int chroot_truncate(struct shim_handle* hdl, file_off_t size) {
 
     lock(&hdl->inode->lock);
     ret = DkStreamSetLength(hdl->pal_handle, size);
+    if (fs_cache_enabled(hdl->inode))
+        fs_cache_invalidate(hdl->inode);
     if (ret == 0) {
         hdl->inode->size = size;
     } else {
@@ -407,6 +422,13 @@ static int chroot_truncate(struct shim_handle* hdl, file_off_t size) {
     return ret;
 }
 
+static void chroot_idrop(struct shim_inode* inode) {
+    assert(locked(&inode->lock));
+
+    if (fs_cache_enabled(inode))
+        fs_cache_invalidate(inode);
+}
+
 static int chroot_readdir(struct shim_dentry* dent, readdir_callback_t callback, void* arg) {
     int ret;
     PAL_HANDLE palhdl;
@@ -631,6 +653,7 @@ struct shim_fs_ops chroot_fs_ops = {
 };
 
 struct shim_d_ops chroot_d_ops = {
+    .unlocked_lookup = true,
     .open    = &chroot_open,
     .lookup  = &chroot_lookup,
     .creat   = &chroot_creat,
@@ -640,6 +663,7 @@ struct shim_d_ops chroot_d_ops = {
     .unlink  = &chroot_unlink,
     .rename  = &chroot_rename,
     .chmod   = &chroot_chmod,
+    .idrop   = &chroot_idrop,
 };
 
 struct shim_fs chroot_builtin_fs = {
@@ -95,6 +95,8 @@ int proc_thread_maps_load(struct shim_dentry* dent, char** out_data, size_t* out
 
             if (vma->file->dentry)
                 dentry_abs_path(vma->file->dentry, &path, /*size=*/NULL);
+            else if (vma->file->type == TYPE_SHM)
+                path = strdup("/dev/zero (deleted)"); /* same as Linux for shared anonymous memory */
 
             EMIT(ADDR_FMT(start), start);
             EMIT("-");
@@ -29,6 +29,10 @@ static struct shim_lock dcache_mgr_lock;
 
 struct shim_lock g_dcache_lock;
 
+/* Locks for serializing lookups of the same dentry (see `get_dentry_lookup_lock`) */
+#define DENTRY_LOOKUP_LOCKS 64
+static struct shim_lock g_dentry_lookup_locks[DENTRY_LOOKUP_LOCKS];
+
 static MEM_MGR dentry_mgr = NULL;
 
 struct shim_dentry* g_dentry_root = NULL;
@@ -56,6 +60,12 @@ int init_dcache(void) {
         return -ENOMEM;
     }
 
+    for (size_t i = 0; i < DENTRY_LOOKUP_LOCKS; i++) {
+        if (!create_lock(&g_dentry_lookup_locks[i])) {
+            return -ENOMEM;
+        }
+    }
+
     dentry_mgr = create_mem_mgr(init_align_up(DCACHE_MGR_ALLOC));
 
     if (g_pal_public_state->parent_process) {
@@ -113,6 +123,8 @@ static void free_dentry(struct shim_dentry* dent) {
     }
 
     free(dent->name);
+    free(dent->cached_abs_path);
+    free(dent->cached_rel_path);
 
     if (dent->parent) {
         put_dentry(dent->parent);
@@ -228,6 +240,11 @@ struct shim_dentry* lookup_dcache(struct shim_dentry* parent, const char* name,
     return NULL;
 }
 
+struct shim_lock* get_dentry_lookup_lock(struct shim_dentry* dent) {
+    uintptr_t idx = (uintptr_t)dent / sizeof(*dent);
+    return &g_dentry_lookup_locks[idx % DENTRY_LOOKUP_LOCKS];
+}
+
 bool dentry_is_ancestor(struct shim_dentry* anc, struct shim_dentry* dent) {
     assert(anc->mount == dent->mount);
 
@@ -335,12 +352,94 @@ static int dentry_path(struct shim_dentry* dent, bool relative, char** path, siz
     return 0;
 }
 
+static char** cached_path_ptr(struct shim_dentry* dent, bool relative) {
+    return relative ? &dent->cached_rel_path : &dent->cached_abs_path;
+}
+
+/* Computes the path of `dent` for caching. If the path of the parent is already cached, this only
+ * needs to append the name. */
+static int compute_path_for_cache(struct shim_dentry* dent, bool relative, char** out_path) {
+    struct shim_dentry* up = relative ? dent->parent : dentry_up(dent);
+    char* up_path = up ? __atomic_load_n(cached_path_ptr(up, relative), __ATOMIC_ACQUIRE) : NULL;
+    if (!up_path)
+        return dentry_path(dent, relative, out_path, /*size=*/NULL);
+
+    /* Don't add '/' after the root, which is "/" for absolute paths and "" for relative ones */
+    size_t up_len = strlen(up_path);
+    bool is_root = relative ? up_len == 0 : up_len == 1;
+    size_t prefix_len = is_root ? up_len : up_len + 1;
+
+    char* path = malloc(prefix_len + dent->name_len + 1);
+    if (!path)
+        return -ENOMEM;
+
+    memcpy(path, up_path, up_len);
+    if (!is_root)
+        path[up_len] = '/';
+    memcpy(path + prefix_len, dent->name, dent->name_len);
+    path[prefix_len + dent->name_len] = '\0';
+
+    *out_path = path;
+    return 0;
+}
+
+static int dentry_cached_path(struct shim_dentry* dent, bool relative, const char** out_path,
+                              size_t* out_size) {
+    char** cache = cached_path_ptr(dent, relative);
+
+    char* path = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+    if (!path) {
+        int ret = compute_path_for_cache(dent, relative, &path);
+        if (ret < 0)
+            return ret;
+
+        /* Another thread might have cached the path in the meantime, in which case use its copy */
+        char* expected = NULL;
+        if (!__atomic_compare_exchange_n(cache, &expected, path, /*weak=*/false, __ATOMIC_ACQ_REL,
+                                         __ATOMIC_ACQUIRE)) {
+            free(path);
+            path = expected;
+        }
+    }
+
+    *out_path = path;
+    if (out_size)
+        *out_size = strlen(path) + 1;
+    return 0;
+}
+
+int dentry_cached_abs_path(struct shim_dentry* dent, const char** out_path, size_t* out_size) {
+    return dentry_cached_path(dent, /*relative=*/false, out_path, out_size);
+}
+
+int dentry_cached_rel_path(struct shim_dentry* dent, const char** out_path, size_t* out_size) {
+    return dentry_cached_path(dent, /*relative=*/true, out_path, out_size);
+}
+
+static int dentry_path_copy(struct shim_dentry* dent, bool relative, char** path, size_t* size) {
+    const char* cached_path;
+    size_t cached_size;
+    int ret = dentry_cached_path(dent, relative, &cached_path, &cached_size);
+    if (ret < 0)
+        return ret;
+
+    char* buf = malloc(cached_size);
+    if (!buf)
+        return -ENOMEM;
+    memcpy(buf, cached_path, cached_size);
+
+    *path = buf;
+    if (size)
+        *size = cached_size;
+    return 0;
+}
+
 int dentry_abs_path(struct shim_dentry* dent, char** path, size_t* size) {
-    return dentry_path(dent, /*relative=*/false, path, size);
+    return dentry_path_copy(dent, /*relative=*/false, path, size);
 }
 
 int dentry_rel_path(struct shim_dentry* dent, char** path, size_t* size) {
-    return dentry_path(dent, /*relative=*/true, path, size);
+    return dentry_path_copy(dent, /*relative=*/true, path, size);
 }
 
 struct shim_inode* get_new_inode(struct shim_mount* mount, mode_t type, mode_t perm) {
@@ -532,6 +631,10 @@ BEGIN_CP_FUNC(dentry) {
         /* `fs_lock` is used only by process leader. */
         new_dent->fs_lock = NULL;
 
+        /* Cached paths will be computed again in the new process if needed */
+        new_dent->cached_abs_path = NULL;
+        new_dent->cached_rel_path = NULL;
+
         DO_CP_MEMBER(str, dent, new_dent, name);
 
         if (new_dent->mount)
@@ -0,0 +1,263 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This file contains the page cache for files read from the host (see `shim_fs_cache.h`).
+ *
+ * Cached pages of an inode are kept in a hash table (`inode->cache_pages`), and all pages are on a
+ * global LRU list. All of this is protected by `g_fs_cache_lock`, which is never held while
+ * calling PAL: on a cache miss, the data is first read into a temporary buffer, and only then
+ * inserted into the cache. `inode->cache_seq` is incremented on each invalidation, so that data
+ * read before a concurrent write is not inserted afterwards. For the same reason, nothing is
+ * inserted once `inode->cache_disabled` is set, even by reads that started before.
+ */
+
+#include "list.h"
+#include "pal.h"
+#include "shim_fs.h"
+#include "shim_fs_cache.h"
+#include "shim_internal.h"
+#include "shim_lock.h"
+#include "stat.h"
+#include "toml_utils.h"
+
+#define uthash_fatal(msg)                      \
+    do {                                       \
+        log_error("uthash error: %s", msg);    \
+        DkProcessExit(ENOMEM);                 \
+    } while (0)
+#include "uthash.h"
+
+#define DEFAULT_READAHEAD_SIZE (64 * 1024)
+
+DEFINE_LIST(fs_cache_page);
+DEFINE_LISTP(fs_cache_page);
+struct fs_cache_page {
+    /* Page number in file (offset divided by PAGE_SIZE), key in `inode->cache_pages` */
+    uint64_t index;
+
+    struct shim_inode* inode;
+
+    /* Number of valid bytes: less than PAGE_SIZE only for the last page of the file */
+    size_t size;
+
+    UT_hash_handle hh;
+    LIST_TYPE(fs_cache_page) lru;
+
+    char data[PAGE_SIZE];
+};
+
+static struct shim_lock g_fs_cache_lock;
+
+/* Most recently used pages first */
+static LISTP_TYPE(fs_cache_page) g_fs_cache_lru = LISTP_INIT;
+
+static size_t g_fs_cache_pages_count = 0;
+
+/* Maximum number of cached pages, 0 if the cache is disabled */
+static size_t g_fs_cache_max_pages = 0;
+
+/* Number of pages read from the host on a cache miss */
+static size_t g_fs_cache_readahead_pages = 0;
+
+int init_fs_cache(void) {
+    if (!create_lock(&g_fs_cache_lock))
+        return -ENOMEM;
+
+    assert(g_manifest_root);
+    size_t cache_size;
+    int ret = toml_sizestring_in(g_manifest_root, "libos.page_cache_size", /*defaultval=*/0,
+                                 &cache_size);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.page_cache_size'");
+        return -EINVAL;
+    }
+
+    size_t readahead_size;
+    ret = toml_sizestring_in(g_manifest_root, "libos.page_cache_readahead",
+                             DEFAULT_READAHEAD_SIZE, &readahead_size);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.page_cache_readahead'");
+        return -EINVAL;
+    }
+
+    g_fs_cache_max_pages = cache_size / PAGE_SIZE;
+
+    /* Read at least one page, and never more than fits in the cache */
+    g_fs_cache_readahead_pages = MIN(MAX(readahead_size / PAGE_SIZE, 1ul), g_fs_cache_max_pages);
+    return 0;
+}
+
+bool fs_cache_enabled(struct shim_inode* inode) {
+    return g_fs_cache_max_pages > 0 && inode->type == S_IFREG && inode->mount->immutable
+           && !__atomic_load_n(&inode->cache_disabled, __ATOMIC_ACQUIRE);
+}
+
+static void remove_page(struct fs_cache_page* page) {
+    assert(locked(&g_fs_cache_lock));
+
+    HASH_DELETE(hh, page->inode->cache_pages, page);
+    LISTP_DEL(page, &g_fs_cache_lru, lru);
+    g_fs_cache_pages_count--;
+    free(page);
+}
+
+/* Adds a page read from the host, unless another thread already did. Evicts the least recently
+ * used pages if the cache is full. */
+static void insert_page(struct shim_inode* inode, uint64_t index, const char* data, size_t size) {
+    assert(locked(&g_fs_cache_lock));
+
+    struct fs_cache_page* page;
+    HASH_FIND(hh, inode->cache_pages, &index, sizeof(index), page);
+    if (page)
+        return;
+
+    while (g_fs_cache_pages_count >= g_fs_cache_max_pages) {
+        struct fs_cache_page* victim = LISTP_LAST_ENTRY(&g_fs_cache_lru, fs_cache_page, lru);
+        remove_page(victim);
+    }
+
+    page = malloc(sizeof(*page));
+    if (!page) {
+        /* Caching is just an optimization */
+        return;
+    }
+
+    page->index = index;
+    page->inode = inode;
+    page->size = size;
+    memcpy(page->data, data, size);
+    INIT_LIST_HEAD(page, lru);
+
+    HASH_ADD(hh, inode->cache_pages, index, sizeof(page->index), page);
+    LISTP_ADD(page, &g_fs_cache_lru, lru);
+    g_fs_cache_pages_count++;
+}
+
+/* Copies data from a cached page (if present) into `buf`. Returns the number of bytes copied, or
+ * -ENOENT if the page is not cached. Sets `*out_eof` if the page is the last one in the file. */
+static ssize_t read_cached_page(struct shim_inode* inode, uint64_t index, size_t page_off,
+                                char* buf, size_t count, bool* out_eof) {
+    lock(&g_fs_cache_lock);
+
+    struct fs_cache_page* page;
+    HASH_FIND(hh, inode->cache_pages, &index, sizeof(index), page);
+    if (!page) {
+        unlock(&g_fs_cache_lock);
+        return -ENOENT;
+    }
+
+    /* Move to the front of the LRU list */
+    LISTP_DEL(page, &g_fs_cache_lru, lru);
+    LISTP_ADD(page, &g_fs_cache_lru, lru);
+
+    size_t copy_size = 0;
+    if (page_off < page->size) {
+        copy_size = MIN(page->size - page_off, count);
+        memcpy(buf, page->data + page_off, copy_size);
+    }
+    *out_eof = page->size < PAGE_SIZE;
+
+    unlock(&g_fs_cache_lock);
+    return copy_size;
+}
+
+ssize_t fs_cache_read(struct shim_inode* inode, PAL_HANDLE pal_handle, file_off_t pos, void* buf,
+                      size_t count) {
+    /* don't use `fs_cache_enabled()`: the cache could have been disabled since the caller checked */
+    assert(g_fs_cache_max_pages > 0 && inode->type == S_IFREG);
+    assert(pos >= 0);
+
+    ssize_t ret;
+    char* readahead_buf = NULL;
+    size_t readahead_size = g_fs_cache_readahead_pages * PAGE_SIZE;
+    size_t done = 0;
+
+    while (done < count) {
+        uint64_t offset = pos + done;
+        uint64_t index = offset / PAGE_SIZE;
+        size_t page_off = offset % PAGE_SIZE;
+
+        bool eof;
+        ret = read_cached_page(inode, index, page_off, (char*)buf + done, count - done, &eof);
+        if (ret >= 0) {
+            done += ret;
+            if (eof)
+                break;
+            continue;
+        }
+
+        /* Cache miss: read this page and the following ones from the host */
+        if (!readahead_buf) {
+            readahead_buf = malloc(readahead_size);
+            if (!readahead_buf) {
+                ret = -ENOMEM;
+                goto out;
+            }
+        }
+
+        lock(&g_fs_cache_lock);
+        uint64_t seq = inode->cache_seq;
+        unlock(&g_fs_cache_lock);
+
+        size_t read_size = readahead_size;
+        ret = DkStreamRead(pal_handle, index * PAGE_SIZE, &read_size, readahead_buf,
+                           /*source=*/NULL, /*size=*/0);
+        if (ret < 0) {
+            ret = pal_to_unix_errno(ret);
+            goto out;
+        }
+
+        /* A short read means end of file, but cache the last partial page only if the file size
+         * confirms that (the host could also return less data for other reasons) */
+        uint64_t file_size = __atomic_load_n(&inode->size, __ATOMIC_RELAXED);
+        bool short_read = read_size < readahead_size;
+
+        lock(&g_fs_cache_lock);
+        for (size_t off = 0; off < read_size && inode->cache_seq == seq && !inode->cache_disabled;
+                off += PAGE_SIZE) {
+            size_t size = MIN(read_size - off, PAGE_SIZE);
+            if (size < PAGE_SIZE && index * PAGE_SIZE + read_size != file_size)
+                break;
+            insert_page(inode, index + off / PAGE_SIZE, readahead_buf + off, size);
+        }
+        unlock(&g_fs_cache_lock);
+
+        if (page_off >= read_size)
+            break;
+        size_t copy_size = MIN(read_size - page_off, count - done);
+        memcpy((char*)buf + done, readahead_buf + page_off, copy_size);
+        done += copy_size;
+
+        if (short_read && page_off + copy_size == read_size)
+            break;
+    }
+
+    ret = done;
+out:
+    free(readahead_buf);
+    /* Report the data we already copied, if any */
+    return done > 0 ? (ssize_t)done : ret;
+}
+
+void fs_cache_invalidate(struct shim_inode* inode) {
+    lock(&g_fs_cache_lock);
+
+    struct fs_cache_page* page;
+    struct fs_cache_page* tmp;
+    HASH_ITER(hh, inode->cache_pages, page, tmp) {
+        remove_page(page);
+    }
+    assert(!inode->cache_pages);
+    inode->cache_seq++;
+
+    unlock(&g_fs_cache_lock);
+}
+
+void fs_cache_disable(struct shim_inode* inode) {
+    lock(&g_fs_cache_lock);
+    __atomic_store_n(&inode->cache_disabled, true, __ATOMIC_RELEASE);
+    unlock(&g_fs_cache_lock);
+
+    fs_cache_invalidate(inode);
+}
@@ -37,6 +37,11 @@ HASHTYPE hash_name(HASHTYPE parent_hbuf, const char* name) {
 }
 
 HASHTYPE hash_abs_path(struct shim_dentry* dent) {
+    /* The path of a dentry never changes, so the hash is computed only once */
+    if (__atomic_load_n(&dent->abs_path_hash_valid, __ATOMIC_ACQUIRE))
+        return dent->abs_path_hash;
+
+    struct shim_dentry* orig_dent = dent;
     HASHTYPE digest = 0;
 
     while (true) {
@@ -48,5 +53,8 @@ HASHTYPE hash_abs_path(struct shim_dentry* dent) {
         digest *= 9;
         dent = up;
     }
+
+    orig_dent->abs_path_hash = digest;
+    __atomic_store_n(&orig_dent->abs_path_hash_valid, true, __ATOMIC_RELEASE);
     return digest;
 }
@@ -452,14 +452,12 @@ int posix_lock_set(struct shim_dentry* dent, struct posix_lock* pl, bool wait) {
         }
         unlock(&g_fs_lock_lock);
 
-        char* path;
-        ret = dentry_abs_path(dent, &path, /*size=*/NULL);
+        const char* path;
+        ret = dentry_cached_abs_path(dent, &path, /*out_size=*/NULL);
         if (ret < 0)
             return ret;
 
-        ret = ipc_posix_lock_set(path, pl, wait);
-        free(path);
-        return ret;
+        return ipc_posix_lock_set(path, pl, wait);
     }
 
     lock(&g_fs_lock_lock);
@@ -545,14 +543,12 @@ int posix_lock_get(struct shim_dentry* dent, struct posix_lock* pl, struct posix
 
     int ret;
     if (g_process_ipc_ids.leader_vmid) {
-        char* path;
-        ret = dentry_abs_path(dent, &path, /*size=*/NULL);
+        const char* path;
+        ret = dentry_cached_abs_path(dent, &path, /*out_size=*/NULL);
         if (ret < 0)
             return ret;
 
-        ret = ipc_posix_lock_get(path, pl, out_pl);
-        free(path);
-        return ret;
+        return ipc_posix_lock_get(path, pl, out_pl);
     }
 
     lock(&g_fs_lock_lock);
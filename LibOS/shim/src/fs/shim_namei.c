@@ -46,24 +46,101 @@ static struct shim_dentry* lookup_dcache_or_create(struct shim_dentry* parent, c
     return dent;
 }
 
+/* Returns the current time for `negative_until`, or 0 if it cannot be determined (which just
+ * disables caching). */
+static uint64_t negative_cache_time(void) {
+    uint64_t time_us = 0;
+    if (DkSystemTimeQuery(&time_us) < 0)
+        return 0;
+    return time_us;
+}
+
+/* Checks if a failed lookup of `dent` is still cached. Clears the expired entry, so that a lookup
+ * in progress is never mistaken for a cached one. */
+static bool is_negative_cached(struct shim_dentry* dent) {
+    assert(locked(&g_dcache_lock));
+
+    if (!dent->negative_until)
+        return false;
+
+    if (dent->negative_until == UINT64_MAX || negative_cache_time() < dent->negative_until)
+        return true;
+
+    dent->negative_until = 0;
+    return false;
+}
+
+/*
+ * Calls the `lookup` operation of the filesystem. If the filesystem supports `unlocked_lookup`,
+ * `g_dcache_lock` is released for the duration of the call, and instead the lookup is serialized
+ * with other lookups of the same dentry. If another thread finishes looking up the dentry while we
+ * wait, its result is used.
+ */
+static int fs_lookup(struct shim_dentry* dent) {
+    assert(locked(&g_dcache_lock));
+
+    struct shim_d_ops* d_ops = dent->mount->fs->d_ops;
+    if (!d_ops->unlocked_lookup)
+        return d_ops->lookup(dent);
+
+    uint64_t seq = dent->lookup_seq;
+    struct shim_lock* lookup_lock = get_dentry_lookup_lock(dent);
+
+    unlock(&g_dcache_lock);
+    lock(lookup_lock);
+    lock(&g_dcache_lock);
+
+    int ret;
+    if (dent->inode || dent->lookup_seq != seq) {
+        ret = dent->inode ? 0 : -ENOENT;
+    } else {
+        unlock(&g_dcache_lock);
+        ret = d_ops->lookup(dent);
+        lock(&g_dcache_lock);
+    }
+
+    unlock(lookup_lock);
+    return ret;
+}
+
 /* Performs lookup operation in the underlying filesystem. Treats -ENOENT from lookup operation as
- * success (but leaves the dentry negative). */
+ * success (but leaves the dentry negative). Failed lookups are cached if the mount allows it.
+ *
+ * Note that `g_dcache_lock` might be temporarily released (see `fs_lookup`). */
 static int lookup_dentry(struct shim_dentry* dent) {
     assert(locked(&g_dcache_lock));
 
     if (dent->inode)
         return 0;
 
-    assert(dent->mount);
-    assert(dent->mount->fs->d_ops);
-    assert(dent->mount->fs->d_ops->lookup);
-    int ret = dent->mount->fs->d_ops->lookup(dent);
+    struct shim_mount* mount = dent->mount;
+    assert(mount);
+
+    if (is_negative_cached(dent))
+        return 0;
+
+    assert(mount->fs->d_ops);
+    assert(mount->fs->d_ops->lookup);
+    int ret = fs_lookup(dent);
     if (ret < 0) {
         assert(!dent->inode);
+        if (ret != -ENOENT)
+            return ret;
+
+        dent->lookup_seq++;
+
         /* Treat -ENOENT as successful lookup (but leave the dentry negative) */
-        return ret == -ENOENT ? 0 : ret;
+        if (mount->immutable) {
+            dent->negative_until = UINT64_MAX;
+        } else if (mount->negative_ttl_us) {
+            uint64_t now = negative_cache_time();
+            if (now)
+                dent->negative_until = now + mount->negative_ttl_us;
+        }
+        return 0;
     }
     assert(dent->inode);
+    dent->lookup_seq++;
     return 0;
 }
 
@@ -588,6 +665,8 @@ static int add_name(const char* name, void* arg) {
  * While `readdir` is callback-based, we don't look up the names inside of callback, but first
  * finish `readdir`. Otherwise, the two filesystem operations (`readdir` and `lookup`) might
  * deadlock.
+ *
+ * For filesystems with `unlocked_lookup`, `g_dcache_lock` is released during these operations.
  */
 static int populate_directory(struct shim_dentry* dent) {
     assert(locked(&g_dcache_lock));
@@ -600,7 +679,18 @@ static int populate_directory(struct shim_dentry* dent) {
         return -EINVAL;
 
     LISTP_TYPE(temp_dirent) ents = LISTP_INIT;
-    int ret = fs->d_ops->readdir(dent, &add_name, &ents);
+    int ret;
+    if (fs->d_ops->unlocked_lookup) {
+        /* The names are collected in a local list, so listing the directory does not need
+         * `g_dcache_lock` */
+        get_dentry(dent);
+        unlock(&g_dcache_lock);
+        ret = fs->d_ops->readdir(dent, &add_name, &ents);
+        lock(&g_dcache_lock);
+        put_dentry(dent);
+    } else {
+        ret = fs->d_ops->readdir(dent, &add_name, &ents);
+    }
     if (ret < 0)
         log_error("readdir error: %d", ret);
 
@@ -636,6 +726,9 @@ static int populate_directory(struct shim_dentry* dent) {
             goto out;
         }
 
+        /* The file was just listed, so a cached failed lookup is stale */
+        child->negative_until = 0;
+
         ret = traverse_mount_and_lookup(&child);
         put_dentry(child);
         if (ret < 0 && ret != -EACCES) {
@@ -668,8 +761,17 @@ int populate_directory_handle(struct shim_handle* hdl) {
     if (dirhdl->dents)
         return 0;
 
-    if ((ret = populate_directory(hdl->dentry)) < 0)
-        goto err;
+    /* `populate_directory` might temporarily release `g_dcache_lock`, so release `hdl->lock` as
+     * well to keep the lock order */
+    unlock(&hdl->lock);
+    ret = populate_directory(hdl->dentry);
+    lock(&hdl->lock);
+    if (ret < 0)
+        return ret;
+
+    /* Another thread might have populated the handle in the meantime */
+    if (dirhdl->dents)
+        return 0;
 
     size_t capacity = hdl->dentry->nchildren + 2; // +2 for ".", ".."
 
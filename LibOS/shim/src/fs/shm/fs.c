@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This file contains code for implementation of 'shm' filesystem.
+ *
+ * Handles of this filesystem wrap host shared memory objects (PAL streams with "shm:" URIs). They
+ * back shared anonymous mappings and System V shared memory segments: the VMA holds a reference to
+ * the handle, so on fork the child receives the PAL handle and re-maps the same host memory instead
+ * of getting a copy of it. Named objects can additionally be opened by name in other processes.
+ */
+
+#include <errno.h>
+
+#include "pal.h"
+#include "pal_error.h"
+#include "shim_flags_conv.h"
+#include "shim_fs.h"
+#include "shim_handle.h"
+#include "shim_internal.h"
+
+static int shm_mmap(struct shim_handle* hdl, void** addr, size_t size, int prot, int flags,
+                    uint64_t offset) {
+    assert(hdl->type == TYPE_SHM);
+
+    if (!(flags & MAP_SHARED))
+        return -EINVAL;
+
+    int ret = DkStreamMap(hdl->pal_handle, addr, LINUX_PROT_TO_PAL(prot, flags), offset, size);
+    return pal_to_unix_errno(ret);
+}
+
+static int shm_uri(const char* name, char** out_uri) {
+    size_t len = static_strlen(URI_PREFIX_SHM) + (name ? strlen(name) : 0) + 1;
+    char* uri = malloc(len);
+    if (!uri)
+        return -ENOMEM;
+
+    snprintf(uri, len, URI_PREFIX_SHM "%s", name ? name : "");
+    *out_uri = uri;
+    return 0;
+}
+
+int open_shm_handle(const char* name, enum pal_create_mode create, size_t size,
+                    struct shim_handle** out_hdl) {
+    char* uri;
+    int ret = shm_uri(name, &uri);
+    if (ret < 0)
+        return ret;
+
+    PAL_HANDLE pal_hdl = NULL;
+    ret = DkStreamOpen(uri, PAL_ACCESS_RDWR, PAL_SHARE_OWNER_R | PAL_SHARE_OWNER_W,
+                       name ? create : PAL_CREATE_IGNORED, /*options=*/0, &pal_hdl);
+    if (ret < 0) {
+        free(uri);
+        if (ret == -PAL_ERROR_NOTSUPPORT || ret == -PAL_ERROR_NOTIMPLEMENTED)
+            return -EOPNOTSUPP;
+        return pal_to_unix_errno(ret);
+    }
+
+    if (size) {
+        ret = DkStreamSetLength(pal_hdl, size);
+        if (ret < 0) {
+            DkObjectClose(pal_hdl);
+            free(uri);
+            return pal_to_unix_errno(ret);
+        }
+    }
+
+    struct shim_handle* hdl = get_new_handle();
+    if (!hdl) {
+        DkObjectClose(pal_hdl);
+        free(uri);
+        return -ENOMEM;
+    }
+
+    hdl->type       = TYPE_SHM;
+    hdl->fs         = &shm_builtin_fs;
+    hdl->flags      = O_RDWR;
+    hdl->acc_mode   = MAY_READ | MAY_WRITE;
+    hdl->uri        = uri;
+    hdl->pal_handle = pal_hdl;
+
+    hdl->info.shm.shmid = -1;
+    hdl->info.shm.size  = size;
+
+    *out_hdl = hdl;
+    return 0;
+}
+
+int delete_shm_object(const char* name) {
+    char* uri;
+    int ret = shm_uri(name, &uri);
+    if (ret < 0)
+        return ret;
+
+    PAL_HANDLE pal_hdl = NULL;
+    ret = DkStreamOpen(uri, PAL_ACCESS_RDWR, /*share_flags=*/0, PAL_CREATE_NEVER, /*options=*/0,
+                       &pal_hdl);
+    free(uri);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    ret = DkStreamDelete(pal_hdl, PAL_DELETE_ALL);
+    DkObjectClose(pal_hdl);
+    return pal_to_unix_errno(ret);
+}
+
+struct shim_fs_ops shm_fs_ops = {
+    .mmap = &shm_mmap,
+};
+
+struct shim_fs shm_builtin_fs = {
+    .name   = "shm",
+    .fs_ops = &shm_fs_ops,
+};
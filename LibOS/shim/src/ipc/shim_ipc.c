@@ -196,6 +196,26 @@ void remove_outgoing_ipc_connection(IDTYPE dest) {
     unlock(&g_msg_waiters_tree_lock);
 }
 
+bool is_process_disconnected(IDTYPE dest) {
+    struct shim_ipc_connection* conn = NULL;
+    int ret = ipc_connect(dest, &conn);
+    if (ret < 0) {
+        /* nobody listens on the IPC pipe of `dest` */
+        return ret == -ECONNREFUSED;
+    }
+
+    lock(&conn->lock);
+    pal_wait_flags_t events = 0;
+    pal_wait_flags_t ret_events = 0;
+    uint64_t timeout_us = 0;
+    ret = DkStreamsWaitEvents(1, &conn->handle, &events, &ret_events, &timeout_us);
+    unlock(&conn->lock);
+    put_ipc_connection(conn);
+
+    /* the other end of the connection is closed only when `dest` exits */
+    return ret == 0 && (ret_events & PAL_WAIT_ERROR);
+}
+
 void init_ipc_msg(struct shim_ipc_msg* msg, unsigned char code, size_t size) {
     SET_UNALIGNED(msg->header.size, size);
     SET_UNALIGNED(msg->header.seq, 0ul);
@@ -0,0 +1,396 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * IPC glue code for System V IPC objects.
+ */
+
+#include "shim_ipc.h"
+#include "shim_sysv.h"
+
+static int send_request_and_get_int(struct shim_ipc_msg* msg) {
+    void* data;
+    int ret = ipc_send_msg_and_get_response(g_process_ipc_ids.leader_vmid, msg, &data);
+    if (ret < 0)
+        return ret;
+    int result = *(int*)data;
+    free(data);
+    return result;
+}
+
+static int send_int_response(IDTYPE dest, unsigned long seq, int result) {
+    size_t total_msg_size = get_ipc_msg_size(sizeof(result));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_response(msg, seq, total_msg_size);
+    memcpy(msg->data, &result, sizeof(result));
+    return ipc_send_message(dest, msg);
+}
+
+int ipc_sysv_shm_get(int key, size_t size, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_shm_get msgin = {
+        .key = key,
+        .size = size,
+        .flags = flags,
+        .pid = pid,
+        .uid = uid,
+        .gid = gid,
+    };
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SHM_GET, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_shm_attach(int shmid, IDTYPE pid, bool detach, size_t* out_size) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_shm_attach msgin = {
+        .shmid = shmid,
+        .pid = pid,
+        .detach = detach,
+    };
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SHM_ATTACH, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    void* data;
+    int ret = ipc_send_msg_and_get_response(g_process_ipc_ids.leader_vmid, msg, &data);
+    if (ret < 0)
+        return ret;
+
+    struct shim_ipc_sysv_shm_attach_resp* resp = data;
+    int result = resp->result;
+    if (result == 0 && out_size)
+        *out_size = resp->size;
+    free(data);
+    return result;
+}
+
+int ipc_sysv_shm_ctl(int shmid, int cmd, IDTYPE pid, struct shmid64_ds* buf) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_shm_ctl msgin = {
+        .shmid = shmid,
+        .cmd = cmd,
+        .pid = pid,
+    };
+    if (buf)
+        msgin.buf = *buf;
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SHM_CTL, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    void* data;
+    int ret = ipc_send_msg_and_get_response(g_process_ipc_ids.leader_vmid, msg, &data);
+    if (ret < 0)
+        return ret;
+
+    struct shim_ipc_sysv_shm_ctl_resp* resp = data;
+    int result = resp->result;
+    if (result == 0 && buf)
+        *buf = resp->buf;
+    free(data);
+    return result;
+}
+
+int ipc_sysv_shm_inherit(IDTYPE parent_pid, IDTYPE child_pid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_shm_inherit msgin = {
+        .parent_pid = parent_pid,
+        .child_pid = child_pid,
+    };
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SHM_INHERIT, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_shm_clear_pid(IDTYPE pid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(pid));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SHM_CLEAR_PID, total_msg_size);
+    memcpy(msg->data, &pid, sizeof(pid));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_shm_get_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_shm_get* msgin = data;
+    int result = sysv_shm_get(msgin->key, msgin->size, msgin->flags, msgin->pid, msgin->uid,
+                              msgin->gid);
+    return send_int_response(src, seq, result);
+}
+
+int ipc_sysv_shm_attach_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_shm_attach* msgin = data;
+
+    struct shim_ipc_sysv_shm_attach_resp msgout = {0};
+    msgout.result = sysv_shm_attach(msgin->shmid, msgin->pid, msgin->detach, &msgout.size);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgout));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_response(msg, seq, total_msg_size);
+    memcpy(msg->data, &msgout, sizeof(msgout));
+    return ipc_send_message(src, msg);
+}
+
+int ipc_sysv_shm_ctl_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_shm_ctl* msgin = data;
+
+    struct shim_ipc_sysv_shm_ctl_resp msgout = {
+        .buf = msgin->buf,
+    };
+    msgout.result = sysv_shm_ctl(msgin->shmid, msgin->cmd, msgin->pid, &msgout.buf);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgout));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_response(msg, seq, total_msg_size);
+    memcpy(msg->data, &msgout, sizeof(msgout));
+    return ipc_send_message(src, msg);
+}
+
+int ipc_sysv_shm_inherit_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_shm_inherit* msgin = data;
+    int result = sysv_shm_inherit(msgin->parent_pid, msgin->child_pid);
+    return send_int_response(src, seq, result);
+}
+
+int ipc_sysv_shm_clear_pid_callback(IDTYPE src, void* data, unsigned long seq) {
+    IDTYPE* pid = data;
+    int result = sysv_shm_clear_pid(*pid);
+    return send_int_response(src, seq, result);
+}
+
+int ipc_sysv_sem_get(int key, int nsems, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_sem_get msgin = {
+        .key = key,
+        .nsems = nsems,
+        .flags = flags,
+        .pid = pid,
+        .uid = uid,
+        .gid = gid,
+    };
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_GET, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_sem_op(int semid, struct sembuf* sops, size_t nsops, bool is_undo, IDTYPE pid,
+                    uint64_t id) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_sem_op msgin = {
+        .semid = semid,
+        .pid = pid,
+        .id = id,
+        .is_undo = is_undo,
+        .nsops = nsops,
+    };
+
+    size_t sops_size = nsops * sizeof(*sops);
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin) + sops_size);
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_OP, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+    memcpy(msg->data + sizeof(msgin), sops, sops_size);
+
+    /* the result comes back as a separate `IPC_MSG_SYSV_SEM_DONE` message */
+    return ipc_send_message(g_process_ipc_ids.leader_vmid, msg);
+}
+
+int ipc_sysv_sem_done(IDTYPE vmid, uint64_t id, int result) {
+    struct shim_ipc_sysv_sem_done msgin = {
+        .id = id,
+        .result = result,
+    };
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_DONE, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+
+    return ipc_send_message(vmid, msg);
+}
+
+int ipc_sysv_sem_cancel(uint64_t id) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(id));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_CANCEL, total_msg_size);
+    memcpy(msg->data, &id, sizeof(id));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_sem_wake(int semid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(semid));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_WAKE, total_msg_size);
+    memcpy(msg->data, &semid, sizeof(semid));
+
+    return ipc_send_message(g_process_ipc_ids.leader_vmid, msg);
+}
+
+int ipc_sysv_sem_ctl(int semid, int semnum, int cmd, IDTYPE pid, int val, struct semid64_ds* buf,
+                     unsigned short* array, size_t array_len) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct shim_ipc_sysv_sem_ctl msgin = {
+        .semid = semid,
+        .semnum = semnum,
+        .cmd = cmd,
+        .pid = pid,
+        .val = val,
+        .array_len = array_len,
+    };
+    if (buf)
+        msgin.buf = *buf;
+
+    /* `array` can have up to `SEMMSL` elements, too much for the stack */
+    size_t array_size = array_len * sizeof(*array);
+    size_t total_msg_size = get_ipc_msg_size(sizeof(msgin) + array_size);
+    struct shim_ipc_msg* msg = malloc(total_msg_size);
+    if (!msg)
+        return -ENOMEM;
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_CTL, total_msg_size);
+    memcpy(msg->data, &msgin, sizeof(msgin));
+    if (array_size)
+        memcpy(msg->data + sizeof(msgin), array, array_size);
+
+    void* data;
+    int ret = ipc_send_msg_and_get_response(g_process_ipc_ids.leader_vmid, msg, &data);
+    free(msg);
+    if (ret < 0)
+        return ret;
+
+    struct shim_ipc_sysv_sem_ctl_resp* resp = data;
+    int result = resp->result;
+    if (result >= 0) {
+        if (buf)
+            *buf = resp->buf;
+        if (resp->array_len) {
+            assert(resp->array_len == array_len);
+            memcpy(array, resp->array, array_size);
+        }
+    }
+    free(data);
+    return result;
+}
+
+int ipc_sysv_sem_clear_pid(IDTYPE pid) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    size_t total_msg_size = get_ipc_msg_size(sizeof(pid));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, IPC_MSG_SYSV_SEM_CLEAR_PID, total_msg_size);
+    memcpy(msg->data, &pid, sizeof(pid));
+
+    return send_request_and_get_int(msg);
+}
+
+int ipc_sysv_sem_get_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_sem_get* msgin = data;
+    int result = sysv_sem_get(msgin->key, msgin->nsems, msgin->flags, msgin->pid, msgin->uid,
+                              msgin->gid);
+    return send_int_response(src, seq, result);
+}
+
+int ipc_sysv_sem_op_callback(IDTYPE src, void* data, unsigned long seq) {
+    __UNUSED(seq);
+    struct shim_ipc_sysv_sem_op* msgin = data;
+    int ret = sysv_sem_op(msgin->semid, msgin->sops, msgin->nsops, msgin->is_undo, msgin->pid, src,
+                          msgin->id);
+    if (ret < 0) {
+        /* the request was not accepted, report the error back to the requester */
+        ret = ipc_sysv_sem_done(src, msgin->id, ret);
+        if (ret < 0)
+            log_warning("failed to report semop result to %u: %d", src, ret);
+    }
+    return 0;
+}
+
+int ipc_sysv_sem_done_callback(IDTYPE src, void* data, unsigned long seq) {
+    __UNUSED(src);
+    __UNUSED(seq);
+    struct shim_ipc_sysv_sem_done* msgin = data;
+    sysv_sem_request_done(msgin->id, msgin->result);
+    return 0;
+}
+
+int ipc_sysv_sem_cancel_callback(IDTYPE src, void* data, unsigned long seq) {
+    uint64_t* id = data;
+    int result = sysv_sem_cancel(src, *id);
+    return send_int_response(src, seq, result);
+}
+
+int ipc_sysv_sem_wake_callback(IDTYPE src, void* data, unsigned long seq) {
+    __UNUSED(src);
+    __UNUSED(seq);
+    int* semid = data;
+    int ret = sysv_sem_wake(*semid);
+    if (ret < 0)
+        log_warning("failed to wake up waiters of semaphore set %d: %d", *semid, ret);
+    return 0;
+}
+
+int ipc_sysv_sem_ctl_callback(IDTYPE src, void* data, unsigned long seq) {
+    struct shim_ipc_sysv_sem_ctl* msgin = data;
+
+    size_t array_size = msgin->array_len * sizeof(*msgin->array);
+    size_t resp_size = sizeof(struct shim_ipc_sysv_sem_ctl_resp) + array_size;
+    struct shim_ipc_sysv_sem_ctl_resp* resp = malloc(resp_size);
+    if (!resp)
+        return -ENOMEM;
+
+    resp->buf = msgin->buf;
+    resp->array_len = msgin->array_len;
+    if (array_size)
+        memcpy(resp->array, msgin->array, array_size);
+
+    resp->result = sysv_sem_ctl(msgin->semid, msgin->semnum, msgin->cmd, msgin->pid, msgin->val,
+                                &resp->buf, resp->array, resp->array_len);
+
+    size_t total_msg_size = get_ipc_msg_size(resp_size);
+    struct shim_ipc_msg* msg = malloc(total_msg_size);
+    if (!msg) {
+        free(resp);
+        return -ENOMEM;
+    }
+    init_ipc_response(msg, seq, total_msg_size);
+    memcpy(msg->data, resp, resp_size);
+    free(resp);
+
+    int ret = ipc_send_message(src, msg);
+    free(msg);
+    return ret;
+}
+
+int ipc_sysv_sem_clear_pid_callback(IDTYPE src, void* data, unsigned long seq) {
+    IDTYPE* pid = data;
+    int result = sysv_sem_clear_pid(*pid);
+    return send_int_response(src, seq, result);
+}
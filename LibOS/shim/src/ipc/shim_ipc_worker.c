@@ -16,6 +16,7 @@
 #include "shim_ipc.h"
 #include "shim_lock.h"
 #include "shim_pollable_event.h"
+#include "shim_sysv.h"
 #include "shim_thread.h"
 #include "shim_types.h"
 #include "shim_utils.h"
@@ -63,6 +64,20 @@ static ipc_callback ipc_callbacks[] = {
     [IPC_MSG_POSIX_LOCK_SET]       = ipc_posix_lock_set_callback,
     [IPC_MSG_POSIX_LOCK_GET]       = ipc_posix_lock_get_callback,
     [IPC_MSG_POSIX_LOCK_CLEAR_PID] = ipc_posix_lock_clear_pid_callback,
+
+    [IPC_MSG_SYSV_SHM_GET]       = ipc_sysv_shm_get_callback,
+    [IPC_MSG_SYSV_SHM_ATTACH]    = ipc_sysv_shm_attach_callback,
+    [IPC_MSG_SYSV_SHM_CTL]       = ipc_sysv_shm_ctl_callback,
+    [IPC_MSG_SYSV_SHM_INHERIT]   = ipc_sysv_shm_inherit_callback,
+    [IPC_MSG_SYSV_SHM_CLEAR_PID] = ipc_sysv_shm_clear_pid_callback,
+
+    [IPC_MSG_SYSV_SEM_GET]       = ipc_sysv_sem_get_callback,
+    [IPC_MSG_SYSV_SEM_OP]        = ipc_sysv_sem_op_callback,
+    [IPC_MSG_SYSV_SEM_DONE]      = ipc_sysv_sem_done_callback,
+    [IPC_MSG_SYSV_SEM_CANCEL]    = ipc_sysv_sem_cancel_callback,
+    [IPC_MSG_SYSV_SEM_WAKE]      = ipc_sysv_sem_wake_callback,
+    [IPC_MSG_SYSV_SEM_CTL]       = ipc_sysv_sem_ctl_callback,
+    [IPC_MSG_SYSV_SEM_CLEAR_PID] = ipc_sysv_sem_clear_pid_callback,
 };
 
 static void ipc_leader_died_callback(void) {
@@ -80,6 +95,7 @@ static void disconnect_callbacks(struct shim_ipc_connection* conn) {
 
     if (!g_process_ipc_ids.leader_vmid) {
         sync_server_disconnect_callback(conn->vmid);
+        sysv_sem_disconnect_callback(conn->vmid);
     }
 
     /*
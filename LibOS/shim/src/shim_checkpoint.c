@@ -15,15 +15,22 @@
 #include "pal.h"
 #include "shim_internal.h"
 #include "shim_ipc.h"
+#include "shim_lock.h"
 #include "shim_process.h"
+#include "shim_tcb.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
 #include "shim_vma.h"
+#include "spinlock.h"
+#include "toml_utils.h"
 
 #define CP_MMAP_FLAGS    (MAP_PRIVATE | MAP_ANONYMOUS | VMA_INTERNAL)
 #define CP_MAP_ENTRY_NUM 64
 #define CP_HASH_SIZE     256
 
+/* number of pages queried for being populated at once, see `memory_runs` */
+#define CP_POPULATED_BATCH 256
+
 DEFINE_LIST(cp_map_entry);
 struct cp_map_entry {
     LIST_TYPE(cp_map_entry) hlist;
@@ -127,6 +134,9 @@ BEGIN_CP_FUNC(memory) {
     entry->addr = obj;
     entry->size = size;
     entry->prot = PAL_PROT_READ | PAL_PROT_WRITE;
+    entry->sparse = false;
+    entry->runs_cnt = 0;
+    entry->runs = NULL;
     entry->next = store->first_mem_entry;
 
     store->first_mem_entry = entry;
@@ -137,6 +147,80 @@ BEGIN_CP_FUNC(memory) {
 }
 END_CP_FUNC_NO_RS(memory)
 
+static bool is_zero_page(const void* addr, size_t size) {
+    const uint64_t* words = addr;
+    for (size_t i = 0; i < size / sizeof(*words); i++)
+        if (words[i])
+            return false;
+    return true;
+}
+
+/*
+ * Turns an already checkpointed anonymous memory entry into a sparse one: only runs of pages that
+ * may hold non-zero data are sent, and the child maps the rest as fresh zero-filled memory. Pages
+ * never touched are reported by the PAL (if supported); populated but readable pages are
+ * additionally checked for being all-zero.
+ *
+ * Runs are appended one by one directly to the checkpoint, so we cannot use `ADD_CP_OFFSET` (it
+ * prepends each allocation with its own OOB entry); instead we emit a single OOB entry and fix its
+ * size once the runs are known.
+ */
+BEGIN_CP_FUNC(memory_runs) {
+    __UNUSED(size);
+    __UNUSED(objp);
+    assert(size == sizeof(struct shim_mem_entry));
+
+    struct shim_mem_entry* entry = (struct shim_mem_entry*)obj;
+    assert(IS_ALLOC_ALIGNED_PTR(entry->addr) && IS_ALLOC_ALIGNED(entry->size));
+
+    struct shim_cp_entry* oob = (void*)base + __ADD_CP_OFFSET(sizeof(struct shim_cp_entry));
+    oob->cp_type = CP_OOB;
+    oob->cp_val = 0;
+    size_t runs_off = store->offset;
+
+    bool readable = entry->prot & PAL_PROT_READ;
+    size_t populated_size = 0;
+    struct shim_mem_run* run = NULL;
+    uint8_t populated[CP_POPULATED_BATCH];
+
+    size_t off = 0;
+    while (off < entry->size) {
+        size_t batch_size = MIN(entry->size - off, CP_POPULATED_BATCH * ALLOC_ALIGNMENT);
+        size_t batch_pages = batch_size / ALLOC_ALIGNMENT;
+
+        if (DkVirtualMemoryQueryPopulated(entry->addr + off, batch_size, populated) < 0) {
+            /* PAL cannot tell untouched pages apart, rely on zero-page detection only */
+            memset(populated, 1, batch_pages);
+        }
+
+        for (size_t i = 0; i < batch_pages; i++, off += ALLOC_ALIGNMENT) {
+            if (!populated[i] || (readable && is_zero_page(entry->addr + off, ALLOC_ALIGNMENT))) {
+                run = NULL;
+                continue;
+            }
+
+            populated_size += ALLOC_ALIGNMENT;
+            if (run) {
+                run->size += ALLOC_ALIGNMENT;
+                continue;
+            }
+
+            run = (void*)base + __ADD_CP_OFFSET(sizeof(*run));
+            run->offset = off;
+            run->size = ALLOC_ALIGNMENT;
+            entry->runs_cnt++;
+        }
+    }
+
+    oob->cp_val = store->offset - runs_off;
+    entry->runs = entry->runs_cnt ? (void*)base + runs_off : NULL;
+    entry->sparse = true;
+
+    log_debug("checkpointing %p-%p: %lu of %lu bytes populated in %lu runs", entry->addr,
+              entry->addr + entry->size, populated_size, entry->size, entry->runs_cnt);
+}
+END_CP_FUNC_NO_RS(memory_runs)
+
 /* Checkpointing mess takes `sizeof(*obj)`, but `PAL_HANDLE` is just opaque pointer, which we do not
  * know the size of, hence we pass a pointer to it and just dereference it here. */
 BEGIN_CP_FUNC(palhdl_ptr) {
@@ -225,7 +309,13 @@ static int send_memory_on_stream(PAL_HANDLE stream, struct shim_cp_store* store)
             }
         }
 
-        ret = write_exact(stream, mem_addr, mem_size);
+        if (entry->sparse) {
+            for (size_t i = 0; i < entry->runs_cnt && ret >= 0; i++) {
+                ret = write_exact(stream, mem_addr + entry->runs[i].offset, entry->runs[i].size);
+            }
+        } else {
+            ret = write_exact(stream, mem_addr, mem_size);
+        }
 
         if (!(mem_prot & PAL_PROT_READ) && mem_size > 0) {
             /* the area was made readable above; revert to original permissions */
@@ -299,8 +389,10 @@ static int receive_memory_on_stream(PAL_HANDLE handle, struct checkpoint_hdr* hd
 
         for (; entry; entry = entry->next) {
             CP_REBASE(entry->next);
+            CP_REBASE(entry->runs);
 
-            log_debug("memory entry [%p]: %p-%p", entry, entry->addr, entry->addr + entry->size);
+            log_debug("memory entry [%p]: %p-%p%s", entry, entry->addr, entry->addr + entry->size,
+                      entry->sparse ? " (sparse)" : "");
 
             void* addr = ALLOC_ALIGN_DOWN_PTR(entry->addr);
             PAL_NUM size = (char*)ALLOC_ALIGN_UP_PTR(entry->addr + entry->size) - (char*)addr;
@@ -312,9 +404,21 @@ static int receive_memory_on_stream(PAL_HANDLE handle, struct checkpoint_hdr* hd
                 return pal_to_unix_errno(ret);
             }
 
-            ret = read_exact(handle, entry->addr, entry->size);
-            if (ret < 0) {
-                return ret;
+            /* memory returned by DkVirtualMemoryAlloc() is zeroed, so we only need to fill in
+             * the populated runs of a sparse entry */
+            if (entry->sparse) {
+                for (size_t i = 0; i < entry->runs_cnt; i++) {
+                    ret = read_exact(handle, entry->addr + entry->runs[i].offset,
+                                     entry->runs[i].size);
+                    if (ret < 0) {
+                        return ret;
+                    }
+                }
+            } else {
+                ret = read_exact(handle, entry->addr, entry->size);
+                if (ret < 0) {
+                    return ret;
+                }
             }
 
             if (!(prot & PAL_PROT_WRITE)) {
@@ -408,6 +512,43 @@ out:
     return ret;
 }
 
+/*
+ * Cached checkpoint store. Allocating a new store on each fork is expensive: the PAL has to provide
+ * zeroed memory (on SGX, this means clearing every page of the store), and a 64MB store is mostly
+ * unused since a typical checkpoint takes a few hundred kilobytes. So after sending a checkpoint, we
+ * clear only the used part of the store and keep the store for the next fork. The kept store is
+ * never smaller than `CP_INIT_VMA_SIZE` (it is trimmed only if it was extended beyond twice the
+ * largest checkpoint created so far, the high-water mark), so a checkpoint needs to extend a reused
+ * store no more often than a new one (see `__ADD_CP_OFFSET`). Only one store is cached; concurrent
+ * forks allocate their own stores, and whichever finishes last frees its store. This also replaces
+ * reserving address space after each new store, which was meant to keep the space for the next
+ * fork from fragmenting.
+ *
+ * The counters below describe how the store is allocated, reused and extended; they are printed at
+ * debug log level after each checkpoint.
+ */
+static spinlock_t g_cp_store_lock = INIT_SPINLOCK_UNLOCKED;
+static void* g_cp_store_cache;
+static size_t g_cp_store_cache_size;
+static size_t g_cp_high_water;
+static size_t g_cp_stores_allocated;
+static size_t g_cp_stores_reused;
+static size_t g_cp_store_extensions;
+
+static int cp_free(void* addr, size_t size) {
+    void* tmp_vma = NULL;
+    int ret = bkeep_munmap(addr, size, /*is_internal=*/true, &tmp_vma);
+    if (ret < 0) {
+        log_warning("failed unmapping checkpoint store %p-%p (ret = %d)", addr, addr + size, ret);
+        return ret;
+    }
+    if (DkVirtualMemoryFree(addr, size) < 0) {
+        BUG();
+    }
+    bkeep_remove_tmp_vma(tmp_vma);
+    return 0;
+}
+
 static void* cp_alloc(void* addr, size_t size) {
     if (addr) {
         log_debug("extending checkpoint store: %p-%p (size = %lu)", addr, addr + size, size);
@@ -415,31 +556,15 @@ static void* cp_alloc(void* addr, size_t size) {
         if (bkeep_mmap_fixed(addr, size, PROT_READ | PROT_WRITE,
                              CP_MMAP_FLAGS | MAP_FIXED_NOREPLACE, NULL, 0, "cpstore") < 0)
             return NULL;
+        __atomic_add_fetch(&g_cp_store_extensions, 1, __ATOMIC_RELAXED);
     } else {
-        /* FIXME: It is unclear if the below strategy helps */
-        /* Here we use a strategy to reduce internal fragmentation of virtual memory space. Because
-         * we need a relatively large, continuous space for dumping the checkpoint data, internal
-         * fragmentation can cause the process to drain the virtual address space after forking a
-         * few times. The previous space used for checkpoint may be fragmented at the next fork.
-         * A simple trick we use here is to reserve some space right after the checkpoint space. The
-         * reserved space is half of the size of the checkpoint space. */
-        size_t reserve_size = ALLOC_ALIGN_UP(size >> 1);
-
-        log_debug("allocating checkpoint store (size = %ld, reserve = %ld)", size, reserve_size);
-
-        int ret = bkeep_mmap_any(size + reserve_size, PROT_READ | PROT_WRITE, CP_MMAP_FLAGS, NULL,
-                                 0, "cpstore", &addr);
+        log_debug("allocating checkpoint store (size = %ld)", size);
+
+        int ret = bkeep_mmap_any(size, PROT_READ | PROT_WRITE, CP_MMAP_FLAGS, NULL, 0, "cpstore",
+                                 &addr);
         if (ret < 0) {
             return NULL;
         }
-
-        /* we reserved [addr, addr + size + reserve_size) to reduce fragmentation (see above); now
-         * we unmap [addr + size, addr + size + reserve_size) to reclaim this memory region */
-        void* tmp_vma = NULL;
-        if (bkeep_munmap(addr + size, reserve_size, /*is_internal=*/true, &tmp_vma) < 0) {
-            BUG();
-        }
-        bkeep_remove_tmp_vma(tmp_vma);
     }
 
     int ret = DkVirtualMemoryAlloc(&addr, size, 0, PAL_PROT_READ | PAL_PROT_WRITE);
@@ -455,6 +580,215 @@ static void* cp_alloc(void* addr, size_t size) {
     return addr;
 }
 
+/* Size of a new or cached store: `CP_INIT_VMA_SIZE`, or twice the high-water mark if larger, so
+ * that the store rarely needs to be extended. */
+static size_t cp_store_size(void) {
+    return MAX(ALLOC_ALIGN_UP(g_cp_high_water * 2), (size_t)CP_INIT_VMA_SIZE);
+}
+
+/* Takes the cached store, or allocates a new one. The store memory is zeroed in both cases. */
+static int cp_store_get(struct shim_cp_store* store) {
+    spinlock_lock(&g_cp_store_lock);
+    void* cached = g_cp_store_cache;
+    size_t cached_size = g_cp_store_cache_size;
+    size_t size = cp_store_size();
+    g_cp_store_cache = NULL;
+    g_cp_store_cache_size = 0;
+    if (cached)
+        g_cp_stores_reused++;
+    spinlock_unlock(&g_cp_store_lock);
+
+    store->alloc = cp_alloc;
+
+    if (cached) {
+        store->base = (uintptr_t)cached;
+        store->bound = cached_size;
+        return 0;
+    }
+
+    store->bound = size;
+    while (1) {
+        /* try allocating checkpoint; if allocation fails, try with smaller sizes */
+        store->base = (uintptr_t)cp_alloc(0, store->bound);
+        if (store->base)
+            break;
+
+        store->bound >>= 1;
+        if (store->bound < ALLOC_ALIGNMENT)
+            return -ENOMEM;
+    }
+
+    __atomic_add_fetch(&g_cp_stores_allocated, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Clears the used part of the store and caches the store for the next checkpoint (trimmed to
+ * `cp_store_size()`), or frees it if another store is already cached or `reuse` is false. The
+ * latter is used after a failed checkpoint, which may have failed because the store could not be
+ * extended; the next fork then allocates a new store instead. */
+static void cp_store_put(struct shim_cp_store* store, bool reuse) {
+    void* base = (void*)store->base;
+    size_t size = store->bound;
+
+    if (!reuse) {
+        (void)cp_free(base, size);
+        return;
+    }
+
+    memset(base, 0, store->offset);
+
+    spinlock_lock(&g_cp_store_lock);
+    size_t keep_size = cp_store_size();
+    spinlock_unlock(&g_cp_store_lock);
+
+    /* if trimming fails, we simply keep the whole store */
+    if (size > keep_size && cp_free(base + keep_size, size - keep_size) == 0)
+        size = keep_size;
+
+    spinlock_lock(&g_cp_store_lock);
+    bool cache = !g_cp_store_cache;
+    if (cache) {
+        g_cp_store_cache = base;
+        g_cp_store_cache_size = size;
+    }
+    spinlock_unlock(&g_cp_store_lock);
+
+    if (!cache)
+        (void)cp_free(base, size);
+}
+
+/* Updates the high-water mark with the size of a created checkpoint and prints the statistics of
+ * checkpoint stores. */
+static void cp_store_account(struct shim_cp_store* store) {
+    spinlock_lock(&g_cp_store_lock);
+    g_cp_high_water = MAX(g_cp_high_water, store->offset);
+    size_t high_water = g_cp_high_water;
+    size_t reused = g_cp_stores_reused;
+    spinlock_unlock(&g_cp_store_lock);
+
+    log_debug("checkpoint of %lu bytes created in a store of %lu bytes (high-water mark: %lu "
+              "bytes; stores allocated: %lu, reused: %lu, extended: %lu times)", store->offset,
+              store->bound, high_water,
+              __atomic_load_n(&g_cp_stores_allocated, __ATOMIC_RELAXED), reused,
+              __atomic_load_n(&g_cp_store_extensions, __ATOMIC_RELAXED));
+}
+
+/*
+ * Pool of pre-created child processes. Creating a new host process (and on SGX, a new enclave) is
+ * the most expensive part of fork, but it does not depend on the state of the forking process: the
+ * new child just waits for the checkpoint header. So we keep up to `g_prefork_pool_size` such idle
+ * children around and hand one of them out on each fork. The pool is filled lazily, after the first
+ * fork, by a short-lived internal thread, so that processes which never fork do not spawn idle
+ * children. An idle child exits quietly once its handle is closed (see `shim_init()`).
+ */
+#define PREFORK_POOL_MAX_SIZE 32
+
+static struct shim_lock g_prefork_lock;
+static PAL_HANDLE g_prefork_pool[PREFORK_POOL_MAX_SIZE];
+static size_t g_prefork_pool_size;
+static size_t g_prefork_pool_cnt;
+static bool g_prefork_refilling;
+static bool g_prefork_destroyed;
+
+int init_prefork_pool(void) {
+    if (!create_lock(&g_prefork_lock))
+        return -ENOMEM;
+
+    assert(g_manifest_root);
+    int64_t pool_size;
+    int ret = toml_int_in(g_manifest_root, "libos.prefork_pool_size", /*defaultval=*/0,
+                          &pool_size);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.prefork_pool_size'");
+        return -EINVAL;
+    }
+    if (pool_size < 0 || pool_size > PREFORK_POOL_MAX_SIZE) {
+        log_error("'libos.prefork_pool_size' = %ld is negative or greater than %d", pool_size,
+                  PREFORK_POOL_MAX_SIZE);
+        return -EINVAL;
+    }
+
+    g_prefork_pool_size = pool_size;
+    return 0;
+}
+
+static int prefork_refill_thread(void* arg) {
+    struct shim_thread* self = (struct shim_thread*)arg;
+
+    shim_tcb_init();
+    set_cur_thread(self);
+
+    log_setprefix(shim_get_tcb());
+
+    lock(&g_prefork_lock);
+    while (!g_prefork_destroyed && g_prefork_pool_cnt < g_prefork_pool_size) {
+        unlock(&g_prefork_lock);
+
+        PAL_HANDLE pal_process = NULL;
+        int ret = DkProcessCreate(/*args=*/NULL, &pal_process);
+
+        lock(&g_prefork_lock);
+        if (ret < 0) {
+            log_warning("failed to pre-create a child process: %ld", pal_to_unix_errno(ret));
+            break;
+        }
+        if (g_prefork_destroyed) {
+            DkObjectClose(pal_process);
+            break;
+        }
+        g_prefork_pool[g_prefork_pool_cnt++] = pal_process;
+    }
+    g_prefork_refilling = false;
+    unlock(&g_prefork_lock);
+
+    put_thread(self);
+    DkThreadExit(/*clear_child_tid=*/NULL);
+    /* UNREACHABLE */
+}
+
+/* Starts refilling the pool in background, unless it is already full or being refilled. */
+static void prefork_pool_refill(void) {
+    lock(&g_prefork_lock);
+    if (g_prefork_destroyed || g_prefork_refilling || g_prefork_pool_cnt == g_prefork_pool_size)
+        goto out;
+
+    struct shim_thread* thread = get_new_internal_thread();
+    if (!thread)
+        goto out;
+
+    PAL_HANDLE handle = NULL;
+    int ret = DkThreadCreate(prefork_refill_thread, thread, &handle);
+    if (ret < 0) {
+        log_warning("failed to start refilling the prefork pool: %ld", pal_to_unix_errno(ret));
+        put_thread(thread);
+        goto out;
+    }
+    thread->pal_handle = handle;
+    g_prefork_refilling = true;
+
+out:
+    unlock(&g_prefork_lock);
+}
+
+static PAL_HANDLE prefork_pool_take(void) {
+    PAL_HANDLE pal_process = NULL;
+
+    lock(&g_prefork_lock);
+    if (g_prefork_pool_cnt)
+        pal_process = g_prefork_pool[--g_prefork_pool_cnt];
+    unlock(&g_prefork_lock);
+
+    return pal_process;
+}
+
+void destroy_prefork_pool(void) {
+    lock(&g_prefork_lock);
+    g_prefork_destroyed = true;
+    while (g_prefork_pool_cnt)
+        DkObjectClose(g_prefork_pool[--g_prefork_pool_cnt]);
+    unlock(&g_prefork_lock);
+}
+
 int create_process_and_send_checkpoint(migrate_func_t migrate_func,
                                        struct shim_child_process* child_process,
                                        struct shim_process* process_description,
@@ -462,35 +796,29 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
     assert(child_process);
 
     int ret = 0;
+    struct shim_cp_store cpstore;
+    memset(&cpstore, 0, sizeof(cpstore));
 
     /* FIXME: Child process requires some time to initialize before starting to receive checkpoint
-     * data. Parallelizing process creation and checkpointing could improve latency of forking. */
+     * data. Parallelizing process creation and checkpointing could improve latency of forking.
+     * With `libos.prefork_pool_size` set, the child is usually taken from the prefork pool, so it
+     * is already initialized. */
     PAL_HANDLE pal_process = NULL;
-    ret = DkProcessCreate(/*args=*/NULL, &pal_process);
-    if (ret < 0) {
-        ret = pal_to_unix_errno(ret);
-        goto out;
+    if (g_prefork_pool_size) {
+        pal_process = prefork_pool_take();
+        prefork_pool_refill();
     }
-
-    /* allocate a space for dumping the checkpoint data */
-    struct shim_cp_store cpstore;
-    memset(&cpstore, 0, sizeof(cpstore));
-    cpstore.alloc = cp_alloc;
-    cpstore.bound = CP_INIT_VMA_SIZE;
-
-    while (1) {
-        /* try allocating checkpoint; if allocation fails, try with smaller sizes */
-        cpstore.base = (uintptr_t)cp_alloc(0, cpstore.bound);
-        if (cpstore.base)
-            break;
-
-        cpstore.bound >>= 1;
-        if (cpstore.bound < ALLOC_ALIGNMENT)
-            break;
+    if (!pal_process) {
+        ret = DkProcessCreate(/*args=*/NULL, &pal_process);
+        if (ret < 0) {
+            ret = pal_to_unix_errno(ret);
+            goto out;
+        }
     }
 
-    if (!cpstore.base) {
-        ret = -ENOMEM;
+    /* allocate a space for dumping the checkpoint data (or reuse the one of the previous fork) */
+    ret = cp_store_get(&cpstore);
+    if (ret < 0) {
         log_error("failed allocating enough memory for checkpoint");
         goto out;
     }
@@ -509,7 +837,7 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
         goto out;
     }
 
-    log_debug("checkpoint of %lu bytes created", cpstore.offset);
+    cp_store_account(&cpstore);
 
     struct checkpoint_hdr hdr;
     memset(&hdr, 0, sizeof(hdr));
@@ -546,16 +874,8 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
         goto out;
     }
 
-    void* tmp_vma = NULL;
-    ret = bkeep_munmap((void*)cpstore.base, cpstore.bound, /*is_internal=*/true, &tmp_vma);
-    if (ret < 0) {
-        log_error("failed unmaping checkpoint (ret = %d)", ret);
-        goto out;
-    }
-    if (DkVirtualMemoryFree((void*)cpstore.base, cpstore.bound) < 0) {
-        BUG();
-    }
-    bkeep_remove_tmp_vma(tmp_vma);
+    cp_store_put(&cpstore, /*reuse=*/true);
+    cpstore.base = 0;
 
     /* wait for final ack from child process */
     char dummy_c = 0;
@@ -584,6 +904,8 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
 
     ret = 0;
 out:
+    if (cpstore.base)
+        cp_store_put(&cpstore, /*reuse=*/false);
     if (pal_process)
         DkObjectClose(pal_process);
 
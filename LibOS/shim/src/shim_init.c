@@ -16,6 +16,7 @@
 #include "shim_context.h"
 #include "shim_defs.h"
 #include "shim_fs.h"
+#include "shim_fs_cache.h"
 #include "shim_fs_lock.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
@@ -23,6 +24,7 @@
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_sync.h"
+#include "shim_sysv.h"
 #include "shim_tcb.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
@@ -407,6 +409,9 @@ noreturn void* shim_init(int argc, const char** argv, const char** envp) {
     RUN_INIT(init_rlimit);
     RUN_INIT(init_fs);
     RUN_INIT(init_fs_lock);
+    RUN_INIT(init_fs_cache);
+    RUN_INIT(init_sysv_shm);
+    RUN_INIT(init_sysv_sem);
     RUN_INIT(init_dcache);
     RUN_INIT(init_handle);
     RUN_INIT(init_r_debug);
@@ -416,7 +421,26 @@ noreturn void* shim_init(int argc, const char** argv, const char** envp) {
     if (g_pal_public_state->parent_process) {
         struct checkpoint_hdr hdr;
 
-        int ret = read_exact(g_pal_public_state->parent_process, &hdr, sizeof(hdr));
+        /* Read the first chunk of the header separately: a clean EOF before any byte means that we
+         * were an idle process in the parent's prefork pool and the parent closed us. EOF in the
+         * middle of the header (e.g. the parent died while sending it) is an error. */
+        size_t first_read;
+        int ret;
+        do {
+            first_read = sizeof(hdr);
+            ret = DkStreamRead(g_pal_public_state->parent_process, /*offset=*/0, &first_read, &hdr,
+                               /*source=*/NULL, /*size=*/0);
+        } while (ret == -PAL_ERROR_INTERRUPTED || ret == -PAL_ERROR_TRYAGAIN);
+        if (ret == 0 && first_read == 0) {
+            log_debug("shim_init: parent closed the connection before sending a checkpoint");
+            DkProcessExit(0);
+        }
+        if (ret < 0) {
+            ret = pal_to_unix_errno(ret);
+        } else {
+            ret = read_exact(g_pal_public_state->parent_process, (char*)&hdr + first_read,
+                             sizeof(hdr) - first_read);
+        }
         if (ret < 0) {
             log_error("shim_init: failed to read the whole checkpoint header: %d", ret);
             DkProcessExit(1);
@@ -439,6 +463,7 @@ noreturn void* shim_init(int argc, const char** argv, const char** envp) {
     log_setprefix(shim_get_tcb());
 
     RUN_INIT(init_async_worker);
+    RUN_INIT(init_prefork_pool);
 
     const char** new_argp;
     elf_auxv_t* new_auxv;
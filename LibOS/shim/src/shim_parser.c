@@ -121,9 +121,12 @@ struct parser_table {
                       parse_pointer_arg, parse_pointer_arg, parse_pointer_arg}},
     [__NR_madvise] = {.slow = false, .name = "madvise", .parser = {parse_long_arg,
                       parse_pointer_arg, parse_pointer_arg, parse_madvise_behavior}},
-    [__NR_shmget] = {.slow = false, .name = "shmget", .parser = {NULL}},
-    [__NR_shmat] = {.slow = false, .name = "shmat", .parser = {NULL}},
-    [__NR_shmctl] = {.slow = false, .name = "shmctl", .parser = {NULL}},
+    [__NR_shmget] = {.slow = false, .name = "shmget", .parser = {parse_long_arg,
+                     parse_integer_arg, parse_pointer_arg, parse_integer_arg}},
+    [__NR_shmat] = {.slow = false, .name = "shmat", .parser = {parse_pointer_ret,
+                    parse_integer_arg, parse_pointer_arg, parse_integer_arg}},
+    [__NR_shmctl] = {.slow = false, .name = "shmctl", .parser = {parse_long_arg,
+                     parse_integer_arg, parse_integer_arg, parse_pointer_arg}},
     [__NR_dup] = {.slow = false, .name = "dup", .parser = {parse_long_arg, parse_integer_arg}},
     [__NR_dup2] = {.slow = false, .name = "dup2", .parser = {parse_long_arg, parse_integer_arg,
                    parse_integer_arg}},
@@ -190,7 +193,8 @@ struct parser_table {
                     parse_pointer_arg, parse_integer_arg}},
     [__NR_semctl] = {.slow = false, .name = "semctl", .parser = {parse_long_arg, parse_integer_arg,
                      parse_integer_arg, parse_integer_arg, parse_pointer_arg}},
-    [__NR_shmdt] = {.slow = false, .name = "shmdt", .parser = {NULL}},
+    [__NR_shmdt] = {.slow = false, .name = "shmdt", .parser = {parse_long_arg,
+                    parse_pointer_arg}},
     [__NR_msgget] = {.slow = true, .name = "msgget", .parser = {parse_long_arg, parse_integer_arg,
                      parse_integer_arg}},
     [__NR_msgsnd] = {.slow = true, .name = "msgsnd", .parser = {parse_long_arg, parse_integer_arg,
@@ -416,7 +420,7 @@ struct parser_table {
     [__NR_set_tid_address] = {.slow = false, .name = "set_tid_address", .parser = {parse_long_arg,
                               parse_pointer_arg}},
     [__NR_restart_syscall] = {.slow = false, .name = "restart_syscall", .parser = {NULL}},
-    [__NR_semtimedop] = {.slow = false, .name = "semtimedop", .parser = {parse_long_arg,
+    [__NR_semtimedop] = {.slow = true, .name = "semtimedop", .parser = {parse_long_arg,
                          parse_integer_arg, parse_pointer_arg, parse_integer_arg,
                          parse_pointer_arg}},
     [__NR_fadvise64] = {.slow = false, .name = "fadvise64", .parser = {NULL}},
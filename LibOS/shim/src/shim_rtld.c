@@ -34,6 +34,7 @@
 #include "shim_vdso.h"
 #include "shim_vdso-arch.h"
 #include "shim_vma.h"
+#include "toml_utils.h"
 
 /*
  * Structure describing a loaded ELF object. Originally based on glibc link_map structure.
@@ -115,6 +116,13 @@ struct loadcmd {
 static struct link_map* g_exec_map = NULL;
 static struct link_map* g_interp_map = NULL;
 
+/* Interpreter kept mapped during execve, together with its load commands; see
+ * `cache_interp_object()`. Enabled with `libos.reuse_interpreter_on_execve`. */
+static bool g_reuse_interp_on_execve = false;
+static struct link_map* g_cached_interp_map = NULL;
+static struct loadcmd* g_cached_interp_loadcmds = NULL;
+static size_t g_cached_interp_n_loadcmds = 0;
+
 static int read_file_fragment(struct shim_handle* file, void* buf, size_t size, file_off_t offset);
 
 static struct link_map* new_elf_object(const char* realname) {
@@ -709,7 +717,221 @@ out:
     return ret;
 }
 
+/*
+ * Read-only segments of the interpreter are kept mapped across execve, so that they do not have to
+ * be read (and on SGX, verified) again if the new executable uses the same interpreter, which is
+ * almost always the case. Writable segments and segments with zero-filled pages are always loaded
+ * again. Note that this means that the interpreter stays at the same address after execve, i.e. it
+ * is not re-randomized; this is why it is disabled by default.
+ */
+static bool is_loadcmd_reusable(const struct loadcmd* c) {
+    return !(c->prot & PROT_WRITE) && c->start < c->map_end && c->map_end == c->alloc_end;
+}
+
+/* Checks that [addr, addr + length) is still a single private mapping of `file` that was never
+ * writable, i.e. that its contents were not changed since it was loaded. Returns its protections
+ * and file offset of `addr`. */
+static bool is_file_mapping_intact(void* addr, size_t length, struct shim_handle* file,
+                                   int* out_prot, uint64_t* out_offset) {
+    struct shim_vma_info vma_info;
+    if (lookup_vma(addr, &vma_info) < 0)
+        return false;
+
+    bool intact = vma_info.file == file
+                  && !(vma_info.prot & PROT_WRITE)
+                  && (vma_info.flags & (MAP_PRIVATE | VMA_UNMAPPED | VMA_INTERNAL | VMA_TAINTED))
+                         == MAP_PRIVATE
+                  && (uintptr_t)addr + length <= (uintptr_t)vma_info.addr + vma_info.length;
+
+    *out_prot = vma_info.prot;
+    *out_offset = vma_info.file_offset + ((uintptr_t)addr - (uintptr_t)vma_info.addr);
+
+    if (vma_info.file)
+        put_handle(vma_info.file);
+    return intact;
+}
+
+/* Unmaps [start, end) and bookkeeps it again as reserved, so that nothing else gets mapped there. */
+static int unmap_and_reserve(uintptr_t start, uintptr_t end) {
+    if (start >= end)
+        return 0;
+
+    int ret = bkeep_mmap_fixed((void*)start, end - start, PROT_NONE, MAP_FIXED | VMA_UNMAPPED,
+                               /*file=*/NULL, /*offset=*/0, /*comment=*/NULL);
+    if (ret < 0)
+        return ret;
+
+    if (DkVirtualMemoryFree((void*)start, end - start) < 0)
+        BUG();
+    return 0;
+}
+
+/*
+ * Called during execve, before the address space is freed. If the read-only segments of the
+ * interpreter are intact, keeps them mapped (see `is_in_cached_elf_object()`), unmaps the rest of
+ * the interpreter's memory area and reserves it for loading the writable segments again.
+ */
+static int cache_interp_object(struct link_map* l) {
+    int prot;
+    uint64_t offset;
+
+    /* the program headers must be intact before we trust the load commands read from them */
+    if (!is_file_mapping_intact(l->l_phdr, l->l_phnum * sizeof(elf_phdr_t), l->l_file, &prot,
+                                &offset))
+        return -EACCES;
+
+    struct loadcmd* loadcmds;
+    size_t n_loadcmds;
+    int ret = read_all_loadcmds(l->l_phdr, l->l_phnum, &n_loadcmds, &loadcmds);
+    if (ret < 0)
+        return ret;
+
+    for (struct loadcmd* c = &loadcmds[0]; c < &loadcmds[n_loadcmds]; c++) {
+        if (!is_loadcmd_reusable(c))
+            continue;
+        if (!is_file_mapping_intact((void*)(c->start + l->l_base_diff), c->map_end - c->start,
+                                    l->l_file, &prot, &offset)
+                || prot != c->prot || offset != c->map_off) {
+            ret = -EACCES;
+            goto err;
+        }
+    }
+
+    uintptr_t cur = l->l_map_start;
+    for (struct loadcmd* c = &loadcmds[0]; c < &loadcmds[n_loadcmds]; c++) {
+        if (!is_loadcmd_reusable(c))
+            continue;
+        ret = unmap_and_reserve(cur, c->start + l->l_base_diff);
+        if (ret < 0)
+            goto err;
+        cur = c->map_end + l->l_base_diff;
+    }
+    ret = unmap_and_reserve(cur, l->l_map_end);
+    if (ret < 0)
+        goto err;
+
+    g_cached_interp_map = l;
+    g_cached_interp_loadcmds = loadcmds;
+    g_cached_interp_n_loadcmds = n_loadcmds;
+    return 0;
+
+err:
+    free(loadcmds);
+    return ret;
+}
+
+bool is_in_cached_elf_object(void* addr, size_t length) {
+    return g_cached_interp_map && (uintptr_t)addr >= g_cached_interp_map->l_map_start
+           && (uintptr_t)addr + length <= g_cached_interp_map->l_map_end;
+}
+
+/* Unmaps the cached interpreter, except for the part overlapping the (already loaded) new
+ * executable, which could be a non-PIE binary mapped at fixed addresses. */
+static void drop_cached_interp(struct link_map* exec_map) {
+    struct link_map* l = g_cached_interp_map;
+    uintptr_t ranges[2][2] = {
+        { l->l_map_start, MIN(l->l_map_end, exec_map->l_map_start) },
+        { MAX(l->l_map_start, exec_map->l_map_end), l->l_map_end },
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(ranges); i++) {
+        if (ranges[i][0] >= ranges[i][1])
+            continue;
+        void* tmp_vma = NULL;
+        if (bkeep_munmap((void*)ranges[i][0], ranges[i][1] - ranges[i][0], /*is_internal=*/false,
+                         &tmp_vma) < 0)
+            BUG();
+        if (DkVirtualMemoryFree((void*)ranges[i][0], ranges[i][1] - ranges[i][0]) < 0)
+            BUG();
+        bkeep_remove_tmp_vma(tmp_vma);
+    }
+
+    remove_elf_object(l);
+    free(g_cached_interp_loadcmds);
+    g_cached_interp_map = NULL;
+    g_cached_interp_loadcmds = NULL;
+    g_cached_interp_n_loadcmds = 0;
+}
+
+/* Returns true if the interpreter of `exec_map` is the same file as the cached one, with the same
+ * program headers. */
+static bool can_reuse_cached_interp(struct link_map* exec_map) {
+    struct link_map* l = g_cached_interp_map;
+
+    if (!need_interp(exec_map))
+        return false;
+    if (exec_map->l_map_start < l->l_map_end && l->l_map_start < exec_map->l_map_end)
+        return false;
+
+    struct shim_handle* hdl = get_new_handle();
+    if (!hdl)
+        return false;
+
+    bool ret = false;
+    elf_phdr_t* phdr = NULL;
+
+    lock(&g_dcache_lock);
+    int err = find_and_open_interp(exec_map->l_interp_libname, hdl);
+    unlock(&g_dcache_lock);
+    if (err < 0 || hdl->dentry != l->l_file->dentry)
+        goto out;
+
+    elf_ehdr_t ehdr;
+    if (load_elf_header(hdl, &ehdr) < 0 || ehdr.e_phnum != l->l_phnum
+            || (ehdr.e_entry ? ehdr.e_entry + l->l_base_diff : 0) != l->l_entry)
+        goto out;
+
+    size_t phdr_size = ehdr.e_phnum * sizeof(elf_phdr_t);
+    phdr = malloc(phdr_size);
+    if (!phdr)
+        goto out;
+    if (read_file_fragment(hdl, phdr, phdr_size, ehdr.e_phoff) < 0)
+        goto out;
+
+    ret = memcmp(phdr, l->l_phdr, phdr_size) == 0;
+out:
+    free(phdr);
+    put_handle(hdl);
+    return ret;
+}
+
+static int load_cached_interp_object(struct link_map* exec_map) {
+    struct link_map* l = g_cached_interp_map;
+    int ret;
+
+    if (!can_reuse_cached_interp(exec_map)) {
+        drop_cached_interp(exec_map);
+        return 0;
+    }
+
+    log_debug("reusing read-only segments of \"%s\"", l->l_name);
+    for (struct loadcmd* c = &g_cached_interp_loadcmds[0];
+            c < &g_cached_interp_loadcmds[g_cached_interp_n_loadcmds]; c++) {
+        if (is_loadcmd_reusable(c))
+            continue;
+        if ((ret = execute_loadcmd(c, l->l_base_diff, l->l_file)) < 0) {
+            log_debug("loading %s: failed to execute load command (%d)", l->l_name, ret);
+            return ret;
+        }
+    }
+
+    free(g_cached_interp_loadcmds);
+    g_cached_interp_map = NULL;
+    g_cached_interp_loadcmds = NULL;
+    g_cached_interp_n_loadcmds = 0;
+
+    append_r_debug(l->l_file->uri, (void*)l->l_base_diff);
+    g_interp_map = l;
+    return 0;
+}
+
 int load_elf_interp(struct link_map* exec_map) {
+    if (g_cached_interp_map) {
+        int ret = load_cached_interp_object(exec_map);
+        if (ret < 0)
+            return ret;
+    }
+
     if (!g_interp_map && need_interp(exec_map))
         return load_interp_object(exec_map);
 
@@ -722,7 +944,8 @@ void remove_loaded_elf_objects(void) {
         g_exec_map = NULL;
     }
     if (g_interp_map) {
-        remove_elf_object(g_interp_map);
+        if (!g_reuse_interp_on_execve || cache_interp_object(g_interp_map) < 0)
+            remove_elf_object(g_interp_map);
         g_interp_map = NULL;
     }
 }
@@ -771,7 +994,13 @@ static int vdso_map_init(void) {
 }
 
 int init_elf_objects(void) {
-    int ret = 0;
+    int ret = toml_bool_in(g_manifest_root, "libos.reuse_interpreter_on_execve",
+                           /*defaultval=*/false, &g_reuse_interp_on_execve);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.reuse_interpreter_on_execve' (the value must be `true` or "
+                  "`false`)");
+        return -EINVAL;
+    }
 
     lock(&g_process.fs_lock);
     struct shim_handle* exec = g_process.exec;
@@ -13,6 +13,7 @@
 #include "shim_internal.h"
 #include "shim_ipc.h"
 #include "shim_lock.h"
+#include "shim_sysv.h"
 #include "shim_table.h"
 #include "shim_thread.h"
 #include "shim_types.h"
@@ -197,8 +198,17 @@ static long do_clone_new_vm(IDTYPE child_vmid, unsigned long flags, struct shim_
     child_process->uid = thread->uid;
     child_process->vmid = child_vmid;
 
-    long ret = create_process_and_send_checkpoint(&migrate_fork, child_process,
-                                                  &process_description, thread);
+    /* The child inherits all attached System V shared memory segments of its parent. */
+    long ret = sysv_shm_inherit(g_process.pid, process_description.pid);
+    if (ret >= 0) {
+        ret = create_process_and_send_checkpoint(&migrate_fork, child_process,
+                                                 &process_description, thread);
+        if (ret < 0) {
+            int tmp_ret = sysv_shm_clear_pid(process_description.pid);
+            if (tmp_ret < 0)
+                log_warning("error detaching System V shared memory segments: %d", tmp_ret);
+        }
+    }
 
     if (parent_stack) {
         pal_context_set_sp(self->shim_tcb->context.regs, parent_stack);
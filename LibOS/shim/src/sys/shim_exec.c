@@ -11,8 +11,10 @@
 #include "shim_internal.h"
 #include "shim_lock.h"
 #include "shim_process.h"
+#include "shim_sysv.h"
 #include "shim_table.h"
 #include "shim_thread.h"
+#include "shim_utils.h"
 #include "shim_vma.h"
 
 static int close_on_exec(struct shim_fd_handle* fd_hdl, struct shim_handle_map* map) {
@@ -27,6 +29,20 @@ static int close_cloexec_handle(struct shim_handle_map* map) {
     return walk_handle_map(&close_on_exec, map);
 }
 
+static void free_user_range(void* addr, size_t length) {
+    if (!length)
+        return;
+
+    void* tmp_vma = NULL;
+    if (bkeep_munmap(addr, length, /*is_internal=*/false, &tmp_vma) < 0) {
+        BUG();
+    }
+    if (DkVirtualMemoryFree(addr, length) < 0) {
+        BUG();
+    }
+    bkeep_remove_tmp_vma(tmp_vma);
+}
+
 /* new_argp: pointer to beginning of first stack frame (argc, argv[0], ...)
  * new_auxv: pointer inside first stack frame (auxv[0], auxv[1], ...) */
 noreturn static void __shim_do_execve_rtld(void* new_argp, elf_auxv_t* new_auxv) {
@@ -48,24 +64,39 @@ noreturn static void __shim_do_execve_rtld(void* new_argp, elf_auxv_t* new_auxv)
         goto error;
     }
 
+    /* Free adjacent VMAs together, so that the whole address space is usually freed in a few
+     * calls, regardless of the number of VMAs. */
     struct shim_thread* cur_thread = get_cur_thread();
+    void* range_addr = NULL;
+    size_t range_length = 0;
     for (struct shim_vma_info* vma = vmas; vma < vmas + count; vma++) {
-        /* Don't free the current stack */
-        if (vma->addr == cur_thread->stack || vma->addr == cur_thread->stack_red)
-            continue;
+        /* Don't free the current stack and the interpreter segments that will be reused */
+        bool keep = vma->addr == cur_thread->stack || vma->addr == cur_thread->stack_red
+                    || is_in_cached_elf_object(vma->addr, vma->length);
 
-        void* tmp_vma = NULL;
-        if (bkeep_munmap(vma->addr, vma->length, !!(vma->flags & VMA_INTERNAL), &tmp_vma) < 0) {
-            BUG();
-        }
-        if (DkVirtualMemoryFree(vma->addr, vma->length) < 0) {
-            BUG();
+        if (!keep && range_length && (char*)range_addr + range_length == vma->addr) {
+            range_length += vma->length;
+            continue;
         }
-        bkeep_remove_tmp_vma(tmp_vma);
+
+        free_user_range(range_addr, range_length);
+        range_addr   = keep ? NULL : vma->addr;
+        range_length = keep ? 0 : vma->length;
     }
+    free_user_range(range_addr, range_length);
 
     free_vma_info_array(vmas, count);
 
+    /* All attached System V shared memory segments were unmapped above. */
+    ret = sysv_shm_clear_pid(g_process.pid);
+    if (ret < 0)
+        goto error;
+
+    /* Other threads are gone, drop their System V semaphore requests. */
+    ret = sysv_sem_clear_pid(g_process.pid);
+    if (ret < 0)
+        goto error;
+
     lock(&g_process.fs_lock);
     struct shim_handle* exec = g_process.exec;
     get_handle(exec);
@@ -7,11 +7,13 @@
  */
 
 #include "pal.h"
+#include "shim_checkpoint.h"
 #include "shim_fs_lock.h"
 #include "shim_ipc.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_signal.h"
+#include "shim_sysv.h"
 #include "shim_table.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
@@ -34,6 +36,8 @@ static noreturn void libos_clean_and_exit(int exit_code) {
         put_thread(async_thread);
     }
 
+    destroy_prefork_pool();
+
     /*
      * At this point there should be only 2 threads running: this + IPC worker.
      * XXX: We release current thread's ID, yet we are still running. We never put the (possibly)
@@ -54,6 +58,11 @@ static noreturn void libos_clean_and_exit(int exit_code) {
 
     terminate_ipc_worker();
 
+    /* No more IPC requests can create System V objects now; if we are the IPC leader, remove their
+     * host files, nobody could look them up anymore anyway. */
+    sysv_shm_delete_host_objects();
+    sysv_sem_delete_host_objects();
+
     log_debug("process %u exited with status %d", g_process_ipc_ids.self_vmid, exit_code);
 
     /* TODO: We exit whole libos, but there are some objects that might need cleanup - we should do
@@ -99,6 +108,18 @@ noreturn void thread_exit(int error_code, int term_signal) {
     if (ret < 0)
         log_warning("error clearing POSIX locks: %d", ret);
 
+    ret = sysv_shm_clear_pid(g_process.pid);
+    if (ret < 0)
+        log_warning("error detaching System V shared memory segments: %d", ret);
+
+    ret = sysv_sem_clear_pid(g_process.pid);
+    if (ret < 0)
+        log_warning("error clearing System V semaphore requests: %d", ret);
+
+    ret = sysv_sem_undo_all();
+    if (ret < 0)
+        log_warning("error applying System V semaphore adjustments: %d", ret);
+
     /* This is the last thread of the process. Let parent know we exited. */
     ret = ipc_cld_exit_send(error_code, term_signal);
     if (ret < 0) {
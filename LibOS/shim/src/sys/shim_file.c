@@ -380,6 +380,12 @@ long shim_do_renameat(int olddirfd, const char* oldpath, int newdirfd, const cha
     if (ret < 0)
         goto out;
 
+    /* `g_dcache_lock` might have been released during the second lookup, so check again */
+    if (!old_dent->inode) {
+        ret = -ENOENT;
+        goto out;
+    }
+
     // Both dentries should have a ref count of at least 2 at this point
     assert(REF_GET(old_dent->ref_count) >= 2);
     assert(REF_GET(new_dent->ref_count) >= 2);
@@ -32,9 +32,9 @@ long shim_do_getcwd(char* buf, size_t buf_size) {
     get_dentry(cwd);
     unlock(&g_process.fs_lock);
 
-    char* path = NULL;
+    const char* path;
     size_t size;
-    int ret = dentry_abs_path(cwd, &path, &size);
+    int ret = dentry_cached_abs_path(cwd, &path, &size);
     if (ret < 0)
         goto out;
 
@@ -47,8 +47,6 @@ long shim_do_getcwd(char* buf, size_t buf_size) {
         memcpy(buf, path, size);
     }
 
-    free(path);
-
 out:
     put_dentry(cwd);
     return ret;
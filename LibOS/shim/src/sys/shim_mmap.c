@@ -124,6 +124,24 @@ void* shim_do_mmap(void* addr, size_t length, int prot, int flags, int fd, unsig
         }
     }
 
+    if ((flags & MAP_ANONYMOUS) && (flags & MAP_TYPE) == MAP_SHARED) {
+        /* Back shared anonymous memory with a host shared memory object, so that child processes
+         * re-map the same memory instead of receiving a copy of it on fork. */
+        offset = 0;
+        ret = open_shm_handle(/*name=*/NULL, PAL_CREATE_IGNORED, length, &hdl);
+        if (ret == -EOPNOTSUPP) {
+            static unsigned int warned = 0;
+            if (__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED) == 0) {
+                log_warning("Shared anonymous memory is not supported by the PAL, it will not be "
+                            "shared with child processes.");
+            }
+            hdl = NULL;
+            ret = 0;
+        } else if (ret < 0) {
+            return (void*)ret;
+        }
+    }
+
 #ifdef MAP_32BIT
     /* ignore MAP_32BIT when MAP_FIXED is set */
     if ((flags & (MAP_32BIT | MAP_FIXED)) == (MAP_32BIT | MAP_FIXED))
@@ -0,0 +1,1170 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Implementation of System V semaphores: system calls "semget", "semop", "semtimedop" and
+ * "semctl".
+ *
+ * See `shim_sysv.h` for an overview of the design.
+ */
+
+#include <errno.h>
+#include <linux/ipc.h>
+#include <linux/sem.h>
+
+#include "cpu.h"
+#include "list.h"
+#include "pal.h"
+#include "shim_fs.h"
+#include "shim_handle.h"
+#include "shim_internal.h"
+#include "shim_ipc.h"
+#include "shim_lock.h"
+#include "shim_process.h"
+#include "shim_sysv.h"
+#include "shim_table.h"
+#include "shim_thread.h"
+#include "shim_utils.h"
+#include "shim_vma.h"
+
+struct sysv_sem_value {
+    int semval;
+    IDTYPE sempid;
+};
+
+/* Values of a semaphore set. Lives in a host shared memory object mapped by all processes which
+ * use the fast path, so all fields are protected by the lock in `lock_owner` (see
+ * `sem_shared_trylock`). */
+struct sysv_sem_shared {
+    /* VMID of the process holding the lock, 0 if the lock is free */
+    IDTYPE lock_owner;
+    /* Set by `IPC_RMID`, processes which still have the values mapped must not use them anymore. */
+    bool removed;
+    /* Number of requests queued in the IPC leader; if non-zero, a process which changes the values
+     * must call `sysv_sem_wake`. */
+    uint32_t waiters;
+    uint64_t otime;
+    uint32_t nsems;
+    struct sysv_sem_value sems[];
+};
+
+/* Operations waiting until they can be performed. Exists only in the IPC leader. */
+DEFINE_LISTP(sysv_sem_request);
+DEFINE_LIST(sysv_sem_request);
+struct sysv_sem_request {
+    IDTYPE vmid;
+    uint64_t id;
+    IDTYPE pid;
+    LIST_TYPE(sysv_sem_request) list;
+    size_t nsops;
+    struct sembuf sops[];
+};
+
+/* Describes a semaphore set. Exists only in the IPC leader. */
+DEFINE_LISTP(sysv_sem_set);
+DEFINE_LIST(sysv_sem_set);
+struct sysv_sem_set {
+    int semid;
+    int key;
+    int nsems;
+
+    IDTYPE uid;
+    IDTYPE gid;
+    IDTYPE cuid;
+    IDTYPE cgid;
+    unsigned int mode;
+    uint64_t ctime;
+
+    struct sysv_sem_shared* shared;
+    size_t shared_size;
+    /* If true, `shared` is mapped from a host shared memory object, otherwise it was allocated with
+     * `malloc` (the host memory is not shareable). */
+    bool shared_mapped;
+
+    LISTP_TYPE(sysv_sem_request) requests;
+    LIST_TYPE(sysv_sem_set) list;
+};
+
+/* Protects all semaphore sets. Only used in the IPC leader. */
+static struct shim_lock g_sysv_sem_lock;
+
+static LISTP_TYPE(sysv_sem_set) g_sysv_sem_sets = LISTP_INIT;
+static int g_sysv_sem_next_id = 0;
+
+/* A `semop` call waiting for its result (see `sysv_sem_op`). */
+DEFINE_LISTP(sem_wait_request);
+DEFINE_LIST(sem_wait_request);
+struct sem_wait_request {
+    uint64_t id;
+    struct shim_thread* thread;
+    int result;
+    bool done;
+    LIST_TYPE(sem_wait_request) list;
+};
+
+/* Semaphore values of a set mapped by a process other than the IPC leader. */
+DEFINE_LISTP(sem_mapping);
+DEFINE_LIST(sem_mapping);
+struct sem_mapping {
+    int semid;
+    /* NULL if the values cannot be mapped, i.e. the fast path is not available */
+    struct sysv_sem_shared* shared;
+    size_t size;
+    LIST_TYPE(sem_mapping) list;
+};
+
+/* `SEM_UNDO` adjustment of a single semaphore. */
+DEFINE_LISTP(sem_undo);
+DEFINE_LIST(sem_undo);
+struct sem_undo {
+    int semid;
+    unsigned short semnum;
+    int adj;
+    LIST_TYPE(sem_undo) list;
+};
+
+/* Protects the per-process state below. Can be taken while holding `g_sysv_sem_lock`, but not the
+ * other way around. */
+static struct shim_lock g_sem_local_lock;
+
+static LISTP_TYPE(sem_wait_request) g_sem_wait_requests = LISTP_INIT;
+static LISTP_TYPE(sem_mapping) g_sem_mappings = LISTP_INIT;
+static LISTP_TYPE(sem_undo) g_sem_undos = LISTP_INIT;
+static uint64_t g_sem_next_request_id = 1;
+
+/* Name of the host object holding semaphore values */
+#define SYSV_SEM_NAME_SIZE 32
+static void sysv_sem_name(int semid, char* buf) {
+    snprintf(buf, SYSV_SEM_NAME_SIZE, "sysv_sem.%d", semid);
+}
+
+int init_sysv_sem(void) {
+    if (!create_lock(&g_sysv_sem_lock))
+        return -ENOMEM;
+    if (!create_lock(&g_sem_local_lock)) {
+        destroy_lock(&g_sysv_sem_lock);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static uint64_t time_now_sec(void) {
+    uint64_t time_us = 0;
+    if (DkSystemTimeQuery(&time_us) < 0)
+        return 0;
+    return time_us / TIME_US_IN_S;
+}
+
+static size_t shared_size(size_t nsems) {
+    return ALLOC_ALIGN_UP(sizeof(struct sysv_sem_shared) + nsems * sizeof(struct sysv_sem_value));
+}
+
+static int map_shared(struct shim_handle* hdl, size_t size, struct sysv_sem_shared** out_shared) {
+    void* addr = NULL;
+    int ret = bkeep_mmap_any(size, PROT_READ | PROT_WRITE, MAP_SHARED | VMA_INTERNAL,
+                             /*file=*/NULL, /*offset=*/0, "sysv_sem", &addr);
+    if (ret < 0)
+        return ret;
+
+    ret = DkStreamMap(hdl->pal_handle, &addr, PAL_PROT_READ | PAL_PROT_WRITE, /*offset=*/0, size);
+    if (ret < 0) {
+        void* tmp_vma = NULL;
+        if (bkeep_munmap(addr, size, /*is_internal=*/true, &tmp_vma) < 0)
+            BUG();
+        bkeep_remove_tmp_vma(tmp_vma);
+        return pal_to_unix_errno(ret);
+    }
+
+    *out_shared = addr;
+    return 0;
+}
+
+static void unmap_shared(struct sysv_sem_shared* shared, size_t size) {
+    void* tmp_vma = NULL;
+    if (bkeep_munmap(shared, size, /*is_internal=*/true, &tmp_vma) < 0)
+        BUG();
+    if (DkVirtualMemoryFree(shared, size) < 0)
+        BUG();
+    bkeep_remove_tmp_vma(tmp_vma);
+}
+
+/*
+ * The lock of set values is shared by processes, so a plain spinlock would hang all users of the
+ * set forever if its holder died while holding it. Instead, the lock records the VMID of its
+ * holder, and only the IPC leader releases a lock held by another process, once that process is
+ * known to be dead:
+ *
+ * - When a process disconnects from the IPC leader, the leader releases the locks it held (see
+ *   `sysv_sem_disconnect_callback`).
+ * - Waiters spin only briefly and then yield the CPU. A process other than the leader gives up
+ *   after `SEM_LOCK_TIMEOUT_US` and sends its operations to the leader instead.
+ * - The leader (which may wait in the IPC worker, before it can notice the disconnect) asks the
+ *   host every `SEM_LOCK_TIMEOUT_US` whether the holder is still alive (see
+ *   `is_process_disconnected`).
+ *
+ * A live holder is never preempted, however long it holds the lock. Threads of one process never
+ * wait for each other on this lock: the leader takes it only under `g_sysv_sem_lock`, other
+ * processes only under `g_sem_local_lock`.
+ */
+#define SEM_LOCK_SPINS      1000
+#define SEM_LOCK_TIMEOUT_US (1000 * 1000)
+
+static bool sem_shared_trylock(struct sysv_sem_shared* shared) {
+    IDTYPE self = g_process_ipc_ids.self_vmid;
+    assert(self);
+
+    uint64_t start_time = 0;
+    for (size_t i = 0;; i++) {
+        IDTYPE expected = 0;
+        if (__atomic_compare_exchange_n(&shared->lock_owner, &expected, self, /*weak=*/false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+        assert(expected != self);
+
+        if (i < SEM_LOCK_SPINS) {
+            CPU_RELAX();
+            continue;
+        }
+
+        uint64_t now = 0;
+        if (DkSystemTimeQuery(&now) < 0)
+            return false;
+        if (!start_time) {
+            start_time = now;
+        } else if (now - start_time >= SEM_LOCK_TIMEOUT_US) {
+            return false;
+        }
+        DkThreadYieldExecution();
+    }
+}
+
+/* Releases the lock if it is still held by `owner`, which must be dead. Only for the IPC leader. */
+static void sem_shared_release_dead(struct sysv_sem_shared* shared, IDTYPE owner, int semid) {
+    assert(!g_process_ipc_ids.leader_vmid);
+
+    if (__atomic_compare_exchange_n(&shared->lock_owner, &owner, 0, /*weak=*/false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        log_warning("process %u died while holding the lock of semaphore set %d, releasing it "
+                    "(values of the set may be inconsistent)", owner, semid);
+    }
+}
+
+/* Takes the lock in the IPC leader; never fails, see above. */
+static void sem_shared_lock(struct sysv_sem_shared* shared, int semid) {
+    assert(!g_process_ipc_ids.leader_vmid);
+
+    while (!sem_shared_trylock(shared)) {
+        IDTYPE owner = __atomic_load_n(&shared->lock_owner, __ATOMIC_RELAXED);
+        if (owner && is_process_disconnected(owner))
+            sem_shared_release_dead(shared, owner, semid);
+    }
+}
+
+static void sem_shared_unlock(struct sysv_sem_shared* shared) {
+    IDTYPE self = g_process_ipc_ids.self_vmid;
+    if (!__atomic_compare_exchange_n(&shared->lock_owner, &self, 0, /*weak=*/false,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        /* the leader released our lock, so it considers us dead */
+        log_error("lock of a semaphore set was taken from a live process (owner: %u)", self);
+        BUG();
+    }
+}
+
+/*
+ * Tries to perform all operations atomically. The lock of `shared` must be held, `now` is the
+ * current time in seconds (queried before taking the lock). Returns 0 on success,
+ * -EAGAIN if the operations would block (in which case nothing is changed) or another negative
+ * error code.
+ */
+static int try_semop(struct sysv_sem_shared* shared, struct sembuf* sops, size_t nsops,
+                     bool is_undo, IDTYPE pid, uint64_t now) {
+    if (shared->removed)
+        return -EIDRM;
+
+    for (size_t i = 0; i < nsops; i++)
+        if (sops[i].sem_num >= shared->nsems)
+            return -EFBIG;
+
+    int ret = 0;
+    size_t i;
+    for (i = 0; i < nsops; i++) {
+        struct sysv_sem_value* sem = &shared->sems[sops[i].sem_num];
+        int val = sem->semval + sops[i].sem_op;
+        if (is_undo) {
+            /* same as Linux, adjustments applied on exit are clamped instead of failing */
+            val = MIN(MAX(val, 0), SEMVMX);
+        } else if (sops[i].sem_op == 0 ? sem->semval != 0 : val < 0) {
+            ret = -EAGAIN;
+            break;
+        } else if (val > SEMVMX) {
+            ret = -ERANGE;
+            break;
+        }
+        sem->semval = val;
+    }
+
+    if (ret < 0) {
+        /* roll back operations done so far; they cannot come from `is_undo` which never fails */
+        assert(!is_undo);
+        while (i--)
+            shared->sems[sops[i].sem_num].semval -= sops[i].sem_op;
+        return ret;
+    }
+
+    for (i = 0; i < nsops; i++)
+        shared->sems[sops[i].sem_num].sempid = pid;
+    shared->otime = now;
+    return 0;
+}
+
+static void report_result(IDTYPE vmid, uint64_t id, int result) {
+    if (vmid == g_process_ipc_ids.self_vmid) {
+        sysv_sem_request_done(id, result);
+        return;
+    }
+
+    int ret = ipc_sysv_sem_done(vmid, id, result);
+    if (ret < 0) {
+        /* the requesting process has probably exited */
+        log_debug("failed to report result of semop %lu to %u: %d", id, vmid, ret);
+    }
+}
+
+static struct sysv_sem_set* find_set_by_key(int key) {
+    assert(locked(&g_sysv_sem_lock));
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        if (set->key == key)
+            return set;
+    }
+    return NULL;
+}
+
+static struct sysv_sem_set* find_set_by_id(int semid) {
+    assert(locked(&g_sysv_sem_lock));
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        if (set->semid == semid)
+            return set;
+    }
+    return NULL;
+}
+
+static void dequeue_request(struct sysv_sem_set* set, struct sysv_sem_request* req) {
+    LISTP_DEL(req, &set->requests, list);
+    sem_shared_lock(set->shared, set->semid);
+    set->shared->waiters--;
+    sem_shared_unlock(set->shared);
+    free(req);
+}
+
+/* Retries queued requests of `set` in FIFO order, until none of them can be performed. */
+static void retry_requests(struct sysv_sem_set* set) {
+    assert(locked(&g_sysv_sem_lock));
+
+    uint64_t now = time_now_sec();
+    bool progress;
+    do {
+        progress = false;
+        struct sysv_sem_request* req;
+        struct sysv_sem_request* tmp;
+        LISTP_FOR_EACH_ENTRY_SAFE(req, tmp, &set->requests, list) {
+            sem_shared_lock(set->shared, set->semid);
+            int ret = try_semop(set->shared, req->sops, req->nsops, /*is_undo=*/false, req->pid,
+                                now);
+            sem_shared_unlock(set->shared);
+            if (ret == -EAGAIN)
+                continue;
+
+            report_result(req->vmid, req->id, ret);
+            dequeue_request(set, req);
+            if (ret == 0) {
+                /* values changed, requests before this one might be able to proceed now */
+                progress = true;
+            }
+        }
+    } while (progress);
+}
+
+static void destroy_set(struct sysv_sem_set* set) {
+    assert(locked(&g_sysv_sem_lock));
+
+    log_debug("destroying System V semaphore set %d", set->semid);
+
+    sem_shared_lock(set->shared, set->semid);
+    set->shared->removed = true;
+    sem_shared_unlock(set->shared);
+
+    struct sysv_sem_request* req;
+    struct sysv_sem_request* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(req, tmp, &set->requests, list) {
+        report_result(req->vmid, req->id, -EIDRM);
+        dequeue_request(set, req);
+    }
+
+    if (set->shared_mapped) {
+        char name[SYSV_SEM_NAME_SIZE];
+        sysv_sem_name(set->semid, name);
+        int ret = delete_shm_object(name);
+        if (ret < 0)
+            log_warning("failed to delete host object of semaphore set %d: %d", set->semid, ret);
+        unmap_shared(set->shared, set->shared_size);
+    } else {
+        free(set->shared);
+    }
+
+    LISTP_DEL(set, &g_sysv_sem_sets, list);
+    free(set);
+}
+
+int sysv_sem_get(int key, int nsems, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_get(key, nsems, flags, pid, uid, gid);
+    }
+
+    int ret;
+    lock(&g_sysv_sem_lock);
+
+    if (key != IPC_PRIVATE) {
+        struct sysv_sem_set* set = find_set_by_key(key);
+        if (set) {
+            if ((flags & IPC_CREAT) && (flags & IPC_EXCL)) {
+                ret = -EEXIST;
+            } else if (nsems > set->nsems) {
+                ret = -EINVAL;
+            } else {
+                ret = set->semid;
+            }
+            goto out;
+        }
+
+        if (!(flags & IPC_CREAT)) {
+            ret = -ENOENT;
+            goto out;
+        }
+    }
+
+    if (nsems <= 0 || nsems > SEMMSL) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    struct sysv_sem_set* set = calloc(1, sizeof(*set));
+    if (!set) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    int semid = g_sysv_sem_next_id;
+    char name[SYSV_SEM_NAME_SIZE];
+    sysv_sem_name(semid, name);
+
+    size_t size = shared_size(nsems);
+    struct shim_handle* hdl = NULL;
+    ret = open_shm_handle(name, PAL_CREATE_ALWAYS, size, &hdl);
+    if (ret == 0) {
+        ret = map_shared(hdl, size, &set->shared);
+        put_handle(hdl);
+        if (ret < 0) {
+            delete_shm_object(name);
+            free(set);
+            goto out;
+        }
+        set->shared_mapped = true;
+    } else if (ret == -EOPNOTSUPP) {
+        /* no shareable host memory, all operations on this set will go through us */
+        set->shared = calloc(1, size);
+        if (!set->shared) {
+            free(set);
+            ret = -ENOMEM;
+            goto out;
+        }
+    } else {
+        free(set);
+        goto out;
+    }
+
+    g_sysv_sem_next_id++;
+
+    /* the object is new (zeroed), so `lock_owner` is already 0 */
+    set->shared->nsems = nsems;
+
+    set->semid       = semid;
+    set->key         = key;
+    set->nsems       = nsems;
+    set->uid         = uid;
+    set->gid         = gid;
+    set->cuid        = uid;
+    set->cgid        = gid;
+    set->mode        = flags & 0777;
+    set->ctime       = time_now_sec();
+    set->shared_size = size;
+    INIT_LISTP(&set->requests);
+    INIT_LIST_HEAD(set, list);
+    LISTP_ADD_TAIL(set, &g_sysv_sem_sets, list);
+
+    log_debug("created System V semaphore set %d (key %d, nsems %d) by %u", semid, key, nsems, pid);
+    ret = semid;
+out:
+    unlock(&g_sysv_sem_lock);
+    return ret;
+}
+
+int sysv_sem_op(int semid, struct sembuf* sops, size_t nsops, bool is_undo, IDTYPE pid,
+                IDTYPE vmid, uint64_t id) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_op(semid, sops, nsops, is_undo, pid, id);
+    }
+
+    int ret;
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set = find_set_by_id(semid);
+    if (!set) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    bool nowait = is_undo;
+    for (size_t i = 0; i < nsops; i++)
+        if (sops[i].sem_flg & IPC_NOWAIT)
+            nowait = true;
+
+    uint64_t now = time_now_sec();
+    sem_shared_lock(set->shared, set->semid);
+    ret = try_semop(set->shared, sops, nsops, is_undo, pid, now);
+    if (ret == -EAGAIN && !nowait) {
+        struct sysv_sem_request* req = malloc(sizeof(*req) + nsops * sizeof(*sops));
+        if (req) {
+            req->vmid  = vmid;
+            req->id    = id;
+            req->pid   = pid;
+            req->nsops = nsops;
+            memcpy(req->sops, sops, nsops * sizeof(*sops));
+            INIT_LIST_HEAD(req, list);
+            LISTP_ADD_TAIL(req, &set->requests, list);
+            set->shared->waiters++;
+            sem_shared_unlock(set->shared);
+            unlock(&g_sysv_sem_lock);
+            /* the result will be reported by `retry_requests`, `destroy_set` or never, if the
+             * requester cancels the request */
+            return 0;
+        }
+        ret = -ENOMEM;
+    }
+    sem_shared_unlock(set->shared);
+
+    if (ret == 0)
+        retry_requests(set);
+out:
+    report_result(vmid, id, ret);
+    unlock(&g_sysv_sem_lock);
+    return 0;
+}
+
+int sysv_sem_cancel(IDTYPE vmid, uint64_t id) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_cancel(id);
+    }
+
+    int ret = 0;
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        struct sysv_sem_request* req;
+        LISTP_FOR_EACH_ENTRY(req, &set->requests, list) {
+            if (req->vmid == vmid && req->id == id) {
+                dequeue_request(set, req);
+                ret = 1;
+                goto out;
+            }
+        }
+    }
+
+out:
+    unlock(&g_sysv_sem_lock);
+    return ret;
+}
+
+int sysv_sem_wake(int semid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_wake(semid);
+    }
+
+    int ret = 0;
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set = find_set_by_id(semid);
+    if (set) {
+        retry_requests(set);
+    } else {
+        ret = -EINVAL;
+    }
+
+    unlock(&g_sysv_sem_lock);
+    return ret;
+}
+
+static size_t count_requests(struct sysv_sem_set* set, int semnum, bool zero) {
+    size_t count = 0;
+    struct sysv_sem_request* req;
+    LISTP_FOR_EACH_ENTRY(req, &set->requests, list) {
+        for (size_t i = 0; i < req->nsops; i++) {
+            if (req->sops[i].sem_num == semnum && (zero ? req->sops[i].sem_op == 0
+                                                        : req->sops[i].sem_op < 0)) {
+                count++;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+int sysv_sem_ctl(int semid, int semnum, int cmd, IDTYPE pid, int val, struct semid64_ds* buf,
+                 unsigned short* array, size_t array_len) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_ctl(semid, semnum, cmd, pid, val, buf, array, array_len);
+    }
+
+    int ret;
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set = find_set_by_id(semid);
+    if (!set) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    struct sysv_sem_shared* shared = set->shared;
+    switch (cmd) {
+        case GETVAL:
+        case GETPID:
+        case GETNCNT:
+        case GETZCNT:
+        case SETVAL:
+            if (semnum < 0 || semnum >= set->nsems) {
+                ret = -EINVAL;
+                goto out;
+            }
+            break;
+        case GETALL:
+        case SETALL:
+            if (array_len != (size_t)set->nsems) {
+                ret = -EINVAL;
+                goto out;
+            }
+            break;
+    }
+
+    ret = 0;
+    switch (cmd) {
+        case IPC_STAT:
+            memset(buf, 0, sizeof(*buf));
+            buf->sem_perm.key  = set->key;
+            buf->sem_perm.uid  = set->uid;
+            buf->sem_perm.gid  = set->gid;
+            buf->sem_perm.cuid = set->cuid;
+            buf->sem_perm.cgid = set->cgid;
+            buf->sem_perm.mode = set->mode;
+            sem_shared_lock(shared, semid);
+            buf->sem_otime     = shared->otime;
+            sem_shared_unlock(shared);
+            buf->sem_ctime     = set->ctime;
+            buf->sem_nsems     = set->nsems;
+            break;
+
+        case IPC_SET:
+            set->uid   = buf->sem_perm.uid;
+            set->gid   = buf->sem_perm.gid;
+            set->mode  = buf->sem_perm.mode & 0777;
+            set->ctime = time_now_sec();
+            break;
+
+        case IPC_RMID:
+            destroy_set(set);
+            break;
+
+        case GETVAL:
+        case GETPID:
+            sem_shared_lock(shared, semid);
+            ret = cmd == GETVAL ? shared->sems[semnum].semval : (int)shared->sems[semnum].sempid;
+            sem_shared_unlock(shared);
+            break;
+
+        case GETNCNT:
+        case GETZCNT:
+            ret = count_requests(set, semnum, /*zero=*/cmd == GETZCNT);
+            break;
+
+        case GETALL:
+            sem_shared_lock(shared, semid);
+            for (size_t i = 0; i < array_len; i++)
+                array[i] = shared->sems[i].semval;
+            sem_shared_unlock(shared);
+            break;
+
+        case SETVAL:
+            if (val < 0 || val > SEMVMX) {
+                ret = -ERANGE;
+                break;
+            }
+            sem_shared_lock(shared, semid);
+            shared->sems[semnum].semval = val;
+            shared->sems[semnum].sempid = pid;
+            sem_shared_unlock(shared);
+            set->ctime = time_now_sec();
+            retry_requests(set);
+            break;
+
+        case SETALL:
+            for (size_t i = 0; i < array_len; i++) {
+                if (array[i] > SEMVMX) {
+                    ret = -ERANGE;
+                    goto out;
+                }
+            }
+            sem_shared_lock(shared, semid);
+            for (size_t i = 0; i < array_len; i++) {
+                shared->sems[i].semval = array[i];
+                shared->sems[i].sempid = pid;
+            }
+            sem_shared_unlock(shared);
+            set->ctime = time_now_sec();
+            retry_requests(set);
+            break;
+
+        default:
+            ret = -EINVAL;
+            break;
+    }
+
+out:
+    unlock(&g_sysv_sem_lock);
+    return ret;
+}
+
+void sysv_sem_disconnect_callback(IDTYPE vmid) {
+    assert(!g_process_ipc_ids.leader_vmid);
+
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        sem_shared_release_dead(set->shared, vmid, set->semid);
+    }
+
+    unlock(&g_sysv_sem_lock);
+}
+
+void sysv_sem_delete_host_objects(void) {
+    if (g_process_ipc_ids.leader_vmid)
+        return;
+
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        if (!set->shared_mapped)
+            continue;
+
+        char name[SYSV_SEM_NAME_SIZE];
+        sysv_sem_name(set->semid, name);
+        int ret = delete_shm_object(name);
+        if (ret < 0)
+            log_warning("failed to delete host object of semaphore set %d: %d", set->semid, ret);
+    }
+
+    unlock(&g_sysv_sem_lock);
+}
+
+int sysv_sem_clear_pid(IDTYPE pid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_sem_clear_pid(pid);
+    }
+
+    lock(&g_sysv_sem_lock);
+
+    struct sysv_sem_set* set;
+    LISTP_FOR_EACH_ENTRY(set, &g_sysv_sem_sets, list) {
+        struct sysv_sem_request* req;
+        struct sysv_sem_request* tmp;
+        LISTP_FOR_EACH_ENTRY_SAFE(req, tmp, &set->requests, list) {
+            if (req->pid == pid)
+                dequeue_request(set, req);
+        }
+    }
+
+    unlock(&g_sysv_sem_lock);
+    return 0;
+}
+
+void sysv_sem_request_done(uint64_t id, int result) {
+    lock(&g_sem_local_lock);
+
+    struct sem_wait_request* req;
+    LISTP_FOR_EACH_ENTRY(req, &g_sem_wait_requests, list) {
+        if (req->id == id) {
+            req->result = result;
+            req->done = true;
+            thread_wakeup(req->thread);
+            goto out;
+        }
+    }
+    log_debug("no thread waits for result of semop %lu", id);
+
+out:
+    unlock(&g_sem_local_lock);
+}
+
+/* Returns the mapping of values of set `semid`, creating it if needed, or NULL if the set does not
+ * exist (anymore). */
+static struct sem_mapping* get_mapping(int semid) {
+    assert(locked(&g_sem_local_lock));
+    assert(g_process_ipc_ids.leader_vmid);
+
+    struct sem_mapping* mapping;
+    LISTP_FOR_EACH_ENTRY(mapping, &g_sem_mappings, list) {
+        if (mapping->semid == semid)
+            return mapping;
+    }
+
+    char name[SYSV_SEM_NAME_SIZE];
+    sysv_sem_name(semid, name);
+
+    struct shim_handle* hdl = NULL;
+    int ret = open_shm_handle(name, PAL_CREATE_NEVER, /*size=*/0, &hdl);
+    if (ret < 0 && ret != -EOPNOTSUPP)
+        return NULL;
+
+    mapping = calloc(1, sizeof(*mapping));
+    if (!mapping) {
+        if (hdl)
+            put_handle(hdl);
+        return NULL;
+    }
+    mapping->semid = semid;
+
+    if (hdl) {
+        PAL_STREAM_ATTR attr;
+        ret = DkStreamAttributesQueryByHandle(hdl->pal_handle, &attr);
+        if (ret == 0 && attr.pending_size >= sizeof(struct sysv_sem_shared)
+                && IS_ALLOC_ALIGNED(attr.pending_size)) {
+            mapping->size = attr.pending_size;
+            ret = map_shared(hdl, mapping->size, &mapping->shared);
+        } else {
+            ret = -EINVAL;
+        }
+        put_handle(hdl);
+        if (ret < 0) {
+            free(mapping);
+            return NULL;
+        }
+    }
+
+    INIT_LIST_HEAD(mapping, list);
+    LISTP_ADD(mapping, &g_sem_mappings, list);
+    return mapping;
+}
+
+/*
+ * Performs the operations directly on mapped values (the fast path). Returns 0 or a negative error
+ * code if the operations were done or failed, 1 if they have to be sent to the IPC leader.
+ */
+static int semop_fast(int semid, struct sembuf* sops, size_t nsops, bool is_undo, bool nowait) {
+    assert(g_process_ipc_ids.leader_vmid);
+
+    int ret;
+    bool wake = false;
+    lock(&g_sem_local_lock);
+
+    struct sem_mapping* mapping = get_mapping(semid);
+    if (!mapping || !mapping->shared) {
+        ret = 1;
+        goto out;
+    }
+
+    struct sysv_sem_shared* shared = mapping->shared;
+    uint64_t now = time_now_sec();
+    if (!sem_shared_trylock(shared)) {
+        /* the lock is held for too long, maybe by a dead process; the leader will sort it out */
+        ret = 1;
+        goto out;
+    }
+    ret = try_semop(shared, sops, nsops, is_undo, g_process.pid, now);
+    wake = ret == 0 && shared->waiters > 0;
+    sem_shared_unlock(shared);
+
+    if (ret == -EIDRM) {
+        /* the set was removed, its ID is not valid anymore */
+        LISTP_DEL(mapping, &g_sem_mappings, list);
+        unmap_shared(mapping->shared, mapping->size);
+        free(mapping);
+        ret = -EINVAL;
+    } else if (ret == -EAGAIN && !nowait) {
+        ret = 1;
+    }
+
+out:
+    unlock(&g_sem_local_lock);
+
+    if (wake) {
+        int tmp_ret = sysv_sem_wake(semid);
+        if (tmp_ret < 0)
+            log_warning("failed to wake up waiters of semaphore set %d: %d", semid, tmp_ret);
+    }
+    return ret;
+}
+
+/* Sends the operations to the IPC leader (or handles them directly, if we are the leader) and waits
+ * for the result. */
+static int semop_slow(int semid, struct sembuf* sops, size_t nsops, bool is_undo,
+                      uint64_t* timeout_us) {
+    struct sem_wait_request req = {
+        .id = __atomic_fetch_add(&g_sem_next_request_id, 1, __ATOMIC_RELAXED),
+        .thread = get_cur_thread(),
+    };
+    INIT_LIST_HEAD(&req, list);
+
+    lock(&g_sem_local_lock);
+    LISTP_ADD(&req, &g_sem_wait_requests, list);
+    unlock(&g_sem_local_lock);
+
+    int ret = sysv_sem_op(semid, sops, nsops, is_undo, g_process.pid,
+                          g_process_ipc_ids.self_vmid, req.id);
+    if (ret < 0)
+        goto out;
+
+    /* `SEM_UNDO` adjustments are applied on exit and cannot be interrupted */
+    bool interruptible = !is_undo;
+    while (true) {
+        thread_prepare_wait();
+
+        lock(&g_sem_local_lock);
+        bool done = req.done;
+        unlock(&g_sem_local_lock);
+        if (done)
+            break;
+
+        ret = thread_wait(interruptible ? timeout_us : NULL,
+                          /*ignore_pending_signals=*/!interruptible);
+        if (ret == -EINTR || ret == -ETIMEDOUT) {
+            int cancelled = sysv_sem_cancel(g_process_ipc_ids.self_vmid, req.id);
+            if (cancelled < 0) {
+                ret = cancelled;
+                goto out;
+            }
+            if (cancelled) {
+                /* semtimedop returns EAGAIN on timeout */
+                ret = ret == -ETIMEDOUT ? -EAGAIN : -EINTR;
+                goto out;
+            }
+            /* the request was already performed (or failed), its result is on the way */
+            interruptible = false;
+        } else if (ret < 0) {
+            log_error("waiting for semop result failed: %d", ret);
+            BUG();
+        }
+    }
+    ret = req.result;
+
+out:
+    lock(&g_sem_local_lock);
+    LISTP_DEL(&req, &g_sem_wait_requests, list);
+    unlock(&g_sem_local_lock);
+    return ret;
+}
+
+static void record_undo(int semid, struct sembuf* sops, size_t nsops) {
+    lock(&g_sem_local_lock);
+    for (size_t i = 0; i < nsops; i++) {
+        if (!(sops[i].sem_flg & SEM_UNDO) || sops[i].sem_op == 0)
+            continue;
+
+        struct sem_undo* undo;
+        bool found = false;
+        LISTP_FOR_EACH_ENTRY(undo, &g_sem_undos, list) {
+            if (undo->semid == semid && undo->semnum == sops[i].sem_num) {
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            undo = calloc(1, sizeof(*undo));
+            if (!undo) {
+                log_warning("out of memory, SEM_UNDO adjustment of semaphore set %d is lost",
+                            semid);
+                continue;
+            }
+            undo->semid = semid;
+            undo->semnum = sops[i].sem_num;
+            INIT_LIST_HEAD(undo, list);
+            LISTP_ADD(undo, &g_sem_undos, list);
+        }
+        undo->adj -= sops[i].sem_op;
+    }
+    unlock(&g_sem_local_lock);
+}
+
+static int do_semop(int semid, struct sembuf* sops, size_t nsops, bool is_undo,
+                    uint64_t* timeout_us) {
+    bool nowait = is_undo;
+    for (size_t i = 0; i < nsops; i++)
+        if (sops[i].sem_flg & IPC_NOWAIT)
+            nowait = true;
+
+    int ret = 1;
+    if (g_process_ipc_ids.leader_vmid)
+        ret = semop_fast(semid, sops, nsops, is_undo, nowait);
+    if (ret == 1)
+        ret = semop_slow(semid, sops, nsops, is_undo, timeout_us);
+
+    if (ret == 0 && !is_undo)
+        record_undo(semid, sops, nsops);
+    return ret;
+}
+
+int sysv_sem_undo_all(void) {
+    LISTP_TYPE(sem_undo) undos = LISTP_INIT;
+
+    lock(&g_sem_local_lock);
+    LISTP_SPLICE_INIT(&g_sem_undos, &undos, list, sem_undo);
+    unlock(&g_sem_local_lock);
+
+    struct sem_undo* undo;
+    struct sem_undo* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(undo, tmp, &undos, list) {
+        if (undo->adj != 0) {
+            struct sembuf sop = {
+                .sem_num = undo->semnum,
+                .sem_op  = MIN(MAX(undo->adj, -SEMVMX), SEMVMX),
+                .sem_flg = 0,
+            };
+            int ret = do_semop(undo->semid, &sop, 1, /*is_undo=*/true, /*timeout_us=*/NULL);
+            if (ret < 0 && ret != -EINVAL && ret != -EIDRM) {
+                log_warning("failed to apply SEM_UNDO adjustment of semaphore set %d: %d",
+                            undo->semid, ret);
+            }
+        }
+        LISTP_DEL(undo, &undos, list);
+        free(undo);
+    }
+    return 0;
+}
+
+long shim_do_semget(int key, int nsems, int semflg) {
+    struct shim_thread* cur_thread = get_cur_thread();
+    return sysv_sem_get(key, nsems, semflg, g_process.pid, cur_thread->euid, cur_thread->egid);
+}
+
+static long do_semtimedop(int semid, struct sembuf* sops, size_t nsops, uint64_t* timeout_us) {
+    if (semid < 0 || nsops == 0)
+        return -EINVAL;
+    if (nsops > SEMOPM)
+        return -E2BIG;
+    if (!is_user_memory_readable(sops, nsops * sizeof(*sops)))
+        return -EFAULT;
+
+    struct sembuf* ksops = malloc(nsops * sizeof(*ksops));
+    if (!ksops)
+        return -ENOMEM;
+    memcpy(ksops, sops, nsops * sizeof(*ksops));
+
+    long ret = do_semop(semid, ksops, nsops, /*is_undo=*/false, timeout_us);
+    free(ksops);
+    return ret;
+}
+
+long shim_do_semop(int semid, struct sembuf* sops, size_t nsops) {
+    return do_semtimedop(semid, sops, nsops, /*timeout_us=*/NULL);
+}
+
+long shim_do_semtimedop(int semid, struct sembuf* sops, size_t nsops,
+                        const struct __kernel_timespec* timeout) {
+    if (!timeout)
+        return do_semtimedop(semid, sops, nsops, /*timeout_us=*/NULL);
+
+    if (!is_user_memory_readable(timeout, sizeof(*timeout)))
+        return -EFAULT;
+    if (timeout->tv_sec < 0 || timeout->tv_nsec < 0
+            || (uint64_t)timeout->tv_nsec >= TIME_NS_IN_S)
+        return -EINVAL;
+
+    uint64_t timeout_us = timespec_to_us(timeout);
+    return do_semtimedop(semid, sops, nsops, &timeout_us);
+}
+
+long shim_do_semctl(int semid, int semnum, int cmd, unsigned long arg) {
+    if (semid < 0)
+        return -EINVAL;
+
+    /* the x86-64 ABI always uses `struct semid64_ds`, IPC_64 flag is not required */
+    cmd &= ~IPC_64;
+
+    struct semid64_ds kbuf;
+    struct semid64_ds* buf = (struct semid64_ds*)arg;
+    unsigned short* array = (unsigned short*)arg;
+    long ret;
+    switch (cmd) {
+        case IPC_STAT:
+            if (!is_user_memory_writable(buf, sizeof(*buf)))
+                return -EFAULT;
+            ret = sysv_sem_ctl(semid, semnum, cmd, g_process.pid, /*val=*/0, &kbuf,
+                               /*array=*/NULL, /*array_len=*/0);
+            if (ret < 0)
+                return ret;
+            memcpy(buf, &kbuf, sizeof(kbuf));
+            return 0;
+
+        case IPC_SET:
+            if (!is_user_memory_readable(buf, sizeof(*buf)))
+                return -EFAULT;
+            memcpy(&kbuf, buf, sizeof(kbuf));
+            return sysv_sem_ctl(semid, semnum, cmd, g_process.pid, /*val=*/0, &kbuf,
+                                /*array=*/NULL, /*array_len=*/0);
+
+        case IPC_RMID:
+        case GETVAL:
+        case GETPID:
+        case GETNCNT:
+        case GETZCNT:
+        case SETVAL:
+            return sysv_sem_ctl(semid, semnum, cmd, g_process.pid, /*val=*/(int)arg,
+                                /*buf=*/NULL, /*array=*/NULL, /*array_len=*/0);
+
+        case GETALL:
+        case SETALL:
+            break;
+
+        default:
+            return -EINVAL;
+    }
+
+    /* GETALL and SETALL: get the size of the set first */
+    ret = sysv_sem_ctl(semid, semnum, IPC_STAT, g_process.pid, /*val=*/0, &kbuf, /*array=*/NULL,
+                       /*array_len=*/0);
+    if (ret < 0)
+        return ret;
+
+    size_t nsems = kbuf.sem_nsems;
+    size_t array_size = nsems * sizeof(*array);
+    if (cmd == GETALL ? !is_user_memory_writable(array, array_size)
+                      : !is_user_memory_readable(array, array_size))
+        return -EFAULT;
+
+    unsigned short* karray = malloc(array_size);
+    if (!karray)
+        return -ENOMEM;
+
+    if (cmd == SETALL)
+        memcpy(karray, array, array_size);
+
+    ret = sysv_sem_ctl(semid, semnum, cmd, g_process.pid, /*val=*/0, /*buf=*/NULL, karray, nsems);
+    if (ret >= 0 && cmd == GETALL)
+        memcpy(array, karray, array_size);
+
+    free(karray);
+    return ret;
+}
@@ -0,0 +1,584 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Implementation of System V shared memory: system calls "shmget", "shmat", "shmdt" and "shmctl".
+ *
+ * See `shim_sysv.h` for an overview of the design.
+ */
+
+#include <errno.h>
+#include <linux/ipc.h>
+#include <linux/shm.h>
+
+#include "list.h"
+#include "pal.h"
+#include "shim_fs.h"
+#include "shim_handle.h"
+#include "shim_internal.h"
+#include "shim_ipc.h"
+#include "shim_lock.h"
+#include "shim_process.h"
+#include "shim_sysv.h"
+#include "shim_table.h"
+#include "shim_thread.h"
+#include "shim_vma.h"
+
+/* Not exported by Linux UAPI headers, see "include/linux/shm.h" in Linux sources */
+#define SHM_DEST 01000
+
+/* Number of attaches of a segment by one process */
+struct sysv_shm_attach {
+    IDTYPE pid;
+    size_t count;
+};
+
+/* Describes a shared memory segment. Exists only in the IPC leader. */
+DEFINE_LISTP(sysv_shm_segment);
+DEFINE_LIST(sysv_shm_segment);
+struct sysv_shm_segment {
+    int shmid;
+    int key;
+    size_t size;
+
+    IDTYPE uid;
+    IDTYPE gid;
+    IDTYPE cuid;
+    IDTYPE cgid;
+    unsigned int mode;
+
+    IDTYPE cpid;
+    IDTYPE lpid;
+    uint64_t atime;
+    uint64_t dtime;
+    uint64_t ctime;
+
+    /* Set by `IPC_RMID`, the segment is destroyed after its last detach. */
+    bool removed;
+
+    struct sysv_shm_attach* attaches;
+    size_t attaches_cnt;
+
+    LIST_TYPE(sysv_shm_segment) list;
+};
+
+/* Global lock for the whole subsystem. Protects access to `g_sysv_shm_segments` and
+ * `g_sysv_shm_next_id`. */
+static struct shim_lock g_sysv_lock;
+
+static LISTP_TYPE(sysv_shm_segment) g_sysv_shm_segments = LISTP_INIT;
+static int g_sysv_shm_next_id = 0;
+
+/* Name of the host shared memory object holding segment contents */
+#define SYSV_SHM_NAME_SIZE 32
+static void sysv_shm_name(int shmid, char* buf) {
+    snprintf(buf, SYSV_SHM_NAME_SIZE, "sysv_shm.%d", shmid);
+}
+
+int init_sysv_shm(void) {
+    if (!create_lock(&g_sysv_lock))
+        return -ENOMEM;
+    return 0;
+}
+
+static uint64_t time_now_sec(void) {
+    uint64_t time_us = 0;
+    if (DkSystemTimeQuery(&time_us) < 0)
+        return 0;
+    return time_us / TIME_US_IN_S;
+}
+
+static struct sysv_shm_segment* find_segment_by_key(int key) {
+    assert(locked(&g_sysv_lock));
+
+    struct sysv_shm_segment* seg;
+    LISTP_FOR_EACH_ENTRY(seg, &g_sysv_shm_segments, list) {
+        if (!seg->removed && seg->key == key)
+            return seg;
+    }
+    return NULL;
+}
+
+static struct sysv_shm_segment* find_segment_by_id(int shmid) {
+    assert(locked(&g_sysv_lock));
+
+    struct sysv_shm_segment* seg;
+    LISTP_FOR_EACH_ENTRY(seg, &g_sysv_shm_segments, list) {
+        if (seg->shmid == shmid)
+            return seg;
+    }
+    return NULL;
+}
+
+static struct sysv_shm_attach* find_attach(struct sysv_shm_segment* seg, IDTYPE pid) {
+    for (size_t i = 0; i < seg->attaches_cnt; i++) {
+        if (seg->attaches[i].pid == pid)
+            return &seg->attaches[i];
+    }
+    return NULL;
+}
+
+static int add_attach(struct sysv_shm_segment* seg, IDTYPE pid, size_t count) {
+    struct sysv_shm_attach* attach = find_attach(seg, pid);
+    if (attach) {
+        attach->count += count;
+        return 0;
+    }
+
+    struct sysv_shm_attach* new_attaches = malloc((seg->attaches_cnt + 1) * sizeof(*new_attaches));
+    if (!new_attaches)
+        return -ENOMEM;
+
+    if (seg->attaches_cnt)
+        memcpy(new_attaches, seg->attaches, seg->attaches_cnt * sizeof(*new_attaches));
+    new_attaches[seg->attaches_cnt].pid = pid;
+    new_attaches[seg->attaches_cnt].count = count;
+
+    free(seg->attaches);
+    seg->attaches = new_attaches;
+    seg->attaches_cnt++;
+    return 0;
+}
+
+static void remove_attach(struct sysv_shm_segment* seg, struct sysv_shm_attach* attach) {
+    size_t idx = attach - seg->attaches;
+    assert(idx < seg->attaches_cnt);
+    seg->attaches[idx] = seg->attaches[seg->attaches_cnt - 1];
+    seg->attaches_cnt--;
+}
+
+static size_t segment_nattch(struct sysv_shm_segment* seg) {
+    size_t nattch = 0;
+    for (size_t i = 0; i < seg->attaches_cnt; i++)
+        nattch += seg->attaches[i].count;
+    return nattch;
+}
+
+/* Destroys the segment if it was removed and nobody has it attached anymore. The host object was
+ * already deleted by `IPC_RMID`, existing mappings keep its memory alive. */
+static void maybe_destroy_segment(struct sysv_shm_segment* seg) {
+    assert(locked(&g_sysv_lock));
+
+    if (!seg->removed || segment_nattch(seg) > 0)
+        return;
+
+    log_debug("destroying System V shared memory segment %d", seg->shmid);
+    LISTP_DEL(seg, &g_sysv_shm_segments, list);
+    free(seg->attaches);
+    free(seg);
+}
+
+int sysv_shm_get(int key, size_t size, int flags, IDTYPE pid, IDTYPE uid, IDTYPE gid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_shm_get(key, size, flags, pid, uid, gid);
+    }
+
+    int ret;
+    lock(&g_sysv_lock);
+
+    if (key != IPC_PRIVATE) {
+        struct sysv_shm_segment* seg = find_segment_by_key(key);
+        if (seg) {
+            if ((flags & IPC_CREAT) && (flags & IPC_EXCL)) {
+                ret = -EEXIST;
+            } else if (size > seg->size) {
+                ret = -EINVAL;
+            } else {
+                ret = seg->shmid;
+            }
+            goto out;
+        }
+
+        if (!(flags & IPC_CREAT)) {
+            ret = -ENOENT;
+            goto out;
+        }
+    }
+
+    if (size < SHMMIN || size > SHMMAX) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    struct sysv_shm_segment* seg = calloc(1, sizeof(*seg));
+    if (!seg) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    int shmid = g_sysv_shm_next_id;
+    char name[SYSV_SHM_NAME_SIZE];
+    sysv_shm_name(shmid, name);
+
+    /* Create the host object here, attaching processes only open it by name */
+    struct shim_handle* hdl = NULL;
+    ret = open_shm_handle(name, PAL_CREATE_ALWAYS, size, &hdl);
+    if (ret < 0) {
+        free(seg);
+        if (ret == -EOPNOTSUPP) {
+            log_warning("System V shared memory is not supported by the PAL");
+            ret = -ENOSYS;
+        }
+        goto out;
+    }
+    put_handle(hdl);
+
+    g_sysv_shm_next_id++;
+
+    uint64_t now = time_now_sec();
+    seg->shmid = shmid;
+    seg->key   = key;
+    seg->size  = size;
+    seg->uid   = uid;
+    seg->gid   = gid;
+    seg->cuid  = uid;
+    seg->cgid  = gid;
+    seg->mode  = flags & 0777;
+    seg->cpid  = pid;
+    seg->ctime = now;
+    INIT_LIST_HEAD(seg, list);
+    LISTP_ADD_TAIL(seg, &g_sysv_shm_segments, list);
+
+    log_debug("created System V shared memory segment %d (key %d, size %lu)", shmid, key, size);
+    ret = shmid;
+out:
+    unlock(&g_sysv_lock);
+    return ret;
+}
+
+int sysv_shm_attach(int shmid, IDTYPE pid, bool detach, size_t* out_size) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_shm_attach(shmid, pid, detach, out_size);
+    }
+
+    int ret;
+    lock(&g_sysv_lock);
+
+    struct sysv_shm_segment* seg = find_segment_by_id(shmid);
+    if (!seg) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    if (!detach) {
+        if (seg->removed) {
+            ret = -EIDRM;
+            goto out;
+        }
+        ret = add_attach(seg, pid, /*count=*/1);
+        if (ret < 0)
+            goto out;
+        seg->atime = time_now_sec();
+        if (out_size)
+            *out_size = seg->size;
+    } else {
+        struct sysv_shm_attach* attach = find_attach(seg, pid);
+        if (!attach) {
+            ret = -EINVAL;
+            goto out;
+        }
+        if (--attach->count == 0)
+            remove_attach(seg, attach);
+        seg->dtime = time_now_sec();
+    }
+    seg->lpid = pid;
+
+    maybe_destroy_segment(seg);
+    ret = 0;
+out:
+    unlock(&g_sysv_lock);
+    return ret;
+}
+
+int sysv_shm_ctl(int shmid, int cmd, IDTYPE pid, struct shmid64_ds* buf) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_shm_ctl(shmid, cmd, pid, buf);
+    }
+
+    int ret;
+    lock(&g_sysv_lock);
+
+    struct sysv_shm_segment* seg = find_segment_by_id(shmid);
+    if (!seg) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    switch (cmd) {
+        case IPC_STAT:
+            memset(buf, 0, sizeof(*buf));
+            buf->shm_perm.key  = seg->removed ? IPC_PRIVATE : seg->key;
+            buf->shm_perm.uid  = seg->uid;
+            buf->shm_perm.gid  = seg->gid;
+            buf->shm_perm.cuid = seg->cuid;
+            buf->shm_perm.cgid = seg->cgid;
+            buf->shm_perm.mode = seg->mode | (seg->removed ? SHM_DEST : 0);
+            buf->shm_segsz     = seg->size;
+            buf->shm_atime     = seg->atime;
+            buf->shm_dtime     = seg->dtime;
+            buf->shm_ctime     = seg->ctime;
+            buf->shm_cpid      = seg->cpid;
+            buf->shm_lpid      = seg->lpid;
+            buf->shm_nattch    = segment_nattch(seg);
+            break;
+
+        case IPC_SET:
+            seg->uid   = buf->shm_perm.uid;
+            seg->gid   = buf->shm_perm.gid;
+            seg->mode  = buf->shm_perm.mode & 0777;
+            seg->ctime = time_now_sec();
+            break;
+
+        case IPC_RMID:
+            if (!seg->removed) {
+                char name[SYSV_SHM_NAME_SIZE];
+                sysv_shm_name(seg->shmid, name);
+                ret = delete_shm_object(name);
+                if (ret < 0)
+                    log_warning("failed to delete host object of segment %d: %d", shmid, ret);
+                seg->removed = true;
+                seg->ctime = time_now_sec();
+            }
+            maybe_destroy_segment(seg);
+            break;
+
+        default:
+            ret = -EINVAL;
+            goto out;
+    }
+
+    __UNUSED(pid);
+    ret = 0;
+out:
+    unlock(&g_sysv_lock);
+    return ret;
+}
+
+int sysv_shm_inherit(IDTYPE parent_pid, IDTYPE child_pid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_shm_inherit(parent_pid, child_pid);
+    }
+
+    int ret = 0;
+    lock(&g_sysv_lock);
+
+    struct sysv_shm_segment* seg;
+    LISTP_FOR_EACH_ENTRY(seg, &g_sysv_shm_segments, list) {
+        struct sysv_shm_attach* attach = find_attach(seg, parent_pid);
+        if (attach) {
+            ret = add_attach(seg, child_pid, attach->count);
+            if (ret < 0)
+                break;
+        }
+    }
+
+    unlock(&g_sysv_lock);
+    return ret;
+}
+
+int sysv_shm_clear_pid(IDTYPE pid) {
+    if (g_process_ipc_ids.leader_vmid) {
+        return ipc_sysv_shm_clear_pid(pid);
+    }
+
+    lock(&g_sysv_lock);
+
+    struct sysv_shm_segment* seg;
+    struct sysv_shm_segment* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(seg, tmp, &g_sysv_shm_segments, list) {
+        struct sysv_shm_attach* attach = find_attach(seg, pid);
+        if (attach) {
+            remove_attach(seg, attach);
+            seg->dtime = time_now_sec();
+            seg->lpid = pid;
+            /* Note that the below call might end up deleting `seg` */
+            maybe_destroy_segment(seg);
+        }
+    }
+
+    unlock(&g_sysv_lock);
+    return 0;
+}
+
+void sysv_shm_delete_host_objects(void) {
+    if (g_process_ipc_ids.leader_vmid)
+        return;
+
+    lock(&g_sysv_lock);
+
+    struct sysv_shm_segment* seg;
+    LISTP_FOR_EACH_ENTRY(seg, &g_sysv_shm_segments, list) {
+        if (seg->removed)
+            continue;
+
+        char name[SYSV_SHM_NAME_SIZE];
+        sysv_shm_name(seg->shmid, name);
+        int ret = delete_shm_object(name);
+        if (ret < 0)
+            log_warning("failed to delete host object of segment %d: %d", seg->shmid, ret);
+        seg->removed = true;
+    }
+
+    unlock(&g_sysv_lock);
+}
+
+long shim_do_shmget(int key, size_t size, int shmflg) {
+    struct shim_thread* cur_thread = get_cur_thread();
+    return sysv_shm_get(key, size, shmflg, g_process.pid, cur_thread->euid, cur_thread->egid);
+}
+
+void* shim_do_shmat(int shmid, const void* shmaddr, int shmflg) {
+    if (shmflg & ~(SHM_RDONLY | SHM_RND | SHM_REMAP | SHM_EXEC))
+        return (void*)-EINVAL;
+
+    void* addr = (void*)shmaddr;
+    if (addr) {
+        if (shmflg & SHM_RND) {
+            addr = ALLOC_ALIGN_DOWN_PTR(addr);
+        } else if (!IS_ALLOC_ALIGNED_PTR(addr)) {
+            return (void*)-EINVAL;
+        }
+    } else if (shmflg & SHM_REMAP) {
+        return (void*)-EINVAL;
+    }
+
+    size_t size = 0;
+    long ret = sysv_shm_attach(shmid, g_process.pid, /*detach=*/false, &size);
+    if (ret < 0)
+        return (void*)ret;
+
+    size_t length = ALLOC_ALIGN_UP(size);
+    int prot = PROT_READ | (shmflg & SHM_RDONLY ? 0 : PROT_WRITE)
+               | (shmflg & SHM_EXEC ? PROT_EXEC : 0);
+    int flags = MAP_SHARED;
+
+    char name[SYSV_SHM_NAME_SIZE];
+    sysv_shm_name(shmid, name);
+
+    struct shim_handle* hdl = NULL;
+    ret = open_shm_handle(name, PAL_CREATE_NEVER, /*size=*/0, &hdl);
+    if (ret < 0) {
+        /* the segment was removed in the meantime */
+        if (ret == -ENOENT)
+            ret = -EIDRM;
+        goto out_detach;
+    }
+    hdl->info.shm.shmid = shmid;
+    hdl->info.shm.size = size;
+
+    if (addr) {
+        if (!access_ok(addr, length) || addr < g_pal_public_state->user_address_start
+                || (uintptr_t)g_pal_public_state->user_address_end < (uintptr_t)addr + length) {
+            ret = -EINVAL;
+            goto out_handle;
+        }
+        flags |= (shmflg & SHM_REMAP) ? MAP_FIXED : MAP_FIXED_NOREPLACE;
+        ret = bkeep_mmap_fixed(addr, length, prot, flags, hdl, /*offset=*/0, /*comment=*/NULL);
+        if (ret == -EEXIST)
+            ret = -EINVAL;
+    } else {
+        ret = bkeep_mmap_any_aslr(length, prot, flags, hdl, /*offset=*/0, /*comment=*/NULL, &addr);
+        if (ret < 0)
+            ret = -ENOMEM;
+    }
+    if (ret < 0)
+        goto out_handle;
+
+    void* ret_addr = addr;
+    ret = hdl->fs->fs_ops->mmap(hdl, &ret_addr, length, prot, flags, /*offset=*/0);
+    if (ret < 0) {
+        void* tmp_vma = NULL;
+        if (bkeep_munmap(addr, length, /*is_internal=*/false, &tmp_vma) < 0) {
+            log_error("[shmat] Failed to remove bookkeeped memory that was not allocated at %p-%p!",
+                      addr, (char*)addr + length);
+            BUG();
+        }
+        bkeep_remove_tmp_vma(tmp_vma);
+        goto out_handle;
+    }
+    assert(ret_addr == addr);
+
+    /* the VMA holds its own reference to `hdl` */
+    put_handle(hdl);
+    return addr;
+
+out_handle:
+    put_handle(hdl);
+out_detach:;
+    int tmp_ret = sysv_shm_attach(shmid, g_process.pid, /*detach=*/true, /*out_size=*/NULL);
+    if (tmp_ret < 0)
+        log_warning("[shmat] Failed to detach segment %d: %d", shmid, tmp_ret);
+    return (void*)ret;
+}
+
+long shim_do_shmdt(const void* shmaddr) {
+    if (!IS_ALLOC_ALIGNED_PTR(shmaddr))
+        return -EINVAL;
+
+    struct shim_vma_info vma_info;
+    if (lookup_vma((void*)shmaddr, &vma_info) < 0)
+        return -EINVAL;
+
+    struct shim_handle* hdl = vma_info.file;
+    if (!hdl || hdl->type != TYPE_SHM || hdl->info.shm.shmid < 0 || vma_info.addr != shmaddr
+            || vma_info.file_offset != 0) {
+        if (hdl)
+            put_handle(hdl);
+        return -EINVAL;
+    }
+
+    int shmid = hdl->info.shm.shmid;
+    size_t length = ALLOC_ALIGN_UP(hdl->info.shm.size);
+    put_handle(hdl);
+
+    /* Note that this also unmaps whatever the application mapped over a part of the segment,
+     * Linux would unmap only the parts of the segment */
+    void* tmp_vma = NULL;
+    int ret = bkeep_munmap((void*)shmaddr, length, /*is_internal=*/false, &tmp_vma);
+    if (ret < 0)
+        return ret;
+
+    if (DkVirtualMemoryFree((void*)shmaddr, length) < 0) {
+        BUG();
+    }
+
+    bkeep_remove_tmp_vma(tmp_vma);
+
+    return sysv_shm_attach(shmid, g_process.pid, /*detach=*/true, /*out_size=*/NULL);
+}
+
+long shim_do_shmctl(int shmid, int cmd, struct shmid64_ds* buf) {
+    /* the x86-64 ABI always uses `struct shmid64_ds`, IPC_64 flag is not required */
+    cmd &= ~IPC_64;
+
+    struct shmid64_ds kbuf;
+    int ret;
+    switch (cmd) {
+        case IPC_STAT:
+            if (!is_user_memory_writable(buf, sizeof(*buf)))
+                return -EFAULT;
+            ret = sysv_shm_ctl(shmid, cmd, g_process.pid, &kbuf);
+            if (ret < 0)
+                return ret;
+            memcpy(buf, &kbuf, sizeof(kbuf));
+            return 0;
+
+        case IPC_SET:
+            if (!is_user_memory_readable(buf, sizeof(*buf)))
+                return -EFAULT;
+            memcpy(&kbuf, buf, sizeof(kbuf));
+            return sysv_shm_ctl(shmid, cmd, g_process.pid, &kbuf);
+
+        case IPC_RMID:
+            return sysv_shm_ctl(shmid, cmd, g_process.pid, /*buf=*/NULL);
+
+        case SHM_LOCK:
+        case SHM_UNLOCK:
+            /* Gramine does not swap memory out, locking is a no-op (as in `mlock`), just check that
+             * the segment exists */
+            return sysv_shm_ctl(shmid, IPC_STAT, g_process.pid, &kbuf);
+
+        default:
+            return -EINVAL;
+    }
+}
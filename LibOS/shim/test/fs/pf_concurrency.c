@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This is a native (non-Gramine) test for concurrent operations on a single protected file context,
+ * like the one shared by all handles to a protected file inside Gramine. Each thread writes to and
+ * reads from its own region of the file (so the expected contents are known), while also querying,
+ * extending and flushing the file. The file is then reopened and verified.
+ */
+
+#define _XOPEN_SOURCE 700
+#include <pthread.h>
+
+#include "common.h"
+#include "pf_util.h"
+#include "protected_files.h"
+
+#define REGION_SIZE (256 * 1024)
+#define MAX_IO_SIZE (10 * 1024)
+#define ITERATIONS  500
+
+struct thread_args {
+    int id;
+    uint8_t* shadow; /* expected contents of the thread's region */
+    size_t written;  /* end of data written by the thread (relative to the region) */
+};
+
+static pf_key_t g_key = {0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99, 0x88,
+                         0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00};
+static pthread_barrier_t g_barrier;
+static pf_context_t* g_pf;
+static uint64_t g_total_size;
+
+static void check(pf_status_t pfs, const char* what, int id) {
+    if (PF_FAILURE(pfs))
+        fatal_error("thread %d: %s failed: %s\n", id, what, pf_strerror(pfs));
+}
+
+static size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+static uint32_t next_rand(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+static void* worker(void* arg) {
+    struct thread_args* args = arg;
+    uint64_t region = (uint64_t)args->id * REGION_SIZE;
+    uint32_t state = args->id + 1;
+    uint8_t* buf = malloc(MAX_IO_SIZE);
+    if (!buf)
+        fatal_error("out of memory\n");
+
+    pthread_barrier_wait(&g_barrier);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        /* write to a random part of the region */
+        size_t offset = next_rand(&state) % REGION_SIZE;
+        size_t size = min_size(next_rand(&state) % MAX_IO_SIZE + 1, REGION_SIZE - offset);
+        for (size_t j = 0; j < size; j++)
+            args->shadow[offset + j] = (uint8_t)(args->id * 31 + i + j);
+        check(pf_write(g_pf, region + offset, size, args->shadow + offset), "pf_write", args->id);
+        if (offset + size > args->written)
+            args->written = offset + size;
+
+        /* read back a random part of the region, the file only grows */
+        offset = next_rand(&state) % REGION_SIZE;
+        size = min_size(next_rand(&state) % MAX_IO_SIZE + 1, REGION_SIZE - offset);
+        size_t bytes_read;
+        check(pf_read(g_pf, region + offset, size, buf, &bytes_read), "pf_read", args->id);
+        if (offset < args->written && bytes_read < min_size(size, args->written - offset))
+            fatal_error("thread %d: short read at %lu: %lu\n", args->id, region + offset,
+                        bytes_read);
+        if (memcmp(buf, args->shadow + offset, bytes_read))
+            fatal_error("thread %d: wrong data read at %lu\n", args->id, region + offset);
+
+        uint64_t file_size;
+        check(pf_get_size(g_pf, &file_size), "pf_get_size", args->id);
+        if (file_size < region + args->written || file_size > g_total_size)
+            fatal_error("thread %d: wrong file size %lu\n", args->id, file_size);
+
+        if (args->id == 0 && i == ITERATIONS / 2)
+            check(pf_set_size(g_pf, g_total_size), "pf_set_size", args->id);
+
+        if (i % 64 == 63)
+            check(pf_flush(g_pf), "pf_flush", args->id);
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static void verify(const char* path, int n_threads, struct thread_args* args) {
+    int fd = open(path, O_RDWR);
+    if (fd < 0)
+        fatal_error("open(%s) failed: %s\n", path, strerror(errno));
+    off_t real_size = lseek(fd, 0, SEEK_END);
+    if (real_size < 0)
+        fatal_error("lseek(%s) failed: %s\n", path, strerror(errno));
+
+    pf_context_t* pf;
+    check(pf_open(&fd, path, real_size, PF_FILE_MODE_READ, /*create=*/false, PF_NODE_SIZE,
+                  /*integrity_only=*/false, &g_key, &pf), "pf_open", -1);
+
+    uint64_t file_size;
+    check(pf_get_size(pf, &file_size), "pf_get_size", -1);
+    if (file_size != g_total_size)
+        fatal_error("wrong file size %lu (expected %lu)\n", file_size, g_total_size);
+
+    uint8_t* buf = malloc(REGION_SIZE);
+    if (!buf)
+        fatal_error("out of memory\n");
+    for (int i = 0; i < n_threads; i++) {
+        size_t bytes_read;
+        check(pf_read(pf, (uint64_t)i * REGION_SIZE, REGION_SIZE, buf, &bytes_read), "pf_read",
+              -1);
+        if (bytes_read != REGION_SIZE || memcmp(buf, args[i].shadow, REGION_SIZE))
+            fatal_error("wrong data in region of thread %d\n", i);
+    }
+    free(buf);
+
+    check(pf_close(pf), "pf_close", -1);
+    close(fd);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3)
+        fatal_error("Usage: %s <path> <n_threads>\n", argv[0]);
+
+    const char* path = argv[1];
+    int n_threads = atoi(argv[2]);
+    if (n_threads < 1)
+        fatal_error("invalid number of threads\n");
+    g_total_size = (uint64_t)n_threads * REGION_SIZE;
+
+    if (pf_init() != 0)
+        fatal_error("pf_init failed\n");
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0)
+        fatal_error("open(%s) failed: %s\n", path, strerror(errno));
+    check(pf_open(&fd, path, /*underlying_size=*/0, PF_FILE_MODE_READ | PF_FILE_MODE_WRITE,
+                  /*create=*/true, PF_NODE_SIZE, /*integrity_only=*/false, &g_key, &g_pf),
+          "pf_open", -1);
+
+    pthread_barrier_init(&g_barrier, NULL, n_threads);
+    pthread_t threads[n_threads];
+    struct thread_args args[n_threads];
+    for (int i = 0; i < n_threads; i++) {
+        args[i].id = i;
+        args[i].written = 0;
+        args[i].shadow = calloc(1, REGION_SIZE);
+        if (!args[i].shadow)
+            fatal_error("out of memory\n");
+    }
+    for (int i = 1; i < n_threads; i++)
+        pthread_create(&threads[i], NULL, worker, &args[i]);
+
+    worker(&args[0]);
+
+    for (int i = 1; i < n_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&g_barrier);
+
+    check(pf_close(g_pf), "pf_close", -1);
+    close(fd);
+
+    verify(path, n_threads, args);
+
+    for (int i = 0; i < n_threads; i++)
+        free(args[i].shadow);
+
+    printf("TEST OK\n");
+    return 0;
+}
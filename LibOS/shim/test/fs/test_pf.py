@@ -4,15 +4,14 @@ import filecmp
 import os
 import shutil
 import subprocess
+import time
 import unittest
 
 # Named import, so that Pytest does not pick up TC_00_FileSystem as belonging to this module.
 import test_fs
 
-from graminelibos.regression import (
-    HAS_SGX,
-    expectedFailureIf,
-)
+import graminelibos
+from graminelibos.regression import HAS_SGX
 
 @unittest.skipUnless(HAS_SGX, 'Protected files require SGX support')
 class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
@@ -54,8 +53,12 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
     def copy_input(self, input_path, output_path):
         self.__encrypt_file(input_path, output_path)
 
-    def __encrypt_file(self, input_path, output_path):
+    def __encrypt_file(self, input_path, output_path, node_size=None, integrity_only=False):
         args = ['encrypt', '-w', self.WRAP_KEY, '-i', input_path, '-o', output_path]
+        if node_size:
+            args += ['-n', str(node_size)]
+        if integrity_only:
+            args += ['-I']
         stdout, stderr = self.__pf_crypt(args)
         return (stdout, stderr)
 
@@ -82,6 +85,128 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
             self.__decrypt_file(self.OUTPUT_FILES[i], dec_path)
             self.assertTrue(filecmp.cmp(self.INPUT_FILES[i], dec_path, shallow=False))
 
+    def test_011_encrypt_decrypt_node_boundaries(self):
+        # first 3072 bytes of data are kept in the metadata node, the rest in 4096-byte data nodes
+        # (96 per MHT node); whole data nodes are encrypted and decrypted bypassing the node cache,
+        # partial ones go through it
+        sizes = [3072 + nodes * 4096 + delta for nodes in [1, 2, 95, 96, 97, 200]
+                 for delta in [-1, 0, 1]]
+        for size in sizes:
+            input_path = os.path.join(self.OUTPUT_DIR, f'boundary_{size}')
+            with open(input_path, 'wb') as file:
+                file.write(os.urandom(size))
+            enc_path = input_path + '.enc'
+            dec_path = input_path + '.dec'
+            self.__encrypt_file(input_path, enc_path)
+            self.__decrypt_file(enc_path, dec_path)
+            self.assertTrue(filecmp.cmp(input_path, dec_path, shallow=False))
+
+    def test_012_encrypt_decrypt_node_size(self):
+        # the node size is recorded in the file, decryption doesn't need to know it
+        for node_size in [8192, 65536, 262144]:
+            for i in self.INDEXES:
+                enc_path = os.path.join(self.OUTPUT_DIR,
+                                        f'{os.path.basename(self.INPUT_FILES[i])}.{node_size}')
+                dec_path = enc_path + '.dec'
+                self.__encrypt_file(self.INPUT_FILES[i], enc_path, node_size)
+                self.__decrypt_file(enc_path, dec_path)
+                self.assertTrue(filecmp.cmp(self.INPUT_FILES[i], dec_path, shallow=False))
+
+    def test_013_encrypt_invalid_node_size(self):
+        enc_path = os.path.join(self.OUTPUT_DIR, 'invalid_node_size')
+        for node_size in [0, 2048, 4097, 12288, 524288]:
+            with self.assertRaises(subprocess.CalledProcessError):
+                self.__encrypt_file(self.INPUT_FILES[-1], enc_path, node_size)
+
+    def test_014_encrypt_decrypt_integrity_only(self):
+        # data nodes of integrity-only files are stored in plaintext; with the default node size,
+        # the first data node (file offset 3072) directly follows the metadata and root MHT nodes
+        for i in self.INDEXES:
+            enc_path = os.path.join(self.OUTPUT_DIR,
+                                    f'{os.path.basename(self.INPUT_FILES[i])}.integrity')
+            dec_path = enc_path + '.dec'
+            self.__encrypt_file(self.INPUT_FILES[i], enc_path, integrity_only=True)
+            self.__decrypt_file(enc_path, dec_path)
+            self.assertTrue(filecmp.cmp(self.INPUT_FILES[i], dec_path, shallow=False))
+
+            if self.FILE_SIZES[i] < 3072 + 4096:
+                continue
+            with open(self.INPUT_FILES[i], 'rb') as file:
+                file.seek(3072)
+                plaintext = file.read(4096)
+            with open(enc_path, 'rb') as file:
+                file.seek(2 * 4096)
+                self.assertEqual(file.read(4096), plaintext)
+            with open(self.ENCRYPTED_FILES[i], 'rb') as file:
+                file.seek(2 * 4096)
+                self.assertNotEqual(file.read(4096), plaintext)
+
+    def test_020_encrypt_decrypt_throughput(self):
+        size = 64 * 1024 * 1024
+        input_path = os.path.join(self.OUTPUT_DIR, 'throughput')
+        with open(input_path, 'wb') as file:
+            file.write(os.urandom(size))
+
+        for node_size in [4096, 65536, 262144]:
+            enc_path = f'{input_path}.{node_size}.enc'
+            dec_path = f'{input_path}.{node_size}.dec'
+
+            start = time.perf_counter()
+            self.__encrypt_file(input_path, enc_path, node_size)
+            encrypt_time = time.perf_counter() - start
+
+            start = time.perf_counter()
+            self.__decrypt_file(enc_path, dec_path)
+            decrypt_time = time.perf_counter() - start
+
+            self.assertTrue(filecmp.cmp(input_path, dec_path, shallow=False))
+            print(f'pf_crypt throughput (node size {node_size}): '
+                  f'encrypt {size / encrypt_time / 2**20:.1f} MiB/s, '
+                  f'decrypt {size / decrypt_time / 2**20:.1f} MiB/s')
+            os.remove(enc_path)
+            os.remove(dec_path)
+
+    def test_021_encrypt_write_callbacks(self):
+        # adjacent nodes are written back with a single (vectored) write callback, so encrypting
+        # a file must not issue one write per 4096-byte node
+        size = 4 * 1024 * 1024
+        nodes = size // 4096
+        input_path = os.path.join(self.OUTPUT_DIR, 'write_callbacks')
+        enc_path = input_path + '.enc'
+        dec_path = input_path + '.dec'
+        with open(input_path, 'wb') as file:
+            file.write(os.urandom(size))
+
+        stdout, _ = self.__pf_crypt(['encrypt', '-v', '-w', self.WRAP_KEY, '-i', input_path,
+                                     '-o', enc_path])
+        writes = [line for line in stdout.splitlines() if line.startswith('linux_write')]
+        self.assertLess(len(writes), nodes // 16)
+
+        self.__decrypt_file(enc_path, dec_path)
+        self.assertTrue(filecmp.cmp(input_path, dec_path, shallow=False))
+
+    def test_022_decrypt_throughput_integrity_only(self):
+        # reading integrity-only files only verifies a MAC per data node instead of decrypting it
+        size = 64 * 1024 * 1024
+        input_path = os.path.join(self.OUTPUT_DIR, 'throughput_integrity')
+        with open(input_path, 'wb') as file:
+            file.write(os.urandom(size))
+
+        for integrity_only in [False, True]:
+            enc_path = f'{input_path}.{integrity_only}.enc'
+            dec_path = f'{input_path}.{integrity_only}.dec'
+            self.__encrypt_file(input_path, enc_path, integrity_only=integrity_only)
+
+            start = time.perf_counter()
+            self.__decrypt_file(enc_path, dec_path)
+            decrypt_time = time.perf_counter() - start
+
+            self.assertTrue(filecmp.cmp(input_path, dec_path, shallow=False))
+            mode = 'integrity-only' if integrity_only else 'encrypted'
+            print(f'pf_crypt decrypt throughput ({mode}): {size / decrypt_time / 2**20:.1f} MiB/s')
+            os.remove(enc_path)
+            os.remove(dec_path)
+
     # overrides TC_00_FileSystem to change input dir (from plaintext to encrypted)
     def test_100_open_close(self):
         # the test binary expects a path to read-only (existing) file or a path to file that
@@ -90,16 +215,10 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
         output_path = os.path.join(self.OUTPUT_DIR, 'test_100') # new file
         stdout, stderr = self.run_binary(['open_close', 'R', input_path])
         self.verify_open_close(stdout, stderr, input_path, 'input')
-        # the following test tries to open multiple handles to a single writable PF, should fail
-        try:
-            stdout, stderr = self.run_binary(['open_close', 'W', output_path])
-            self.assertIn('ERROR: Failed to open output file', stderr)
-        except subprocess.CalledProcessError as exc:
-            self.assertNotEqual(exc.returncode, 0)
-            self.assertTrue(os.path.isfile(output_path))
-        else:
-            print('[!] Fail: open_close returned 0')
-            self.fail()
+        # multiple handles to a single writable PF share the PF context
+        stdout, stderr = self.run_binary(['open_close', 'W', output_path])
+        self.verify_open_close(stdout, stderr, output_path, 'output')
+        self.assertTrue(os.path.isfile(output_path))
 
     # overrides TC_00_FileSystem to change input dir (from plaintext to encrypted)
     def test_101_open_flags(self):
@@ -140,10 +259,32 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
         self.__decrypt_file(file, dec_path)
         self.assertEqual(os.stat(dec_path).st_size, size)
 
-    @expectedFailureIf(HAS_SGX)
-    # pylint: disable=fixme
-    def test_140_file_truncate(self):
-        self.fail() # TODO: port these to the new file format
+    def test_141_file_truncate_cycles(self):
+        # shrink and extend the same files repeatedly, across data node and MHT node boundaries
+        # (with 4096-byte nodes, the first 3072 bytes are kept in the metadata node and an MHT node
+        # covers 96 data nodes); data before each cut must survive and the rest must read back as
+        # zeros after the next extension
+        i = self.FILE_SIZES.index(1048577)
+        with open(self.INPUT_FILES[i], 'rb') as file:
+            expected = file.read()
+        out_1_path = self.OUTPUT_FILES[i] + 'a'
+        out_2_path = self.OUTPUT_FILES[i] + 'b'
+        self.copy_input(self.INPUT_FILES[i], out_1_path)
+        self.copy_input(self.INPUT_FILES[i], out_2_path)
+
+        mht_boundary = 3072 + 96 * 4096
+        for size in [1048576, 700000, mht_boundary + 5, 900000, mht_boundary, mht_boundary + 4096,
+                     3072 + 2 * 4096, 3072 + 4096 + 10, 2000000, 3100, 3072, 5000, 1000, 70000,
+                     0, 4096]:
+            stdout, stderr = self.run_binary(['truncate', out_1_path, out_2_path, str(size)])
+            self.assertNotIn('ERROR: ', stderr)
+            self.assertIn('ftruncate(' + out_2_path + ') to ' + str(size) + ' OK', stdout)
+            expected = expected[:size] + bytes(max(size - len(expected), 0))
+            for path in [out_1_path, out_2_path]:
+                dec_path = path + '.dec'
+                self.__decrypt_file(path, dec_path)
+                with open(dec_path, 'rb') as file:
+                    self.assertEqual(file.read(), expected, f'{path} truncated to {size}')
 
     def test_150_file_rename(self):
         path1 = os.path.join(self.OUTPUT_DIR, 'test_150a')
@@ -160,6 +301,14 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
             print('[!] Fail: successfully decrypted renamed file: ' + path2)
             self.fail()
 
+    def test_160_concurrent_context_native(self):
+        # runs natively, exercises the locking of a PF context shared by multiple threads
+        path = os.path.join(self.OUTPUT_DIR, 'test_160')
+        binary = os.path.join(graminelibos._CONFIG_PKGLIBDIR, 'tests', 'libos', 'fs',
+                              'pf_concurrency')
+        stdout, _ = self.run_native_binary([binary, path, '8'])
+        self.assertIn('TEST OK', stdout)
+
     # overrides TC_00_FileSystem to decrypt output
     def verify_copy_content(self, input_path, output_path):
         dec_path = os.path.join(self.OUTPUT_DIR, os.path.basename(output_path) + '.dec')
@@ -197,20 +346,37 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
                                          timeout=30)
         self.verify_copy(stdout, stderr, '/mounted/pf_input', executable)
 
+    def test_211_copy_dir_integrity_only(self):
+        # PFs created under `sgx.protected_files_integrity_only` paths are stored in plaintext, but
+        # still need the wrap key to be read
+        integrity_dir = os.path.join(self.TEST_DIR, 'pf_integrity')
+        shutil.rmtree(integrity_dir, ignore_errors=True)
+        os.mkdir(integrity_dir)
+        executable = 'copy_whole'
+        stdout, stderr = self.run_binary([executable, self.ENCRYPTED_DIR, integrity_dir],
+                                         timeout=30)
+        self.verify_copy(stdout, stderr, self.ENCRYPTED_DIR, executable)
+
+        for i in self.INDEXES:
+            output_path = os.path.join(integrity_dir, str(self.FILE_SIZES[i]))
+            self.verify_copy_content(self.INPUT_FILES[i], output_path)
+            if self.FILE_SIZES[i] >= 3072 + 4096:
+                with open(self.INPUT_FILES[i], 'rb') as file:
+                    file.seek(3072)
+                    plaintext = file.read(4096)
+                with open(output_path, 'rb') as file:
+                    file.seek(2 * 4096)
+                    self.assertEqual(file.read(4096), plaintext)
+
     def __corrupt_file(self, input_path, output_path):
         cmd = [self.PF_TAMPER, '-w', self.WRAP_KEY, '-i', input_path, '-o', output_path]
         return self.run_native_binary(cmd)
 
-    # invalid/corrupted files
-    def test_500_invalid(self):
-        invalid_dir = os.path.join(self.TEST_DIR, 'pf_invalid')
+    def __check_invalid(self, original_input, invalid_dir):
         if not os.path.exists(invalid_dir):
             os.mkdir(invalid_dir)
 
-        # prepare valid encrypted file (largest one for maximum possible corruptions)
-        original_input = self.OUTPUT_FILES[-1]
-        self.__encrypt_file(self.INPUT_FILES[-1], original_input)
-        # generate invalid files based on the above
+        # generate invalid files based on the valid encrypted file
         self.__corrupt_file(original_input, invalid_dir)
 
         # try to decrypt invalid files
@@ -230,3 +396,32 @@ class TC_50_ProtectedFiles(test_fs.TC_00_FileSystem):
             else:
                 print('[!] Fail: successfully decrypted file: ' + name)
                 self.fail()
+
+    # invalid/corrupted files
+    def test_500_invalid(self):
+        # prepare valid encrypted file (largest one for maximum possible corruptions)
+        original_input = self.OUTPUT_FILES[-1]
+        self.__encrypt_file(self.INPUT_FILES[-1], original_input)
+        self.__check_invalid(original_input, os.path.join(self.TEST_DIR, 'pf_invalid'))
+
+    def test_501_invalid_node_size(self):
+        # same as above, with a non-default node size (also recorded in the metadata, so it can be
+        # corrupted too); the file needs at least two MHT nodes (192 data nodes each)
+        node_size = 8192
+        plain_input = os.path.join(self.OUTPUT_DIR, 'invalid_node_size_input')
+        with open(plain_input, 'wb') as file:
+            file.write(os.urandom(2 * 1024 * 1024))
+        original_input = os.path.join(self.OUTPUT_DIR, 'invalid_node_size')
+        self.__encrypt_file(plain_input, original_input, node_size)
+        self.__check_invalid(original_input, os.path.join(self.TEST_DIR, 'pf_invalid_node_size'))
+
+    def test_502_invalid_integrity_only(self):
+        # same as above, for an integrity-only file (plaintext data nodes and metadata flags can be
+        # corrupted too)
+        plain_input = os.path.join(self.OUTPUT_DIR, 'invalid_integrity_only_input')
+        with open(plain_input, 'wb') as file:
+            file.write(os.urandom(1024 * 1024))
+        original_input = os.path.join(self.OUTPUT_DIR, 'invalid_integrity_only')
+        self.__encrypt_file(plain_input, original_input, integrity_only=True)
+        self.__check_invalid(original_input,
+                             os.path.join(self.TEST_DIR, 'pf_invalid_integrity_only'))
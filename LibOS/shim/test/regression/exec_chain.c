@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test (and a simple benchmark) for a chain of execve calls: the program maps the requested number
+ * of separate memory areas and executes itself again, until the requested number of executions is
+ * reached. Prints the average latency of execve.
+ *
+ * Usage: exec_chain <number of execve calls> <number of memory areas>
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char** argv) {
+    /* the two last arguments are internal: current iteration and start time */
+    if (argc != 3 && argc != 5)
+        errx(1, "usage: %s <number of execve calls> <number of memory areas>", argv[0]);
+
+    unsigned long execs = strtoul(argv[1], NULL, 10);
+    unsigned long areas = strtoul(argv[2], NULL, 10);
+    unsigned long iteration = argc == 5 ? strtoul(argv[3], NULL, 10) : 0;
+    uint64_t start = argc == 5 ? strtoull(argv[4], NULL, 10) : now_us();
+
+    if (iteration == execs) {
+        if (execs)
+            printf("average execve latency: %" PRIu64 " us\n", (now_us() - start) / execs);
+        puts("TEST OK");
+        return 0;
+    }
+
+    /* alternate protections, so that the host does not merge adjacent areas */
+    for (unsigned long i = 0; i < areas; i++) {
+        int prot = (i % 2) ? PROT_READ : PROT_READ | PROT_WRITE;
+        if (mmap(NULL, 4096, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED)
+            err(1, "mmap");
+    }
+
+    char iteration_str[32];
+    char start_str[32];
+    snprintf(iteration_str, sizeof(iteration_str), "%lu", iteration + 1);
+    snprintf(start_str, sizeof(start_str), "%" PRIu64, start);
+
+    char* new_argv[] = { argv[0], argv[1], argv[2], iteration_str, start_str, NULL };
+    execv(argv[0], new_argv);
+    err(1, "execve");
+}
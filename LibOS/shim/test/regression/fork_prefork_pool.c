@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for forking with `libos.prefork_pool_size` set: most of the children are taken from the
+ * prefork pool and must still receive the state of the parent. Also prints the average fork
+ * latency, which can be compared with the same binary run with different pool sizes.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FORK_COUNT 20
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static int g_value;
+
+static void wait_for_child(pid_t pid, int expected_code) {
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != expected_code)
+        errx(1, "child died with status: %#x", status);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+int main(void) {
+    uint64_t total_us = 0;
+
+    for (int i = 0; i < FORK_COUNT; i++) {
+        g_value = i;
+
+        uint64_t start = now_us();
+        pid_t pid = CHECK(fork());
+        if (pid == 0) {
+            if (g_value != i)
+                errx(1, "child %d: wrong value of a global variable: %d", i, g_value);
+            if (i == FORK_COUNT - 1) {
+                /* the last child forks too, this time with its own (not yet filled) pool */
+                pid_t grandchild = CHECK(fork());
+                if (grandchild == 0)
+                    _exit(42);
+                wait_for_child(grandchild, 42);
+            }
+            _exit(i);
+        }
+        total_us += now_us() - start;
+
+        wait_for_child(pid, i);
+
+        /* give the pool some time to refill in background */
+        usleep(100 * 1000);
+    }
+
+    printf("average fork latency: %" PRIu64 " us\n", total_us / FORK_COUNT);
+    puts("TEST OK");
+    return 0;
+}
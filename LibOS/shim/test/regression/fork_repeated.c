@@ -0,0 +1,164 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for repeated forks, which reuse the checkpoint store of the previous fork: the children must
+ * receive the state of the parent also when it grows between forks (so that the checkpoint outgrows
+ * the previous ones), when memory is mapped and unmapped between forks (so that the memory after
+ * the reused store may be taken) and when two threads fork concurrently. Also prints the latency of
+ * the first fork and the average latency of the following ones.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FORK_COUNT        20
+#define GROW_ROUNDS       8
+#define FDS_PER_ROUND     64
+#define THREAD_FORK_COUNT 10
+#define MMAP_ROUNDS       4
+#define MMAP_AREAS        1024
+#define PAGE_SIZE         4096
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static int g_value;
+
+static void wait_for_child(pid_t pid, int expected_code) {
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != expected_code)
+        errx(1, "child died with status: %#x", status);
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &ts));
+    return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+/* forks a child which checks that it sees `value` and `fds_count` open descriptors starting at
+ * `first_fd`; returns the fork latency */
+static uint64_t fork_and_check(int value, int first_fd, int fds_count) {
+    uint64_t start = now_us();
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        if (g_value != value)
+            errx(1, "child: wrong value of a global variable: %d (expected %d)", g_value, value);
+        for (int i = 0; i < fds_count; i++)
+            if (fcntl(first_fd + i, F_GETFD) < 0)
+                errx(1, "child: fd %d was not inherited", first_fd + i);
+        _exit(value % 100);
+    }
+    uint64_t latency = now_us() - start;
+
+    wait_for_child(pid, value % 100);
+    return latency;
+}
+
+/* maps `MMAP_AREAS` separate pages (each one adds an entry to the checkpoint) and forks a child
+ * which checks their contents; the pages are unmapped only after another fork, so that the store
+ * of that fork may be placed elsewhere, and the next one may find the pages after it mapped */
+static void mmap_and_fork(int round, char** areas) {
+    for (int i = 0; i < MMAP_AREAS; i++) {
+        /* alternate protections, so that the areas are not merged */
+        int prot = (i % 2) ? PROT_READ : PROT_READ | PROT_WRITE;
+        areas[i] = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                        0);
+        if (areas[i] == MAP_FAILED)
+            err(1, "mmap");
+        areas[i][0] = (char)(round + i);
+        CHECK(mprotect(areas[i], PAGE_SIZE, prot));
+    }
+
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        for (int i = 0; i < MMAP_AREAS; i++)
+            if (areas[i][0] != (char)(round + i))
+                errx(1, "child: wrong contents of area %d in round %d", i, round);
+        _exit(0);
+    }
+    wait_for_child(pid, 0);
+}
+
+static void* thread_func(void* arg) {
+    for (int i = 0; i < THREAD_FORK_COUNT; i++)
+        fork_and_check(g_value, /*first_fd=*/0, /*fds_count=*/0);
+    return NULL;
+}
+
+int main(void) {
+    g_value = 1;
+    uint64_t first_us = fork_and_check(g_value, /*first_fd=*/0, /*fds_count=*/0);
+    uint64_t next_us = 0;
+    for (int i = 0; i < FORK_COUNT; i++)
+        next_us += fork_and_check(g_value, /*first_fd=*/0, /*fds_count=*/0);
+
+    /* the checkpoint grows with each round, so the store has to be extended */
+    int fd = CHECK(open("/dev/null", O_RDONLY));
+    int first_fd = -1;
+    int fds_count = 0;
+    for (int round = 0; round < GROW_ROUNDS; round++) {
+        for (int i = 0; i < FDS_PER_ROUND; i++) {
+            int new_fd = CHECK(dup(fd));
+            if (first_fd < 0)
+                first_fd = new_fd;
+            if (new_fd != first_fd + fds_count)
+                errx(1, "unexpected fd %d", new_fd);
+            fds_count++;
+        }
+        g_value = round + 2;
+        fork_and_check(g_value, first_fd, fds_count);
+    }
+
+    for (int i = 0; i < fds_count; i++)
+        CHECK(close(first_fd + i));
+    CHECK(close(fd));
+
+    /* memory is mapped and unmapped between forks */
+    static char* areas[2][MMAP_AREAS];
+    for (int round = 0; round < MMAP_ROUNDS; round++) {
+        char** cur = areas[round % 2];
+        char** prev = areas[(round + 1) % 2];
+        mmap_and_fork(round, cur);
+        fork_and_check(g_value, /*first_fd=*/0, /*fds_count=*/0);
+        if (round > 0)
+            for (int i = 0; i < MMAP_AREAS; i++)
+                CHECK(munmap(prev[i], PAGE_SIZE));
+    }
+    for (int i = 0; i < MMAP_AREAS; i++)
+        CHECK(munmap(areas[(MMAP_ROUNDS - 1) % 2][i], PAGE_SIZE));
+
+    /* concurrent forks get different stores */
+    g_value = GROW_ROUNDS + 2;
+    pthread_t threads[2];
+    for (int i = 0; i < 2; i++) {
+        int ret = pthread_create(&threads[i], NULL, thread_func, NULL);
+        if (ret)
+            errx(1, "pthread_create failed: %d", ret);
+    }
+    for (int i = 0; i < 2; i++) {
+        int ret = pthread_join(threads[i], NULL);
+        if (ret)
+            errx(1, "pthread_join failed: %d", ret);
+    }
+
+    printf("fork latency: first %" PRIu64 " us, next %" PRIu64 " us (average of %d)\n", first_us,
+           next_us / FORK_COUNT, FORK_COUNT);
+    puts("TEST OK");
+    return 0;
+}
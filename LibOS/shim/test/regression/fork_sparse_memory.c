@@ -0,0 +1,117 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Checks that a large, barely touched anonymous mapping is correctly migrated to a child process.
+ * Gramine sends only populated non-zero pages during fork, so the child must see the written
+ * pages, zeros in both untouched pages and pages which were written and then zeroed, and must be
+ * able to write anywhere in the mapping.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PAGES_CNT 4096
+
+static size_t g_page_size;
+
+/* every 7th page holds data, every 11th page (not holding data) is written and then zeroed */
+static bool page_has_data(size_t i) {
+    return i % 7 == 3;
+}
+
+static bool page_was_zeroed(size_t i) {
+    return !page_has_data(i) && i % 11 == 5;
+}
+
+static uint32_t page_value(size_t i) {
+    return 0xdead0000 | (uint32_t)i;
+}
+
+static int check_contents(const char* m) {
+    for (size_t i = 0; i < PAGES_CNT; i++) {
+        const uint32_t* page = (const uint32_t*)(m + i * g_page_size);
+        uint32_t expected = page_has_data(i) ? page_value(i) : 0;
+        for (size_t j = 0; j < g_page_size / sizeof(*page); j++) {
+            uint32_t expected_word = (j == 0 || j == g_page_size / sizeof(*page) - 1) ? expected
+                                                                                       : 0;
+            if (page[j] != expected_word) {
+                printf("page %zu word %zu: expected 0x%x, got 0x%x\n", i, j, expected_word,
+                       page[j]);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    g_page_size = getpagesize();
+
+    char* m = mmap(NULL, PAGES_CNT * g_page_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m == MAP_FAILED)
+        err(1, "mmap");
+
+    /* read-only mapping with a single non-zero page, checks sparse sending of unwritable memory */
+    char* ro = mmap(NULL, 16 * g_page_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ro == MAP_FAILED)
+        err(1, "mmap");
+    ro[5 * g_page_size + 1] = 0x42;
+    if (mprotect(ro, 16 * g_page_size, PROT_READ) < 0)
+        err(1, "mprotect");
+
+    for (size_t i = 0; i < PAGES_CNT; i++) {
+        uint32_t* page = (uint32_t*)(m + i * g_page_size);
+        if (page_has_data(i)) {
+            page[0] = page_value(i);
+            page[g_page_size / sizeof(*page) - 1] = page_value(i);
+        } else if (page_was_zeroed(i)) {
+            page[0] = 1;
+            __atomic_store_n(&page[0], 0, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+
+    if (pid == 0) {
+        if (check_contents(m))
+            return 1;
+
+        for (size_t i = 0; i < 16; i++) {
+            char expected = i == 5 ? 0x42 : 0;
+            if (ro[i * g_page_size + 1] != expected) {
+                printf("read-only page %zu: expected 0x%x, got 0x%x\n", i, expected,
+                       ro[i * g_page_size + 1]);
+                return 1;
+            }
+        }
+
+        /* the whole mapping (including pages not sent by the parent) must stay writable */
+        memset(m, 0xff, PAGES_CNT * g_page_size);
+        return 0;
+    }
+
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child died with status: %#x", status);
+
+    /* child's writes must not be visible in parent */
+    if (check_contents(m))
+        return 1;
+
+    puts("TEST OK");
+    return 0;
+}
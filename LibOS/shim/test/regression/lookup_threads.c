@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Concurrent path lookups: several threads repeatedly `stat` and `open` the same existing and
+ * non-existing files, while one more thread keeps listing the directory. Checks that all threads
+ * get consistent results, and prints the achieved lookup rate (useful for comparing lock contention
+ * in the dentry cache, e.g. on a host filesystem with slow lookups).
+ *
+ * Usage: lookup_threads <directory> <number of threads> <iterations per thread>
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FILES_COUNT 16
+#define MAX_THREADS 64
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static const char* g_dir;
+static unsigned long g_iterations;
+static volatile bool g_lookups_done;
+
+static void file_path(char* buf, size_t size, const char* prefix, int i) {
+    snprintf(buf, size, "%s/%s_%d", g_dir, prefix, i);
+}
+
+static void* lookup_thread(void* arg) {
+    (void)arg;
+    char path[256];
+    struct stat st;
+
+    for (unsigned long it = 0; it < g_iterations; it++) {
+        for (int i = 0; i < FILES_COUNT; i++) {
+            file_path(path, sizeof(path), "file", i);
+            CHECK(stat(path, &st));
+            if (!S_ISREG(st.st_mode))
+                errx(1, "%s is not a regular file", path);
+
+            int fd = CHECK(open(path, O_RDONLY));
+            CHECK(close(fd));
+
+            file_path(path, sizeof(path), "missing", i);
+            if (stat(path, &st) != -1 || errno != ENOENT)
+                errx(1, "stat of non-existing %s did not fail with ENOENT", path);
+        }
+    }
+    return NULL;
+}
+
+static void* readdir_thread(void* arg) {
+    (void)arg;
+
+    do {
+        DIR* dir = opendir(g_dir);
+        if (!dir)
+            err(1, "opendir %s", g_dir);
+
+        int count = 0;
+        struct dirent* dent;
+        errno = 0;
+        while ((dent = readdir(dir))) {
+            if (strncmp(dent->d_name, "file_", strlen("file_")) == 0)
+                count++;
+        }
+        if (errno)
+            err(1, "readdir %s", g_dir);
+        closedir(dir);
+
+        if (count != FILES_COUNT)
+            errx(1, "readdir returned %d files, expected %d", count, FILES_COUNT);
+    } while (!__atomic_load_n(&g_lookups_done, __ATOMIC_RELAXED));
+
+    return NULL;
+}
+
+static double time_diff(struct timespec* start, struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 4)
+        errx(1, "usage: %s <directory> <number of threads> <iterations per thread>", argv[0]);
+
+    g_dir = argv[1];
+    int threads_count = atoi(argv[2]);
+    g_iterations = strtoul(argv[3], NULL, 10);
+    if (threads_count <= 0 || threads_count > MAX_THREADS)
+        errx(1, "wrong number of threads: %d", threads_count);
+
+    char path[256];
+    for (int i = 0; i < FILES_COUNT; i++) {
+        file_path(path, sizeof(path), "file", i);
+        int fd = CHECK(open(path, O_CREAT | O_WRONLY, 0600));
+        CHECK(close(fd));
+    }
+
+    pthread_t readdir_tid;
+    if ((errno = pthread_create(&readdir_tid, NULL, readdir_thread, NULL)))
+        err(1, "pthread_create");
+
+    struct timespec start, end;
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    pthread_t tids[MAX_THREADS];
+    for (int i = 0; i < threads_count; i++) {
+        if ((errno = pthread_create(&tids[i], NULL, lookup_thread, NULL)))
+            err(1, "pthread_create");
+    }
+    for (int i = 0; i < threads_count; i++) {
+        if ((errno = pthread_join(tids[i], NULL)))
+            err(1, "pthread_join");
+    }
+
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &end));
+
+    __atomic_store_n(&g_lookups_done, true, __ATOMIC_RELAXED);
+    if ((errno = pthread_join(readdir_tid, NULL)))
+        err(1, "pthread_join");
+
+    /* every iteration does three lookups (two `stat`, one `open`) per file */
+    double lookups = 3.0 * FILES_COUNT * g_iterations * threads_count;
+    printf("%d threads: %.0f lookups/s\n", threads_count, lookups / time_diff(&start, &end));
+
+    for (int i = 0; i < FILES_COUNT; i++) {
+        file_path(path, sizeof(path), "file", i);
+        CHECK(unlink(path));
+    }
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Checks that anonymous MAP_SHARED memory stays shared between parent and child processes: several
+ * children concurrently increment a counter in shared memory, and writes done by the parent after
+ * fork must be visible to the children (and vice versa).
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHILDREN_CNT 4
+#define ITERATIONS   10000
+
+struct shared {
+    uint64_t counter;
+    uint32_t go;
+    uint32_t done[CHILDREN_CNT];
+};
+
+int main(void) {
+    size_t page_size = getpagesize();
+
+    struct shared* shared = mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        err(1, "mmap");
+
+    /* second page is written only by children, to check that whole mapping is shared */
+    char* second_page = (char*)shared + page_size;
+
+    pid_t pids[CHILDREN_CNT];
+    for (size_t i = 0; i < CHILDREN_CNT; i++) {
+        pids[i] = fork();
+        if (pids[i] < 0)
+            err(1, "fork");
+
+        if (pids[i] == 0) {
+            /* wait for the parent to write after fork */
+            while (!__atomic_load_n(&shared->go, __ATOMIC_ACQUIRE))
+                ;
+
+            for (size_t j = 0; j < ITERATIONS; j++)
+                __atomic_add_fetch(&shared->counter, 1, __ATOMIC_RELAXED);
+
+            second_page[i] = (char)(i + 1);
+            __atomic_store_n(&shared->done[i], 1, __ATOMIC_RELEASE);
+            return 0;
+        }
+    }
+
+    __atomic_store_n(&shared->go, 1, __ATOMIC_RELEASE);
+
+    for (size_t i = 0; i < CHILDREN_CNT; i++) {
+        int status = 0;
+        if (waitpid(pids[i], &status, 0) < 0)
+            err(1, "waitpid");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            errx(1, "child died with status: %#x", status);
+    }
+
+    for (size_t i = 0; i < CHILDREN_CNT; i++) {
+        if (__atomic_load_n(&shared->done[i], __ATOMIC_ACQUIRE) != 1)
+            errx(1, "child %zu did not report completion", i);
+        if (second_page[i] != (char)(i + 1))
+            errx(1, "write of child %zu to second page is not visible", i);
+    }
+
+    uint64_t counter = __atomic_load_n(&shared->counter, __ATOMIC_RELAXED);
+    if (counter != CHILDREN_CNT * ITERATIONS)
+        errx(1, "wrong counter value: %lu (expected %u)", counter, CHILDREN_CNT * ITERATIONS);
+
+    /* MADV_DONTNEED does not drop contents of shared memory */
+    if (madvise(shared, 2 * page_size, MADV_DONTNEED) < 0)
+        err(1, "madvise");
+    if (shared->counter != CHILDREN_CNT * ITERATIONS || second_page[0] != 1)
+        errx(1, "shared memory contents lost after MADV_DONTNEED");
+
+    if (munmap(shared, 2 * page_size) < 0)
+        err(1, "munmap");
+
+    puts("TEST OK");
+    return 0;
+}
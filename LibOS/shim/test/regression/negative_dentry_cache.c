@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for caching of failed lookups (`negative_cache_ttl` mount option). The parent looks up
+ * a non-existent file, a child process creates it, and the parent looks it up again: the failed
+ * lookup should still be cached. After the TTL passes, the file should be visible. Files created by
+ * the process itself should always be visible.
+ *
+ * Usage: negative_dentry_cache <directory> <TTL in milliseconds>
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static bool file_exists(const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0)
+        return true;
+    if (errno != ENOENT)
+        err(1, "stat %s", path);
+    return false;
+}
+
+static void create_file(const char* path) {
+    int fd = CHECK(open(path, O_CREAT | O_WRONLY, 0600));
+    CHECK(close(fd));
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3)
+        errx(1, "usage: %s <directory> <TTL in milliseconds>", argv[0]);
+
+    unsigned long ttl_ms = strtoul(argv[2], NULL, 10);
+
+    char path[256];
+    snprintf(path, sizeof(path), "%s/created_by_child", argv[1]);
+    char own_path[256];
+    snprintf(own_path, sizeof(own_path), "%s/created_by_parent", argv[1]);
+    unlink(path);
+    unlink(own_path);
+
+    if (file_exists(path))
+        errx(1, "%s exists before creation", path);
+
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        create_file(path);
+        _exit(0);
+    }
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child died with status: %#x", status);
+
+    puts(file_exists(path) ? "negative lookup not cached" : "negative lookup cached");
+
+    usleep((ttl_ms + 100) * 1000);
+    if (!file_exists(path))
+        errx(1, "%s is not visible after the TTL passed", path);
+    puts("negative lookup expired");
+
+    /* changes done by the process itself are visible immediately */
+    if (file_exists(own_path))
+        errx(1, "%s exists before creation", own_path);
+    create_file(own_path);
+    if (!file_exists(own_path))
+        errx(1, "%s is not visible after creation", own_path);
+    CHECK(unlink(own_path));
+    if (file_exists(own_path))
+        errx(1, "%s is visible after deletion", own_path);
+
+    CHECK(unlink(path));
+    puts("TEST OK");
+    return 0;
+}
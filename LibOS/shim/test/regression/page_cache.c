@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for the page cache (`libos.page_cache_size`): repeated and unaligned reads of a small file,
+ * invalidation on `write` and `ftruncate` through another handle, and sequential reads of a file
+ * larger than the cache (so that pages are evicted). Prints read throughput for both files.
+ *
+ * With `shared_mmap`, checks instead that stores to a writable shared mapping of a cached file are
+ * visible to `read` (this is not supported on SGX).
+ *
+ * Usage: page_cache <directory> <iterations>
+ *        page_cache <directory> shared_mmap
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SMALL_FILE_SIZE 5000
+#define LARGE_FILE_SIZE (256 * 1024)
+#define CHUNK_SIZE      1000
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static char g_buf[LARGE_FILE_SIZE];
+
+static char pattern(size_t pos, char seed) {
+    return (char)(pos * 7 % 251 + seed);
+}
+
+static void create_file(const char* path, size_t size, char seed) {
+    for (size_t i = 0; i < size; i++)
+        g_buf[i] = pattern(i, seed);
+
+    int fd = CHECK(open(path, O_CREAT | O_TRUNC | O_WRONLY, 0600));
+    ssize_t n = CHECK(write(fd, g_buf, size));
+    if ((size_t)n != size)
+        errx(1, "short write to %s", path);
+    CHECK(close(fd));
+}
+
+static void check_pread(int fd, size_t pos, size_t count, size_t expected, char seed) {
+    char buf[CHUNK_SIZE];
+    if (count > sizeof(buf))
+        errx(1, "wrong read size");
+
+    ssize_t n = CHECK(pread(fd, buf, count, pos));
+    if ((size_t)n != expected)
+        errx(1, "pread(%zu, %zu) returned %zd bytes, expected %zu", pos, count, n, expected);
+    for (size_t i = 0; i < expected; i++) {
+        if (buf[i] != pattern(pos + i, seed))
+            errx(1, "wrong data at offset %zu", pos + i);
+    }
+}
+
+/* Reads the whole file sequentially with `read`, returns the time taken in seconds */
+static double read_sequentially(int fd, size_t size, char seed) {
+    struct timespec start, end;
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &start));
+
+    CHECK(lseek(fd, 0, SEEK_SET));
+    size_t pos = 0;
+    while (true) {
+        char buf[CHUNK_SIZE];
+        ssize_t n = CHECK(read(fd, buf, sizeof(buf)));
+        if (n == 0)
+            break;
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != pattern(pos + i, seed))
+                errx(1, "wrong data at offset %zu", pos + i);
+        }
+        pos += n;
+    }
+    if (pos != size)
+        errx(1, "read %zu bytes, expected %zu", pos, size);
+
+    CHECK(clock_gettime(CLOCK_MONOTONIC, &end));
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static void test_small_file(const char* dir, unsigned long iterations) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/small", dir);
+    create_file(path, SMALL_FILE_SIZE, 0);
+
+    int fd = CHECK(open(path, O_RDONLY));
+
+    double time = 0;
+    for (unsigned long i = 0; i < iterations; i++)
+        time += read_sequentially(fd, SMALL_FILE_SIZE, 0);
+    printf("small file: %.0f reads/s\n", iterations / time);
+
+    /* unaligned reads, across a page boundary and at the end of file */
+    check_pread(fd, 4090, 100, 100, 0);
+    check_pread(fd, SMALL_FILE_SIZE - 1, 100, 1, 0);
+    check_pread(fd, SMALL_FILE_SIZE, 100, 0, 0);
+
+    /* writes through another handle have to be visible */
+    int fd_rw = CHECK(open(path, O_RDWR));
+    char data[CHUNK_SIZE];
+    for (size_t i = 0; i < sizeof(data); i++)
+        data[i] = pattern(4000 + i, 1);
+    ssize_t n = CHECK(pwrite(fd_rw, data, sizeof(data), 4000));
+    if (n != sizeof(data))
+        errx(1, "short write to %s", path);
+    check_pread(fd, 4000, CHUNK_SIZE, CHUNK_SIZE, 1);
+    check_pread(fd, 3000, CHUNK_SIZE, CHUNK_SIZE, 0);
+
+    /* ... and so do truncations */
+    CHECK(ftruncate(fd_rw, 3500));
+    check_pread(fd, 3000, CHUNK_SIZE, 500, 0);
+
+    CHECK(close(fd_rw));
+    CHECK(close(fd));
+    CHECK(unlink(path));
+}
+
+static void test_large_file(const char* dir, unsigned long iterations) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/large", dir);
+    create_file(path, LARGE_FILE_SIZE, 2);
+
+    int fd = CHECK(open(path, O_RDONLY));
+
+    double time = 0;
+    for (unsigned long i = 0; i < iterations; i++)
+        time += read_sequentially(fd, LARGE_FILE_SIZE, 2);
+    printf("large file: %.0f reads/s\n", iterations / time);
+
+    CHECK(close(fd));
+    CHECK(unlink(path));
+}
+
+static void test_shared_mmap(const char* dir) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/shared_mmap", dir);
+    create_file(path, SMALL_FILE_SIZE, 0);
+
+    /* read the file, so that its pages are cached */
+    int fd = CHECK(open(path, O_RDONLY));
+    check_pread(fd, 4000, CHUNK_SIZE, CHUNK_SIZE, 0);
+
+    int fd_rw = CHECK(open(path, O_RDWR));
+    char* addr = mmap(NULL, SMALL_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_rw, 0);
+    if (addr == MAP_FAILED)
+        err(1, "mmap");
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+        addr[4000 + i] = pattern(4000 + i, 1);
+
+    /* the stores are visible without `msync`, and stay visible after it */
+    check_pread(fd, 4000, CHUNK_SIZE, CHUNK_SIZE, 1);
+    CHECK(msync(addr, SMALL_FILE_SIZE, MS_ASYNC));
+    check_pread(fd, 3000, CHUNK_SIZE, CHUNK_SIZE, 0);
+    check_pread(fd, 4000, CHUNK_SIZE, CHUNK_SIZE, 1);
+
+    CHECK(munmap(addr, SMALL_FILE_SIZE));
+    CHECK(close(fd_rw));
+    CHECK(close(fd));
+    CHECK(unlink(path));
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3)
+        errx(1, "usage: %s <directory> <iterations>|shared_mmap", argv[0]);
+
+    if (strcmp(argv[2], "shared_mmap") == 0) {
+        test_shared_mmap(argv[1]);
+        puts("TEST OK");
+        return 0;
+    }
+
+    unsigned long iterations = strtoul(argv[2], NULL, 10);
+    if (iterations == 0)
+        errx(1, "wrong number of iterations");
+
+    test_small_file(argv[1], iterations);
+    test_large_file(argv[1], iterations / 10 + 1);
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,96 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Benchmark for `stat` and `open` of files at different path depths. Creates a chain of nested
+ * directories, places a file at several depths, and prints the achieved rate of operations for
+ * each of them.
+ *
+ * Usage: path_depth <directory> <iterations>
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_DEPTH 20
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static const int g_depths[] = {2, 5, 10, 20};
+
+/* Builds "<dir>/d01/d02/.../d<depth>" */
+static void dir_path(char* buf, size_t size, const char* dir, int depth) {
+    size_t pos = snprintf(buf, size, "%s", dir);
+    for (int i = 1; i <= depth && pos < size; i++)
+        pos += snprintf(buf + pos, size - pos, "/d%02d", i);
+    if (pos >= size)
+        errx(1, "path too long");
+}
+
+static double time_diff(struct timespec* start, struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3)
+        errx(1, "usage: %s <directory> <iterations>", argv[0]);
+
+    const char* dir = argv[1];
+    unsigned long iterations = strtoul(argv[2], NULL, 10);
+    if (iterations == 0)
+        errx(1, "wrong number of iterations");
+
+    char path[1024];
+    for (int depth = 1; depth <= MAX_DEPTH; depth++) {
+        dir_path(path, sizeof(path), dir, depth);
+        if (mkdir(path, 0700) == -1 && errno != EEXIST)
+            err(1, "mkdir %s", path);
+    }
+
+    for (size_t i = 0; i < sizeof(g_depths) / sizeof(g_depths[0]); i++) {
+        int depth = g_depths[i];
+        dir_path(path, sizeof(path), dir, depth);
+        strcat(path, "/file");
+
+        int fd = CHECK(open(path, O_CREAT | O_WRONLY, 0600));
+        CHECK(close(fd));
+
+        struct timespec start, end;
+        CHECK(clock_gettime(CLOCK_MONOTONIC, &start));
+        for (unsigned long it = 0; it < iterations; it++) {
+            struct stat st;
+            CHECK(stat(path, &st));
+            if (!S_ISREG(st.st_mode))
+                errx(1, "%s is not a regular file", path);
+
+            fd = CHECK(open(path, O_RDONLY));
+            CHECK(close(fd));
+        }
+        CHECK(clock_gettime(CLOCK_MONOTONIC, &end));
+
+        printf("depth %d: %.0f stat+open/s\n", depth, iterations / time_diff(&start, &end));
+        CHECK(unlink(path));
+    }
+
+    for (int depth = MAX_DEPTH; depth >= 1; depth--) {
+        dir_path(path, sizeof(path), dir, depth);
+        CHECK(rmdir(path));
+    }
+
+    puts("TEST OK");
+    return 0;
+}
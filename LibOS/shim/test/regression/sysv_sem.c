@@ -0,0 +1,189 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for System V semaphores (`semget`, `semop`, `semtimedop`, `semctl`): non-blocking and timed
+ * operations, lock handoff between two processes, `SEM_UNDO` on exit, a user of the set killed
+ * in the middle of its operations and waking up waiters on `IPC_RMID`. At exit, one set is left
+ * not removed; its host file must not outlive the test.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HANDOFF_ITERATIONS 1000
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+union semun {
+    int val;
+    struct semid_ds* buf;
+    unsigned short* array;
+};
+
+static void sem_add(int semid, unsigned short num, short op, short flags) {
+    struct sembuf sop = { .sem_num = num, .sem_op = op, .sem_flg = flags };
+    CHECK(semop(semid, &sop, 1));
+}
+
+static void wait_for_child(pid_t pid) {
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child died with status: %#x", status);
+}
+
+static void test_nonblocking(int semid) {
+    struct sembuf sop = { .sem_num = 0, .sem_op = -1, .sem_flg = IPC_NOWAIT };
+    if (semop(semid, &sop, 1) != -1 || errno != EAGAIN)
+        errx(1, "semop with IPC_NOWAIT did not fail with EAGAIN");
+
+    struct timespec timeout = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+    sop.sem_flg = 0;
+    if (semtimedop(semid, &sop, 1, &timeout) != -1 || errno != EAGAIN)
+        errx(1, "semtimedop did not time out with EAGAIN");
+
+    /* all operations are performed atomically: the second one blocks, so the first is not done */
+    struct sembuf sops[2] = {
+        { .sem_num = 1, .sem_op = -1, .sem_flg = IPC_NOWAIT },
+        { .sem_num = 0, .sem_op = -1, .sem_flg = IPC_NOWAIT },
+    };
+    if (semop(semid, sops, 2) != -1 || errno != EAGAIN)
+        errx(1, "semop of multiple operations did not fail with EAGAIN");
+    if (CHECK(semctl(semid, 1, GETVAL)) != 1)
+        errx(1, "failed semop changed a semaphore value");
+
+    struct sembuf bad = { .sem_num = 2, .sem_op = 1, .sem_flg = 0 };
+    if (semop(semid, &bad, 1) != -1 || errno != EFBIG)
+        errx(1, "semop on out-of-range semaphore did not fail with EFBIG");
+}
+
+/* Parent and child pass the "lock" back and forth: semaphore 0 wakes the child, semaphore 1 wakes
+ * the parent. Every iteration blocks, so this exercises the slow path as well. */
+static void test_handoff(int semid) {
+    sem_add(semid, 1, -1, 0);
+
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        for (int i = 0; i < HANDOFF_ITERATIONS; i++) {
+            sem_add(semid, 0, -1, 0);
+            sem_add(semid, 1, 1, 0);
+        }
+        _exit(0);
+    }
+
+    for (int i = 0; i < HANDOFF_ITERATIONS; i++) {
+        sem_add(semid, 0, 1, 0);
+        sem_add(semid, 1, -1, 0);
+    }
+
+    wait_for_child(pid);
+
+    sem_add(semid, 1, 1, 0);
+    if (CHECK(semctl(semid, 0, GETVAL)) != 0 || CHECK(semctl(semid, 1, GETVAL)) != 1)
+        errx(1, "wrong semaphore values after handoff");
+}
+
+static void test_undo(int semid) {
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        sem_add(semid, 1, -1, SEM_UNDO);
+        sem_add(semid, 0, 2, SEM_UNDO);
+        sem_add(semid, 0, -1, SEM_UNDO);
+        if (semctl(semid, 1, GETVAL) != 0 || semctl(semid, 0, GETVAL) != 1)
+            errx(1, "child: wrong semaphore values");
+        _exit(0);
+    }
+
+    wait_for_child(pid);
+
+    if (CHECK(semctl(semid, 0, GETVAL)) != 0 || CHECK(semctl(semid, 1, GETVAL)) != 1)
+        errx(1, "SEM_UNDO adjustments were not applied on exit");
+}
+
+/* A child keeps operating on the set until it is killed; the set must stay usable afterwards. */
+static void test_killed_user(int semid) {
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        while (1) {
+            sem_add(semid, 0, 1, 0);
+            sem_add(semid, 0, -1, 0);
+        }
+    }
+
+    usleep(50 * 1000);
+    CHECK(kill(pid, SIGKILL));
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGKILL)
+        errx(1, "child was not killed: %#x", status);
+
+    CHECK(semctl(semid, 0, SETVAL, (union semun){ .val = 0 }));
+    sem_add(semid, 0, 1, IPC_NOWAIT);
+    sem_add(semid, 0, -1, IPC_NOWAIT);
+    if (CHECK(semctl(semid, 0, GETVAL)) != 0 || CHECK(semctl(semid, 1, GETVAL)) != 1)
+        errx(1, "wrong semaphore values after the child was killed");
+}
+
+static void test_rmid(int semid) {
+    pid_t pid = CHECK(fork());
+    if (pid == 0) {
+        struct sembuf sop = { .sem_num = 0, .sem_op = -1, .sem_flg = 0 };
+        if (semop(semid, &sop, 1) != -1 || errno != EIDRM)
+            errx(1, "child: blocked semop did not fail with EIDRM");
+        _exit(0);
+    }
+
+    /* wait until the child blocks */
+    while (CHECK(semctl(semid, 0, GETNCNT)) != 1)
+        usleep(1000);
+
+    CHECK(semctl(semid, 0, IPC_RMID));
+    wait_for_child(pid);
+
+    if (semctl(semid, 0, GETVAL) != -1 || errno != EINVAL)
+        errx(1, "removed semaphore set still exists");
+}
+
+int main(void) {
+    int semid = CHECK(semget(IPC_PRIVATE, 2, IPC_CREAT | 0600));
+
+    unsigned short values[2] = { 0, 1 };
+    CHECK(semctl(semid, 0, SETALL, (union semun){ .array = values }));
+    values[0] = values[1] = 42;
+    CHECK(semctl(semid, 0, GETALL, (union semun){ .array = values }));
+    if (values[0] != 0 || values[1] != 1)
+        errx(1, "GETALL returned wrong values: %u %u", values[0], values[1]);
+
+    struct semid_ds ds;
+    CHECK(semctl(semid, 0, IPC_STAT, (union semun){ .buf = &ds }));
+    if (ds.sem_nsems != 2)
+        errx(1, "IPC_STAT returned wrong number of semaphores: %lu", ds.sem_nsems);
+
+    test_nonblocking(semid);
+    test_handoff(semid);
+    test_undo(semid);
+    test_killed_user(semid);
+    test_rmid(semid);
+
+    /* a set which is never removed; its host object must be deleted on our exit */
+    CHECK(semget(IPC_PRIVATE, 1, IPC_CREAT | 0600));
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,132 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test for System V shared memory (`shmget`, `shmat`, `shmdt`, `shmctl`). The parent creates and
+ * attaches a segment, the child uses the inherited attach and also attaches the segment again by
+ * key; writes done by one process must be visible to the other. At exit, one segment is left not
+ * removed; its host file must not outlive the test.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHM_KEY  0x6772616d
+#define SHM_SIZE (3 * 4096 + 100)
+
+#define CHECK(x) ({                             \
+    __typeof__(x) _x = (x);                     \
+    if (_x == -1) {                             \
+        err(1, "error at line %d", __LINE__);   \
+    }                                           \
+    _x;                                         \
+})
+
+static size_t get_nattch(int shmid) {
+    struct shmid_ds ds;
+    CHECK(shmctl(shmid, IPC_STAT, &ds));
+    if (ds.shm_segsz != SHM_SIZE)
+        errx(1, "wrong segment size: %zu", ds.shm_segsz);
+    return ds.shm_nattch;
+}
+
+static int child(int shmid, char* inherited) {
+    if (inherited[0] != 'P' || inherited[SHM_SIZE - 1] != 'p')
+        errx(1, "child: parent's writes are not visible in the inherited attach");
+
+    int shmid2 = CHECK(shmget(SHM_KEY, 0, 0));
+    if (shmid2 != shmid)
+        errx(1, "child: shmget returned a different segment: %d (expected %d)", shmid2, shmid);
+
+    char* addr = shmat(shmid, NULL, 0);
+    if (addr == (void*)-1)
+        err(1, "child: shmat");
+    if (addr == inherited)
+        errx(1, "child: shmat returned an already attached address");
+
+    if (get_nattch(shmid) != 3)
+        errx(1, "child: wrong number of attaches");
+
+    if (addr[0] != 'P')
+        errx(1, "child: parent's writes are not visible in the new attach");
+
+    /* write through one attach, check through the other */
+    addr[1] = 'C';
+    if (inherited[1] != 'C')
+        errx(1, "child: writes are not visible in the other attach of the same process");
+
+    CHECK(shmdt(addr));
+    return 0;
+}
+
+int main(void) {
+    int shmid = CHECK(shmget(SHM_KEY, SHM_SIZE, IPC_CREAT | IPC_EXCL | 0600));
+
+    if (shmget(SHM_KEY, SHM_SIZE, IPC_CREAT | IPC_EXCL | 0600) != -1 || errno != EEXIST)
+        errx(1, "shmget with IPC_EXCL of an existing key did not fail with EEXIST");
+    if (shmget(SHM_KEY, SHM_SIZE + 4096, 0) != -1 || errno != EINVAL)
+        errx(1, "shmget with too large size did not fail with EINVAL");
+
+    char* addr = shmat(shmid, NULL, 0);
+    if (addr == (void*)-1)
+        err(1, "shmat");
+
+    /* new segments are zero-filled */
+    for (size_t i = 0; i < SHM_SIZE; i++)
+        if (addr[i] != 0)
+            errx(1, "new segment is not zeroed at offset %zu", i);
+
+    addr[0] = 'P';
+    addr[SHM_SIZE - 1] = 'p';
+
+    if (get_nattch(shmid) != 1)
+        errx(1, "wrong number of attaches after shmat");
+
+    pid_t pid = CHECK(fork());
+    if (pid == 0)
+        return child(shmid, addr);
+
+    int status = 0;
+    CHECK(waitpid(pid, &status, 0));
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child died with status: %#x", status);
+
+    if (addr[1] != 'C')
+        errx(1, "child's write is not visible in the parent");
+
+    /* the child detached (or exited), only our attach is left */
+    if (get_nattch(shmid) != 1)
+        errx(1, "wrong number of attaches after child exit");
+
+    /* the segment stays usable until the last detach, but cannot be found by key anymore */
+    CHECK(shmctl(shmid, IPC_RMID, NULL));
+    if (shmget(SHM_KEY, 0, 0) != -1 || errno != ENOENT)
+        errx(1, "removed segment can still be found by key");
+    addr[2] = 'R';
+    if (addr[0] != 'P' || addr[2] != 'R')
+        errx(1, "removed segment lost its contents");
+
+    CHECK(shmdt(addr));
+    if (shmdt(addr) != -1 || errno != EINVAL)
+        errx(1, "second shmdt did not fail with EINVAL");
+
+    /* the segment was destroyed on the last detach */
+    if (shmctl(shmid, IPC_STAT, &(struct shmid_ds){0}) != -1 || errno != EINVAL)
+        errx(1, "segment still exists after IPC_RMID and the last detach");
+
+    /* a segment which is never removed; its host object must be deleted on our exit */
+    int leaked_shmid = CHECK(shmget(IPC_PRIVATE, SHM_SIZE, IPC_CREAT | 0600));
+    char* leaked_addr = shmat(leaked_shmid, NULL, 0);
+    if (leaked_addr == (void*)-1)
+        err(1, "shmat");
+    leaked_addr[0] = 'L';
+
+    puts("TEST OK");
+    return 0;
+}
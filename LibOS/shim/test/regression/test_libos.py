@@ -206,6 +206,23 @@ class TC_01_Bootstrap(RegressionTestCase):
         self.assertIn('TEST OK', stdout)
         self.assertNotIn('grandchild', stderr)
 
+    def test_206_fork_prefork_pool(self):
+        stdout, _ = self.run_binary(['fork_prefork_pool'], timeout=60)
+        self.assertIn('TEST OK', stdout)
+
+    def test_207_exec_chain(self):
+        # few memory areas, many executions
+        stdout, _ = self.run_binary(['exec_chain', '100', '10'], timeout=120)
+        self.assertIn('TEST OK', stdout)
+
+        # many memory areas, few executions
+        stdout, _ = self.run_binary(['exec_chain', '10', '2000'], timeout=120)
+        self.assertIn('TEST OK', stdout)
+
+    def test_208_fork_repeated(self):
+        stdout, _ = self.run_binary(['fork_repeated'], timeout=120)
+        self.assertIn('TEST OK', stdout)
+
     def test_210_exec_invalid_args(self):
         stdout, _ = self.run_binary(['exec_invalid_args'])
 
@@ -711,6 +728,16 @@ class TC_30_Syscall(RegressionTestCase):
         stdout, _ = self.run_binary(['madvise'])
         self.assertIn('TEST OK', stdout)
 
+    def test_058_fork_sparse_memory(self):
+        stdout, _ = self.run_binary(['fork_sparse_memory'])
+        self.assertIn('TEST OK', stdout)
+
+    @unittest.skipIf(HAS_SGX,
+        'Shared anonymous memory is not shared between processes on SGX')
+    def test_059_mmap_shared_anon(self):
+        stdout, _ = self.run_binary(['mmap_shared_anon'])
+        self.assertIn('TEST OK', stdout)
+
     @unittest.skip('sigaltstack isn\'t correctly implemented')
     def test_060_sigaltstack(self):
         stdout, _ = self.run_binary(['sigaltstack'])
@@ -807,6 +834,24 @@ class TC_30_Syscall(RegressionTestCase):
                 os.remove('tmp/lock_file')
         self.assertIn('TEST OK', stdout)
 
+    @staticmethod
+    def sysv_host_objects(kind):
+        # named host objects of System V IPC, see `shim_sysv.h`
+        return {name for name in os.listdir('/dev/shm') if '.sysv_%s.' % kind in name}
+
+    @unittest.skipIf(HAS_SGX, 'System V shared memory is not supported on SGX')
+    def test_120_sysv_shm(self):
+        objects_before = self.sysv_host_objects('shm')
+        stdout, _ = self.run_binary(['sysv_shm'])
+        self.assertIn('TEST OK', stdout)
+        self.assertEqual(self.sysv_host_objects('shm') - objects_before, set())
+
+    def test_121_sysv_sem(self):
+        objects_before = self.sysv_host_objects('sem')
+        stdout, _ = self.run_binary(['sysv_sem'])
+        self.assertIn('TEST OK', stdout)
+        self.assertEqual(self.sysv_host_objects('sem') - objects_before, set())
+
 class TC_31_Syscall(RegressionTestCase):
     def test_000_syscall_redirect(self):
         stdout, _ = self.run_binary(['syscall'])
@@ -896,6 +941,36 @@ class TC_40_FileSystem(RegressionTestCase):
         stdout, _ = self.run_binary(['fdleak'], timeout=10)
         self.assertIn("Test succeeded.", stdout)
 
+    def test_031_negative_dentry_cache(self):
+        os.makedirs('tmp/negative_cache', exist_ok=True)
+        stdout, _ = self.run_binary(['negative_dentry_cache', '/mnt/negative_cache', '1000'])
+        self.assertIn('negative lookup cached', stdout)
+        self.assertIn('negative lookup expired', stdout)
+        self.assertIn('TEST OK', stdout)
+
+    def test_032_lookup_threads(self):
+        os.makedirs('tmp/lookup_threads', exist_ok=True)
+        stdout, _ = self.run_binary(['lookup_threads', 'tmp/lookup_threads', '8', '100'],
+                                    timeout=60)
+        self.assertIn('TEST OK', stdout)
+
+    def test_033_page_cache(self):
+        os.makedirs('tmp/page_cache', exist_ok=True)
+        stdout, _ = self.run_binary(['page_cache', '/mnt/page_cache', '1000'], timeout=60)
+        self.assertIn('TEST OK', stdout)
+
+    def test_034_path_depth(self):
+        os.makedirs('tmp/path_depth', exist_ok=True)
+        stdout, _ = self.run_binary(['path_depth', 'tmp/path_depth', '1000'], timeout=60)
+        self.assertIn('depth 20:', stdout)
+        self.assertIn('TEST OK', stdout)
+
+    @unittest.skipIf(HAS_SGX, 'Writable shared file mappings are not supported on SGX')
+    def test_035_page_cache_shared_mmap(self):
+        os.makedirs('tmp/page_cache', exist_ok=True)
+        stdout, _ = self.run_binary(['page_cache', '/mnt/page_cache', 'shared_mmap'])
+        self.assertIn('TEST OK', stdout)
+
     def get_cache_levels_cnt(self):
         cpu0 = '/sys/devices/system/cpu/cpu0/'
         self.assertTrue(os.path.exists(f'{cpu0}/cache/'))
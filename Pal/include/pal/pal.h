@@ -74,6 +74,7 @@ enum {
     PAL_TYPE_THREAD,
     PAL_TYPE_EVENT,
     PAL_TYPE_EVENTFD,
+    PAL_TYPE_SHM,
     PAL_HANDLE_TYPE_BOUND,
 };
 
@@ -190,6 +191,21 @@ int DkVirtualMemoryFree(void* addr, PAL_NUM size);
  */
 int DkVirtualMemoryProtect(void* addr, PAL_NUM size, pal_prot_flags_t prot);
 
+/*!
+ * \brief Query which pages of a previously allocated memory mapping were ever populated.
+ *
+ * \param      addr  The address.
+ * \param      size  The size.
+ * \param[out] vec   Array of `size / alloc_align` bytes. On success, each byte is set to 1 if the
+ *                   corresponding page may contain non-zero data and to 0 if the page was never
+ *                   touched (and thus reads as zeros).
+ *
+ * Both `addr` and `size` must be non-zero and aligned at the allocation alignment. The result is
+ * only valid for anonymous (not file-backed) private memory. PALs that cannot distinguish
+ * untouched pages return #PAL_ERROR_NOTIMPLEMENTED; callers must then treat all pages as populated.
+ */
+int DkVirtualMemoryQueryPopulated(void* addr, PAL_NUM size, uint8_t* vec);
+
 /*
  * PROCESS CREATION
  */
@@ -205,6 +205,7 @@ int _DkVirtualMemoryAlloc(void** addr_ptr, uint64_t size, pal_alloc_flags_t allo
                           pal_prot_flags_t prot);
 int _DkVirtualMemoryFree(void* addr, uint64_t size);
 int _DkVirtualMemoryProtect(void* addr, uint64_t size, pal_prot_flags_t prot);
+int _DkVirtualMemoryQueryPopulated(void* addr, uint64_t size, uint8_t* vec);
 
 /* DkObject calls */
 int _DkObjectClose(PAL_HANDLE object_handle);
@@ -0,0 +1,169 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Size classes and slot/size limits of `struct buf_pool`. A trace of large OCALL buffers is then
+ * replayed through a per-thread and a shared pool, configured as in Linux-SGX PAL: they must not
+ * need more mmap/munmap OCALLs than the single cached buffer per thread that they replaced.
+ *
+ * `buf_pool_test benchmark` also prints both OCALL counts.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "buf_pool.h"
+#include "pal.h"
+#include "pal_regression.h"
+
+#define KIB(x) ((x) * 1024UL)
+#define MIB(x) ((x) * 1024UL * 1024UL)
+
+static void test_classes(void) {
+    static const struct {
+        size_t size;
+        int cls;
+    } cases[] = {
+        {0, 0}, {1, 0}, {KIB(64), 0}, {KIB(64) + 1, 1}, {KIB(516), 4}, {MIB(1), 4}, {MIB(16), 8},
+        {MIB(16) + 1, -1}, {MIB(100), -1},
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+        int cls = buf_pool_class(cases[i].size);
+        if (cls != cases[i].cls)
+            FAIL("Size %lu got class %d instead of %d", cases[i].size, cls, cases[i].cls);
+        if (cls >= 0 && buf_pool_class_size(cls) < cases[i].size)
+            FAIL("Class %d is too small for size %lu", cls, cases[i].size);
+    }
+}
+
+static void test_pool(void) {
+    struct buf_pool pool = {0};
+    if (buf_pool_put(&pool, 0, (void*)0x1000))
+        FAIL("Zero-initialized pool accepted a buffer");
+
+    buf_pool_init(&pool, /*slots=*/2, /*max_size=*/MIB(1) + KIB(128));
+
+    if (!buf_pool_put(&pool, 0, (void*)0x1000) || !buf_pool_put(&pool, 0, (void*)0x2000))
+        FAIL("Pool did not accept buffers");
+    if (buf_pool_put(&pool, 0, (void*)0x3000))
+        FAIL("Pool accepted more buffers than slots");
+    if (!buf_pool_put(&pool, 4, (void*)0x4000))
+        FAIL("Pool did not accept a buffer of another class");
+    if (buf_pool_put(&pool, 1, (void*)0x5000))
+        FAIL("Pool accepted buffers over its size limit");
+    if (pool.size != MIB(1) + KIB(128))
+        FAIL("Wrong pool size: %lu", pool.size);
+
+    if (buf_pool_get(&pool, 1))
+        FAIL("Pool returned a buffer of an empty class");
+    if (buf_pool_get(&pool, 0) != (void*)0x2000 || buf_pool_get(&pool, 0) != (void*)0x1000)
+        FAIL("Pool returned wrong buffers");
+    if (buf_pool_get(&pool, 0))
+        FAIL("Pool returned a buffer from an emptied class");
+    if (buf_pool_get(&pool, 4) != (void*)0x4000)
+        FAIL("Pool returned wrong buffer");
+    if (pool.size != 0)
+        FAIL("Wrong pool size: %lu", pool.size);
+}
+
+/*
+ * Trace of buffer sizes of OCALLs that don't fit on the untrusted stack (> 512KiB), shaped like
+ * a server that reads files in chunks of various sizes and sends them over sockets. `nested` marks
+ * OCALLs issued while the previous buffer is still in use (e.g. from a signal handler).
+ */
+static const struct {
+    size_t size;
+    bool nested;
+} g_trace[] = {
+    {MIB(1), false},      {MIB(1), false},      {KIB(600), false},    {MIB(2), false},
+    {MIB(1), false},      {KIB(800), true},     {MIB(4), false},      {MIB(1), false},
+    {KIB(520), false},    {MIB(2), false},      {MIB(1) + 1, false},  {MIB(1), true},
+    {MIB(8), false},      {MIB(1), false},      {MIB(32), false},     {MIB(2), false},
+    {KIB(700), false},    {MIB(1), false},      {MIB(4), true},       {MIB(1), false},
+};
+#define TRACE_ROUNDS 100
+
+struct sim {
+    struct buf_pool thread_pool;
+    struct buf_pool shared_pool;
+    size_t ocalls;
+    uintptr_t next_addr;
+};
+
+static void* sim_get(struct sim* sim, size_t size) {
+    int cls = buf_pool_class(size);
+    void* buf = NULL;
+    if (cls >= 0) {
+        buf = buf_pool_get(&sim->thread_pool, cls);
+        if (!buf)
+            buf = buf_pool_get(&sim->shared_pool, cls);
+    }
+    if (!buf) {
+        sim->ocalls++; /* mmap */
+        buf = (void*)sim->next_addr;
+        sim->next_addr += cls >= 0 ? buf_pool_class_size(cls) : size;
+    }
+    return buf;
+}
+
+static void sim_put(struct sim* sim, size_t size, void* buf) {
+    int cls = buf_pool_class(size);
+    if (cls >= 0 && (buf_pool_put(&sim->thread_pool, cls, buf)
+                     || buf_pool_put(&sim->shared_pool, cls, buf)))
+        return;
+    sim->ocalls++; /* munmap */
+}
+
+static void test_trace(bool print_stats) {
+    struct sim sim = {.next_addr = 0x10000000};
+    /* same limits as in Linux-SGX PAL */
+    buf_pool_init(&sim.thread_pool, /*slots=*/2, /*max_size=*/MIB(16));
+    buf_pool_init(&sim.shared_pool, /*slots=*/8, /*max_size=*/MIB(64));
+
+    /* single cached buffer per thread, as used before */
+    size_t single_ocalls = 0;
+    size_t single_size = 0;
+
+    size_t total = 0;
+    for (size_t round = 0; round < TRACE_ROUNDS; round++) {
+        for (size_t i = 0; i < ARRAY_SIZE(g_trace); i++) {
+            size_t size = ALIGN_UP(g_trace[i].size, KIB(4));
+            void* buf = sim_get(&sim, size);
+            total++;
+            if (size > single_size) {
+                single_ocalls += single_size ? 2 : 1; /* munmap of the old buffer + mmap */
+                single_size = size;
+            }
+
+            if (i + 1 < ARRAY_SIZE(g_trace) && g_trace[i + 1].nested) {
+                size_t nested_size = ALIGN_UP(g_trace[i + 1].size, KIB(4));
+                void* nested_buf = sim_get(&sim, nested_size);
+                if (nested_buf == buf)
+                    FAIL("The same buffer was returned twice");
+                sim_put(&sim, nested_size, nested_buf);
+                total++;
+                single_ocalls += 2; /* the cache is in use, explicit mmap + munmap */
+                i++;
+            }
+
+            sim_put(&sim, size, buf);
+        }
+    }
+
+    if (print_stats)
+        pal_printf("OCALL buffer trace: %lu buffers, %lu mmap/munmap OCALLs with pools, %lu with a "
+                   "single cached buffer\n", total, sim.ocalls, single_ocalls);
+    if (sim.ocalls > single_ocalls)
+        FAIL("Pools needed more OCALLs than a single cached buffer");
+}
+
+int main(int argc, char** argv) {
+    test_classes();
+    test_pool();
+    test_trace(/*print_stats=*/argc > 1 && !strcmp(argv[1], "benchmark"));
+
+    pal_printf("TEST OK\n");
+    return 0;
+}
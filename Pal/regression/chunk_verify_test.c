@@ -0,0 +1,238 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * `chunked_file_copy_and_verify()` on aligned, unaligned, partial and empty ranges of a file whose
+ * last chunk is shorter, and on files with a modified chunk. Chunks are hashed the same way as
+ * trusted files in Linux-SGX PAL, so the test is built only for that PAL (where mbedTLS is
+ * available).
+ *
+ * `chunk_verify_test benchmark` also measures copying a large file in one go and in small unaligned
+ * reads.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "chunk_verify.h"
+#include "mbedtls/sha256.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+
+#define TEST_CHUNK_SIZE 4096UL
+#define TEST_FILE_SIZE  (10 * TEST_CHUNK_SIZE + 100) /* the last chunk is partial */
+#define CANARY          0xcc
+
+#define BENCH_CHUNK_SIZE (16 * 1024UL) /* same as TRUSTED_CHUNK_SIZE in Linux-SGX PAL */
+#define BENCH_FILE_SIZE  (16 * 1024 * 1024UL)
+#define BENCH_READ_SIZE  4000UL
+
+/* SHA-256 from mbedTLS, truncated to 128 bits, as in Linux-SGX PAL (see `lib_SHA256Init()` etc.);
+ * also counts hashed bytes to check that every chunk is hashed exactly once */
+struct test_hash_ctx {
+    mbedtls_sha256_context sha;
+    uint64_t hashed;
+};
+
+static uint64_t g_total_hashed;
+
+static int test_hash_init(void* _ctx) {
+    struct test_hash_ctx* ctx = _ctx;
+    mbedtls_sha256_init(&ctx->sha);
+    mbedtls_sha256_starts(&ctx->sha, /*is224=*/0);
+    ctx->hashed = 0;
+    return 0;
+}
+
+static int test_hash_update(void* _ctx, const void* data, size_t size) {
+    struct test_hash_ctx* ctx = _ctx;
+    mbedtls_sha256_update(&ctx->sha, data, size);
+    ctx->hashed += size;
+    return 0;
+}
+
+static int test_hash_final(void* _ctx, uint8_t hash[CHUNK_HASH_SIZE]) {
+    struct test_hash_ctx* ctx = _ctx;
+    g_total_hashed += ctx->hashed;
+
+    uint8_t sha256[32];
+    mbedtls_sha256_finish(&ctx->sha, sha256);
+    mbedtls_sha256_free(&ctx->sha);
+    memcpy(hash, sha256, CHUNK_HASH_SIZE);
+    return 0;
+}
+
+static const struct chunk_hash_ops g_test_hash_ops = {
+    .init   = test_hash_init,
+    .update = test_hash_update,
+    .final  = test_hash_final,
+};
+
+static void* alloc(size_t size) {
+    void* addr = NULL;
+    if (DkVirtualMemoryAlloc(&addr, ALIGN_UP(size, 4096), /*alloc_type=*/0,
+                             PAL_PROT_READ | PAL_PROT_WRITE) < 0)
+        FAIL("DkVirtualMemoryAlloc failed");
+    return addr;
+}
+
+static void init_file(struct chunked_file* file, uint8_t* umem, uint64_t size, size_t chunk_size,
+                      uint8_t* chunk_hashes) {
+    for (uint64_t i = 0; i < size; i++)
+        umem[i] = test_rand();
+
+    file->umem         = umem;
+    file->size         = size;
+    file->chunk_size   = chunk_size;
+    file->chunk_hashes = chunk_hashes;
+    file->hash_ops     = &g_test_hash_ops;
+
+    struct test_hash_ctx ctx;
+    for (uint64_t offset = 0; offset < size; offset += chunk_size) {
+        test_hash_init(&ctx);
+        test_hash_update(&ctx, umem + offset, MIN(size - offset, chunk_size));
+        test_hash_final(&ctx, chunk_hashes + offset / chunk_size * CHUNK_HASH_SIZE);
+    }
+}
+
+static struct chunked_file g_file;
+static uint8_t g_umem[TEST_FILE_SIZE];
+static uint8_t g_chunk_hashes[UDIV_ROUND_UP(TEST_FILE_SIZE, TEST_CHUNK_SIZE) * CHUNK_HASH_SIZE];
+static uint8_t g_buf[TEST_FILE_SIZE + 1];
+
+static int copy(uint64_t offset, uint64_t end, uint64_t* out_bad_chunk) {
+    struct test_hash_ctx ctx;
+    memset(g_buf, CANARY, sizeof(g_buf));
+    int ret = chunked_file_copy_and_verify(&g_file, &ctx, g_buf, offset, end, out_bad_chunk);
+    if (g_buf[end - offset] != CANARY)
+        FAIL("Copying [%lu, %lu) wrote past the end of the buffer", offset, end);
+    return ret;
+}
+
+static void check_copy(uint64_t offset, uint64_t end) {
+    uint64_t bad_chunk;
+    g_total_hashed = 0;
+    int ret = copy(offset, end, &bad_chunk);
+    if (ret < 0)
+        FAIL("Copying [%lu, %lu) failed: %d", offset, end, ret);
+    if (memcmp(g_buf, g_umem + offset, end - offset))
+        FAIL("Copying [%lu, %lu) returned wrong data", offset, end);
+
+    uint64_t hashed = 0;
+    if (offset < end)
+        hashed = MIN(ALIGN_UP(end, TEST_CHUNK_SIZE), TEST_FILE_SIZE)
+                 - ALIGN_DOWN(offset, TEST_CHUNK_SIZE);
+    if (g_total_hashed != hashed)
+        FAIL("Copying [%lu, %lu) hashed %lu bytes instead of %lu", offset, end, g_total_hashed,
+             hashed);
+}
+
+static void check_bad_copy(uint64_t offset, uint64_t end, uint64_t expected_bad_chunk) {
+    uint64_t bad_chunk;
+    int ret = copy(offset, end, &bad_chunk);
+    if (ret != -PAL_ERROR_DENIED)
+        FAIL("Copying [%lu, %lu) of a modified file returned %d", offset, end, ret);
+    if (bad_chunk != expected_bad_chunk)
+        FAIL("Copying [%lu, %lu) reported bad chunk at %lu instead of %lu", offset, end,
+             bad_chunk, expected_bad_chunk);
+    for (uint64_t i = 0; i < end - offset; i++)
+        if (g_buf[i])
+            FAIL("Copying [%lu, %lu) of a modified file did not zero the buffer", offset, end);
+}
+
+static void test_ranges(void) {
+    init_file(&g_file, g_umem, TEST_FILE_SIZE, TEST_CHUNK_SIZE, g_chunk_hashes);
+
+    uint64_t c = TEST_CHUNK_SIZE;
+    check_copy(0, TEST_FILE_SIZE);
+    check_copy(0, 0);
+    check_copy(c, 3 * c);           /* aligned */
+    check_copy(c + 1, 3 * c - 1);   /* unaligned at both ends */
+    check_copy(c + 10, c + 20);     /* within one chunk */
+    check_copy(c - 1, c + 1);       /* across a chunk boundary */
+    check_copy(2 * c, 2 * c + 1);   /* first byte of a chunk */
+    check_copy(3 * c - 1, 3 * c);   /* last byte of a chunk */
+    check_copy(5 * c + 7, TEST_FILE_SIZE);
+    check_copy(10 * c, TEST_FILE_SIZE);      /* only the partial last chunk */
+    check_copy(10 * c + 50, 10 * c + 60);    /* inside the partial last chunk */
+    check_copy(TEST_FILE_SIZE, TEST_FILE_SIZE);
+
+    for (size_t i = 0; i < 1000; i++) {
+        uint64_t offset = test_rand() % TEST_FILE_SIZE;
+        uint64_t end = offset + test_rand() % (TEST_FILE_SIZE - offset + 1);
+        check_copy(offset, end);
+    }
+}
+
+static void test_modified(void) {
+    uint64_t c = TEST_CHUNK_SIZE;
+
+    /* modify a byte of chunk 3 that lies outside of requested ranges below */
+    g_umem[3 * c + 100]++;
+
+    check_bad_copy(3 * c + 200, 3 * c + 300, 3 * c);
+    check_bad_copy(c, 4 * c, 3 * c);
+    check_bad_copy(3 * c + 50, 5 * c, 3 * c);
+    check_copy(c, 3 * c);
+    check_copy(4 * c, TEST_FILE_SIZE);
+
+    g_umem[3 * c + 100]--;
+    check_copy(0, TEST_FILE_SIZE);
+
+    /* modify the partial last chunk */
+    g_umem[TEST_FILE_SIZE - 1]++;
+    check_bad_copy(10 * c, 10 * c + 1, 10 * c);
+    g_umem[TEST_FILE_SIZE - 1]--;
+}
+
+static void benchmark_throughput(void) {
+    struct chunked_file file;
+    uint8_t* umem = alloc(BENCH_FILE_SIZE);
+    uint8_t* buf = alloc(BENCH_FILE_SIZE);
+    uint8_t* chunk_hashes = alloc(BENCH_FILE_SIZE / BENCH_CHUNK_SIZE * CHUNK_HASH_SIZE);
+    init_file(&file, umem, BENCH_FILE_SIZE, BENCH_CHUNK_SIZE, chunk_hashes);
+
+    struct test_hash_ctx ctx;
+    uint64_t bad_chunk;
+    uint64_t start_time, mid_time, end_time;
+    if (DkSystemTimeQuery(&start_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+
+    if (chunked_file_copy_and_verify(&file, &ctx, buf, 0, BENCH_FILE_SIZE, &bad_chunk) < 0)
+        FAIL("Benchmark copy failed");
+
+    if (DkSystemTimeQuery(&mid_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+
+    size_t reads = 0;
+    for (uint64_t offset = 0; offset + BENCH_READ_SIZE <= BENCH_FILE_SIZE;
+            offset += BENCH_READ_SIZE, reads++) {
+        if (chunked_file_copy_and_verify(&file, &ctx, buf + offset, offset,
+                                         offset + BENCH_READ_SIZE, &bad_chunk) < 0)
+            FAIL("Benchmark read failed");
+    }
+
+    if (DkSystemTimeQuery(&end_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+
+    if (memcmp(buf, umem, reads * BENCH_READ_SIZE))
+        FAIL("Benchmark copied wrong data");
+
+    pal_printf("Chunk verification benchmark: %lu MiB in one copy took %lu us, in %lu unaligned "
+               "reads of %lu bytes took %lu us\n", BENCH_FILE_SIZE / 1024 / 1024,
+               mid_time - start_time, reads, BENCH_READ_SIZE, end_time - mid_time);
+}
+
+int main(int argc, char** argv) {
+    test_srand(1337);
+
+    test_ranges();
+    test_modified();
+    if (argc > 1 && !strcmp(argv[1], "benchmark"))
+        benchmark_throughput();
+
+    pal_printf("TEST OK\n");
+    return 0;
+}
@@ -0,0 +1,248 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Random lookups and insertions into `struct cpuid_cache` (the CPUID results cache of Linux-SGX PAL)
+ * are mirrored in a plain array of entries and the two must always agree; the cache also sees
+ * failing allocations while growing.
+ *
+ * `cpuid_cache_test benchmark` compares lookup times with a linear search in a fixed table.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "cpuid_cache.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+
+#define MAX_ENTRIES 512
+#define TEST_OPS    0x4000
+
+/* the cache never needs more than two tables at once (when growing), each at most 4 * MAX_ENTRIES
+ * entries */
+static struct cpuid_cache_entry g_tables[2][4 * MAX_ENTRIES];
+static bool g_table_used[2];
+static bool g_fail_alloc;
+
+static void* alloc_mem(size_t size) {
+    if (g_fail_alloc || size > sizeof(g_tables[0]))
+        return NULL;
+    for (size_t i = 0; i < ARRAY_SIZE(g_tables); i++) {
+        if (!g_table_used[i]) {
+            g_table_used[i] = true;
+            /* the cache must not rely on the memory being zeroed */
+            memset(g_tables[i], 0xcc, size);
+            return g_tables[i];
+        }
+    }
+    FAIL("The cache allocated more than two tables");
+}
+
+static void free_mem(void* ptr) {
+    for (size_t i = 0; i < ARRAY_SIZE(g_tables); i++) {
+        if (ptr == g_tables[i]) {
+            if (!g_table_used[i])
+                FAIL("Double free of table %lu", i);
+            g_table_used[i] = false;
+            return;
+        }
+    }
+    FAIL("Freeing unknown memory %p", ptr);
+}
+
+static struct cpuid_cache g_cache;
+
+/* model: list of cached entries */
+static struct cpuid_cache_entry g_model[MAX_ENTRIES];
+static size_t g_model_count;
+
+static struct cpuid_cache_entry* model_find(uint32_t leaf, uint32_t subleaf) {
+    for (size_t i = 0; i < g_model_count; i++)
+        if (g_model[i].leaf == leaf && g_model[i].subleaf == subleaf)
+            return &g_model[i];
+    return NULL;
+}
+
+static void reset(size_t max_count) {
+    cpuid_cache_clear(&g_cache);
+    cpuid_cache_init(&g_cache, max_count, alloc_mem, free_mem);
+    g_model_count = 0;
+    g_fail_alloc = false;
+}
+
+static void random_key(uint32_t* leaf, uint32_t* subleaf) {
+    /* mostly basic leaves with a few subleaves, sometimes extended leaves */
+    *leaf = test_rand() % 4 ? test_rand() % 0x20 : 0x80000000 + test_rand() % 9;
+    *subleaf = test_rand() % 2 ? 0 : test_rand() % 24;
+}
+
+static void check_get(uint32_t leaf, uint32_t subleaf) {
+    uint32_t values[4];
+    struct cpuid_cache_entry* entry = model_find(leaf, subleaf);
+    bool found = cpuid_cache_get(&g_cache, leaf, subleaf, values);
+    if (found != !!entry)
+        FAIL("Lookup of %#x/%#x returned %d, expected %d", leaf, subleaf, found, !!entry);
+    if (found && memcmp(values, entry->values, sizeof(values)))
+        FAIL("Lookup of %#x/%#x returned wrong values", leaf, subleaf);
+}
+
+static void do_add(uint32_t leaf, uint32_t subleaf) {
+    uint32_t values[4] = {test_rand(), test_rand(), test_rand(), test_rand()};
+    struct cpuid_cache_entry* entry = model_find(leaf, subleaf);
+    bool expect_fail = !entry && (g_model_count >= g_cache.max_count || g_fail_alloc);
+
+    int ret = cpuid_cache_add(&g_cache, leaf, subleaf, values);
+    if (expect_fail) {
+        /* allocation is needed only when growing, so it may still succeed */
+        if (ret != -PAL_ERROR_NOMEM && (ret < 0 || g_model_count >= g_cache.max_count))
+            FAIL("Adding %#x/%#x to a full cache returned %d", leaf, subleaf, ret);
+        if (ret < 0)
+            return;
+    } else if (ret < 0) {
+        FAIL("Adding %#x/%#x failed: %d", leaf, subleaf, ret);
+    }
+
+    if (!entry) {
+        entry = &g_model[g_model_count++];
+        entry->leaf = leaf;
+        entry->subleaf = subleaf;
+    }
+    memcpy(entry->values, values, sizeof(values));
+}
+
+static void check_cache(int line) {
+    if (g_cache.count != g_model_count)
+        FAIL("Cache has %lu entries, model has %lu (line %d)", g_cache.count, g_model_count, line);
+    if (g_cache.count * 2 > g_cache.capacity)
+        FAIL("Cache is more than half full (line %d)", line);
+    for (size_t i = 0; i < g_model_count; i++)
+        check_get(g_model[i].leaf, g_model[i].subleaf);
+}
+
+static void test_basic(void) {
+    uint32_t values[4] = {1, 2, 3, 4};
+
+    struct cpuid_cache zero_cache = {0};
+    if (cpuid_cache_add(&zero_cache, 0, 0, values) != -PAL_ERROR_NOMEM)
+        FAIL("Zero-initialized cache accepted an entry");
+    if (cpuid_cache_get(&zero_cache, 0, 0, values))
+        FAIL("Zero-initialized cache returned an entry");
+
+    reset(/*max_count=*/100);
+    check_get(0, 0);
+    do_add(0x7, 0);
+    do_add(0x7, 1);
+    do_add(0x80000000, 0);
+    do_add(0x7, 1); /* replace */
+    check_cache(__LINE__);
+    check_get(0x80000007, 0);
+    check_get(0x7, 2);
+
+    /* grow through several capacities */
+    for (uint32_t i = 0; i < 100; i++)
+        do_add(0xd, i);
+    check_cache(__LINE__);
+    if (g_cache.count != g_cache.max_count)
+        FAIL("Cache did not fill up: %lu entries", g_cache.count);
+    do_add(0xd, 1000); /* full */
+    do_add(0xd, 5);    /* replacing works even in a full cache */
+    check_cache(__LINE__);
+
+    /* failed allocation leaves the cache unchanged */
+    reset(/*max_count=*/MAX_ENTRIES);
+    for (uint32_t i = 0; i < CPUID_CACHE_INIT_CAPACITY / 2; i++)
+        do_add(0x4, i);
+    g_fail_alloc = true;
+    do_add(0x4, 1000);
+    check_cache(__LINE__);
+    g_fail_alloc = false;
+    do_add(0x4, 1000);
+    check_cache(__LINE__);
+
+    cpuid_cache_clear(&g_cache);
+    if (g_table_used[0] || g_table_used[1])
+        FAIL("Clearing the cache did not free its memory");
+    g_model_count = 0;
+    check_cache(__LINE__);
+}
+
+static void test_random(void) {
+    reset(/*max_count=*/MAX_ENTRIES / 2);
+
+    for (size_t i = 0; i < TEST_OPS; i++) {
+        uint32_t leaf, subleaf;
+        random_key(&leaf, &subleaf);
+        if (test_rand() % 2) {
+            do_add(leaf, subleaf);
+        } else {
+            check_get(leaf, subleaf);
+        }
+        if (i % 256 == 0)
+            check_cache(__LINE__);
+    }
+    check_cache(__LINE__);
+}
+
+/* Looks up typical keys (a few hundred leaf + subleaf pairs, as probed e.g. by topology discovery
+ * libraries) and compares the time with a linear search in a table of the same entries. */
+static void benchmark_lookup(void) {
+    reset(/*max_count=*/MAX_ENTRIES);
+    for (uint32_t leaf = 0; leaf < 0x20; leaf++)
+        for (uint32_t subleaf = 0; subleaf < 8; subleaf++)
+            do_add(leaf, subleaf);
+    for (uint32_t leaf = 0x80000000; leaf <= 0x80000008; leaf++)
+        do_add(leaf, 0);
+    check_cache(__LINE__);
+
+    size_t lookups = 0x100000;
+    uint32_t keys[64][2];
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        struct cpuid_cache_entry* entry = &g_model[test_rand() % g_model_count];
+        keys[i][0] = entry->leaf;
+        keys[i][1] = entry->subleaf;
+    }
+
+    uint64_t start_time, mid_time, end_time;
+    uint32_t values[4];
+    uint32_t sum = 0;
+    if (DkSystemTimeQuery(&start_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+    for (size_t i = 0; i < lookups; i++) {
+        uint32_t* key = keys[i % ARRAY_SIZE(keys)];
+        if (!cpuid_cache_get(&g_cache, key[0], key[1], values))
+            FAIL("Benchmark lookup failed");
+        sum += values[0];
+    }
+    if (DkSystemTimeQuery(&mid_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+    for (size_t i = 0; i < lookups; i++) {
+        uint32_t* key = keys[i % ARRAY_SIZE(keys)];
+        struct cpuid_cache_entry* entry = model_find(key[0], key[1]);
+        if (!entry)
+            FAIL("Benchmark lookup failed");
+        sum -= entry->values[0];
+    }
+    if (DkSystemTimeQuery(&end_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+
+    if (sum)
+        FAIL("Benchmark lookups returned different values");
+
+    pal_printf("CPUID cache benchmark: %lu lookups among %lu entries took %lu us (linear search: "
+               "%lu us)\n", lookups, g_cache.count, mid_time - start_time, end_time - mid_time);
+}
+
+int main(int argc, char** argv) {
+    test_srand(1337);
+
+    test_basic();
+    test_random();
+    if (argc > 1 && !strcmp(argv[1], "benchmark"))
+        benchmark_lookup();
+
+    pal_printf("TEST OK\n");
+    return 0;
+}
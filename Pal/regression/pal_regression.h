@@ -4,9 +4,21 @@
 #ifndef PAL_REGRESSION_H
 #define PAL_REGRESSION_H
 
+#include <stdint.h>
+
 #include "pal.h"
 
 void __attribute__((format(printf, 1, 2))) pal_printf(const char* fmt, ...);
 void __attribute__((format(printf, 2, 3))) _log(int level, const char* fmt, ...);
 
+#define FAIL(fmt...) ({         \
+    pal_printf(fmt);            \
+    pal_printf("\n");           \
+    DkProcessExit(1);           \
+})
+
+/* Reproducible pseudo-random numbers (based on glibc's `rand_r()`), 0 to 2^21 - 1 */
+void test_srand(uint32_t seed);
+uint32_t test_rand(void);
+
 #endif /* PAL_REGRESSION_H */
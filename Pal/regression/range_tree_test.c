@@ -0,0 +1,277 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Range tree (SGX enclave heap bookkeeping) checked against a per-page model of a small address
+ * space, first with hand-picked corner cases (merging, splitting, conflicting types, allocation
+ * failures), then with random operations.
+ *
+ * `range_tree_test benchmark` also measures allocations in an address space fragmented into many
+ * small gaps.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+#include "range_tree.h"
+
+#define TEST_PAGE_SIZE 0x1000UL
+#define TEST_BASE      0x10000000UL
+#define TEST_PAGES     0x800
+#define TEST_OPS       0x4000
+#define MAX_NODES      0x10000
+
+static struct range_tree_node g_nodes[MAX_NODES];
+static struct range_tree_node* g_free_nodes[MAX_NODES];
+static size_t g_free_nodes_count;
+static bool g_fail_alloc;
+
+static struct range_tree_node* alloc_node(void) {
+    if (g_fail_alloc || !g_free_nodes_count)
+        return NULL;
+    return g_free_nodes[--g_free_nodes_count];
+}
+
+static void free_node(struct range_tree_node* node) {
+    g_free_nodes[g_free_nodes_count++] = node;
+}
+
+static struct range_tree g_tree;
+
+/* model: 0 for free pages, type + 1 for used ones */
+static uint8_t g_pages[TEST_PAGES];
+
+static uintptr_t page_addr(size_t page) {
+    return TEST_BASE + page * TEST_PAGE_SIZE;
+}
+
+static void reset(void) {
+    g_free_nodes_count = 0;
+    for (size_t i = 0; i < MAX_NODES; i++)
+        g_free_nodes[g_free_nodes_count++] = &g_nodes[i];
+    g_fail_alloc = false;
+    range_tree_init(&g_tree, alloc_node, free_node);
+    memset(g_pages, 0, sizeof(g_pages));
+}
+
+static void check_tree(int line) {
+    if (!debug_range_tree_is_valid(&g_tree))
+        FAIL("Invalid range tree at line %d", line);
+
+    for (size_t i = 0; i < TEST_PAGES; i++) {
+        struct range_tree_node* node = range_tree_find(&g_tree, page_addr(i));
+        uint8_t page = node ? node->type + 1 : 0;
+        if (page != g_pages[i])
+            FAIL("Page %lu is %u in the tree, but %u in the model (line %d)", i, page, g_pages[i],
+                 line);
+    }
+}
+
+static void do_add(size_t start, size_t count, unsigned int type) {
+    size_t free_pages = 0;
+    bool conflict = false;
+    for (size_t i = start; i < start + count; i++) {
+        if (!g_pages[i])
+            free_pages++;
+        else if (g_pages[i] != type + 1)
+            conflict = true;
+    }
+
+    size_t added;
+    int ret = range_tree_add(&g_tree, page_addr(start), page_addr(start + count), type, &added);
+    if (conflict) {
+        if (ret != -PAL_ERROR_INVAL)
+            FAIL("Adding [%lu, %lu) of type %u over another type returned %d", start,
+                 start + count, type, ret);
+        return;
+    }
+    if (ret < 0)
+        FAIL("Adding [%lu, %lu) of type %u failed: %d", start, start + count, type, ret);
+    if (added != free_pages * TEST_PAGE_SIZE)
+        FAIL("Adding [%lu, %lu) added %lu bytes instead of %lu", start, start + count, added,
+             free_pages * TEST_PAGE_SIZE);
+
+    for (size_t i = start; i < start + count; i++)
+        g_pages[i] = type + 1;
+}
+
+static void do_remove(size_t start, size_t count) {
+    size_t used_pages = 0;
+    uint8_t type = 0;
+    bool conflict = false;
+    for (size_t i = start; i < start + count; i++) {
+        if (!g_pages[i])
+            continue;
+        used_pages++;
+        if (type && g_pages[i] != type)
+            conflict = true;
+        type = g_pages[i];
+    }
+
+    size_t removed;
+    int ret = range_tree_remove(&g_tree, page_addr(start), page_addr(start + count), &removed);
+    if (conflict) {
+        if (ret != -PAL_ERROR_INVAL)
+            FAIL("Removing [%lu, %lu) over two types returned %d", start, start + count, ret);
+        return;
+    }
+    if (ret < 0)
+        FAIL("Removing [%lu, %lu) failed: %d", start, start + count, ret);
+    if (removed != used_pages * TEST_PAGE_SIZE)
+        FAIL("Removing [%lu, %lu) removed %lu bytes instead of %lu", start, start + count,
+             removed, used_pages * TEST_PAGE_SIZE);
+
+    for (size_t i = start; i < start + count; i++)
+        g_pages[i] = 0;
+}
+
+static void do_find_free(size_t count) {
+    /* highest run of free pages that fits, allocated at its end */
+    bool expected_found = false;
+    size_t expected = 0;
+    size_t run = 0;
+    for (size_t i = TEST_PAGES; i > 0; i--) {
+        if (g_pages[i - 1]) {
+            run = 0;
+            continue;
+        }
+        run++;
+        if (run == count) {
+            /* pages [i - 1, i - 1 + count) are free and the one above them is not */
+            expected = i - 1;
+            expected_found = true;
+            break;
+        }
+    }
+
+    uintptr_t addr;
+    bool found = range_tree_find_free(&g_tree, page_addr(0), page_addr(TEST_PAGES),
+                                      count * TEST_PAGE_SIZE, &addr);
+    if (found != expected_found || (found && addr != page_addr(expected)))
+        FAIL("Search for %lu free pages returned %d (%#lx), expected %d (%#lx)", count, found,
+             found ? addr : 0, expected_found, expected_found ? page_addr(expected) : 0);
+}
+
+static void test_basic(void) {
+    reset();
+
+    do_add(10, 5, 0);
+    do_add(20, 5, 0);
+    do_add(15, 5, 0); /* merges all three */
+    check_tree(__LINE__);
+    if (g_tree.nodes_count != 1)
+        FAIL("Adjacent ranges were not merged");
+
+    do_add(25, 5, 1); /* touches, but different type */
+    do_add(8, 4, 0);  /* overlaps */
+    do_add(29, 2, 0); /* overlaps another type */
+    check_tree(__LINE__);
+    if (g_tree.nodes_count != 2)
+        FAIL("Wrong number of ranges: %lu", g_tree.nodes_count);
+
+    do_remove(12, 2); /* split */
+    do_remove(24, 2); /* two types */
+    do_remove(5, 20);
+    do_remove(25, 20);
+    check_tree(__LINE__);
+    if (g_tree.nodes_count != 0)
+        FAIL("Wrong number of ranges: %lu", g_tree.nodes_count);
+
+    do_add(0, TEST_PAGES, 1);
+    do_find_free(1);
+    do_remove(TEST_PAGES / 2, 1);
+    do_find_free(1);
+    do_find_free(2);
+    check_tree(__LINE__);
+
+    /* failed allocation leaves the tree unchanged */
+    g_fail_alloc = true;
+    size_t size;
+    if (range_tree_remove(&g_tree, page_addr(100), page_addr(101), &size) != -PAL_ERROR_NOMEM)
+        FAIL("Split did not fail without a free node");
+    if (range_tree_add(&g_tree, page_addr(TEST_PAGES / 2), page_addr(TEST_PAGES / 2 + 1), 0,
+                       &size) != -PAL_ERROR_NOMEM)
+        FAIL("Adding a range did not fail without a free node");
+    g_fail_alloc = false;
+    check_tree(__LINE__);
+}
+
+static void test_random(void) {
+    reset();
+
+    for (size_t i = 0; i < TEST_OPS; i++) {
+        size_t start = test_rand() % TEST_PAGES;
+        size_t count = test_rand() % MIN(32UL, TEST_PAGES - start) + 1;
+        switch (test_rand() % 4) {
+            case 0:
+            case 1:
+                do_add(start, count, test_rand() % 2);
+                break;
+            case 2:
+                do_remove(start, count);
+                break;
+            case 3:
+                do_find_free(count);
+                break;
+        }
+        if (i % 64 == 0)
+            check_tree(__LINE__);
+    }
+    check_tree(__LINE__);
+}
+
+/* Allocates single pages from the top, then frees every other one, leaving many small gaps, and
+ * measures allocations that don't fit in them (the worst case for a linear first-fit search). */
+static void benchmark_fragmentation(void) {
+    reset();
+
+    size_t ranges = MAX_NODES / 2;
+    uintptr_t upper = TEST_BASE + 4 * ranges * TEST_PAGE_SIZE;
+    size_t size;
+    for (size_t i = 0; i < 2 * ranges; i++) {
+        uintptr_t addr;
+        if (!range_tree_find_free(&g_tree, TEST_BASE, upper, TEST_PAGE_SIZE, &addr)
+                || range_tree_add(&g_tree, addr, addr + TEST_PAGE_SIZE, i % 2, &size) < 0)
+            FAIL("Benchmark setup failed");
+    }
+    for (size_t i = 0; i < 2 * ranges; i += 2)
+        if (range_tree_remove(&g_tree, upper - (i + 1) * TEST_PAGE_SIZE,
+                              upper - i * TEST_PAGE_SIZE, &size) < 0)
+            FAIL("Benchmark setup failed");
+
+    size_t allocs = 0x10000;
+    uint64_t start_time, end_time;
+    if (DkSystemTimeQuery(&start_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+    for (size_t i = 0; i < allocs; i++) {
+        uintptr_t addr;
+        if (!range_tree_find_free(&g_tree, TEST_BASE, upper, 2 * TEST_PAGE_SIZE, &addr)
+                || range_tree_add(&g_tree, addr, addr + 2 * TEST_PAGE_SIZE, 0, &size) < 0
+                || range_tree_remove(&g_tree, addr, addr + 2 * TEST_PAGE_SIZE, &size) < 0)
+            FAIL("Benchmark allocation failed");
+    }
+    if (DkSystemTimeQuery(&end_time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+
+    if (!debug_range_tree_is_valid(&g_tree))
+        FAIL("Invalid range tree after benchmark");
+
+    pal_printf("Fragmentation benchmark: %lu allocations with %lu ranges took %lu us\n", allocs,
+               g_tree.nodes_count, end_time - start_time);
+}
+
+int main(int argc, char** argv) {
+    test_srand(1337);
+
+    test_basic();
+    test_random();
+    if (argc > 1 && !strcmp(argv[1], "benchmark"))
+        benchmark_fragmentation();
+
+    pal_printf("TEST OK\n");
+    return 0;
+}
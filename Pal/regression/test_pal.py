@@ -37,6 +37,23 @@ class TC_00_Basic(RegressionTestCase):
         _, stderr = self.run_binary(['printf_test'])
         self.assertIn("TEST OK", stderr)
 
+    def test_004_range_tree(self):
+        _, stderr = self.run_binary(['range_tree_test'])
+        self.assertIn("TEST OK", stderr)
+
+    def test_005_buf_pool(self):
+        _, stderr = self.run_binary(['buf_pool_test'])
+        self.assertIn("TEST OK", stderr)
+
+    @unittest.skipUnless(HAS_SGX, 'chunk_verify_test is built only for SGX PAL (needs mbedTLS)')
+    def test_006_chunk_verify(self):
+        _, stderr = self.run_binary(['chunk_verify_test'])
+        self.assertIn("TEST OK", stderr)
+
+    def test_007_cpuid_cache(self):
+        _, stderr = self.run_binary(['cpuid_cache_test'])
+        self.assertIn("TEST OK", stderr)
+
 
 class TC_00_BasicSet2(RegressionTestCase):
     @unittest.skipUnless(ON_X86, "x86-specific")
@@ -35,6 +35,21 @@ void _log(int level, const char* fmt, ...) {
     va_end(ap);
 }
 
+static uint32_t g_test_seed;
+
+void test_srand(uint32_t seed) {
+    g_test_seed = seed;
+}
+
+/* source: https://elixir.bootlin.com/glibc/glibc-2.31/source/stdlib/rand_r.c (simplified) */
+uint32_t test_rand(void) {
+    g_test_seed = g_test_seed * 1103515245 + 12345;
+    uint32_t result = (g_test_seed / 65536) % 2048;
+    g_test_seed = g_test_seed * 1103515245 + 12345;
+    result = (result << 10) ^ ((g_test_seed / 65536) % 1024);
+    return result;
+}
+
 noreturn void abort(void) {
     DkProcessExit(131); /* ENOTRECOVERABLE = 131 */
 }
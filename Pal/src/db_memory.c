@@ -66,6 +66,22 @@ int DkVirtualMemoryProtect(void* addr, PAL_NUM size, pal_prot_flags_t prot) {
     return _DkVirtualMemoryProtect(addr, size, prot);
 }
 
+int DkVirtualMemoryQueryPopulated(void* addr, PAL_NUM size, uint8_t* vec) {
+    if (!addr || !size || !vec) {
+        return -PAL_ERROR_INVAL;
+    }
+
+    if (!IS_ALLOC_ALIGNED_PTR(addr) || !IS_ALLOC_ALIGNED(size)) {
+        return -PAL_ERROR_INVAL;
+    }
+
+    if (_DkCheckMemoryMappable(addr, size)) {
+        return -PAL_ERROR_DENIED;
+    }
+
+    return _DkVirtualMemoryQueryPopulated(addr, size, vec);
+}
+
 int add_preloaded_range(uintptr_t start, uintptr_t end, const char* comment) {
     size_t new_cnt = g_pal_public_state.preloaded_ranges_cnt + 1;
     void* new_ranges = malloc(new_cnt * sizeof(*g_pal_public_state.preloaded_ranges));
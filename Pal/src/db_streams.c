@@ -23,6 +23,7 @@ extern struct handle_ops g_thread_ops;
 extern struct handle_ops g_proc_ops;
 extern struct handle_ops g_event_ops;
 extern struct handle_ops g_eventfd_ops;
+extern struct handle_ops g_shm_ops;
 
 const struct handle_ops* g_pal_handle_ops[PAL_HANDLE_TYPE_BOUND] = {
     [PAL_TYPE_FILE]    = &g_file_ops,
@@ -39,6 +40,7 @@ const struct handle_ops* g_pal_handle_ops[PAL_HANDLE_TYPE_BOUND] = {
     [PAL_TYPE_THREAD]  = &g_thread_ops,
     [PAL_TYPE_EVENT]   = &g_event_ops,
     [PAL_TYPE_EVENTFD] = &g_eventfd_ops,
+    [PAL_TYPE_SHM]     = &g_shm_ops,
 };
 
 /* parse_stream_uri scan the uri, seperate prefix and search for
@@ -63,6 +65,7 @@ static int parse_stream_uri(const char** uri, char** prefix, struct handle_ops**
             static_assert(static_strlen(URI_PREFIX_TCP) == 4, "URI_PREFIX_TCP has unexpected length");
             static_assert(static_strlen(URI_PREFIX_UDP) == 4, "URI_PREFIX_UDP has unexpected length");
             static_assert(static_strlen(URI_PREFIX_DEV) == 4, "URI_PREFIX_DEV has unexpected length");
+            static_assert(static_strlen(URI_PREFIX_SHM) == 4, "URI_PREFIX_SHM has unexpected length");
 
             if (strstartswith(u, URI_PREFIX_DIR))
                 hops = &g_dir_ops;
@@ -72,6 +75,8 @@ static int parse_stream_uri(const char** uri, char** prefix, struct handle_ops**
                 hops = &g_udp_ops;
             else if (strstartswith(u, URI_PREFIX_DEV))
                 hops = &g_dev_ops;
+            else if (strstartswith(u, URI_PREFIX_SHM))
+                hops = &g_shm_ops;
             break;
 
         case 5: ;
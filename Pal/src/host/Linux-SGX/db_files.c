@@ -110,58 +110,33 @@ static int file_open(PAL_HANDLE* handle, const char* type, const char* uri,
     }
 
     if (pf) {
-        pf_lock();
-
-        pf_file_mode_t pf_mode = 0;
-        if (pal_access == PAL_ACCESS_RDONLY) {
-            pf_mode = PF_FILE_MODE_READ;
-        } else if (pal_access == PAL_ACCESS_WRONLY) {
-            pf_mode = PF_FILE_MODE_WRITE;
-        } else {
-            assert(pal_access == PAL_ACCESS_RDWR);
-            pf_mode = PF_FILE_MODE_READ | PF_FILE_MODE_WRITE;
-        }
-
-        if ((pf_mode & PF_FILE_MODE_WRITE) && pf->writable_fd >= 0) {
-            log_warning("file_open(%s): disallowing concurrent writable handle",
-                        hdl->file.realpath);
-            ret = -PAL_ERROR_DENIED;
-            goto fail_pf_unlock;
-        }
-
         /* Protected files sometimes needs to be read and written (e.g. to read or save some
-         * metadata), regardless of the requested open mode. */
+         * metadata), regardless of the requested open mode. All handles to a PF share a single PF
+         * context, access mode of each handle is enforced by the LibOS. */
         flags = (flags & ~O_ACCMODE) | O_RDWR;
 
         fd = ocall_open(uri, flags, pal_share);
         if (fd < 0) {
             ret = unix_to_pal_error(fd);
-            goto fail_pf_unlock;
+            goto fail;
         }
 
         ret = ocall_fstat(fd, &st);
         if (ret < 0) {
             ret = unix_to_pal_error(ret);
-            goto fail_pf_unlock;
+            goto fail;
         }
 
         hdl->file.fd = fd;
         hdl->file.seekable = !S_ISFIFO(st.st_mode);
 
-        pf = load_protected_file(hdl->file.realpath, (int*)&hdl->file.fd, st.st_size, pf_mode,
-                                 do_create, pf);
+        pf = load_protected_file(hdl->file.realpath, fd, st.st_size, do_create, pf);
         if (!pf) {
-            log_warning("load_protected_file(%s, %d) failed", hdl->file.realpath, hdl->file.fd);
+            log_warning("load_protected_file(%s, %d) failed", hdl->file.realpath, fd);
             ret = -PAL_ERROR_DENIED;
-            goto fail_pf_unlock;
-        }
-
-        if (pf_mode & PF_FILE_MODE_WRITE) {
-            pf->writable_fd = fd;
+            goto fail;
         }
-
-        pf->refcount++;
-        pf_unlock();
+        hdl->file.pf = pf;
 
         *handle = hdl;
         return 0;
@@ -210,12 +185,7 @@ static int file_open(PAL_HANDLE* handle, const char* type, const char* uri,
     *handle = hdl;
     return 0;
 
-fail_pf_unlock:
-    pf_unlock();
 fail:
-    if (pf && pf->context && pf->refcount == 0)
-        unload_protected_file(pf);
-
     if (fd >= 0)
         ocall_close(fd);
 
@@ -245,7 +215,7 @@ static int64_t pf_file_read(struct protected_file* pf, PAL_HANDLE handle, uint64
 
 /* 'read' operation for file streams. */
 static int64_t file_read(PAL_HANDLE handle, uint64_t offset, uint64_t count, void* buffer) {
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
 
     if (pf)
         return pf_file_read(pf, handle, offset, count, buffer);
@@ -272,12 +242,9 @@ static int64_t file_read(PAL_HANDLE handle, uint64_t offset, uint64_t count, voi
         return 0;
 
     off_t end = MIN(offset + count, total);
-    off_t aligned_offset = ALIGN_DOWN(offset, TRUSTED_CHUNK_SIZE);
-    off_t aligned_end    = ALIGN_UP(end, TRUSTED_CHUNK_SIZE);
 
-    ret = copy_and_verify_trusted_file(handle->file.realpath, buffer, handle->file.umem,
-                                       aligned_offset, aligned_end, offset, end, chunk_hashes,
-                                       total);
+    ret = copy_and_verify_trusted_file(handle->file.realpath, buffer, handle->file.umem, offset,
+                                       end, chunk_hashes, total);
     if (ret < 0)
         return ret;
 
@@ -305,7 +272,7 @@ static int64_t pf_file_write(struct protected_file* pf, PAL_HANDLE handle, uint6
 
 /* 'write' operation for file streams. */
 static int64_t file_write(PAL_HANDLE handle, uint64_t offset, uint64_t count, const void* buffer) {
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
 
     if (pf)
         return pf_file_write(pf, handle, offset, count, buffer);
@@ -332,30 +299,22 @@ static int64_t file_write(PAL_HANDLE handle, uint64_t offset, uint64_t count, co
 }
 
 static int pf_file_close(struct protected_file* pf, PAL_HANDLE handle) {
-    int fd = handle->file.fd;
+    bool fd_taken;
+    int ret = unload_protected_file(pf, handle->file.fd, &fd_taken);
+    if (ret < 0)
+        return ret;
 
-    if (pf->refcount == 0) {
-        log_error("pf_file_close(PF fd %d): refcount == 0", fd);
-        return -PAL_ERROR_INVAL;
+    handle->file.pf = NULL;
+    if (fd_taken) {
+        /* the fd is still used by the PF context (shared with other handles) */
+        handle->file.fd = PAL_IDX_POISON;
     }
-
-    pf_lock();
-    if (pf->writable_fd == fd)
-        pf->writable_fd = -1;
-    pf_unlock();
-
-    pf->refcount--;
-
-    if (pf->refcount == 0)
-        return unload_protected_file(pf);
-
     return 0;
 }
 
 /* 'close' operation for file streams */
 static int file_close(PAL_HANDLE handle) {
-    int fd = handle->file.fd;
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
 
     if (pf) {
         int ret = pf_file_close(pf, handle);
@@ -368,7 +327,8 @@ static int file_close(PAL_HANDLE handle) {
         ocall_munmap_untrusted(handle->file.umem, handle->file.total);
     }
 
-    ocall_close(fd);
+    if (handle->file.fd != PAL_IDX_POISON)
+        ocall_close(handle->file.fd);
 
     /* initial realpath is part of handle object and will be freed with it */
     if (handle->file.realpath && handle->file.realpath != (void*)handle + HANDLE_SIZE(file))
@@ -450,9 +410,7 @@ static int pf_file_map(struct protected_file* pf, PAL_HANDLE handle, void** addr
         map->offset = offset;
         map->buffer = *addr;
 
-        pf_lock();
-        LISTP_ADD_TAIL(map, &g_pf_map_list, list);
-        pf_unlock();
+        add_pf_map(map);
     }
 
     if (prot & PAL_PROT_READ) {
@@ -506,7 +464,7 @@ static int file_map(PAL_HANDLE handle, void** addr, pal_prot_flags_t prot, uint6
         return -PAL_ERROR_INVAL;
     }
 
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
     if (pf)
         return pf_file_map(pf, handle, addr, prot, offset, size);
 
@@ -559,9 +517,8 @@ static int file_map(PAL_HANDLE handle, void** addr, pal_prot_flags_t prot, uint6
             goto out;
         }
 
-        ret = copy_and_verify_trusted_file(handle->file.realpath, mem, handle->file.umem,
-                                           aligned_offset, aligned_end, offset, end, chunk_hashes,
-                                           handle->file.total);
+        ret = copy_and_verify_trusted_file(handle->file.realpath, mem, handle->file.umem, offset,
+                                           end, chunk_hashes, handle->file.total);
         if (ret < 0) {
             log_error("file_map - copy & verify on trusted file returned %d", ret);
             goto out;
@@ -622,7 +579,7 @@ static int64_t pf_file_setlength(struct protected_file* pf, PAL_HANDLE handle, u
 
 /* 'setlength' operation for file stream. */
 static int64_t file_setlength(PAL_HANDLE handle, uint64_t length) {
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
     if (pf)
         return pf_file_setlength(pf, handle, length);
 
@@ -637,7 +594,7 @@ static int64_t file_setlength(PAL_HANDLE handle, uint64_t length) {
 /* 'flush' operation for file stream. */
 static int file_flush(PAL_HANDLE handle) {
     int fd = handle->file.fd;
-    struct protected_file* pf = find_protected_file_handle(handle);
+    struct protected_file* pf = handle->file.pf;
     if (pf) {
         int ret = flush_pf_maps(pf, /*buffer=*/NULL, /*remove=*/false);
         if (ret < 0) {
@@ -684,10 +641,10 @@ static inline void file_attrcopy(PAL_STREAM_ATTR* attr, struct stat* stat) {
 
 static int pf_file_attrquery(struct protected_file* pf, int fd_from_attrquery, const char* path,
                              uint64_t real_size, PAL_STREAM_ATTR* attr) {
-    pf = load_protected_file(path, &fd_from_attrquery, real_size, PF_FILE_MODE_READ,
-                             /*create=*/false, pf);
-    if (!pf) {
-        log_warning("pf_file_attrquery: load_protected_file(%s, %d) failed", path,
+    uint64_t size;
+    int ret = get_protected_file_size(pf, path, fd_from_attrquery, real_size, &size);
+    if (ret < 0) {
+        log_warning("pf_file_attrquery: get_protected_file_size(%s, %d) failed", path,
                     fd_from_attrquery);
         /* The call above will fail for PFs that were tampered with or have a wrong path.
          * glibc kills the process if this fails during directory enumeration, but that
@@ -696,22 +653,7 @@ static int pf_file_attrquery(struct protected_file* pf, int fd_from_attrquery, c
         return -PAL_ERROR_DENIED;
     }
 
-    uint64_t size;
-    pf_status_t pfs = pf_get_size(pf->context, &size);
-    __UNUSED(pfs);
-    assert(PF_SUCCESS(pfs));
     attr->pending_size = size;
-
-    pf_handle_t pf_handle;
-    pfs = pf_get_handle(pf->context, &pf_handle);
-    assert(PF_SUCCESS(pfs));
-
-    if (fd_from_attrquery == *(int*)pf_handle) { /* this is a PF opened just for us, close it */
-        pfs = pf_close(pf->context);
-        pf->context = NULL;
-        assert(PF_SUCCESS(pfs));
-    }
-
     return 0;
 }
 
@@ -791,7 +733,7 @@ static int file_attrquerybyhdl(PAL_HANDLE handle, PAL_STREAM_ATTR* attr) {
 
     if (attr->handle_type != PAL_TYPE_DIR) {
         /* For protected files return the data size, not real FS size */
-        struct protected_file* pf = find_protected_file_handle(handle);
+        struct protected_file* pf = handle->file.pf;
         if (pf) {
             /* protected files should be regular files (seekable) */
             if (!handle->file.seekable)
@@ -13,6 +13,7 @@
 #include <stdnoreturn.h>
 
 #include "api.h"
+#include "enclave_pages.h"
 #include "enclave_pf.h"
 #include "enclave_tf.h"
 #include "init.h"
@@ -886,6 +887,7 @@ noreturn void pal_linux_main(char* uptr_libpal_uri, size_t libpal_uri_len, char*
 
     g_pal_linuxsgx_state.heap_min = GET_ENCLAVE_TLS(heap_min);
     g_pal_linuxsgx_state.heap_max = GET_ENCLAVE_TLS(heap_max);
+    init_enclave_pages();
 
     /* Skip URI_PREFIX_FILE. */
     if (libpal_uri_len < URI_PREFIX_FILE_LEN) {
@@ -1080,6 +1082,11 @@ noreturn void pal_linux_main(char* uptr_libpal_uri, size_t libpal_uri_len, char*
         ocall_exit(1, /*is_exitgroup=*/true);
     }
 
+    if ((ret = init_cpuid_cache()) < 0) {
+        log_error("Failed to initialize CPUID cache: %d", ret);
+        ocall_exit(1, /*is_exitgroup=*/true);
+    }
+
     /* this should be placed *after all* initialize-from-manifest routines */
     if ((ret = print_warnings_on_insecure_configs(parent)) < 0) {
         log_error("Cannot parse the manifest (while checking for insecure configurations)");
@@ -88,6 +88,14 @@ int _DkVirtualMemoryProtect(void* addr, uint64_t size, pal_prot_flags_t prot) {
     return 0;
 }
 
+int _DkVirtualMemoryQueryPopulated(void* addr, uint64_t size, uint8_t* vec) {
+    __UNUSED(addr);
+    __UNUSED(size);
+    __UNUSED(vec);
+    /* enclave pages are committed on allocation, so there is no notion of untouched pages */
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
 uint64_t _DkMemoryQuota(void) {
     return g_pal_linuxsgx_state.heap_max - g_pal_linuxsgx_state.heap_min;
 }
@@ -10,6 +10,7 @@
 
 #include "api.h"
 #include "cpu.h"
+#include "cpuid_cache.h"
 #include "enclave_pf.h"
 #include "hex.h"
 #include "pal.h"
@@ -114,56 +115,24 @@ int _DkSystemTimeQuery(uint64_t* out_usec) {
     return 0;
 }
 
-#define CPUID_CACHE_SIZE 64 /* cache only 64 distinct CPUID entries; sufficient for most apps */
-static struct pal_cpuid {
-    unsigned int leaf, subleaf;
-    unsigned int values[4];
-} g_pal_cpuid_cache[CPUID_CACHE_SIZE];
+#define CPUID_CACHE_DEFAULT_SIZE 256
+#define CPUID_CACHE_MAX_SIZE     16384
 
-static int g_pal_cpuid_cache_top = 0;
+/* zero-initialized, so caches nothing until init_cpuid_cache() sets its size from the manifest */
+static struct cpuid_cache g_cpuid_cache;
 static spinlock_t g_cpuid_cache_lock = INIT_SPINLOCK_UNLOCKED;
 
-static int get_cpuid_from_cache(unsigned int leaf, unsigned int subleaf, unsigned int values[4]) {
-    int ret = -PAL_ERROR_DENIED;
-
+static bool get_cpuid_from_cache(unsigned int leaf, unsigned int subleaf, unsigned int values[4]) {
     spinlock_lock(&g_cpuid_cache_lock);
-    for (int i = 0; i < g_pal_cpuid_cache_top; i++) {
-        if (g_pal_cpuid_cache[i].leaf == leaf && g_pal_cpuid_cache[i].subleaf == subleaf) {
-            values[0] = g_pal_cpuid_cache[i].values[0];
-            values[1] = g_pal_cpuid_cache[i].values[1];
-            values[2] = g_pal_cpuid_cache[i].values[2];
-            values[3] = g_pal_cpuid_cache[i].values[3];
-            ret = 0;
-            break;
-        }
-    }
+    bool found = cpuid_cache_get(&g_cpuid_cache, leaf, subleaf, values);
     spinlock_unlock(&g_cpuid_cache_lock);
-    return ret;
+    return found;
 }
 
 static void add_cpuid_to_cache(unsigned int leaf, unsigned int subleaf, unsigned int values[4]) {
     spinlock_lock(&g_cpuid_cache_lock);
-
-    struct pal_cpuid* chosen = NULL;
-    if (g_pal_cpuid_cache_top < CPUID_CACHE_SIZE) {
-        for (int i = 0; i < g_pal_cpuid_cache_top; i++) {
-            if (g_pal_cpuid_cache[i].leaf == leaf && g_pal_cpuid_cache[i].subleaf == subleaf) {
-                /* this CPUID entry is already present in the cache, no need to add */
-                break;
-            }
-        }
-        chosen = &g_pal_cpuid_cache[g_pal_cpuid_cache_top++];
-    }
-
-    if (chosen) {
-        chosen->leaf      = leaf;
-        chosen->subleaf   = subleaf;
-        chosen->values[0] = values[0];
-        chosen->values[1] = values[1];
-        chosen->values[2] = values[2];
-        chosen->values[3] = values[3];
-    }
-
+    /* if the cache is full, the values are simply not cached */
+    (void)cpuid_cache_add(&g_cpuid_cache, leaf, subleaf, values);
     spinlock_unlock(&g_cpuid_cache_lock);
 }
 
@@ -459,7 +428,7 @@ int _DkCpuIdRetrieve(uint32_t leaf, uint32_t subleaf, uint32_t values[4]) {
     if (known_leaf->zero_subleaf)
         subleaf = 0;
 
-    if (known_leaf->cache && !get_cpuid_from_cache(leaf, subleaf, values))
+    if (known_leaf->cache && get_cpuid_from_cache(leaf, subleaf, values))
         return 0;
 
     if (ocall_cpuid(leaf, subleaf, values) < 0)
@@ -476,6 +445,105 @@ fail:
     _DkProcessExit(1);
 }
 
+/* max number of leaf + subleaf pairs pre-populated in the CPUID cache, see init_cpuid_cache() */
+#define CPUID_PREFETCH_MAX 64
+
+/* Returns subleaves of a cacheable leaf that are worth pre-populating: all of them for leaves with
+ * a few fixed subleaves (see also the checks in _DkCpuIdRetrieve()), and those describing the CPU
+ * extensions enabled in the enclave for leaf 0xD. */
+static size_t get_prefetch_subleaves(const struct cpuid_leaf* known_leaf, uint64_t xfrm,
+                                     unsigned int subleaves[LAST_CPU_EXTENSION]) {
+    size_t count = 0;
+
+    if (known_leaf->zero_subleaf) {
+        subleaves[count++] = 0;
+        return count;
+    }
+
+    switch (known_leaf->leaf) {
+        case EXTENDED_STATE_LEAF:
+            subleaves[count++] = X87;
+            subleaves[count++] = SSE;
+            for (int i = AVX; i < LAST_CPU_EXTENSION; i++)
+                if (extension_enabled(xfrm, i))
+                    subleaves[count++] = i;
+            break;
+        case 0x10:
+            for (unsigned int i = 0; i < 4; i++)
+                subleaves[count++] = i;
+            break;
+        case 0x07:
+        case 0x0F:
+        case 0x14:
+        case AMX_TILE_INFO_LEAF:
+            subleaves[count++] = 0;
+            subleaves[count++] = 1;
+            break;
+        default:
+            subleaves[count++] = 0;
+            break;
+    }
+    return count;
+}
+
+int init_cpuid_cache(void) {
+    int64_t cache_size;
+    int ret = toml_int_in(g_pal_public_state.manifest_root, "sgx.cpuid_cache_size",
+                          CPUID_CACHE_DEFAULT_SIZE, &cache_size);
+    if (ret < 0 || cache_size < 0 || cache_size > CPUID_CACHE_MAX_SIZE) {
+        log_error("Cannot parse 'sgx.cpuid_cache_size' (the value must be between 0 and %d)",
+                  CPUID_CACHE_MAX_SIZE);
+        return -PAL_ERROR_INVAL;
+    }
+
+    spinlock_lock(&g_cpuid_cache_lock);
+    cpuid_cache_init(&g_cpuid_cache, cache_size, malloc, free);
+    spinlock_unlock(&g_cpuid_cache_lock);
+
+    if (!cache_size)
+        return 0;
+
+    /* Pre-populate the cache with all cacheable leaves (vendor, feature flags, cache and TLB
+     * information, XSAVE layout, etc.) in a single OCALL; applications query most of them at
+     * startup anyway, and would otherwise need one OCALL per leaf + subleaf pair. */
+    uint64_t xfrm = g_pal_linuxsgx_state.enclave_info.attributes.xfrm;
+    bool amx_enabled = extension_enabled(xfrm, AMX_TILECFG)
+                       && extension_enabled(xfrm, AMX_TILEDATA);
+
+    unsigned int leaves[CPUID_PREFETCH_MAX];
+    unsigned int subleaves[CPUID_PREFETCH_MAX];
+    unsigned int values[CPUID_PREFETCH_MAX][4];
+    size_t count = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(cpuid_known_leaves); i++) {
+        const struct cpuid_leaf* known_leaf = &cpuid_known_leaves[i];
+        if (!known_leaf->cache)
+            continue;
+        bool is_amx_leaf = known_leaf->leaf == AMX_TILE_INFO_LEAF
+                           || known_leaf->leaf == AMX_TMUL_INFO_LEAF;
+        if (is_amx_leaf && !amx_enabled)
+            continue;
+
+        unsigned int leaf_subleaves[LAST_CPU_EXTENSION];
+        size_t leaf_count = get_prefetch_subleaves(known_leaf, xfrm, leaf_subleaves);
+        for (size_t j = 0; j < leaf_count; j++) {
+            assert(count < CPUID_PREFETCH_MAX);
+            leaves[count]    = known_leaf->leaf;
+            subleaves[count] = leaf_subleaves[j];
+            count++;
+        }
+    }
+
+    if (ocall_cpuid_batch(count, leaves, subleaves, values) < 0)
+        return -PAL_ERROR_DENIED;
+
+    for (size_t i = 0; i < count; i++) {
+        sanitize_cpuid(leaves[i], subleaves[i], values[i]);
+        add_cpuid_to_cache(leaves[i], subleaves[i], values[i]);
+    }
+    return 0;
+}
+
 int _DkAttestationReport(const void* user_report_data, PAL_NUM* user_report_data_size,
                          void* target_info, PAL_NUM* target_info_size, void* report,
                          PAL_NUM* report_size) {
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This file contains operations to handle streams with URIs that have "shm:".
+ *
+ * Host shared memory cannot be mapped at enclave addresses, so shared memory objects are not
+ * supported in SGX enclaves. Callers are expected to fall back to process-private memory.
+ */
+
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_internal.h"
+
+static int shm_open(PAL_HANDLE* handle, const char* type, const char* uri, enum pal_access access,
+                    pal_share_flags_t share, enum pal_create_mode create,
+                    pal_stream_options_t options) {
+    __UNUSED(handle);
+    __UNUSED(type);
+    __UNUSED(uri);
+    __UNUSED(access);
+    __UNUSED(share);
+    __UNUSED(create);
+    __UNUSED(options);
+    return -PAL_ERROR_NOTSUPPORT;
+}
+
+struct handle_ops g_shm_ops = {
+    .open = &shm_open,
+};
@@ -180,6 +180,8 @@ static int handle_deserialize(PAL_HANDLE* handle, const void* data, size_t size,
         case PAL_TYPE_FILE:
             hdl->file.realpath = hdl->file.realpath ? (const char*)hdl + hdlsz : NULL;
             hdl->file.chunk_hashes = NULL;
+            /* PF contexts are not inherited, I/O on such handles fails until reopened */
+            hdl->file.pf = hdl->file.realpath ? find_protected_file(hdl->file.realpath) : NULL;
             break;
         case PAL_TYPE_PIPE:
         case PAL_TYPE_PIPECLI:
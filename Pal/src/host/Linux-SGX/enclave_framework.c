@@ -1,6 +1,7 @@
 #include <stdbool.h>
 
 #include "api.h"
+#include "chunk_verify.h"
 #include "crypto.h"
 #include "enclave_tf.h"
 #include "hex.h"
@@ -460,82 +461,50 @@ static void set_file_check_policy(int policy) {
     g_file_check_policy = policy;
 }
 
-int copy_and_verify_trusted_file(const char* path, uint8_t* buf, const void* umem,
-                                 off_t aligned_offset, off_t aligned_end, off_t offset, off_t end,
-                                 sgx_chunk_hash_t* chunk_hashes, size_t file_size) {
-    int ret = 0;
-
-    assert(IS_ALIGNED(aligned_offset, TRUSTED_CHUNK_SIZE));
-    assert(offset >= aligned_offset && end <= aligned_end);
-
-    uint8_t* tmp_chunk = malloc(TRUSTED_CHUNK_SIZE);
-    if (!tmp_chunk) {
-        ret = -PAL_ERROR_NOMEM;
-        goto failed;
-    }
-
-    sgx_chunk_hash_t* chunk_hashes_item = chunk_hashes + aligned_offset / TRUSTED_CHUNK_SIZE;
-
-    uint8_t* buf_pos = buf;
-    off_t chunk_offset = aligned_offset;
-    for (; chunk_offset < aligned_end; chunk_offset += TRUSTED_CHUNK_SIZE, chunk_hashes_item++) {
-        size_t chunk_size = MIN(file_size - chunk_offset, TRUSTED_CHUNK_SIZE);
-        off_t chunk_end   = chunk_offset + chunk_size;
-
-        sgx_chunk_hash_t chunk_hash[2]; /* each chunk_hash is 128 bits in size but we need 256 */
-
-        LIB_SHA256_CONTEXT chunk_sha;
-        ret = lib_SHA256Init(&chunk_sha);
-        if (ret < 0)
-            goto failed;
-
-        if (chunk_offset >= offset && chunk_end <= end) {
-            /* if current chunk-to-copy completely resides in the requested region-to-copy,
-             * directly copy into buf (without a scratch buffer) and hash in-place */
-            memcpy(buf_pos, umem + chunk_offset, chunk_size);
-
-            ret = lib_SHA256Update(&chunk_sha, buf_pos, chunk_size);
-            if (ret < 0)
-                goto failed;
+static int chunk_sha256_init(void* ctx) {
+    return lib_SHA256Init(ctx);
+}
 
-            buf_pos += chunk_size;
-        } else {
-            /* if current chunk-to-copy only partially overlaps with the requested region-to-copy,
-             * read the file contents into a scratch buffer, verify hash and then copy only the part
-             * needed by the caller */
-            memcpy(tmp_chunk, umem + chunk_offset, chunk_size);
-
-            ret = lib_SHA256Update(&chunk_sha, tmp_chunk, chunk_size);
-            if (ret < 0)
-                goto failed;
-
-            /* determine which part of the chunk is needed by the caller */
-            off_t copy_start = MAX(chunk_offset, offset);
-            off_t copy_end   = MIN(chunk_offset + (off_t)chunk_size, end);
-            assert(copy_end > copy_start);
-
-            memcpy(buf_pos, tmp_chunk + copy_start - chunk_offset, copy_end - copy_start);
-            buf_pos += copy_end - copy_start;
-        }
+static int chunk_sha256_update(void* ctx, const void* data, size_t size) {
+    return lib_SHA256Update(ctx, data, size);
+}
 
-        ret = lib_SHA256Final(&chunk_sha, (uint8_t*)&chunk_hash[0]);
-        if (ret < 0)
-            goto failed;
+static int chunk_sha256_final(void* ctx, uint8_t hash[CHUNK_HASH_SIZE]) {
+    static_assert(sizeof(sgx_chunk_hash_t) == CHUNK_HASH_SIZE, "wrong chunk hash size");
 
-        if (memcmp(chunk_hashes_item, &chunk_hash[0], sizeof(*chunk_hashes_item))) {
-            log_error("Accessing file '%s' is denied: incorrect hash of file chunk at %lu-%lu.",
-                      path, chunk_offset, chunk_end);
-            ret = -PAL_ERROR_DENIED;
-            goto failed;
-        }
-    }
+    sgx_file_hash_t sha256;
+    int ret = lib_SHA256Final(ctx, sha256.bytes);
+    if (ret < 0)
+        return ret;
 
-    free(tmp_chunk);
+    /* note that we truncate SHA256 to 128 bits */
+    memcpy(hash, sha256.bytes, CHUNK_HASH_SIZE);
     return 0;
+}
 
-failed:
-    free(tmp_chunk);
-    memset(buf, 0, end - offset);
+static const struct chunk_hash_ops g_chunk_sha256_ops = {
+    .init   = chunk_sha256_init,
+    .update = chunk_sha256_update,
+    .final  = chunk_sha256_final,
+};
+
+int copy_and_verify_trusted_file(const char* path, uint8_t* buf, const void* umem, off_t offset,
+                                 off_t end, sgx_chunk_hash_t* chunk_hashes, size_t file_size) {
+    struct chunked_file file = {
+        .umem         = umem,
+        .size         = file_size,
+        .chunk_size   = TRUSTED_CHUNK_SIZE,
+        .chunk_hashes = (const uint8_t*)chunk_hashes,
+        .hash_ops     = &g_chunk_sha256_ops,
+    };
+
+    LIB_SHA256_CONTEXT chunk_sha;
+    uint64_t bad_chunk;
+    int ret = chunked_file_copy_and_verify(&file, &chunk_sha, buf, offset, end, &bad_chunk);
+    if (ret == -PAL_ERROR_DENIED) {
+        log_error("Accessing file '%s' is denied: incorrect hash of file chunk at %lu-%lu.",
+                  path, bad_chunk, MIN(bad_chunk + TRUSTED_CHUNK_SIZE, file_size));
+    }
     return ret;
 }
 
@@ -28,6 +28,7 @@
 
 #include "api.h"
 #include "asan.h"
+#include "buf_pool.h"
 #include "cpu.h"
 #include "ocall_types.h"
 #include "pal_internal.h"
@@ -269,29 +270,80 @@ int ocall_munmap_untrusted(const void* addr, size_t size) {
 }
 
 /*
- * Memorize untrusted memory area to avoid mmap/munmap per each read/write IO. Because this cache
- * is per-thread, we don't worry about concurrency. The cache will be carried over thread
- * exit/creation. On fork/exec emulation, untrusted code does vfork/exec, so the mmapped cache
+ * Cache untrusted memory areas to avoid mmap/munmap per each read/write IO. Areas are cached in
+ * power-of-two size classes, first in a small per-thread pool and, if it is full or empty, in
+ * a larger pool shared by all threads. The per-thread pool will be carried over thread
+ * exit/creation. On fork/exec emulation, untrusted code does vfork/exec, so the mmapped areas
  * will be released by exec host syscall.
  *
  * In case of AEX and consequent signal handling, current thread may be interrupted in the middle
- * of using the cache. If there are OCALLs during signal handling, they could interfere with the
- * normal-execution use of the cache, so 'in_use' atomic protects against it. OCALLs during signal
- * handling do not use the cache and always explicitly mmap/munmap untrusted memory; 'need_munmap'
+ * of modifying its pool. If there are OCALLs during signal handling, they could interfere with the
+ * pool, so 'in_use' atomic protects against it; such OCALLs skip the per-thread pool. Likewise, the
+ * shared pool is skipped if its lock can't be taken quickly (it may be held by the interrupted
+ * code). Areas too large for the pools are always explicitly mmapped/munmapped; 'need_munmap'
  * indicates whether explicit munmap is needed at the end of such OCALL.
  */
+#define UNTRUSTED_POOL_THREAD_SLOTS 2
+#define UNTRUSTED_POOL_THREAD_MAX   (16 * 1024 * 1024UL)
+#define UNTRUSTED_POOL_SHARED_SLOTS 8
+#define UNTRUSTED_POOL_SHARED_MAX   (64 * 1024 * 1024UL)
+#define UNTRUSTED_POOL_LOCK_TRIES   1000
+
+static struct buf_pool g_untrusted_pool = {
+    .slots    = UNTRUSTED_POOL_SHARED_SLOTS,
+    .max_size = UNTRUSTED_POOL_SHARED_MAX,
+};
+static spinlock_t g_untrusted_pool_lock = INIT_SPINLOCK_UNLOCKED;
+
+static void* untrusted_pool_get(int cls) {
+    void* addr = NULL;
+
+    struct untrusted_area_cache* cache = &get_tcb_trts()->untrusted_area_cache;
+    uint64_t in_use = 0;
+    if (__atomic_compare_exchange_n(&cache->in_use, &in_use, 1, /*weak=*/false, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+        if (!cache->pool.max_size)
+            buf_pool_init(&cache->pool, UNTRUSTED_POOL_THREAD_SLOTS, UNTRUSTED_POOL_THREAD_MAX);
+        addr = buf_pool_get(&cache->pool, cls);
+        __atomic_store_n(&cache->in_use, 0, __ATOMIC_RELAXED);
+    }
+
+    if (!addr && spinlock_lock_timeout(&g_untrusted_pool_lock, UNTRUSTED_POOL_LOCK_TRIES)) {
+        addr = buf_pool_get(&g_untrusted_pool, cls);
+        spinlock_unlock(&g_untrusted_pool_lock);
+    }
+
+    return addr;
+}
+
+static bool untrusted_pool_put(int cls, void* addr) {
+    bool cached = false;
+
+    struct untrusted_area_cache* cache = &get_tcb_trts()->untrusted_area_cache;
+    uint64_t in_use = 0;
+    if (__atomic_compare_exchange_n(&cache->in_use, &in_use, 1, /*weak=*/false, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED)) {
+        cached = buf_pool_put(&cache->pool, cls, addr);
+        __atomic_store_n(&cache->in_use, 0, __ATOMIC_RELAXED);
+    }
+
+    if (!cached && spinlock_lock_timeout(&g_untrusted_pool_lock, UNTRUSTED_POOL_LOCK_TRIES)) {
+        cached = buf_pool_put(&g_untrusted_pool, cls, addr);
+        spinlock_unlock(&g_untrusted_pool_lock);
+    }
+
+    return cached;
+}
+
 static int ocall_mmap_untrusted_cache(size_t size, void** addrptr, bool* need_munmap) {
     int ret;
 
     *addrptr = NULL;
     *need_munmap = false;
 
-    struct untrusted_area* cache = &get_tcb_trts()->untrusted_area_cache;
-
-    uint64_t in_use = 0;
-    if (!__atomic_compare_exchange_n(&cache->in_use, &in_use, 1, /*weak=*/false, __ATOMIC_RELAXED,
-                                     __ATOMIC_RELAXED)) {
-        /* AEX signal handling case: cache is in use, so make explicit mmap/munmap */
+    int cls = buf_pool_class(size);
+    if (cls < 0) {
+        /* too large to be cached, so make explicit mmap/munmap */
         ret = ocall_mmap_untrusted(addrptr, size, PROT_READ | PROT_WRITE,
                                    MAP_ANONYMOUS | MAP_PRIVATE, /*fd=*/-1, /*offset=*/0);
         if (ret < 0) {
@@ -301,40 +353,28 @@ static int ocall_mmap_untrusted_cache(size_t size, void** addrptr, bool* need_mu
         return 0;
     }
 
-    /* normal execution case: cache was not in use, so use it/allocate new one for reuse */
-    if (cache->valid) {
-        if (cache->size >= size) {
-            *addrptr = cache->addr;
-            return 0;
-        }
-        ret = ocall_munmap_untrusted(cache->addr, cache->size);
-        if (ret < 0) {
-            cache->valid = false;
-            __atomic_store_n(&cache->in_use, 0, __ATOMIC_RELAXED);
-            return ret;
-        }
+    *addrptr = untrusted_pool_get(cls);
+    if (*addrptr) {
+        return 0;
     }
 
-    ret = ocall_mmap_untrusted(addrptr, size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
-                               /*fd=*/-1, /*offset=*/0);
-    if (ret < 0) {
-        cache->valid = false;
-        __atomic_store_n(&cache->in_use, 0, __ATOMIC_RELAXED);
-    } else {
-        cache->valid = true;
-        cache->addr  = *addrptr;
-        cache->size  = size;
-    }
-    return ret;
+    /* nothing cached, allocate new area of the whole class size for reuse */
+    return ocall_mmap_untrusted(addrptr, buf_pool_class_size(cls), PROT_READ | PROT_WRITE,
+                                MAP_ANONYMOUS | MAP_PRIVATE, /*fd=*/-1, /*offset=*/0);
 }
 
 static void ocall_munmap_untrusted_cache(void* addr, size_t size, bool need_munmap) {
     if (need_munmap) {
         ocall_munmap_untrusted(addr, size);
         /* there is not much we can do in case of error */
-    } else {
-        struct untrusted_area* cache = &get_tcb_trts()->untrusted_area_cache;
-        __atomic_store_n(&cache->in_use, 0, __ATOMIC_RELAXED);
+        return;
+    }
+
+    int cls = buf_pool_class(size);
+    assert(cls >= 0);
+    if (!untrusted_pool_put(cls, addr)) {
+        ocall_munmap_untrusted(addr, buf_pool_class_size(cls));
+        /* there is not much we can do in case of error */
     }
 }
 
@@ -373,6 +413,55 @@ int ocall_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int values[4])
     return retval;
 }
 
+int ocall_cpuid_batch(size_t count, const unsigned int leaves[], const unsigned int subleaves[],
+                      unsigned int values[][4]) {
+    int retval = 0;
+    ms_ocall_cpuid_batch_t* ms;
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    ms_ocall_cpuid_t* cpuids = sgx_alloc_on_ustack_aligned(count * sizeof(*cpuids),
+                                                           alignof(*cpuids));
+    if (!cpuids) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        WRITE_ONCE(cpuids[i].ms_leaf, leaves[i]);
+        WRITE_ONCE(cpuids[i].ms_subleaf, subleaves[i]);
+    }
+    WRITE_ONCE(ms->ms_cpuids, cpuids);
+    WRITE_ONCE(ms->ms_count, count);
+
+    do {
+        /* cpuid must be retrieved in the context of current logical core, cannot use exitless */
+        retval = sgx_ocall(OCALL_CPUID_BATCH, ms);
+    } while (retval == -EINTR);
+
+    if (retval < 0) {
+        log_error("OCALL_CPUID_BATCH returned an error (impossible on benign host)");
+        _DkProcessExit(1);
+    }
+
+    if (!retval) {
+        for (size_t i = 0; i < count; i++) {
+            values[i][0] = READ_ONCE(cpuids[i].ms_values[0]);
+            values[i][1] = READ_ONCE(cpuids[i].ms_values[1]);
+            values[i][2] = READ_ONCE(cpuids[i].ms_values[2]);
+            values[i][3] = READ_ONCE(cpuids[i].ms_values[3]);
+        }
+    }
+
+    sgx_reset_ustack(old_ustack);
+    return retval;
+}
+
 int ocall_open(const char* pathname, int flags, unsigned short mode) {
     int retval = 0;
     size_t path_size = pathname ? strlen(pathname) + 1 : 0;
@@ -687,6 +776,78 @@ out:
     return retval;
 }
 
+ssize_t ocall_pwritev(int fd, const struct iovec* iov, size_t iov_count, off_t offset) {
+    long retval = 0;
+    void* obuf = NULL;
+    ms_ocall_pwrite_t* ms;
+    void* ms_buf;
+    size_t count = 0;
+    bool need_munmap = false;
+
+    /* there is no host-side pwritev OCALL: gather the buffers into a single untrusted buffer and
+     * issue a regular pwrite, which costs one enclave exit instead of one per buffer */
+    for (size_t i = 0; i < iov_count; i++) {
+        if (!sgx_is_completely_within_enclave(iov[i].iov_base, iov[i].iov_len))
+            return -EPERM;
+        if (__builtin_add_overflow(count, iov[i].iov_len, &count))
+            return -EINVAL;
+    }
+
+    void* old_ustack = sgx_prepare_ustack();
+
+    if (count > MAX_UNTRUSTED_STACK_BUF) {
+        /* buf is too big and may overflow untrusted stack, so use untrusted heap */
+        retval = ocall_mmap_untrusted_cache(ALLOC_ALIGN_UP(count), &obuf, &need_munmap);
+        if (retval < 0) {
+            goto out;
+        }
+        ms_buf = obuf;
+    } else {
+        ms_buf = sgx_alloc_on_ustack(count);
+        if (!ms_buf) {
+            retval = -EPERM;
+            goto out;
+        }
+    }
+
+    size_t copied = 0;
+    for (size_t i = 0; i < iov_count; i++) {
+        memcpy((char*)ms_buf + copied, iov[i].iov_base, iov[i].iov_len);
+        copied += iov[i].iov_len;
+    }
+
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        retval = -EPERM;
+        goto out;
+    }
+
+    WRITE_ONCE(ms->ms_fd, fd);
+    WRITE_ONCE(ms->ms_count, count);
+    WRITE_ONCE(ms->ms_offset, offset);
+    WRITE_ONCE(ms->ms_buf, ms_buf);
+
+    retval = sgx_exitless_ocall(OCALL_PWRITE, ms);
+
+    if (retval < 0 && retval != -EAGAIN && retval != -EWOULDBLOCK && retval != -EBADF &&
+            retval != -EFBIG && retval != -EINTR && retval != -EINVAL && retval != -EIO &&
+            retval != -ENOSPC && retval != -ENXIO && retval != -EOVERFLOW && retval != -EPIPE &&
+            retval != -ESPIPE) {
+        retval = -EPERM;
+    }
+
+    if (retval > 0 && (size_t)retval > count) {
+        retval = -EPERM;
+        goto out;
+    }
+
+out:
+    sgx_reset_ustack(old_ustack);
+    if (obuf)
+        ocall_munmap_untrusted_cache(obuf, ALLOC_ALIGN_UP(count), need_munmap);
+    return retval;
+}
+
 int ocall_fstat(int fd, struct stat* buf) {
     int retval = 0;
     ms_ocall_fstat_t* ms;
@@ -1532,6 +1693,8 @@ int ocall_poll(struct pollfd* fds, size_t nfds, uint64_t* timeout_us) {
     size_t nfds_bytes = nfds * sizeof(struct pollfd);
     ms_ocall_poll_t* ms;
     uint64_t remaining_time_us = timeout_us ? *timeout_us : (uint64_t)-1;
+    void* obuf = NULL;
+    bool need_munmap = false;
 
     void* old_ustack = sgx_prepare_ustack();
     ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
@@ -1542,10 +1705,20 @@ int ocall_poll(struct pollfd* fds, size_t nfds, uint64_t* timeout_us) {
 
     WRITE_ONCE(ms->ms_nfds, nfds);
     WRITE_ONCE(ms->ms_timeout_us, remaining_time_us);
-    void* untrusted_fds = sgx_copy_to_ustack(fds, nfds_bytes);
-    if (!untrusted_fds) {
-        retval = -EPERM;
-        goto out;
+    void* untrusted_fds;
+    if (nfds_bytes > MAX_UNTRUSTED_STACK_BUF) {
+        retval = ocall_mmap_untrusted_cache(ALLOC_ALIGN_UP(nfds_bytes), &obuf, &need_munmap);
+        if (retval < 0) {
+            goto out;
+        }
+        memcpy(obuf, fds, nfds_bytes);
+        untrusted_fds = obuf;
+    } else {
+        untrusted_fds = sgx_copy_to_ustack(fds, nfds_bytes);
+        if (!untrusted_fds) {
+            retval = -EPERM;
+            goto out;
+        }
     }
     WRITE_ONCE(ms->ms_fds, untrusted_fds);
 
@@ -1578,6 +1751,8 @@ out:
         *timeout_us = remaining_time_us;
     }
     sgx_reset_ustack(old_ustack);
+    if (obuf)
+        ocall_munmap_untrusted_cache(obuf, ALLOC_ALIGN_UP(nfds_bytes), need_munmap);
     return retval;
 }
 
@@ -18,6 +18,9 @@ int ocall_munmap_untrusted(const void* addr, size_t size);
 
 int ocall_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int values[4]);
 
+int ocall_cpuid_batch(size_t count, const unsigned int leaves[], const unsigned int subleaves[],
+                      unsigned int values[][4]);
+
 int ocall_open(const char* pathname, int flags, unsigned short mode);
 
 int ocall_close(int fd);
@@ -30,6 +33,8 @@ ssize_t ocall_pread(int fd, void* buf, size_t count, off_t offset);
 
 ssize_t ocall_pwrite(int fd, const void* buf, size_t count, off_t offset);
 
+ssize_t ocall_pwritev(int fd, const struct iovec* iov, size_t iov_count, off_t offset);
+
 int ocall_fstat(int fd, struct stat* buf);
 
 int ocall_fionread(int fd);
@@ -2,75 +2,87 @@
 
 #include "api.h"
 #include "asan.h"
-#include "list.h"
 #include "pal_error.h"
 #include "pal_linux.h"
+#include "range_tree.h"
 #include "spinlock.h"
 
 struct atomic_int g_allocated_pages;
 
-/* list of VMAs of used memory areas kept in DESCENDING order; note that preallocated PAL internal
- * memory relies on this descending order of allocations (from high addresses to low), see
- * _DkGetAvailableUserAddressRange() for more details */
-DEFINE_LIST(heap_vma);
-struct heap_vma {
-    LIST_TYPE(heap_vma) list;
-    void* bottom;
-    void* top;
-    bool is_pal_internal;
+/* VMAs of used memory areas, ranges of type `true` are pal-internal; new areas are taken from the
+ * highest free slot that fits, note that preallocated PAL internal memory relies on this descending
+ * order of allocations (from high addresses to low), see _DkGetAvailableUserAddressRange() for more
+ * details */
+static struct range_tree g_heap_vmas;
+static spinlock_t g_heap_vma_lock = INIT_SPINLOCK_UNLOCKED;
+
+/* heap_vma objects cannot come from malloc(), which may recurse into get_enclave_pages(); instead
+ * they are carved from pages of PAL-internal memory that the allocator takes for itself (and never
+ * gives back), see __refill_free_vmas() */
+union heap_vma {
+    struct range_tree_node node;
+    union heap_vma* next_free;
 };
-DEFINE_LISTP(heap_vma);
 
-static LISTP_TYPE(heap_vma) g_heap_vma_list = LISTP_INIT;
-static spinlock_t g_heap_vma_lock = INIT_SPINLOCK_UNLOCKED;
+static union heap_vma* g_free_vmas = NULL;
 
-/* heap_vma objects are taken from pre-allocated pool to avoid recursive mallocs */
-#define MAX_HEAP_VMAS 100000
-static struct heap_vma g_heap_vma_pool[MAX_HEAP_VMAS];
-static size_t g_heap_vma_num = 0;
-static struct heap_vma* g_free_vma = NULL;
+static struct range_tree_node* __alloc_vma(void) {
+    assert(spinlock_is_locked(&g_heap_vma_lock));
+
+    union heap_vma* vma = g_free_vmas;
+    if (!vma)
+        return NULL;
+    g_free_vmas = vma->next_free;
+    return &vma->node;
+}
 
-/* returns uninitialized heap_vma, the caller is responsible for setting at least bottom/top */
-static struct heap_vma* __alloc_vma(void) {
+static void __free_vma(struct range_tree_node* node) {
     assert(spinlock_is_locked(&g_heap_vma_lock));
 
-    if (g_free_vma) {
-        /* simple optimization: if there is a cached free vma object, use it */
-        assert((uintptr_t)g_free_vma >= (uintptr_t)&g_heap_vma_pool[0]);
-        assert((uintptr_t)g_free_vma <= (uintptr_t)&g_heap_vma_pool[MAX_HEAP_VMAS - 1]);
+    union heap_vma* vma = container_of(node, union heap_vma, node);
+    vma->next_free = g_free_vmas;
+    g_free_vmas = vma;
+}
 
-        struct heap_vma* ret = g_free_vma;
-        g_free_vma = NULL;
-        g_heap_vma_num++;
-        return ret;
-    }
+/* Takes the highest free page of PAL-internal memory and fills the free list with heap_vma objects
+ * from it. The page is recorded as a pal-internal VMA only after that, so this works even if the
+ * free list was empty. Every tree operation needs at most one new object, so it's enough to call
+ * this before each operation if the free list is empty. */
+static void __refill_free_vmas(void) {
+    assert(spinlock_is_locked(&g_heap_vma_lock));
+    assert(!g_free_vmas);
 
-    /* FIXME: this loop may become perf bottleneck on large number of vma objects; however,
-     * experiments show that this number typically does not exceed 20 (thanks to VMA merging) */
-    for (size_t i = 0; i < MAX_HEAP_VMAS; i++) {
-        if (!g_heap_vma_pool[i].bottom && !g_heap_vma_pool[i].top) {
-            /* found empty slot in the pool, use it */
-            g_heap_vma_num++;
-            return &g_heap_vma_pool[i];
-        }
+    uintptr_t addr;
+    if (!range_tree_find_free(&g_heap_vmas, (uintptr_t)g_pal_linuxsgx_state.heap_min,
+                              (uintptr_t)g_pal_linuxsgx_state.heap_max, g_page_size, &addr))
+        return;
+    if ((void*)addr < g_pal_linuxsgx_state.heap_max - g_pal_internal_mem_size)
+        return;
+
+#ifdef ASAN
+    asan_unpoison_region(addr, g_page_size);
+#endif
+
+    union heap_vma* vmas = (union heap_vma*)addr;
+    for (size_t i = 0; i < g_page_size / sizeof(*vmas); i++) {
+        vmas[i].next_free = g_free_vmas;
+        g_free_vmas = &vmas[i];
     }
 
-    return NULL;
+    size_t allocated;
+    int ret = range_tree_add(&g_heap_vmas, addr, addr + g_page_size, /*type=*/true, &allocated);
+    if (ret < 0) {
+        log_error("Bad memory bookkeeping: cannot record page %p of VMA objects", (void*)addr);
+        ocall_exit(/*exitcode=*/1, /*is_exitgroup=*/true);
+    }
+    __atomic_add_fetch(&g_allocated_pages.counter, allocated / g_page_size, __ATOMIC_SEQ_CST);
 }
 
-static void __free_vma(struct heap_vma* vma) {
-    assert(spinlock_is_locked(&g_heap_vma_lock));
-    assert((uintptr_t)vma >= (uintptr_t)&g_heap_vma_pool[0]);
-    assert((uintptr_t)vma <= (uintptr_t)&g_heap_vma_pool[MAX_HEAP_VMAS - 1]);
-
-    g_free_vma  = vma;
-    vma->top    = 0;
-    vma->bottom = 0;
-    g_heap_vma_num--;
+void init_enclave_pages(void) {
+    range_tree_init(&g_heap_vmas, __alloc_vma, __free_vma);
 }
 
-static void* __create_vma_and_merge(void* addr, size_t size, bool is_pal_internal,
-                                    struct heap_vma* vma_above) {
+static void* __create_vma_and_merge(void* addr, size_t size, bool is_pal_internal) {
     assert(spinlock_is_locked(&g_heap_vma_lock));
     assert(addr && size);
 
@@ -81,87 +93,16 @@ static void* __create_vma_and_merge(void* addr, size_t size, bool is_pal_interna
     if (is_pal_internal && addr < g_pal_linuxsgx_state.heap_max - g_pal_internal_mem_size)
         return NULL;
 
-    /* find enclosing VMAs and check that pal-internal VMAs do not overlap with normal VMAs */
-    struct heap_vma* vma_below;
-    if (vma_above) {
-        vma_below = LISTP_NEXT_ENTRY(vma_above, &g_heap_vma_list, list);
-    } else {
-        /* no VMA above `addr`; VMA right below `addr` must be the first (highest-address) in list */
-        vma_below = LISTP_FIRST_ENTRY(&g_heap_vma_list, struct heap_vma, list);
-    }
-
-    /* check whether [addr, addr + size) overlaps with above VMAs of different type */
-    struct heap_vma* check_vma_above = vma_above;
-    while (check_vma_above && addr + size > check_vma_above->bottom) {
-        if (check_vma_above->is_pal_internal != is_pal_internal) {
-            return NULL;
-        }
-        check_vma_above = LISTP_PREV_ENTRY(check_vma_above, &g_heap_vma_list, list);
-    }
-
-    /* check whether [addr, addr + size) overlaps with below VMAs of different type */
-    struct heap_vma* check_vma_below = vma_below;
-    while (check_vma_below && addr < check_vma_below->top) {
-        if (check_vma_below->is_pal_internal != is_pal_internal) {
-            return NULL;
-        }
-        check_vma_below = LISTP_NEXT_ENTRY(check_vma_below, &g_heap_vma_list, list);
-    }
-
     /* create VMA with [addr, addr+size); in case of existing overlapping VMAs, the created VMA is
-     * merged with them and the old VMAs are discarded, similar to mmap(MAX_FIXED) */
-    struct heap_vma* vma = __alloc_vma();
-    if (!vma)
+     * merged with them and the old VMAs are discarded, similar to mmap(MAX_FIXED); fails if
+     * [addr, addr+size) overlaps VMAs of the other type (we never merge normal VMAs with
+     * pal-internal VMAs) */
+    size_t allocated;
+    int ret = range_tree_add(&g_heap_vmas, (uintptr_t)addr, (uintptr_t)addr + size,
+                             is_pal_internal, &allocated);
+    if (ret < 0)
         return NULL;
-    vma->bottom          = addr;
-    vma->top             = addr + size;
-    vma->is_pal_internal = is_pal_internal;
-
-    /* how much memory was freed because [addr, addr + size) overlapped with VMAs */
-    size_t freed = 0;
-
-    /* Try to merge VMAs as an optimization:
-     *   (1) start from `vma_above` and iterate through VMAs with higher-addresses for merges
-     *   (2) start from `vma_below` and iterate through VMAs with lower-addresses for merges.
-     * Note that we never merge normal VMAs with pal-internal VMAs. */
-    while (vma_above && vma_above->bottom <= vma->top &&
-           vma_above->is_pal_internal == vma->is_pal_internal) {
-        /* newly created VMA grows into above VMA; expand newly created VMA and free above-VMA */
-        freed += vma_above->top - vma_above->bottom;
-        struct heap_vma* vma_above_above = LISTP_PREV_ENTRY(vma_above, &g_heap_vma_list, list);
-
-        vma->bottom = MIN(vma_above->bottom, vma->bottom);
-        vma->top    = MAX(vma_above->top, vma->top);
-        LISTP_DEL(vma_above, &g_heap_vma_list, list);
-
-        __free_vma(vma_above);
-        vma_above = vma_above_above;
-    }
-
-    while (vma_below && vma_below->top >= vma->bottom &&
-           vma_below->is_pal_internal == vma->is_pal_internal) {
-        /* newly created VMA grows into below VMA; expand newly create VMA and free below-VMA */
-        freed += vma_below->top - vma_below->bottom;
-        struct heap_vma* vma_below_below = LISTP_NEXT_ENTRY(vma_below, &g_heap_vma_list, list);
-
-        vma->bottom = MIN(vma_below->bottom, vma->bottom);
-        vma->top    = MAX(vma_below->top, vma->top);
-        LISTP_DEL(vma_below, &g_heap_vma_list, list);
 
-        __free_vma(vma_below);
-        vma_below = vma_below_below;
-    }
-
-    INIT_LIST_HEAD(vma, list);
-    LISTP_ADD_AFTER(vma, vma_above, &g_heap_vma_list, list);
-
-    if (vma->bottom >= vma->top) {
-        log_error("Bad memory bookkeeping: %p - %p", vma->bottom, vma->top);
-        ocall_exit(/*exitcode=*/1, /*is_exitgroup=*/true);
-    }
-
-    assert(vma->top - vma->bottom >= (ptrdiff_t)freed);
-    size_t allocated = vma->top - vma->bottom - freed;
     __atomic_add_fetch(&g_allocated_pages.counter, allocated / g_page_size, __ATOMIC_SEQ_CST);
 
     return addr;
@@ -178,41 +119,23 @@ void* get_enclave_pages(void* addr, size_t size, bool is_pal_internal) {
 
     assert(access_ok(addr, size));
 
-    struct heap_vma* vma_above = NULL;
-    struct heap_vma* vma;
-
     spinlock_lock(&g_heap_vma_lock);
 
+    if (!g_free_vmas)
+        __refill_free_vmas();
+
     if (addr) {
-        /* caller specified concrete address; find VMA right-above this address */
+        /* caller specified concrete address */
         if (addr < g_pal_linuxsgx_state.heap_min || addr + size > g_pal_linuxsgx_state.heap_max)
             goto out;
 
-        LISTP_FOR_EACH_ENTRY(vma, &g_heap_vma_list, list) {
-            if (vma->bottom < addr) {
-                /* current VMA is not above `addr`, thus vma_above is VMA right-above `addr` */
-                break;
-            }
-            vma_above = vma;
-        }
-        ret = __create_vma_and_merge(addr, size, is_pal_internal, vma_above);
+        ret = __create_vma_and_merge(addr, size, is_pal_internal);
     } else {
         /* caller did not specify address; find first (highest-address) empty slot that fits */
-        void* vma_above_bottom = g_pal_linuxsgx_state.heap_max;
-
-        LISTP_FOR_EACH_ENTRY(vma, &g_heap_vma_list, list) {
-            if (vma->top < vma_above_bottom - size) {
-                ret = __create_vma_and_merge(vma_above_bottom - size, size, is_pal_internal,
-                                             vma_above);
-                goto out;
-            }
-            vma_above = vma;
-            vma_above_bottom = vma_above->bottom;
-        }
-
-        /* corner case: there may be enough space between heap bottom and the lowest-address VMA */
-        if (g_pal_linuxsgx_state.heap_min < vma_above_bottom - size)
-            ret = __create_vma_and_merge(vma_above_bottom - size, size, is_pal_internal, vma_above);
+        uintptr_t free_addr;
+        if (range_tree_find_free(&g_heap_vmas, (uintptr_t)g_pal_linuxsgx_state.heap_min,
+                                 (uintptr_t)g_pal_linuxsgx_state.heap_max, size, &free_addr))
+            ret = __create_vma_and_merge((void*)free_addr, size, is_pal_internal);
     }
 
 out:
@@ -252,60 +175,23 @@ int free_enclave_pages(void* addr, size_t size) {
 
     spinlock_lock(&g_heap_vma_lock);
 
-    /* VMA list contains both normal and pal-internal VMAs; it is impossible to free an area
-     * that overlaps with VMAs of two types at the same time, so we fail in such cases */
-    bool is_pal_internal_set = false;
-    bool is_pal_internal = false;
+    if (!g_free_vmas)
+        __refill_free_vmas();
 
     /* how much memory was actually freed, since [addr, addr + size) can overlap with VMAs */
-    size_t freed = 0;
-
-    struct heap_vma* vma;
-    struct heap_vma* p;
-    LISTP_FOR_EACH_ENTRY_SAFE(vma, p, &g_heap_vma_list, list) {
-        if (vma->bottom >= addr + size)
-            continue;
-        if (vma->top <= addr)
-            break;
-
-        /* found VMA overlapping with area to free; check it is either normal or pal-internal */
-        if (!is_pal_internal_set) {
-            is_pal_internal = vma->is_pal_internal;
-            is_pal_internal_set = true;
-        }
+    size_t freed;
 
-        if (is_pal_internal != vma->is_pal_internal) {
-            log_error("Area to free (address %p, size %lu) overlaps with both normal and "
-                      "pal-internal VMAs",
-                      addr, size);
-            ret = -PAL_ERROR_INVAL;
-            goto out;
-        }
-
-        freed += MIN(vma->top, addr + size) - MAX(vma->bottom, addr);
-
-        if (vma->bottom < addr) {
-            /* create VMA [vma->bottom, addr); this may leave VMA [addr + size, vma->top), see below */
-            struct heap_vma* new = __alloc_vma();
-            if (!new) {
-                log_error("Cannot create split VMA during freeing of address %p", addr);
-                ret = -PAL_ERROR_NOMEM;
-                goto out;
-            }
-            new->top             = addr;
-            new->bottom          = vma->bottom;
-            new->is_pal_internal = vma->is_pal_internal;
-            INIT_LIST_HEAD(new, list);
-            LIST_ADD(new, vma, list);
-        }
-
-        /* compress overlapping VMA to [addr + size, vma->top) */
-        vma->bottom = addr + size;
-        if (vma->top <= addr + size) {
-            /* memory area to free completely covers/extends above the rest of the VMA */
-            LISTP_DEL(vma, &g_heap_vma_list, list);
-            __free_vma(vma);
-        }
+    /* VMA tree contains both normal and pal-internal VMAs; it is impossible to free an area
+     * that overlaps with VMAs of two types at the same time, so we fail in such cases */
+    ret = range_tree_remove(&g_heap_vmas, (uintptr_t)addr, (uintptr_t)addr + size, &freed);
+    if (ret == -PAL_ERROR_INVAL) {
+        log_error("Area to free (address %p, size %lu) overlaps with both normal and "
+                  "pal-internal VMAs",
+                  addr, size);
+        goto out;
+    } else if (ret < 0) {
+        log_error("Cannot create split VMA during freeing of address %p", addr);
+        goto out;
     }
 
     __atomic_sub_fetch(&g_allocated_pages.counter, freed / g_page_size, __ATOMIC_SEQ_CST);
@@ -37,7 +37,10 @@ bool g_pf_wrap_key_set = false;
  */
 
 /* List of map buffers */
-LISTP_TYPE(pf_map) g_pf_map_list = LISTP_INIT;
+static LISTP_TYPE(pf_map) g_pf_map_list = LISTP_INIT;
+
+/* Lock for g_pf_map_list; may be taken while holding a PF lock (but not the other way around) */
+static spinlock_t g_pf_map_list_lock = INIT_SPINLOCK_UNLOCKED;
 
 /* Callbacks for protected files handling */
 static pf_status_t cb_read(pf_handle_t handle, void* buffer, uint64_t offset, size_t size) {
@@ -95,6 +98,44 @@ static pf_status_t cb_write(pf_handle_t handle, const void* buffer, uint64_t off
     return PF_STATUS_SUCCESS;
 }
 
+static pf_status_t cb_writev(pf_handle_t handle, const pf_iovec_t* iov, size_t iov_count,
+                             uint64_t offset) {
+    int fd = *(int*)handle;
+    struct iovec vec[PF_IOV_MAX];
+    assert(iov_count <= PF_IOV_MAX);
+    for (size_t i = 0; i < iov_count; i++) {
+        vec[i].iov_base = (void*)iov[i].buffer;
+        vec[i].iov_len = iov[i].size;
+    }
+
+    ssize_t written;
+    do {
+        written = ocall_pwritev(fd, vec, iov_count, offset);
+    } while (written == -EINTR);
+
+    if (written < 0) {
+        log_warning("cb_writev(%d, %p, %lu, %lu): write failed: %ld", fd, iov, iov_count, offset,
+                    written);
+        return PF_STATUS_CALLBACK_FAILED;
+    }
+
+    /* short write, write the rest buffer by buffer */
+    size_t to_skip = written;
+    for (size_t i = 0; i < iov_count; i++) {
+        if (to_skip < iov[i].size) {
+            pf_status_t status = cb_write(handle, (const uint8_t*)iov[i].buffer + to_skip,
+                                          offset + to_skip, iov[i].size - to_skip);
+            if (PF_FAILURE(status))
+                return status;
+            to_skip = 0;
+        } else {
+            to_skip -= iov[i].size;
+        }
+        offset += iov[i].size;
+    }
+    return PF_STATUS_SUCCESS;
+}
+
 static pf_status_t cb_truncate(pf_handle_t handle, uint64_t size) {
     int fd = *(int*)handle;
     int ret = ocall_ftruncate(fd, size);
@@ -162,16 +203,23 @@ static struct protected_file* g_protected_files = NULL;
 /* Collection of registered protected directories */
 static struct protected_file* g_protected_dirs = NULL;
 
-/* Lock for operations on global PF structures */
+/* Node size of newly created PFs (existing PFs record their own node size) */
+static uint32_t g_pf_node_size = PF_NODE_SIZE;
+
+/* Normalized paths (files or directories) under which new PFs are created integrity-only; only
+ * modified during initialization where Gramine runs single-threaded */
+static char** g_pf_integrity_only_paths = NULL;
+static size_t g_pf_integrity_only_paths_cnt = 0;
+
+/* Lock for the collections of registered PFs and for the wrap key; I/O on PFs doesn't take it,
+ * each PF has its own lock (and each PF context has its own lock inside the PF library) */
 static spinlock_t g_protected_file_lock = INIT_SPINLOCK_UNLOCKED;
 
-/* Take ownership of the global PF lock */
-void pf_lock(void) {
+static void pf_lock(void) {
     spinlock_lock(&g_protected_file_lock);
 }
 
-/* Release ownership of the global PF lock */
-void pf_unlock(void) {
+static void pf_unlock(void) {
     spinlock_unlock(&g_protected_file_lock);
 }
 
@@ -205,33 +253,20 @@ static struct protected_file* find_protected_dir(const char* path) {
     return pf;
 }
 
-/* Find PF by handle */
-struct protected_file* find_protected_file_handle(PAL_HANDLE handle) {
-    char* uri = malloc(URI_MAX);
-    if (!uri) {
-        return NULL;
-    }
-
-    struct protected_file* ret = NULL;
+static int register_protected_path(const char* path, enum pf_key_type key_type,
+                                   struct protected_file** new_pf);
 
-    /* TODO: this logic is inefficient, add a PF reference to PAL_HANDLE instead */
-    int uri_len = _DkStreamGetName(handle, uri, URI_MAX);
-    if (uri_len < 0) {
-        goto out;
+/* Check if path is one of the integrity-only paths or is contained in one of them */
+static bool is_integrity_only_path(const char* path) {
+    for (size_t i = 0; i < g_pf_integrity_only_paths_cnt; i++) {
+        const char* prefix = g_pf_integrity_only_paths[i];
+        size_t prefix_len = strlen(prefix);
+        if (!memcmp(prefix, path, prefix_len) && (!path[prefix_len] || path[prefix_len] == '/'))
+            return true;
     }
-
-    /* uri is prefixed by "file:", we need path */
-    assert(strstartswith(uri, URI_PREFIX_FILE));
-    ret = find_protected_file(uri + URI_PREFIX_FILE_LEN);
-
-out:
-    free(uri);
-    return ret;
+    return false;
 }
 
-static int register_protected_path(const char* path, enum pf_key_type key_type,
-                                   struct protected_file** new_pf);
-
 /* Return a registered PF that matches specified path
    (or the path that is contained in a registered PF directory) */
 struct protected_file* get_protected_file(const char* path) {
@@ -375,9 +410,12 @@ static int register_protected_path(const char* path, enum pf_key_type key_type,
     else
         path = normpath;
 
-    if (find_protected_file(path)) {
+    struct protected_file* old = find_protected_file(path);
+    if (old) {
         ret = 0;
         log_debug("register_protected_path: file %s already registered", path);
+        if (new_pf)
+            *new_pf = old;
         goto out;
     }
 
@@ -388,6 +426,7 @@ static int register_protected_path(const char* path, enum pf_key_type key_type,
     }
 
     new->key_type = key_type;
+    new->integrity_only = is_integrity_only_path(path);
 
     new->path_len = strlen(path);
     /* This is never freed but so isn't the whole struct, PFs persist for the whole lifetime
@@ -399,15 +438,18 @@ static int register_protected_path(const char* path, enum pf_key_type key_type,
     }
 
     memcpy(new->path, path, new->path_len + 1);
+    spinlock_init(&new->lock);
     new->refcount = 0;
-    new->writable_fd = -1;
+    new->host_fd = -1;
+    new->host_fd_owned = false;
 
     bool is_dir;
     ret = is_directory(path, &is_dir);
     if (ret < 0)
         goto out;
 
-    log_debug("register_protected_path: [%s] %s = %p", is_dir ? "dir" : "file", path, new);
+    log_debug("register_protected_path: [%s%s] %s = %p", is_dir ? "dir" : "file",
+              new->integrity_only ? ", integrity-only" : "", path, new);
 
     if (is_dir)
         register_protected_dir(path, key_type);
@@ -417,6 +459,19 @@ static int register_protected_path(const char* path, enum pf_key_type key_type,
     if (is_dir) {
         HASH_ADD_STR(g_protected_dirs, path, new);
     } else {
+        /* another thread may have registered the same file in the meantime (all handles to a file
+         * must share one PF) */
+        HASH_FIND_STR(g_protected_files, path, old);
+        if (old) {
+            pf_unlock();
+            if (new_pf)
+                *new_pf = old;
+            ret = 0;
+            free(new->path);
+            free(new);
+            new = NULL;
+            goto out;
+        }
         HASH_ADD_STR(g_protected_files, path, new);
     }
 
@@ -566,6 +621,83 @@ out:
     return ret;
 }
 
+/* Read `sgx.protected_files_integrity_only = ["file1", ..]`, must be called before registering
+ * the PFs themselves */
+static int read_integrity_only_paths(void) {
+    int ret;
+    toml_table_t* manifest_sgx = toml_table_in(g_pal_public_state.manifest_root, "sgx");
+    if (!manifest_sgx)
+        return 0;
+
+    toml_array_t* toml_paths = toml_array_in(manifest_sgx, "protected_files_integrity_only");
+    if (!toml_paths)
+        return 0;
+
+    ssize_t toml_paths_cnt = toml_array_nelem(toml_paths);
+    if (toml_paths_cnt < 0)
+        return -PAL_ERROR_DENIED;
+    if (toml_paths_cnt == 0)
+        return 0;
+
+    g_pf_integrity_only_paths = calloc(toml_paths_cnt, sizeof(*g_pf_integrity_only_paths));
+    if (!g_pf_integrity_only_paths)
+        return -PAL_ERROR_NOMEM;
+
+    char* toml_path_str = NULL;
+
+    for (ssize_t i = 0; i < toml_paths_cnt; i++) {
+        toml_raw_t toml_path_str_raw = toml_raw_at(toml_paths, i);
+        if (!toml_path_str_raw) {
+            log_error("Invalid integrity-only protected file in manifest at index %ld", i);
+            ret = -PAL_ERROR_INVAL;
+            goto out;
+        }
+
+        ret = toml_rtos(toml_path_str_raw, &toml_path_str);
+        if (ret < 0) {
+            log_error("Invalid integrity-only protected file in manifest at index %ld (not a "
+                      "string)", i);
+            ret = -PAL_ERROR_INVAL;
+            goto out;
+        }
+
+        if (!strstartswith(toml_path_str, URI_PREFIX_FILE)) {
+            log_error("Invalid URI [%s]: Protected files must start with 'file:'", toml_path_str);
+            ret = -PAL_ERROR_INVAL;
+            goto out;
+        }
+
+        size_t normpath_size = strlen(toml_path_str) + 1;
+        char* normpath = malloc(normpath_size);
+        if (!normpath) {
+            ret = -PAL_ERROR_NOMEM;
+            goto out;
+        }
+
+        /* normalize the same way as register_protected_path() does, then discard "file:" */
+        ret = get_norm_path(toml_path_str, normpath, &normpath_size);
+        if (ret < 0) {
+            log_error("Couldn't normalize path (%s): %s", toml_path_str, pal_strerror(ret));
+            free(normpath);
+            goto out;
+        }
+        if (strstartswith(normpath, URI_PREFIX_FILE))
+            memmove(normpath, normpath + URI_PREFIX_FILE_LEN,
+                    strlen(normpath) - URI_PREFIX_FILE_LEN + 1);
+
+        /* this is never freed, the list persists for the whole lifetime of the process */
+        g_pf_integrity_only_paths[g_pf_integrity_only_paths_cnt++] = normpath;
+
+        free(toml_path_str);
+        toml_path_str = NULL;
+    }
+
+    ret = 0;
+out:
+    free(toml_path_str);
+    return ret;
+}
+
 static int register_protected_files(enum pf_key_type key_type) {
     int ret;
 
@@ -598,7 +730,7 @@ int init_protected_files(void) {
     debug_callback = cb_debug;
 #endif
 
-    pf_set_callbacks(cb_read, cb_write, cb_truncate, cb_aes_cmac, cb_aes_gcm_encrypt,
+    pf_set_callbacks(cb_read, cb_write, cb_writev, cb_truncate, cb_aes_cmac, cb_aes_gcm_encrypt,
                      cb_aes_gcm_decrypt, cb_random, debug_callback);
 
     ret = sgx_get_seal_key(SGX_KEYPOLICY_MRENCLAVE, &g_pf_mrenclave_key);
@@ -645,6 +777,28 @@ int init_protected_files(void) {
         g_pf_wrap_key_set = true;
     }
 
+    size_t node_size;
+    ret = toml_sizestring_in(g_pal_public_state.manifest_root, "sgx.protected_files_node_size",
+                             PF_NODE_SIZE, &node_size);
+    if (ret < 0) {
+        log_error("Cannot parse 'sgx.protected_files_node_size'");
+        return -PAL_ERROR_INVAL;
+    }
+
+    if (node_size < PF_NODE_SIZE || node_size > PF_NODE_SIZE_MAX || !IS_POWER_OF_2(node_size)) {
+        log_error("Invalid 'sgx.protected_files_node_size' value (must be a power of two between "
+                  "%u and %u)", PF_NODE_SIZE, PF_NODE_SIZE_MAX);
+        return -PAL_ERROR_INVAL;
+    }
+    g_pf_node_size = node_size;
+
+    ret = read_integrity_only_paths();
+    if (ret < 0) {
+        log_error("Reading 'sgx.protected_files_integrity_only' from the manifest failed: %s",
+                  pal_strerror(ret));
+        return ret;
+    }
+
     ret = register_protected_files(PROTECTED_FILE_KEY_WRAP);
     if (ret < 0) {
         log_error("Malformed protected files found in manifest");
@@ -666,9 +820,10 @@ int init_protected_files(void) {
     return 0;
 }
 
-/* Open/create a PF */
+/* Open/create a PF context */
 static int open_protected_file(const char* path, struct protected_file* pf, pf_handle_t handle,
-                               uint64_t size, pf_file_mode_t mode, bool create) {
+                               uint64_t size, pf_file_mode_t mode, bool create,
+                               pf_context_t** context) {
     pf_key_t* pf_key = NULL;
     switch (pf->key_type) {
         case PROTECTED_FILE_KEY_WRAP:
@@ -690,7 +845,8 @@ static int open_protected_file(const char* path, struct protected_file* pf, pf_h
     }
 
     pf_status_t pfs;
-    pfs = pf_open(handle, path, size, mode, create, pf_key, &pf->context);
+    pfs = pf_open(handle, path, size, mode, create, g_pf_node_size, pf->integrity_only, pf_key,
+                  context);
     if (PF_FAILURE(pfs)) {
         log_warning("pf_open(%d, %s) failed: %s", *(int*)handle, path, pf_strerror(pfs));
         return -PAL_ERROR_DENIED;
@@ -701,25 +857,39 @@ static int open_protected_file(const char* path, struct protected_file* pf, pf_h
 /* Prepare a PF for I/O
    This function registers the PF if path is in a registered PF directory, then
    calls the appropriate PF function to open/create it (if allowed) */
-struct protected_file* load_protected_file(const char* path, int* fd, uint64_t size,
-                                           pf_file_mode_t mode, bool create,
+struct protected_file* load_protected_file(const char* path, int fd, uint64_t size, bool create,
                                            struct protected_file* pf) {
-    log_debug("load_protected_file: %s, fd %d, size %lu, mode %d, create %d, pf %p", path,
-              *fd, size, mode, create, pf);
+    log_debug("load_protected_file: %s, fd %d, size %lu, create %d, pf %p", path, fd, size,
+              create, pf);
 
     if (!pf)
         pf = get_protected_file(path);
 
-    if (pf) {
-        if (!pf->context) {
-            log_debug("load_protected_file: %s, fd %d: opening new PF %p", path, *fd, pf);
-            int ret = open_protected_file(path, pf, (pf_handle_t)fd, size, mode, create);
-            if (ret < 0)
-                return NULL;
-        } else {
-            log_debug("load_protected_file: %s, fd %d: returning old PF %p", path, *fd, pf);
+    if (!pf)
+        return NULL;
+
+    spinlock_lock(&pf->lock);
+    if (!pf->context) {
+        log_debug("load_protected_file: %s, fd %d: opening new PF %p", path, fd, pf);
+        assert(pf->refcount == 0);
+        /* the context is shared by all handles, whatever their access mode (the LibOS checks it),
+         * so it's always writable */
+        pf->host_fd = fd;
+        pf->host_fd_owned = false;
+        int ret = open_protected_file(path, pf, (pf_handle_t)&pf->host_fd, size,
+                                      PF_FILE_MODE_READ | PF_FILE_MODE_WRITE, create,
+                                      &pf->context);
+        if (ret < 0) {
+            pf->host_fd = -1;
+            spinlock_unlock(&pf->lock);
+            return NULL;
         }
+    } else {
+        log_debug("load_protected_file: %s, fd %d: returning old PF %p (fd %d)", path, fd, pf,
+                  pf->host_fd);
     }
+    pf->refcount++;
+    spinlock_unlock(&pf->lock);
 
     return pf;
 }
@@ -735,7 +905,7 @@ int flush_pf_maps(struct protected_file* pf, void* buffer, bool remove) {
     uint64_t pf_size;
     pf_status_t pfs;
 
-    pf_lock();
+    spinlock_lock(&g_pf_map_list_lock);
     LISTP_FOR_EACH_ENTRY_SAFE(map, tmp, &g_pf_map_list, list) {
         if (pf && map->pf != pf)
             continue;
@@ -757,7 +927,7 @@ int flush_pf_maps(struct protected_file* pf, void* buffer, bool remove) {
             pfs = pf_write(map_pf->context, map->offset, map_size, map->buffer);
             if (PF_FAILURE(pfs)) {
                 log_error("flush_pf_maps: pf_write failed: %s", pf_strerror(pfs));
-                pf_unlock();
+                spinlock_unlock(&g_pf_map_list_lock);
                 return -PAL_ERROR_INVAL;
             }
         }
@@ -768,23 +938,88 @@ int flush_pf_maps(struct protected_file* pf, void* buffer, bool remove) {
         }
     }
 
-    pf_unlock();
+    spinlock_unlock(&g_pf_map_list_lock);
     return 0;
 }
 
-/* Flush map buffers and unload/close the PF */
-int unload_protected_file(struct protected_file* pf) {
+/* Add a map buffer to be flushed to the PF on close */
+void add_pf_map(struct pf_map* map) {
+    spinlock_lock(&g_pf_map_list_lock);
+    LISTP_ADD_TAIL(map, &g_pf_map_list, list);
+    spinlock_unlock(&g_pf_map_list_lock);
+}
+
+/* Drop a reference to the PF; the last one flushes map buffers and unloads/closes the PF */
+int unload_protected_file(struct protected_file* pf, int fd, bool* fd_taken) {
+    int ret = 0;
+    *fd_taken = false;
+
+    spinlock_lock(&pf->lock);
+    if (pf->refcount == 0) {
+        log_error("unload_protected_file(%p, fd %d): refcount == 0", pf, fd);
+        ret = -PAL_ERROR_INVAL;
+        goto out;
+    }
+
+    if (--pf->refcount > 0) {
+        if (fd == pf->host_fd && !pf->host_fd_owned) {
+            /* the context keeps using this fd, it will be closed together with the context */
+            pf->host_fd_owned = true;
+            *fd_taken = true;
+        }
+        goto out;
+    }
+
     /* flush all pf's maps and delete them */
-    int ret = flush_pf_maps(pf, NULL, true);
-    if (ret < 0)
-        return ret;
+    ret = flush_pf_maps(pf, NULL, true);
+    if (ret < 0) {
+        pf->refcount++;
+        goto out;
+    }
+
     pf_status_t pfs = pf_close(pf->context);
     if (PF_FAILURE(pfs)) {
         log_warning("unload_protected_file(%p) failed: %s", pf, pf_strerror(pfs));
     }
-
     pf->context = NULL;
-    return 0;
+
+    if (pf->host_fd_owned)
+        ocall_close(pf->host_fd);
+    pf->host_fd = -1;
+    pf->host_fd_owned = false;
+out:
+    spinlock_unlock(&pf->lock);
+    return ret;
+}
+
+/* Get data size of a PF; if no handle to it is open, open it just for this query */
+int get_protected_file_size(struct protected_file* pf, const char* path, int fd,
+                            uint64_t real_size, uint64_t* size) {
+    int ret = 0;
+    pf_status_t pfs;
+
+    spinlock_lock(&pf->lock);
+    if (pf->context) {
+        pfs = pf_get_size(pf->context, size);
+        assert(PF_SUCCESS(pfs));
+        goto out;
+    }
+
+    pf_context_t* context = NULL;
+    ret = open_protected_file(path, pf, (pf_handle_t)&fd, real_size, PF_FILE_MODE_READ,
+                              /*create=*/false, &context);
+    if (ret < 0)
+        goto out;
+
+    pfs = pf_get_size(context, size);
+    assert(PF_SUCCESS(pfs));
+
+    pfs = pf_close(context);
+    assert(PF_SUCCESS(pfs));
+    __UNUSED(pfs);
+out:
+    spinlock_unlock(&pf->lock);
+    return ret;
 }
 
 int set_protected_files_key(const char* pf_key_hex) {
@@ -11,11 +11,11 @@
  * Features:
  * - Data is encrypted (confidentiality) and integrity protected (tamper resistance).
  * - File swap protection (a PF can only be accessed when in a specific path).
+ * - Optional integrity-only mode (data is authenticated but stored in plaintext).
  * - Transparency (Gramine app sees PFs as regular files, no need to modify the app).
  *
  * Limitations:
  * - Metadata currently limits PF path size to 512 bytes and filename size to 260 bytes.
- * - Truncating protected files is not yet implemented.
  * - The recovery file feature is disabled (present in Intel SGX SDK).
  */
 
@@ -29,6 +29,7 @@
 #include "pal.h"
 #include "pal_internal.h"
 #include "protected_files.h"
+#include "spinlock.h"
 
 /* Used to track map buffers for protected files */
 DEFINE_LIST(pf_map);
@@ -41,32 +42,31 @@ struct pf_map {
 };
 DEFINE_LISTP(pf_map);
 
-/* List of PF map buffers; this list is traversed on PF flush (on file close) */
-extern LISTP_TYPE(pf_map) g_pf_map_list;
-
 enum pf_key_type {
     PROTECTED_FILE_KEY_WRAP,
     PROTECTED_FILE_KEY_MRENCLAVE,
     PROTECTED_FILE_KEY_MRSIGNER,
 };
 
-/* Data of a protected file */
+/* Data of a protected file
+ *
+ * All handles to the file share one PF context (and its node cache). The context is opened with
+ * the underlying fd of the first handle; if that handle is closed while others are still open, the
+ * PF takes over its fd. Operations on the context are serialized by the PF library (per context),
+ * `lock` only protects opening/closing it. */
 struct protected_file {
     UT_hash_handle hh;
     size_t path_len;
     char* path;
-    pf_context_t* context; /* NULL until PF is opened */
-    int64_t refcount; /* used for deciding when to call unload_protected_file() */
-    int writable_fd; /* fd of underlying file for writable PF, -1 if no writable handles are open */
+    spinlock_t lock; /* protects context, refcount and host_fd (taken before g_pf_map_list_lock) */
+    pf_context_t* context; /* NULL until PF is opened, stays valid while refcount > 0 */
+    int64_t refcount; /* number of handles using the context */
+    int host_fd; /* fd of underlying file used by the context, -1 if PF is not opened */
+    bool host_fd_owned; /* handle that opened host_fd was closed, close it together with context */
     enum pf_key_type key_type;
+    bool integrity_only; /* new PF is created integrity-only (data authenticated, not encrypted) */
 };
 
-/* Take ownership of the global PF lock */
-void pf_lock(void);
-
-/* Release ownership of the global PF lock */
-void pf_unlock(void);
-
 /* Set new wrap key for protected files (e.g., provisioned by remote user) */
 int set_protected_files_key(const char* pf_key_hex);
 
@@ -74,18 +74,17 @@ int set_protected_files_key(const char* pf_key_hex);
    (or the path is contained in a registered PF directory) */
 struct protected_file* get_protected_file(const char* path);
 
-/* Load and initialize a PF (must be called before any I/O operations)
+/* Load and initialize a PF (must be called before any I/O operations) and take a reference to it,
+ * which must be dropped with unload_protected_file()
  *
  * path:   normalized host path
- * fd:     pointer to an opened file descriptor (must point to a valid value for the whole time PF
- *         is being accessed)
+ * fd:     file descriptor of the underlying file, opened for reading and writing (used by the PF
+ *         context if the PF is not opened yet)
  * size:   underlying file size (in bytes)
- * mode:   access mode
  * create: if true, the PF is being created/truncated
  * pf:     (optional) PF pointer if already known
  */
-struct protected_file* load_protected_file(const char* path, int* fd, size_t size,
-                                           pf_file_mode_t mode, bool create,
+struct protected_file* load_protected_file(const char* path, int fd, uint64_t size, bool create,
                                            struct protected_file* pf);
 
 /* Flush PF map buffers and optionally remove and free them.
@@ -93,15 +92,25 @@ struct protected_file* load_protected_file(const char* path, int* fd, size_t siz
    If buffer is NULL, process all maps for given pf. */
 int flush_pf_maps(struct protected_file* pf, void* buffer, bool remove);
 
-/* Flush map buffers and unload/close the PF */
-int unload_protected_file(struct protected_file* pf);
+/* Add a PF map buffer; it is flushed to the PF on PF flush (on file close) */
+void add_pf_map(struct pf_map* map);
+
+/* Drop a reference taken by load_protected_file(), the last one flushes map buffers and
+ * unloads/closes the PF
+ *
+ * fd:       file descriptor that was passed to load_protected_file()
+ * fd_taken: set to true if the PF context keeps using fd (the caller must not close it)
+ */
+int unload_protected_file(struct protected_file* pf, int fd, bool* fd_taken);
+
+/* Get data size of a PF; if the PF is not loaded, it is opened read-only just for the query
+ * (using fd and real_size of the underlying file) */
+int get_protected_file_size(struct protected_file* pf, const char* path, int fd,
+                            uint64_t real_size, uint64_t* size);
 
 /* Find registered PF by path (exact match) */
 struct protected_file* find_protected_file(const char* path);
 
-/* Find protected file by handle (uses handle's path to call find_protected_file) */
-struct protected_file* find_protected_file_handle(PAL_HANDLE handle);
-
 /* Initialize the PF library, register PFs from the manifest */
 int init_protected_files(void);
 
@@ -64,18 +64,17 @@ int load_trusted_or_allowed_file(struct trusted_file* tf, PAL_HANDLE file, bool
  * \param path            file path (currently only for a log message)
  * \param buf             in-enclave buffer where contents of the file are copied
  * \param umem            start of untrusted file memory mapped outside the enclave
- * \param aligned_offset  offset into file contents to copy, aligned to TRUSTED_CHUNK_SIZE
- * \param aligned_end     end of file contents to copy, aligned to TRUSTED_CHUNK_SIZE
- * \param offset          unaligned offset into file contents to copy
- * \param end             unaligned end of file contents to copy
+ * \param offset          offset into file contents to copy (may be unaligned)
+ * \param end             end of file contents to copy (may be unaligned)
  * \param chunk_hashes    array of hashes of all file chunks
  * \param file_size       total size of the file
  *
+ * All TRUSTED_CHUNK_SIZE chunks overlapping with [offset, end) are verified, see `chunk_verify.h`.
+ *
  * \return 0 on success, negative error code on failure
  */
-int copy_and_verify_trusted_file(const char* path, uint8_t* buf, const void* umem,
-                                 off_t aligned_offset, off_t aligned_end, off_t offset, off_t end,
-                                 sgx_chunk_hash_t* chunk_hashes, size_t file_size);
+int copy_and_verify_trusted_file(const char* path, uint8_t* buf, const void* umem, off_t offset,
+                                 off_t end, sgx_chunk_hash_t* chunk_hashes, size_t file_size);
 
 int init_trusted_files(void);
 int init_allowed_files(void);
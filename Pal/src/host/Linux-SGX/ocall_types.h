@@ -29,6 +29,7 @@ enum {
     OCALL_MMAP_UNTRUSTED,
     OCALL_MUNMAP_UNTRUSTED,
     OCALL_CPUID,
+    OCALL_CPUID_BATCH,
     OCALL_OPEN,
     OCALL_CLOSE,
     OCALL_READ,
@@ -94,6 +95,11 @@ typedef struct {
     unsigned int ms_values[4];
 } ms_ocall_cpuid_t;
 
+typedef struct {
+    ms_ocall_cpuid_t* ms_cpuids;
+    size_t ms_count;
+} ms_ocall_cpuid_batch_t;
+
 typedef struct {
     const char* ms_pathname;
     int ms_flags;
@@ -24,6 +24,8 @@
 void* malloc_untrusted(size_t size);
 void free_untrusted(void* mem);
 
+struct protected_file;
+
 DEFINE_LIST(pal_handle_thread);
 struct pal_handle_thread {
     PAL_HDR reserved;
@@ -64,6 +66,7 @@ typedef struct {
             sgx_chunk_hash_t* chunk_hashes; /* array of hashes of file chunks */
             void* umem;                     /* valid only when chunk_hashes != NULL */
             bool seekable;                  /* regular files are seekable, FIFO pipes are not */
+            struct protected_file* pf;      /* NULL if not a protected file */
         } file;
 
         struct {
@@ -177,3 +177,18 @@ void lruc_remove_last(lruc_context_t* lruc) {
     free(ln);
     free(mn);
 }
+
+void lruc_remove(lruc_context_t* lruc, uint64_t key) {
+    lruc_map_node_t* mn = get_map_node(lruc, key);
+    if (!mn)
+        return;
+
+    lruc_list_node_t* ln = mn->list_ptr;
+    assert(ln != NULL);
+    if (lruc->current == ln)
+        lruc->current = NULL;
+    LISTP_DEL(ln, &lruc->list, list);
+    HASH_DEL(lruc->map, mn);
+    free(ln);
+    free(mn);
+}
@@ -28,6 +28,7 @@ void* lruc_get_first(lruc_context_t* context);
 void* lruc_get_next(lruc_context_t* context);
 void* lruc_get_last(lruc_context_t* context);
 void lruc_remove_last(lruc_context_t* context);
+void lruc_remove(lruc_context_t* context, uint64_t key);
 
 void lruc_test(void);
 
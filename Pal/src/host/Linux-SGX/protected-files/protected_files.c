@@ -21,6 +21,7 @@
 /* Host callbacks */
 static pf_read_f     g_cb_read     = NULL;
 static pf_write_f    g_cb_write    = NULL;
+static pf_writev_f   g_cb_writev   = NULL;
 static pf_truncate_f g_cb_truncate = NULL;
 static pf_debug_f    g_cb_debug    = NULL;
 
@@ -152,16 +153,10 @@ static bool ipf_init_fields(pf_context_t* pf) {
         return false;
     }
 #endif
+    rwlock_init(&pf->lock);
     memset(&pf->file_metadata, 0, sizeof(pf->file_metadata));
     memset(&pf->encrypted_part_plain, 0, sizeof(pf->encrypted_part_plain));
     memset(&g_empty_iv, 0, sizeof(g_empty_iv));
-    memset(&pf->root_mht, 0, sizeof(pf->root_mht));
-
-    pf->root_mht.type                 = FILE_MHT_NODE_TYPE;
-    pf->root_mht.physical_node_number = 1;
-    pf->root_mht.node_number          = 0;
-    pf->root_mht.new_node             = true;
-    pf->root_mht.need_writing         = false;
 
     pf->offset         = 0;
     pf->file           = NULL;
@@ -175,8 +170,140 @@ static bool ipf_init_fields(pf_context_t* pf) {
     return true;
 }
 
+static bool ipf_is_valid_node_size(uint32_t node_size) {
+    return node_size >= PF_NODE_SIZE && node_size <= PF_NODE_SIZE_MAX && IS_POWER_OF_2(node_size);
+}
+
+// set up the parts of the context that depend on the node size, once it's known
+static bool ipf_init_node_size(pf_context_t* pf, uint32_t node_size) {
+    assert(ipf_is_valid_node_size(node_size));
+
+    pf->node_size                 = node_size;
+    pf->attached_data_nodes_count = ATTACHED_DATA_NODES_COUNT(node_size);
+    pf->child_mht_nodes_count     = CHILD_MHT_NODES_COUNT(node_size);
+    pf->max_nodes_in_cache        = MAX(MAX_PAGES_IN_CACHE * PF_NODE_SIZE / node_size,
+                                        MIN_PAGES_IN_CACHE);
+    pf->max_nodes_in_write_run    = MIN(MAX(MAX_WRITE_RUN_SIZE / node_size, 1U),
+                                        MAX_NODES_IN_WRITE_RUN);
+
+    pf->node_buffer = malloc(node_size);
+    if (!pf->node_buffer) {
+        pf->last_error = PF_STATUS_NO_MEMORY;
+        return false;
+    }
+
+    pf->root_mht = ipf_alloc_node(pf, FILE_MHT_NODE_TYPE);
+    if (!pf->root_mht)
+        return false;
+
+    pf->root_mht->physical_node_number = 1;
+    pf->root_mht->node_number          = 0;
+    pf->root_mht->new_node             = true;
+    pf->root_mht->need_writing         = false;
+    return true;
+}
+
+// allocate a zeroed file node, together with its buffers for encrypted and decrypted data; data
+// nodes of integrity-only files are stored in plaintext, so they need only one buffer
+static file_node_t* ipf_alloc_node(pf_context_t* pf, uint8_t type) {
+    bool plaintext = pf->integrity_only && type == FILE_DATA_NODE_TYPE;
+    size_t buffers_size = (plaintext ? 1 : 2) * (size_t)pf->node_size;
+
+    file_node_t* file_node = calloc(1, sizeof(*file_node) + buffers_size);
+    if (!file_node) {
+        pf->last_error = PF_STATUS_NO_MEMORY;
+        return NULL;
+    }
+
+    file_node->type      = type;
+    file_node->encrypted = (uint8_t*)(file_node + 1);
+    file_node->decrypted = plaintext ? file_node->encrypted : file_node->encrypted + pf->node_size;
+    return file_node;
+}
+
+static void ipf_free_node(pf_context_t* pf, file_node_t* file_node) {
+    // before deleting the memory, need to scrub the plain secrets
+    erase_memory(file_node->decrypted, pf->node_size);
+    free(file_node);
+}
+
+// crypto data of the data nodes attached to an mht node
+static gcm_crypto_data_t* ipf_data_nodes_crypto(file_node_t* file_mht_node) {
+    assert(file_mht_node->type == FILE_MHT_NODE_TYPE);
+    return (gcm_crypto_data_t*)file_mht_node->decrypted;
+}
+
+// crypto data of the child mht nodes of an mht node (follows the data nodes crypto)
+static gcm_crypto_data_t* ipf_mht_nodes_crypto(pf_context_t* pf, file_node_t* file_mht_node) {
+    return ipf_data_nodes_crypto(file_mht_node) + pf->attached_data_nodes_count;
+}
+
+// generate a new key for a data node and encrypt it from `input` to `output`; for integrity-only
+// files the plaintext is stored as is, only its gmac is computed (`output` must be `input`)
+static bool ipf_protect_data_node(pf_context_t* pf, const void* input, void* output,
+                                  gcm_crypto_data_t* gcm_crypto_data) {
+    pf_status_t status;
+
+    if (!ipf_generate_random_key(pf, &gcm_crypto_data->key))
+        return false;
+
+    if (pf->integrity_only) {
+        assert(input == output);
+        // the plaintext is authenticated as additional data, there's nothing to encrypt
+        status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, input, pf->node_size,
+                                      NULL, 0, NULL, &gcm_crypto_data->gmac);
+    } else {
+        status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0, // aad
+                                      input, pf->node_size, output, &gcm_crypto_data->gmac);
+    }
+    if (PF_FAILURE(status)) {
+        pf->last_error = status;
+        return false;
+    }
+
+    return true;
+}
+
+// decrypt a data node from `input` to `output`, checking its integrity against the gmac; for
+// integrity-only files only the gmac of the plaintext is checked (`output` must be `input`)
+static bool ipf_unprotect_data_node(pf_context_t* pf, const void* input, void* output,
+                                    const gcm_crypto_data_t* gcm_crypto_data) {
+    pf_status_t status;
+
+    if (pf->integrity_only) {
+        assert(input == output);
+        status = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, input, pf->node_size,
+                                      NULL, 0, NULL, &gcm_crypto_data->gmac);
+    } else {
+        status = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0, // aad
+                                      input, pf->node_size, output, &gcm_crypto_data->gmac);
+    }
+    if (PF_FAILURE(status)) {
+        pf->last_error = status;
+        if (status == PF_STATUS_MAC_MISMATCH)
+            pf->file_status = PF_STATUS_CORRUPTED;
+        return false;
+    }
+
+    return true;
+}
+
+// part of the metadata node authenticated as additional data of its encrypted part (the node size
+// and flags, as far as the file version records them)
+static size_t ipf_metadata_aad_size(pf_context_t* pf) {
+    switch (pf->file_metadata.plain_part.minor_version) {
+        case PF_MINOR_VERSION_DEFAULT_NODE_SIZE:
+            return 0;
+        case PF_MINOR_VERSION_NODE_SIZE:
+            return sizeof(pf->file_metadata.node_size);
+        default:
+            return sizeof(pf->file_metadata.node_size) + sizeof(pf->file_metadata.flags);
+    }
+}
+
 static pf_context_t* ipf_open(const char* path, pf_file_mode_t mode, bool create, pf_handle_t file,
-                              uint64_t real_size, const pf_key_t* kdk_key, pf_status_t* status) {
+                              uint64_t real_size, uint32_t node_size, bool integrity_only,
+                              const pf_key_t* kdk_key, pf_status_t* status) {
     *status = PF_STATUS_NO_MEMORY;
     pf_context_t* pf = calloc(1, sizeof(*pf));
 
@@ -214,6 +341,7 @@ static pf_context_t* ipf_open(const char* path, pf_file_mode_t mode, bool create
         goto out;
     }
 
+    // the metadata node and all node sizes are multiples of PF_NODE_SIZE
     if (real_size % PF_NODE_SIZE != 0) {
         pf->last_error = PF_STATUS_INVALID_HEADER;
         goto out;
@@ -230,7 +358,7 @@ static pf_context_t* ipf_open(const char* path, pf_file_mode_t mode, bool create
 
     } else {
         // new file
-        if (!ipf_init_new_file(pf, path))
+        if (!ipf_init_new_file(pf, path, node_size, integrity_only))
             goto out;
     }
 
@@ -243,6 +371,10 @@ out:
 
     if (pf && PF_FAILURE(pf->last_error)) {
         DEBUG_PF("failed: %d", pf->last_error);
+        if (pf->root_mht)
+            ipf_free_node(pf, pf->root_mht);
+        free(pf->node_buffer);
+        free(pf->write_run_buffer);
         free(pf);
         pf = NULL;
     }
@@ -250,9 +382,16 @@ out:
     return pf;
 }
 
+// node 0 is the metadata node, all the following ones are data and mht nodes of the same size
+static uint64_t ipf_node_offset(pf_context_t* pf, uint64_t node_number) {
+    if (node_number == 0)
+        return 0;
+    return METADATA_NODE_SIZE + (node_number - 1) * pf->node_size;
+}
+
 static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_number, void* buffer,
                           uint32_t node_size) {
-    uint64_t offset = node_number * node_size;
+    uint64_t offset = ipf_node_offset(pf, node_number);
 
     pf_status_t status = g_cb_read(handle, buffer, offset, node_size);
     if (PF_FAILURE(status)) {
@@ -263,8 +402,8 @@ static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_nu
     return true;
 }
 
-static bool ipf_write_file(pf_context_t* pf, pf_handle_t handle, uint64_t offset, void* buffer,
-                           uint32_t size) {
+static bool ipf_write_file(pf_context_t* pf, pf_handle_t handle, uint64_t offset,
+                           const void* buffer, uint32_t size) {
     pf_status_t status = g_cb_write(handle, buffer, offset, size);
     if (PF_FAILURE(status)) {
         pf->last_error = status;
@@ -274,9 +413,34 @@ static bool ipf_write_file(pf_context_t* pf, pf_handle_t handle, uint64_t offset
     return true;
 }
 
+// write the buffers one after another, with a single callback if the vectored one is available
+static bool ipf_write_file_vectored(pf_context_t* pf, pf_handle_t handle, uint64_t offset,
+                                    const pf_iovec_t* iov, size_t iov_count) {
+    assert(iov_count <= PF_IOV_MAX);
+
+    if (g_cb_writev) {
+        pf_status_t status = g_cb_writev(handle, iov, iov_count, offset);
+        if (PF_FAILURE(status)) {
+            pf->last_error = status;
+            return false;
+        }
+        return true;
+    }
+
+    for (size_t i = 0; i < iov_count; i++) {
+        pf_status_t status = g_cb_write(handle, iov[i].buffer, offset, iov[i].size);
+        if (PF_FAILURE(status)) {
+            pf->last_error = status;
+            return false;
+        }
+        offset += iov[i].size;
+    }
+    return true;
+}
+
 static bool ipf_write_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_number, void* buffer,
                            uint32_t node_size) {
-    return ipf_write_file(pf, handle, node_number * node_size, buffer, node_size);
+    return ipf_write_file(pf, handle, ipf_node_offset(pf, node_number), buffer, node_size);
 }
 
 static bool ipf_init_existing_file(pf_context_t* pf, const char* path) {
@@ -284,7 +448,7 @@ static bool ipf_init_existing_file(pf_context_t* pf, const char* path) {
 
     // read meta-data node
     if (!ipf_read_node(pf, pf->file, /*node_number=*/0, (uint8_t*)&pf->file_metadata,
-                       PF_NODE_SIZE)) {
+                       METADATA_NODE_SIZE)) {
         return false;
     }
 
@@ -294,17 +458,41 @@ static bool ipf_init_existing_file(pf_context_t* pf, const char* path) {
         return false;
     }
 
-    if (pf->file_metadata.plain_part.major_version != PF_MAJOR_VERSION) {
+    if (pf->file_metadata.plain_part.major_version != PF_MAJOR_VERSION
+            || pf->file_metadata.plain_part.minor_version > PF_MINOR_VERSION) {
         pf->last_error = PF_STATUS_INVALID_VERSION;
         return false;
     }
 
+    // version 1.0 files have the default node size and no flags; newer ones record them in the
+    // metadata node, authenticated as additional data when decrypting the metadata below
+    uint32_t node_size = PF_NODE_SIZE;
+    uint32_t flags = 0;
+    size_t aad_size = ipf_metadata_aad_size(pf);
+    const void* aad = aad_size ? &pf->file_metadata.node_size : NULL;
+    if (aad_size >= sizeof(pf->file_metadata.node_size))
+        node_size = pf->file_metadata.node_size;
+    if (aad_size >= sizeof(pf->file_metadata.node_size) + sizeof(pf->file_metadata.flags))
+        flags = pf->file_metadata.flags;
+
+    if (!ipf_is_valid_node_size(node_size)
+            || (pf->real_file_size - METADATA_NODE_SIZE) % node_size != 0
+            || (flags & ~PF_FLAGS_ALL) != 0) {
+        pf->last_error = PF_STATUS_INVALID_HEADER;
+        return false;
+    }
+
+    pf->integrity_only = flags & PF_FLAG_INTEGRITY_ONLY;
+
+    if (!ipf_init_node_size(pf, node_size))
+        return false;
+
     pf_key_t key;
     if (!ipf_restore_current_metadata_key(pf, &key))
         return false;
 
     // decrypt the encrypted part of the meta-data
-    status = g_cb_aes_gcm_decrypt(&key, &g_empty_iv, NULL, 0,
+    status = g_cb_aes_gcm_decrypt(&key, &g_empty_iv, aad, aad_size,
                                   &pf->file_metadata.encrypted_part,
                                   sizeof(pf->file_metadata.encrypted_part),
                                   &pf->encrypted_part_plain,
@@ -328,31 +516,48 @@ static bool ipf_init_existing_file(pf_context_t* pf, const char* path) {
 
     if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE) {
         // read the root node of the mht
-        if (!ipf_read_node(pf, pf->file, /*node_number=*/1, &pf->root_mht.encrypted.cipher,
-                           PF_NODE_SIZE))
+        if (!ipf_read_node(pf, pf->file, /*node_number=*/1, pf->root_mht->encrypted,
+                           pf->node_size))
             return false;
 
         // this also verifies the root mht gmac against the gmac in the meta-data encrypted part
         status = g_cb_aes_gcm_decrypt(&pf->encrypted_part_plain.mht_key, &g_empty_iv,
                                       NULL, 0, // aad
-                                      &pf->root_mht.encrypted.cipher, PF_NODE_SIZE,
-                                      &pf->root_mht.decrypted.mht,
+                                      pf->root_mht->encrypted, pf->node_size,
+                                      pf->root_mht->decrypted,
                                       &pf->encrypted_part_plain.mht_gmac);
         if (PF_FAILURE(status)) {
             pf->last_error = status;
             return false;
         }
 
-        pf->root_mht.new_node = false;
+        pf->root_mht->new_node = false;
     }
 
     return true;
 }
 
-static bool ipf_init_new_file(pf_context_t* pf, const char* path) {
+static bool ipf_init_new_file(pf_context_t* pf, const char* path, uint32_t node_size,
+                              bool integrity_only) {
+    if (!ipf_is_valid_node_size(node_size)) {
+        pf->last_error = PF_STATUS_INVALID_PARAMETER;
+        return false;
+    }
+
+    pf->integrity_only = integrity_only;
+
+    if (!ipf_init_node_size(pf, node_size))
+        return false;
+
     pf->file_metadata.plain_part.file_id       = PF_FILE_ID;
     pf->file_metadata.plain_part.major_version = PF_MAJOR_VERSION;
-    pf->file_metadata.plain_part.minor_version = PF_MINOR_VERSION;
+    if (node_size == PF_NODE_SIZE && !integrity_only) {
+        pf->file_metadata.plain_part.minor_version = PF_MINOR_VERSION_DEFAULT_NODE_SIZE;
+    } else {
+        pf->file_metadata.plain_part.minor_version = PF_MINOR_VERSION;
+        pf->file_metadata.node_size = node_size;
+        pf->file_metadata.flags = integrity_only ? PF_FLAG_INTEGRITY_ONLY : 0;
+    }
 
     // path length is checked in ipf_open()
     memcpy(pf->encrypted_part_plain.path, path, strlen(path) + 1);
@@ -380,15 +585,16 @@ static bool ipf_close(pf_context_t* pf) {
     pf->file_status = PF_STATUS_UNINITIALIZED;
 
     while ((data = lruc_get_last(pf->cache)) != NULL) {
-        file_node_t* file_node = (file_node_t*)data;
-        erase_memory(&file_node->decrypted, sizeof(file_node->decrypted));
-        free(file_node);
+        ipf_free_node(pf, (file_node_t*)data);
         lruc_remove_last(pf->cache);
     }
 
     // scrub first MD_USER_DATA_SIZE of file data and the gmac_key
     erase_memory(&pf->encrypted_part_plain, sizeof(pf->encrypted_part_plain));
 
+    ipf_free_node(pf, pf->root_mht);
+    free(pf->node_buffer);
+    free(pf->write_run_buffer);
     lruc_destroy(pf->cache);
 
 #ifdef DEBUG
@@ -406,7 +612,7 @@ static bool ipf_internal_flush(pf_context_t* pf) {
         return true;
     }
 
-    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht.need_writing) {
+    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht->need_writing) {
         // otherwise it's just one write - the meta-data node
         if (!ipf_update_all_data_and_mht_nodes(pf)) {
             // this is something that shouldn't happen, can't fix this...
@@ -491,21 +697,14 @@ static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
 
             if (data_node->need_writing) {
                 gcm_crypto_data_t* gcm_crypto_data =
-                    &data_node->parent->decrypted.mht
-                         .data_nodes_crypto[data_node->node_number % ATTACHED_DATA_NODES_COUNT];
-
-                if (!ipf_generate_random_key(pf, &gcm_crypto_data->key))
-                    goto out;
+                    &ipf_data_nodes_crypto(data_node->parent)[data_node->node_number
+                                                              % pf->attached_data_nodes_count];
 
                 // encrypt the data, this also saves the gmac of the operation in the mht crypto
                 // node
-                status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,  // aad
-                                              data_node->decrypted.data.data, PF_NODE_SIZE,
-                                              data_node->encrypted.cipher, &gcm_crypto_data->gmac);
-                if (PF_FAILURE(status)) {
-                    pf->last_error = status;
+                if (!ipf_protect_data_node(pf, data_node->decrypted, data_node->encrypted,
+                                           gcm_crypto_data))
                     goto out;
-                }
 
                 file_mht_node = data_node->parent;
 #ifdef DEBUG
@@ -560,16 +759,16 @@ static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
         file_mht_node = mht_array[dirty_idx - 1];
 
         gcm_crypto_data_t* gcm_crypto_data =
-            &file_mht_node->parent->decrypted.mht
-                 .mht_nodes_crypto[(file_mht_node->node_number - 1) % CHILD_MHT_NODES_COUNT];
+            &ipf_mht_nodes_crypto(pf, file_mht_node->parent)[(file_mht_node->node_number - 1)
+                                                             % pf->child_mht_nodes_count];
 
         if (!ipf_generate_random_key(pf, &gcm_crypto_data->key)) {
             goto out;
         }
 
         status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
-                                      &file_mht_node->decrypted.mht, PF_NODE_SIZE,
-                                      &file_mht_node->encrypted.cipher, &gcm_crypto_data->gmac);
+                                      file_mht_node->decrypted, pf->node_size,
+                                      file_mht_node->encrypted, &gcm_crypto_data->gmac);
         if (PF_FAILURE(status)) {
             pf->last_error = status;
             goto out;
@@ -582,8 +781,8 @@ static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
 
     status = g_cb_aes_gcm_encrypt(&pf->encrypted_part_plain.mht_key, &g_empty_iv,
                                   NULL, 0,
-                                  &pf->root_mht.decrypted.mht, PF_NODE_SIZE,
-                                  &pf->root_mht.encrypted.cipher,
+                                  pf->root_mht->decrypted, pf->node_size,
+                                  pf->root_mht->encrypted,
                                   &pf->encrypted_part_plain.mht_gmac);
     if (PF_FAILURE(status)) {
         pf->last_error = status;
@@ -607,8 +806,12 @@ static bool ipf_update_metadata_node(pf_context_t* pf) {
         return false;
     }
 
+    // the node size and flags (if recorded) are authenticated as additional data
+    size_t aad_size = ipf_metadata_aad_size(pf);
+    const void* aad = aad_size ? &pf->file_metadata.node_size : NULL;
+
     // encrypt meta data encrypted part, also updates the gmac in the meta data plain part
-    status = g_cb_aes_gcm_encrypt(&key, &g_empty_iv, NULL, 0, &pf->encrypted_part_plain,
+    status = g_cb_aes_gcm_encrypt(&key, &g_empty_iv, aad, aad_size, &pf->encrypted_part_plain,
                                   sizeof(metadata_encrypted_t), &pf->file_metadata.encrypted_part,
                                   &pf->file_metadata.plain_part.metadata_gmac);
     if (PF_FAILURE(status)) {
@@ -619,39 +822,75 @@ static bool ipf_update_metadata_node(pf_context_t* pf) {
     return true;
 }
 
+// write the (encrypted) nodes, sorted by physical node number; runs of adjacent nodes are written
+// with a single callback
+static bool ipf_write_nodes(pf_context_t* pf, file_node_t** file_nodes, size_t nodes_count) {
+    pf_iovec_t iov[PF_IOV_MAX];
+
+    size_t i = 0;
+    while (i < nodes_count) {
+        uint64_t first_node_number = file_nodes[i]->physical_node_number;
+        size_t run = 0;
+        while (i + run < nodes_count && run < PF_IOV_MAX
+                && file_nodes[i + run]->physical_node_number == first_node_number + run) {
+            iov[run].buffer = file_nodes[i + run]->encrypted;
+            iov[run].size = pf->node_size;
+            run++;
+        }
+
+        if (!ipf_write_file_vectored(pf, pf->file, ipf_node_offset(pf, first_node_number), iov,
+                                     run)) {
+            return false;
+        }
+
+        for (size_t j = i; j < i + run; j++) {
+            file_nodes[j]->need_writing = false;
+            file_nodes[j]->new_node = false;
+        }
+        i += run;
+    }
+
+    return true;
+}
+
 static bool ipf_write_all_changes_to_disk(pf_context_t* pf) {
-    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht.need_writing) {
-        void* data = NULL;
-        uint8_t* data_to_write;
-        uint64_t node_number;
-        file_node_t* file_node;
+    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht->need_writing) {
+        // the root mht node and the dirty nodes from the cache
+        file_node_t** file_nodes = malloc((lruc_size(pf->cache) + 1) * sizeof(*file_nodes));
+        if (!file_nodes) {
+            pf->last_error = PF_STATUS_NO_MEMORY;
+            return false;
+        }
 
+        size_t nodes_count = 0;
+        file_nodes[nodes_count++] = pf->root_mht;
+
+        void* data;
         for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
-            file_node = (file_node_t*)data;
+            file_node_t* file_node = (file_node_t*)data;
             if (!file_node->need_writing)
                 continue;
 
-            data_to_write = (uint8_t*)&file_node->encrypted;
-            node_number = file_node->physical_node_number;
-
-            if (!ipf_write_node(pf, pf->file, node_number, data_to_write, PF_NODE_SIZE)) {
-                return false;
+            // insertion sort by physical node number; the cache is small and is usually walked
+            // in reverse order of the nodes anyway
+            uint64_t physical_node_number = file_node->physical_node_number;
+            size_t pos = nodes_count++;
+            while (pos > 0 && file_nodes[pos - 1]->physical_node_number > physical_node_number) {
+                file_nodes[pos] = file_nodes[pos - 1];
+                pos--;
             }
-
-            file_node->need_writing = false;
-            file_node->new_node = false;
+            file_nodes[pos] = file_node;
         }
 
-        if (!ipf_write_node(pf, pf->file, /*node_number=*/1, &pf->root_mht.encrypted,
-                            PF_NODE_SIZE)) {
+        bool ret = ipf_write_nodes(pf, file_nodes, nodes_count);
+        free(file_nodes);
+        if (!ret)
             return false;
-        }
-
-        pf->root_mht.need_writing = false;
-        pf->root_mht.new_node = false;
     }
 
-    if (!ipf_write_node(pf, pf->file, /*node_number=*/0, &pf->file_metadata, PF_NODE_SIZE)) {
+    // the metadata node goes last, after all the nodes it (indirectly) describes
+    if (!ipf_write_node(pf, pf->file, /*node_number=*/0, &pf->file_metadata,
+                        METADATA_NODE_SIZE)) {
         return false;
     }
 
@@ -674,7 +913,7 @@ static bool ipf_seek(pf_context_t* pf, uint64_t new_offset) {
         result = true;
     } else if (pf->mode & PF_FILE_MODE_WRITE) {
         // need to extend the file
-        result = PF_SUCCESS(pf_set_size(pf, new_offset));
+        result = ipf_set_size(pf, new_offset);
     }
 
     if (result)
@@ -685,6 +924,28 @@ static bool ipf_seek(pf_context_t* pf, uint64_t new_offset) {
     return result;
 }
 
+static bool ipf_set_size(pf_context_t* pf, uint64_t new_size) {
+    if (!(pf->mode & PF_FILE_MODE_WRITE)) {
+        pf->last_error = PF_STATUS_INVALID_MODE;
+        return false;
+    }
+
+    if (new_size == pf->encrypted_part_plain.size)
+        return true;
+
+    if (new_size > pf->encrypted_part_plain.size) {
+        // extend the file
+        size_t extend_by = new_size - pf->encrypted_part_plain.size;
+        pf->offset = pf->encrypted_part_plain.size;
+        DEBUG_PF("extending the file from %lu to %lu", pf->offset, new_size);
+        return ipf_write(pf, NULL, extend_by) == extend_by;
+    }
+
+    // shrink the file
+    DEBUG_PF("shrinking the file from %lu to %lu", pf->encrypted_part_plain.size, new_size);
+    return ipf_shrink(pf, new_size);
+}
+
 static void ipf_try_clear_error(pf_context_t* pf) {
     if (pf->file_status == PF_STATUS_UNINITIALIZED ||
         pf->file_status == PF_STATUS_CRYPTO_ERROR ||
@@ -763,21 +1024,40 @@ static size_t ipf_write(pf_context_t* pf, const void* ptr, size_t size) {
     }
 
     while (data_left_to_write > 0) {
-        file_node_t* file_data_node = NULL;
-        // return the data node of the current offset, will read it from disk or create new one
-        // if needed (and also the mht node if needed)
-        file_data_node = ipf_get_data_node(pf);
-        if (file_data_node == NULL) {
-            DEBUG_PF("failed to get data node");
-            break;
-        }
+        size_t size_to_write;
+
+        if (data_to_write && data_left_to_write >= pf->node_size && ipf_can_bypass_cache(pf)) {
+            // whole nodes are overwritten, encrypt them straight from the user's buffer
+            size_t nodes_written = ipf_write_data_nodes_direct(pf, data_to_write,
+                                                               data_left_to_write / pf->node_size);
+            if (nodes_written == 0) {
+                DEBUG_PF("failed to write data nodes");
+                break;
+            }
+            size_to_write = nodes_written * pf->node_size;
+        } else {
+            file_node_t* file_data_node = NULL;
+            // return the data node of the current offset, will read it from disk or create new
+            // one if needed (and also the mht node if needed)
+            file_data_node = ipf_get_data_node(pf);
+            if (file_data_node == NULL) {
+                DEBUG_PF("failed to get data node");
+                break;
+            }
+
+            size_t offset_in_node = (size_t)((pf->offset - MD_USER_DATA_SIZE) % pf->node_size);
+            size_t empty_place_left_in_node = pf->node_size - offset_in_node;
+            size_to_write = MIN(data_left_to_write, empty_place_left_in_node);
 
-        size_t offset_in_node = (size_t)((pf->offset - MD_USER_DATA_SIZE) % PF_NODE_SIZE);
-        size_t empty_place_left_in_node = PF_NODE_SIZE - offset_in_node;
-        size_t size_to_write = MIN(data_left_to_write, empty_place_left_in_node);
+            memcpy_or_zero_initialize(&file_data_node->decrypted[offset_in_node], data_to_write,
+                                      size_to_write);
+
+            if (!file_data_node->need_writing) {
+                file_data_node->need_writing = true;
+                ipf_set_mht_nodes_need_writing(pf, file_data_node->parent);
+            }
+        }
 
-        memcpy_or_zero_initialize(&file_data_node->decrypted.data.data[offset_in_node],
-                                  data_to_write, size_to_write);
         pf->offset += size_to_write;
         if (data_to_write)
             data_to_write += size_to_write;
@@ -786,18 +1066,6 @@ static size_t ipf_write(pf_context_t* pf, const void* ptr, size_t size) {
         if (pf->offset > pf->encrypted_part_plain.size) {
             pf->encrypted_part_plain.size = pf->offset; // file grew, update the new file size
         }
-
-        if (!file_data_node->need_writing) {
-            file_data_node->need_writing = true;
-            file_node_t* file_mht_node = file_data_node->parent;
-            while (file_mht_node->node_number != 0) {
-                // set all the mht parent nodes as 'need writing'
-                file_mht_node->need_writing = true;
-                file_mht_node = file_mht_node->parent;
-            }
-            pf->root_mht.need_writing = true;
-            pf->need_writing = true;
-        }
     }
 
     return size - data_left_to_write;
@@ -844,18 +1112,28 @@ static size_t ipf_read(pf_context_t* pf, void* ptr, size_t size) {
     }
 
     while (data_left_to_read > 0) {
-        file_node_t* file_data_node = NULL;
-        // return the data node of the current offset, will read it from disk if needed
-        // (and also the mht node if needed)
-        file_data_node = ipf_get_data_node(pf);
-        if (file_data_node == NULL)
-            break;
+        size_t size_to_read;
 
-        size_t offset_in_node = (pf->offset - MD_USER_DATA_SIZE) % PF_NODE_SIZE;
-        size_t data_left_in_node = PF_NODE_SIZE - offset_in_node;
-        size_t size_to_read = MIN(data_left_to_read, data_left_in_node);
+        if (data_left_to_read >= pf->node_size && ipf_can_bypass_cache(pf)) {
+            // the whole node is requested, decrypt it straight into the user's buffer
+            if (!ipf_read_data_node_direct(pf, out_buffer))
+                break;
+            size_to_read = pf->node_size;
+        } else {
+            file_node_t* file_data_node = NULL;
+            // return the data node of the current offset, will read it from disk if needed
+            // (and also the mht node if needed)
+            file_data_node = ipf_get_data_node(pf);
+            if (file_data_node == NULL)
+                break;
+
+            size_t offset_in_node = (pf->offset - MD_USER_DATA_SIZE) % pf->node_size;
+            size_t data_left_in_node = pf->node_size - offset_in_node;
+            size_to_read = MIN(data_left_to_read, data_left_in_node);
+
+            memcpy(out_buffer, &file_data_node->decrypted[offset_in_node], size_to_read);
+        }
 
-        memcpy(out_buffer, &file_data_node->decrypted.data.data[offset_in_node], size_to_read);
         pf->offset += size_to_read;
         out_buffer += size_to_read;
         data_left_to_read -= size_to_read;
@@ -872,16 +1150,17 @@ static size_t ipf_read(pf_context_t* pf, void* ptr, size_t size) {
 
 // this is a very 'specific' function, tied to the architecture of the file layout,
 // returning the node numbers according to the data offset in the file
-static void get_node_numbers(uint64_t offset, uint64_t* mht_node_number, uint64_t* data_node_number,
-                             uint64_t* physical_mht_node_number,
+static void get_node_numbers(pf_context_t* pf, uint64_t offset, uint64_t* mht_node_number,
+                             uint64_t* data_node_number, uint64_t* physical_mht_node_number,
                              uint64_t* physical_data_node_number) {
-    // physical nodes (file layout):
+    // physical nodes (file layout), for the default node size:
     // node 0 - meta data node
     // node 1 - mht
-    // nodes 2-97 - data (ATTACHED_DATA_NODES_COUNT == 96)
+    // nodes 2-97 - data (ATTACHED_DATA_NODES_COUNT(PF_NODE_SIZE) == 96)
     // node 98 - mht
     // node 99-195 - data
     // etc.
+    // larger node sizes only change the number of data nodes attached to each mht node
     uint64_t _physical_mht_node_number;
     uint64_t _physical_data_node_number;
 
@@ -891,15 +1170,15 @@ static void get_node_numbers(uint64_t offset, uint64_t* mht_node_number, uint64_
 
     assert(offset >= MD_USER_DATA_SIZE);
 
-    _data_node_number = (offset - MD_USER_DATA_SIZE) / PF_NODE_SIZE;
-    _mht_node_number = _data_node_number / ATTACHED_DATA_NODES_COUNT;
+    _data_node_number = (offset - MD_USER_DATA_SIZE) / pf->node_size;
+    _mht_node_number = _data_node_number / pf->attached_data_nodes_count;
     _physical_data_node_number = _data_node_number
                                  + 1 // meta data node
                                  + 1 // mht root
                                  + _mht_node_number; // number of mht nodes in the middle
                                  // (the root mht mht_node_number is 0)
     _physical_mht_node_number = _physical_data_node_number
-                                - _data_node_number % ATTACHED_DATA_NODES_COUNT // now we are at
+                                - _data_node_number % pf->attached_data_nodes_count // now we are at
                                 // the first data node attached to this mht node
                                 - 1; // and now at the mht node itself!
 
@@ -921,7 +1200,7 @@ static file_node_t* ipf_get_data_node(pf_context_t* pf) {
         return NULL;
     }
 
-    if ((pf->offset - MD_USER_DATA_SIZE) % PF_NODE_SIZE == 0
+    if ((pf->offset - MD_USER_DATA_SIZE) % pf->node_size == 0
         && pf->offset == pf->encrypted_part_plain.size) {
         // new node
         file_data_node = ipf_append_data_node(pf);
@@ -931,44 +1210,181 @@ static file_node_t* ipf_get_data_node(pf_context_t* pf) {
     }
 
     // bump all the parents mht to reside before the data node in the cache
-    if (file_data_node != NULL) {
-        file_node_t* file_mht_node = file_data_node->parent;
-        while (file_mht_node->node_number != 0) {
-            // bump the mht node to the head of the lru
-            lruc_get(pf->cache, file_mht_node->physical_node_number);
-            file_mht_node = file_mht_node->parent;
-        }
-    }
+    if (file_data_node != NULL)
+        ipf_bump_mht_nodes(pf, file_data_node->parent);
 
     // even if we didn't get the required data_node, we might have read other nodes in the process
-    while (lruc_size(pf->cache) > MAX_PAGES_IN_CACHE) {
+    if (!ipf_trim_cache(pf))
+        return NULL; // even if we got the data_node!
+
+    return file_data_node;
+}
+
+// bump the mht node and all its parents to the head of the lru, so that they are evicted only
+// after their children
+static void ipf_bump_mht_nodes(pf_context_t* pf, file_node_t* file_mht_node) {
+    while (file_mht_node->node_number != 0) {
+        lruc_get(pf->cache, file_mht_node->physical_node_number);
+        file_mht_node = file_mht_node->parent;
+    }
+}
+
+// evict least recently used nodes until the cache size is within limits, flushing all changes
+// if a dirty node has to be evicted
+static bool ipf_trim_cache(pf_context_t* pf) {
+    while (lruc_size(pf->cache) > pf->max_nodes_in_cache) {
         void* data = lruc_get_last(pf->cache);
         assert(data != NULL);
         // for production -
         if (data == NULL) {
             pf->last_error = PF_STATUS_UNKNOWN_ERROR;
-            return NULL;
+            return false;
         }
 
         if (!((file_node_t*)data)->need_writing) {
             lruc_remove_last(pf->cache);
-
-            // before deleting the memory, need to scrub the plain secrets
-            file_node_t* file_node = (file_node_t*)data;
-            erase_memory(&file_node->decrypted, sizeof(file_node->decrypted));
-            free(file_node);
+            ipf_free_node(pf, (file_node_t*)data);
         } else {
             if (!ipf_internal_flush(pf)) {
                 // error, can't flush cache, file status changed to error
                 assert(pf->file_status != PF_STATUS_SUCCESS);
                 if (pf->file_status == PF_STATUS_SUCCESS)
                     pf->file_status = PF_STATUS_FLUSH_ERROR; // for release set this anyway
-                return NULL;                                 // even if we got the data_node!
+                return false;
             }
         }
     }
 
-    return file_data_node;
+    return true;
+}
+
+// set the mht node and all its parents (up to the root) as 'need writing', after one of its data
+// nodes (or the gcm crypto data of one of them) was changed
+static void ipf_set_mht_nodes_need_writing(pf_context_t* pf, file_node_t* file_mht_node) {
+    while (file_mht_node->node_number != 0) {
+        file_mht_node->need_writing = true;
+        file_mht_node = file_mht_node->parent;
+    }
+    pf->root_mht->need_writing = true;
+    pf->need_writing = true;
+}
+
+// whole data nodes can bypass the cache, unless they're already cached: the cached copy may be
+// newer than the one on disk, and would overwrite the new one on flush
+static bool ipf_can_bypass_cache(pf_context_t* pf) {
+    if (pf->offset < MD_USER_DATA_SIZE || (pf->offset - MD_USER_DATA_SIZE) % pf->node_size != 0)
+        return false;
+
+    uint64_t physical_node_number;
+    get_node_numbers(pf, pf->offset, NULL, NULL, NULL, &physical_node_number);
+    return lruc_find(pf->cache, physical_node_number) == NULL;
+}
+
+// read the whole data node of the current offset and decrypt it directly into `output` (which
+// must be pf->node_size bytes), without adding the node to the cache
+static bool ipf_read_data_node_direct(pf_context_t* pf, void* output) {
+    uint64_t data_node_number;
+    uint64_t physical_node_number;
+
+    get_node_numbers(pf, pf->offset, NULL, &data_node_number, NULL, &physical_node_number);
+    assert(lruc_find(pf->cache, physical_node_number) == NULL);
+
+    file_node_t* file_mht_node = ipf_get_mht_node(pf);
+    if (file_mht_node == NULL) // some error happened
+        return false;
+
+    // plaintext nodes of integrity-only files are read straight into the output
+    uint8_t* buffer = pf->integrity_only ? output : pf->node_buffer;
+    if (!ipf_read_node(pf, pf->file, physical_node_number, buffer, pf->node_size))
+        return false;
+
+    gcm_crypto_data_t* gcm_crypto_data =
+        &ipf_data_nodes_crypto(file_mht_node)[data_node_number % pf->attached_data_nodes_count];
+
+    // this function decrypt the data _and_ checks the integrity of the data against the gmac
+    if (!ipf_unprotect_data_node(pf, buffer, output, gcm_crypto_data)) {
+        // don't leave unverified data in the user's buffer
+        erase_memory(output, pf->node_size);
+        return false;
+    }
+
+    // reading the mht node might have grown the cache
+    ipf_bump_mht_nodes(pf, file_mht_node);
+    return ipf_trim_cache(pf);
+}
+
+// encrypt whole data nodes from `input`, starting with the one of the current offset, and write
+// them to disk immediately, without adding them to the cache; only their parent mht node is
+// updated (and written on the next flush). Up to `nodes_count` adjacent nodes are written with a
+// single callback, as long as they're attached to the same mht node and not cached. Returns the
+// number of nodes written, 0 on error.
+static size_t ipf_write_data_nodes_direct(pf_context_t* pf, const uint8_t* input,
+                                          size_t nodes_count) {
+    uint64_t data_node_number;
+    uint64_t physical_node_number;
+
+    get_node_numbers(pf, pf->offset, NULL, &data_node_number, NULL, &physical_node_number);
+    assert(lruc_find(pf->cache, physical_node_number) == NULL);
+
+    // this also appends a new mht node if we're at the end of the file
+    file_node_t* file_mht_node = ipf_get_mht_node(pf);
+    if (file_mht_node == NULL) // some error happened
+        return 0;
+
+    // the next data nodes are attached to another mht node, which precedes them on disk
+    size_t index_in_mht = data_node_number % pf->attached_data_nodes_count;
+    nodes_count = MIN(nodes_count, pf->attached_data_nodes_count - index_in_mht);
+    nodes_count = MIN(nodes_count, pf->max_nodes_in_write_run);
+
+    uint8_t* buffer = pf->node_buffer;
+    if (pf->integrity_only) {
+        // plaintext nodes are written straight from the user's buffer
+        buffer = (uint8_t*)input;
+    } else if (nodes_count > 1) {
+        if (!pf->write_run_buffer)
+            pf->write_run_buffer = malloc(pf->max_nodes_in_write_run * (size_t)pf->node_size);
+        // a single node can always be written, so this is not an error
+        if (pf->write_run_buffer)
+            buffer = pf->write_run_buffer;
+        else
+            nodes_count = 1;
+    }
+
+    // the mht node is updated only after a successful write, so that it keeps describing the
+    // previous version of the nodes otherwise
+    gcm_crypto_data_t gcm_crypto_data[MAX_NODES_IN_WRITE_RUN];
+    size_t i;
+    for (i = 0; i < nodes_count; i++) {
+        if (i > 0 && lruc_find(pf->cache, physical_node_number + i) != NULL)
+            break;
+
+        if (!ipf_protect_data_node(pf, input + i * pf->node_size, buffer + i * pf->node_size,
+                                   &gcm_crypto_data[i]))
+            goto out;
+    }
+    nodes_count = i;
+
+    // the nodes are adjacent on disk
+    if (!ipf_write_file(pf, pf->file, ipf_node_offset(pf, physical_node_number), buffer,
+                        nodes_count * pf->node_size))
+        goto out;
+
+    memcpy(&ipf_data_nodes_crypto(file_mht_node)[index_in_mht], gcm_crypto_data,
+           nodes_count * sizeof(gcm_crypto_data[0]));
+    erase_memory(gcm_crypto_data, sizeof(gcm_crypto_data));
+
+    ipf_set_mht_nodes_need_writing(pf, file_mht_node);
+
+    // reading or appending the mht node might have grown the cache
+    ipf_bump_mht_nodes(pf, file_mht_node);
+    if (!ipf_trim_cache(pf))
+        return 0;
+
+    return nodes_count;
+
+out:
+    erase_memory(gcm_crypto_data, sizeof(gcm_crypto_data));
+    return 0;
 }
 
 static file_node_t* ipf_append_data_node(pf_context_t* pf) {
@@ -976,25 +1392,20 @@ static file_node_t* ipf_append_data_node(pf_context_t* pf) {
     if (file_mht_node == NULL) // some error happened
         return NULL;
 
-    file_node_t* new_file_data_node = NULL;
-
-    new_file_data_node = calloc(1, sizeof(*new_file_data_node));
-    if (!new_file_data_node) {
-        pf->last_error = PF_STATUS_NO_MEMORY;
+    file_node_t* new_file_data_node = ipf_alloc_node(pf, FILE_DATA_NODE_TYPE);
+    if (!new_file_data_node)
         return NULL;
-    }
 
     uint64_t node_number, physical_node_number;
-    get_node_numbers(pf->offset, NULL, &node_number, NULL, &physical_node_number);
+    get_node_numbers(pf, pf->offset, NULL, &node_number, NULL, &physical_node_number);
 
-    new_file_data_node->type = FILE_DATA_NODE_TYPE;
     new_file_data_node->new_node = true;
     new_file_data_node->parent = file_mht_node;
     new_file_data_node->node_number = node_number;
     new_file_data_node->physical_node_number = physical_node_number;
 
     if (!lruc_add(pf->cache, new_file_data_node->physical_node_number, new_file_data_node)) {
-        free(new_file_data_node);
+        ipf_free_node(pf, new_file_data_node);
         pf->last_error = PF_STATUS_NO_MEMORY;
         return NULL;
     }
@@ -1006,9 +1417,8 @@ static file_node_t* ipf_read_data_node(pf_context_t* pf) {
     uint64_t data_node_number;
     uint64_t physical_node_number;
     file_node_t* file_mht_node;
-    pf_status_t status;
 
-    get_node_numbers(pf->offset, NULL, &data_node_number, NULL, &physical_node_number);
+    get_node_numbers(pf, pf->offset, NULL, &data_node_number, NULL, &physical_node_number);
 
     file_node_t* file_data_node = (file_node_t*)lruc_get(pf->cache, physical_node_number);
     if (file_data_node != NULL)
@@ -1020,44 +1430,34 @@ static file_node_t* ipf_read_data_node(pf_context_t* pf) {
     if (file_mht_node == NULL) // some error happened
         return NULL;
 
-    file_data_node = calloc(1, sizeof(*file_data_node));
-    if (!file_data_node) {
-        pf->last_error = PF_STATUS_NO_MEMORY;
+    file_data_node = ipf_alloc_node(pf, FILE_DATA_NODE_TYPE);
+    if (!file_data_node)
         return NULL;
-    }
 
-    file_data_node->type = FILE_DATA_NODE_TYPE;
     file_data_node->node_number = data_node_number;
     file_data_node->physical_node_number = physical_node_number;
     file_data_node->parent = file_mht_node;
 
     if (!ipf_read_node(pf, pf->file, file_data_node->physical_node_number,
-                       file_data_node->encrypted.cipher, PF_NODE_SIZE)) {
-        free(file_data_node);
+                       file_data_node->encrypted, pf->node_size)) {
+        ipf_free_node(pf, file_data_node);
         return NULL;
     }
 
     gcm_crypto_data_t* gcm_crypto_data =
-        &file_data_node->parent->decrypted.mht
-             .data_nodes_crypto[file_data_node->node_number % ATTACHED_DATA_NODES_COUNT];
+        &ipf_data_nodes_crypto(file_data_node->parent)[file_data_node->node_number
+                                                       % pf->attached_data_nodes_count];
 
     // this function decrypt the data _and_ checks the integrity of the data against the gmac
-    status = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
-                                  file_data_node->encrypted.cipher, PF_NODE_SIZE,
-                                  file_data_node->decrypted.data.data, &gcm_crypto_data->gmac);
-
-    if (PF_FAILURE(status)) {
-        free(file_data_node);
-        pf->last_error = status;
-        if (status == PF_STATUS_MAC_MISMATCH)
-            pf->file_status = PF_STATUS_CORRUPTED;
+    if (!ipf_unprotect_data_node(pf, file_data_node->encrypted, file_data_node->decrypted,
+                                 gcm_crypto_data)) {
+        ipf_free_node(pf, file_data_node);
         return NULL;
     }
 
     if (!lruc_add(pf->cache, file_data_node->physical_node_number, file_data_node)) {
         // scrub the plaintext data
-        erase_memory(&file_data_node->decrypted, sizeof(file_data_node->decrypted));
-        free(file_data_node);
+        ipf_free_node(pf, file_data_node);
         pf->last_error = PF_STATUS_NO_MEMORY;
         return NULL;
     }
@@ -1075,14 +1475,14 @@ static file_node_t* ipf_get_mht_node(pf_context_t* pf) {
         return NULL;
     }
 
-    get_node_numbers(pf->offset, &mht_node_number, NULL, &physical_mht_node_number, NULL);
+    get_node_numbers(pf, pf->offset, &mht_node_number, NULL, &physical_mht_node_number, NULL);
 
     if (mht_node_number == 0)
-        return &pf->root_mht;
+        return pf->root_mht;
 
-    // file is constructed from (ATTACHED_DATA_NODES_COUNT + CHILD_MHT_NODES_COUNT) * PF_NODE_SIZE
+    // file is constructed from (attached_data_nodes_count + child_mht_nodes_count) * node_size
     // bytes per MHT node
-    if ((pf->offset - MD_USER_DATA_SIZE) % (ATTACHED_DATA_NODES_COUNT * PF_NODE_SIZE) == 0 &&
+    if ((pf->offset - MD_USER_DATA_SIZE) % (pf->attached_data_nodes_count * pf->node_size) == 0 &&
             pf->offset == pf->encrypted_part_plain.size) {
         file_mht_node = ipf_append_mht_node(pf, mht_node_number);
     } else {
@@ -1095,30 +1495,26 @@ static file_node_t* ipf_get_mht_node(pf_context_t* pf) {
 static file_node_t* ipf_append_mht_node(pf_context_t* pf, uint64_t mht_node_number) {
     assert(mht_node_number > 0);
     file_node_t* parent_file_mht_node =
-        ipf_read_mht_node(pf, (mht_node_number - 1) / CHILD_MHT_NODES_COUNT);
+        ipf_read_mht_node(pf, (mht_node_number - 1) / pf->child_mht_nodes_count);
 
     if (parent_file_mht_node == NULL) // some error happened
         return NULL;
 
     uint64_t physical_node_number = 1 + // meta data node
-                                    // the '1' is for the mht node preceding every 96 data nodes
-                                    mht_node_number * (1 + ATTACHED_DATA_NODES_COUNT);
+                                    // the '1' is for the mht node preceding its data nodes
+                                    mht_node_number * (1 + pf->attached_data_nodes_count);
 
-    file_node_t* new_file_mht_node = NULL;
-    new_file_mht_node = calloc(1, sizeof(*new_file_mht_node));
-    if (!new_file_mht_node) {
-        pf->last_error = PF_STATUS_NO_MEMORY;
+    file_node_t* new_file_mht_node = ipf_alloc_node(pf, FILE_MHT_NODE_TYPE);
+    if (!new_file_mht_node)
         return NULL;
-    }
 
-    new_file_mht_node->type = FILE_MHT_NODE_TYPE;
     new_file_mht_node->new_node = true;
     new_file_mht_node->parent = parent_file_mht_node;
     new_file_mht_node->node_number = mht_node_number;
     new_file_mht_node->physical_node_number = physical_node_number;
 
     if (!lruc_add(pf->cache, new_file_mht_node->physical_node_number, new_file_mht_node)) {
-        free(new_file_mht_node);
+        ipf_free_node(pf, new_file_mht_node);
         pf->last_error = PF_STATUS_NO_MEMORY;
         return NULL;
     }
@@ -1130,49 +1526,46 @@ static file_node_t* ipf_read_mht_node(pf_context_t* pf, uint64_t mht_node_number
     pf_status_t status;
 
     if (mht_node_number == 0)
-        return &pf->root_mht;
+        return pf->root_mht;
 
     uint64_t physical_node_number = 1 + // meta data node
-                                    // the '1' is for the mht node preceding every 96 data nodes
-                                    mht_node_number * (1 + ATTACHED_DATA_NODES_COUNT);
+                                    // the '1' is for the mht node preceding its data nodes
+                                    mht_node_number * (1 + pf->attached_data_nodes_count);
 
     file_node_t* file_mht_node = (file_node_t*)lruc_find(pf->cache, physical_node_number);
     if (file_mht_node != NULL)
         return file_mht_node;
 
     file_node_t* parent_file_mht_node =
-        ipf_read_mht_node(pf, (mht_node_number - 1) / CHILD_MHT_NODES_COUNT);
+        ipf_read_mht_node(pf, (mht_node_number - 1) / pf->child_mht_nodes_count);
 
     if (parent_file_mht_node == NULL) // some error happened
         return NULL;
 
-    file_mht_node = calloc(1, sizeof(*file_mht_node));
-    if (!file_mht_node) {
-        pf->last_error = PF_STATUS_NO_MEMORY;
+    file_mht_node = ipf_alloc_node(pf, FILE_MHT_NODE_TYPE);
+    if (!file_mht_node)
         return NULL;
-    }
 
-    file_mht_node->type                 = FILE_MHT_NODE_TYPE;
     file_mht_node->node_number          = mht_node_number;
     file_mht_node->physical_node_number = physical_node_number;
     file_mht_node->parent               = parent_file_mht_node;
 
     if (!ipf_read_node(pf, pf->file, file_mht_node->physical_node_number,
-                       file_mht_node->encrypted.cipher, PF_NODE_SIZE)) {
-        free(file_mht_node);
+                       file_mht_node->encrypted, pf->node_size)) {
+        ipf_free_node(pf, file_mht_node);
         return NULL;
     }
 
     gcm_crypto_data_t* gcm_crypto_data =
-        &file_mht_node->parent->decrypted.mht
-             .mht_nodes_crypto[(file_mht_node->node_number - 1) % CHILD_MHT_NODES_COUNT];
+        &ipf_mht_nodes_crypto(pf, file_mht_node->parent)[(file_mht_node->node_number - 1)
+                                                         % pf->child_mht_nodes_count];
 
     // this function decrypt the data _and_ checks the integrity of the data against the gmac
     status = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
-                                  file_mht_node->encrypted.cipher, PF_NODE_SIZE,
-                                  &file_mht_node->decrypted.mht, &gcm_crypto_data->gmac);
+                                  file_mht_node->encrypted, pf->node_size,
+                                  file_mht_node->decrypted, &gcm_crypto_data->gmac);
     if (PF_FAILURE(status)) {
-        free(file_mht_node);
+        ipf_free_node(pf, file_mht_node);
         pf->last_error = status;
         if (status == PF_STATUS_MAC_MISMATCH)
             pf->file_status = PF_STATUS_CORRUPTED;
@@ -1180,8 +1573,7 @@ static file_node_t* ipf_read_mht_node(pf_context_t* pf, uint64_t mht_node_number
     }
 
     if (!lruc_add(pf->cache, file_mht_node->physical_node_number, file_mht_node)) {
-        erase_memory(&file_mht_node->decrypted, sizeof(file_mht_node->decrypted));
-        free(file_mht_node);
+        ipf_free_node(pf, file_mht_node);
         pf->last_error = PF_STATUS_NO_MEMORY;
         return NULL;
     }
@@ -1189,14 +1581,131 @@ static file_node_t* ipf_read_mht_node(pf_context_t* pf, uint64_t mht_node_number
     return file_mht_node;
 }
 
+// drop the data and mht nodes past the new end of the file and truncate the underlying file; the
+// tail of the last (partial) node is zeroed, so that it reads back as zeros if the file is extended
+// again, and the crypto data of the dropped nodes is erased from the mht nodes on the path to it
+static bool ipf_shrink(pf_context_t* pf, uint64_t new_size) {
+    assert(new_size < pf->encrypted_part_plain.size);
+
+    if (PF_FAILURE(pf->file_status)) {
+        pf->last_error = pf->file_status;
+        return false;
+    }
+
+    uint64_t last_physical_node_number = 0; // only the meta data node is left
+    if (new_size > MD_USER_DATA_SIZE) {
+        uint64_t last_mht_node_number;
+        uint64_t last_data_node_number;
+        file_node_t* file_mht_node;
+
+        // the nodes are read (and possibly flushed) while the file still has its old size
+        pf->offset = new_size - 1;
+        get_node_numbers(pf, pf->offset, &last_mht_node_number, &last_data_node_number, NULL,
+                         &last_physical_node_number);
+
+        size_t offset_in_node = (size_t)((new_size - MD_USER_DATA_SIZE) % pf->node_size);
+        if (offset_in_node != 0) {
+            file_node_t* file_data_node = ipf_get_data_node(pf);
+            if (file_data_node == NULL)
+                return false;
+
+            memset(&file_data_node->decrypted[offset_in_node], 0, pf->node_size - offset_in_node);
+            file_data_node->need_writing = true;
+            file_mht_node = file_data_node->parent;
+        } else {
+            file_mht_node = ipf_get_mht_node(pf);
+            if (file_mht_node == NULL)
+                return false;
+        }
+
+        size_t index_in_mht = last_data_node_number % pf->attached_data_nodes_count;
+        erase_memory(&ipf_data_nodes_crypto(file_mht_node)[index_in_mht + 1],
+                     (pf->attached_data_nodes_count - index_in_mht - 1)
+                         * sizeof(gcm_crypto_data_t));
+
+        // only the mht nodes on the path to the last data node can have children that are dropped
+        // and are kept themselves (the others are either dropped or have no dropped children)
+        file_node_t* file_node = file_mht_node;
+        while (true) {
+            uint64_t first_child = file_node->node_number * pf->child_mht_nodes_count + 1;
+            size_t children_kept = 0;
+            if (last_mht_node_number >= first_child)
+                children_kept = MIN(last_mht_node_number - first_child + 1,
+                                    pf->child_mht_nodes_count);
+            erase_memory(&ipf_mht_nodes_crypto(pf, file_node)[children_kept],
+                         (pf->child_mht_nodes_count - children_kept) * sizeof(gcm_crypto_data_t));
+
+            if (file_node->node_number == 0)
+                break;
+            file_node = file_node->parent;
+        }
+
+        ipf_set_mht_nodes_need_writing(pf, file_mht_node);
+    } else {
+        if (new_size < MD_USER_DATA_SIZE)
+            memset(&pf->encrypted_part_plain.data[new_size], 0, MD_USER_DATA_SIZE - new_size);
+
+        // the root mht node is not written for files that fit in the meta data node
+        erase_memory(pf->root_mht->decrypted, pf->node_size);
+        pf->root_mht->need_writing = false;
+        erase_memory(&pf->encrypted_part_plain.mht_key, sizeof(pf->encrypted_part_plain.mht_key));
+        erase_memory(&pf->encrypted_part_plain.mht_gmac,
+                     sizeof(pf->encrypted_part_plain.mht_gmac));
+    }
+
+    // drop the cached nodes past the new end, their changes (if any) are discarded; kept nodes
+    // never point to them, parents always precede their children
+    size_t nodes_count = 0;
+    file_node_t** file_nodes = malloc((lruc_size(pf->cache) + 1) * sizeof(*file_nodes));
+    if (!file_nodes) {
+        pf->last_error = PF_STATUS_NO_MEMORY;
+        return false;
+    }
+
+    void* data;
+    for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
+        file_node_t* file_node = (file_node_t*)data;
+        if (file_node->physical_node_number > last_physical_node_number)
+            file_nodes[nodes_count++] = file_node;
+    }
+
+    for (size_t i = 0; i < nodes_count; i++) {
+        lruc_remove(pf->cache, file_nodes[i]->physical_node_number);
+        ipf_free_node(pf, file_nodes[i]);
+    }
+    free(file_nodes);
+
+    pf->encrypted_part_plain.size = new_size;
+    pf->offset = new_size;
+    pf->end_of_file = false;
+    pf->need_writing = true;
+
+    // the nodes can be removed from disk only after the meta data stops referring to them
+    if (!ipf_internal_flush(pf))
+        return false;
+
+    uint64_t real_size = ipf_node_offset(pf, last_physical_node_number + 1);
+    pf_status_t status = g_cb_truncate(pf->file, real_size);
+    if (PF_FAILURE(status)) {
+        pf->last_error = status;
+        return false;
+    }
+    pf->real_file_size = real_size;
+
+    // reading the last nodes might have grown the cache, all of them are clean now
+    return ipf_trim_cache(pf);
+}
+
 // public API
 
-void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f truncate_f,
-                      pf_aes_cmac_f aes_cmac_f, pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
+void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_writev_f writev_f,
+                      pf_truncate_f truncate_f, pf_aes_cmac_f aes_cmac_f,
+                      pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
                       pf_aes_gcm_decrypt_f aes_gcm_decrypt_f, pf_random_f random_f,
                       pf_debug_f debug_f) {
     g_cb_read            = read_f;
     g_cb_write           = write_f;
+    g_cb_writev          = writev_f;
     g_cb_truncate        = truncate_f;
     g_cb_aes_cmac        = aes_cmac_f;
     g_cb_aes_gcm_encrypt = aes_gcm_encrypt_f;
@@ -1207,12 +1716,14 @@ void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f trunca
 }
 
 pf_status_t pf_open(pf_handle_t handle, const char* path, uint64_t underlying_size,
-                    pf_file_mode_t mode, bool create, const pf_key_t* key, pf_context_t** context) {
+                    pf_file_mode_t mode, bool create, uint32_t node_size, bool integrity_only,
+                    const pf_key_t* key, pf_context_t** context) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
     pf_status_t status;
-    *context = ipf_open(path, mode, create, handle, underlying_size, key, &status);
+    *context = ipf_open(path, mode, create, handle, underlying_size, node_size, integrity_only,
+                        key, &status);
     return status;
 }
 
@@ -1220,12 +1731,11 @@ pf_status_t pf_close(pf_context_t* pf) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
-    if (ipf_close(pf)) {
-        free(pf);
-        return PF_STATUS_SUCCESS;
-    }
+    /* waits for the operations in progress; the caller guarantees that no new ones start */
+    rwlock_write_lock(&pf->lock);
+    pf_status_t ret = ipf_close(pf) ? PF_STATUS_SUCCESS : pf->last_error;
+    rwlock_write_unlock(&pf->lock);
 
-    pf_status_t ret = pf->last_error;
     free(pf);
     return ret;
 }
@@ -1234,34 +1744,25 @@ pf_status_t pf_get_size(pf_context_t* pf, uint64_t* size) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
+    rwlock_read_lock(&pf->lock);
     *size = pf->encrypted_part_plain.size;
+    rwlock_read_unlock(&pf->lock);
     return PF_STATUS_SUCCESS;
 }
 
-// TODO: file truncation
 pf_status_t pf_set_size(pf_context_t* pf, uint64_t size) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
-    if (!(pf->mode & PF_FILE_MODE_WRITE))
-        return PF_STATUS_INVALID_MODE;
-
-    if (size == pf->encrypted_part_plain.size)
-        return PF_STATUS_SUCCESS;
-
-    if (size > pf->encrypted_part_plain.size) {
-        // extend the file
-        pf->offset = pf->encrypted_part_plain.size;
-        DEBUG_PF("extending the file from %lu to %lu", pf->offset, size);
-        if (ipf_write(pf, NULL, size - pf->offset) != size - pf->offset)
-            return pf->last_error;
-
-        return PF_STATUS_SUCCESS;
-    }
-
-    return PF_STATUS_NOT_IMPLEMENTED;
+    pf_status_t ret = PF_STATUS_SUCCESS;
+    rwlock_write_lock(&pf->lock);
+    if (!ipf_set_size(pf, size))
+        ret = pf->last_error;
+    rwlock_write_unlock(&pf->lock);
+    return ret;
 }
 
+/* Reading takes the lock exclusively: it moves the file position and updates the node cache. */
 pf_status_t pf_read(pf_context_t* pf, uint64_t offset, size_t size, void* output,
                     size_t* bytes_read) {
     if (!g_initialized)
@@ -1272,48 +1773,66 @@ pf_status_t pf_read(pf_context_t* pf, uint64_t offset, size_t size, void* output
         return PF_STATUS_SUCCESS;
     }
 
-    if (!ipf_seek(pf, offset))
-        return pf->last_error;
+    pf_status_t ret = PF_STATUS_SUCCESS;
+    rwlock_write_lock(&pf->lock);
 
-    if (pf->end_of_file || pf->offset == pf->encrypted_part_plain.size) {
+    // reading beyond the end never extends the file, even if the context is writable
+    if (offset >= pf->encrypted_part_plain.size) {
+        if (PF_FAILURE(pf->file_status)) {
+            ret = pf->file_status;
+            goto out;
+        }
         pf->end_of_file = true;
         *bytes_read = 0;
-        return PF_STATUS_SUCCESS;
+        goto out;
+    }
+
+    if (!ipf_seek(pf, offset)) {
+        ret = pf->last_error;
+        goto out;
     }
 
     size_t bytes = ipf_read(pf, output, size);
-    if (!bytes)
-        return pf->last_error;
+    if (!bytes) {
+        ret = pf->last_error;
+        goto out;
+    }
 
     *bytes_read = bytes;
-    return PF_STATUS_SUCCESS;
+out:
+    rwlock_write_unlock(&pf->lock);
+    return ret;
 }
 
 pf_status_t pf_write(pf_context_t* pf, uint64_t offset, size_t size, const void* input) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
-    if (!ipf_seek(pf, offset))
-        return pf->last_error;
-
-    if (ipf_write(pf, input, size) != size)
-        return pf->last_error;
-    return PF_STATUS_SUCCESS;
+    pf_status_t ret = PF_STATUS_SUCCESS;
+    rwlock_write_lock(&pf->lock);
+    if (!ipf_seek(pf, offset) || ipf_write(pf, input, size) != size)
+        ret = pf->last_error;
+    rwlock_write_unlock(&pf->lock);
+    return ret;
 }
 
 pf_status_t pf_flush(pf_context_t* pf) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
+    pf_status_t ret = PF_STATUS_SUCCESS;
+    rwlock_write_lock(&pf->lock);
     if (!ipf_internal_flush(pf))
-        return pf->last_error;
-    return PF_STATUS_SUCCESS;
+        ret = pf->last_error;
+    rwlock_write_unlock(&pf->lock);
+    return ret;
 }
 
 pf_status_t pf_get_handle(pf_context_t* pf, pf_handle_t* handle) {
     if (!g_initialized)
         return PF_STATUS_UNINITIALIZED;
 
+    /* the handle is set at open time and never changes */
     *handle = pf->file;
     return PF_STATUS_SUCCESS;
 }
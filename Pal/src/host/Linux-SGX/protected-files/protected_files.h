@@ -56,8 +56,12 @@ typedef enum _pf_status_t {
 #define PF_SUCCESS(status) ((status) == PF_STATUS_SUCCESS)
 #define PF_FAILURE(status) ((status) != PF_STATUS_SUCCESS)
 
+/*! Default size of data and MHT nodes, and the size of the metadata node */
 #define PF_NODE_SIZE 4096U
 
+/*! Maximum size of data and MHT nodes (node sizes are powers of two starting at PF_NODE_SIZE) */
+#define PF_NODE_SIZE_MAX (256 * 1024U)
+
 /*! PF open modes */
 typedef enum _pf_file_mode_t {
     PF_FILE_MODE_READ  = 1,
@@ -90,6 +94,27 @@ typedef pf_status_t (*pf_read_f)(pf_handle_t handle, void* buffer, uint64_t offs
 typedef pf_status_t (*pf_write_f)(pf_handle_t handle, const void* buffer, uint64_t offset,
                                   size_t size);
 
+/*! Maximum number of buffers passed to the vectored write callback */
+#define PF_IOV_MAX 64
+
+/*! Buffer for the vectored write callback */
+typedef struct _pf_iovec_t {
+    const void* buffer;
+    size_t size;
+} pf_iovec_t;
+
+/*!
+ * \brief File vectored write callback
+ *
+ * \param [in] handle File handle
+ * \param [in] iov Buffers to write, one after another
+ * \param [in] iov_count Number of buffers (at most PF_IOV_MAX)
+ * \param [in] offset Offset to write the first buffer to
+ * \return PF status
+ */
+typedef pf_status_t (*pf_writev_f)(pf_handle_t handle, const pf_iovec_t* iov, size_t iov_count,
+                                   uint64_t offset);
+
 /*!
  * \brief File truncate callback
  *
@@ -166,6 +191,8 @@ typedef pf_status_t (*pf_random_f)(uint8_t* buffer, size_t size);
  *
  * \param [in] read_f File read callback
  * \param [in] write_f File write callback
+ * \param [in] writev_f (optional) File vectored write callback, used for writing runs of adjacent
+ *                      nodes; if NULL, \a write_f is called for each node
  * \param [in] truncate_f File truncate callback
  * \param [in] aes_cmac_f AES-CMAC callback
  * \param [in] aes_gcm_encrypt_f AES-GCM encrypt callback
@@ -175,15 +202,24 @@ typedef pf_status_t (*pf_random_f)(uint8_t* buffer, size_t size);
  *
  * \details Must be called before any actual APIs
  */
-void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f truncate_f,
-                      pf_aes_cmac_f aes_cmac_f, pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
+void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_writev_f writev_f,
+                      pf_truncate_f truncate_f, pf_aes_cmac_f aes_cmac_f,
+                      pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
                       pf_aes_gcm_decrypt_f aes_gcm_decrypt_f, pf_random_f random_f,
                       pf_debug_f debug_f);
 
 /*! Context representing an open protected file */
 typedef struct pf_context pf_context_t;
 
-/* Public API */
+/* Public API
+ *
+ * Functions taking a PF context are thread-safe: each context has its own reader/writer lock, so a
+ * single context can be shared by multiple threads (e.g. by all handles to the same file) and
+ * operations on different contexts never contend. pf_get_size() and pf_get_handle() take the lock
+ * shared; all other operations take it exclusively (reads too, as they move the file position and
+ * update the node cache). pf_close() must not be called concurrently with other operations on the
+ * same context. Callbacks are invoked with the lock held and must not call back into the context.
+ */
 
 /*!
  * \brief Convert error code to error message
@@ -201,12 +237,26 @@ const char* pf_strerror(int err);
  * \param [in] underlying_size Underlying file size
  * \param [in] mode Access mode
  * \param [in] create Overwrite file contents if true
+ * \param [in] node_size Size of data and MHT nodes of a new file (a power of two between
+ *                       PF_NODE_SIZE and PF_NODE_SIZE_MAX). Ignored if \a create is false,
+ *                       existing files use the node size recorded in their metadata.
+ * \param [in] integrity_only Create a file whose data nodes are stored in plaintext and only
+ *                            authenticated. Ignored if \a create is false, like \a node_size.
  * \param [in] key Wrap key
  * \param [out] context PF context for later calls
  * \return PF status
+ * \details Bigger nodes reduce the number of crypto operations, host I/O calls and MHT depth for
+ *          large files, at the cost of more memory per cached node and more work for small writes.
+ *
+ *          In integrity-only files, data nodes are protected by a GMAC over their plaintext
+ *          (with the same per-node keys, kept in the encrypted MHT nodes) instead of being
+ *          encrypted, so reads only need to verify the MAC and whole nodes are read straight into
+ *          the caller's buffer. The metadata node (including the first 3KB of data) and the MHT
+ *          nodes are still encrypted. Use this only for data that is not secret.
  */
 pf_status_t pf_open(pf_handle_t handle, const char* path, uint64_t underlying_size,
-                    pf_file_mode_t mode, bool create, const pf_key_t* key, pf_context_t** context);
+                    pf_file_mode_t mode, bool create, uint32_t node_size, bool integrity_only,
+                    const pf_key_t* key, pf_context_t** context);
 
 /*!
  * \brief Close a protected file and commit all changes to disk
@@ -225,6 +275,7 @@ pf_status_t pf_close(pf_context_t* pf);
  * \param [out] output Destination buffer
  * \param [out] bytes_read Number of bytes actually read
  * \return PF status
+ * \details Reading at or past the end of the file returns 0 bytes and never extends the file.
  */
 pf_status_t pf_read(pf_context_t* pf, uint64_t offset, size_t size, void* output,
                     size_t* bytes_read);
@@ -255,8 +306,9 @@ pf_status_t pf_get_size(pf_context_t* pf, uint64_t* size);
  * \param [in] pf PF context
  * \param [in] size Data size to set
  * \return PF status
- * \details If the file is extended, added bytes are zero.
- *          Truncation is not implemented yet (TODO).
+ * \details If the file is extended, added bytes are zero. If the file is shrunk, the nodes past
+ *          the new end are dropped, all changes are flushed and the underlying file is truncated
+ *          with the truncate callback.
  */
 pf_status_t pf_set_size(pf_context_t* pf, uint64_t size);
 
@@ -20,7 +20,18 @@
 
 #define PF_FILE_ID       0x46505f5346415247 /* GRAFS_PF */
 #define PF_MAJOR_VERSION 0x01
-#define PF_MINOR_VERSION 0x00
+#define PF_MINOR_VERSION 0x02
+
+/* Version 1.0 files don't record the node size, it's always PF_NODE_SIZE. Files with that node size
+ * (and without any flags) are still created in this version, so that they can be read by older
+ * implementations. */
+#define PF_MINOR_VERSION_DEFAULT_NODE_SIZE 0x00
+/* Version 1.1 files record the node size, but no flags. They're not created anymore. */
+#define PF_MINOR_VERSION_NODE_SIZE 0x01
+
+/* Data nodes are stored in plaintext and only authenticated (GMAC) */
+#define PF_FLAG_INTEGRITY_ONLY 0x1U
+#define PF_FLAGS_ALL           PF_FLAG_INTEGRITY_ONLY
 
 #define METADATA_KEY_NAME "SGX-PROTECTED-FS-METADATA-KEY"
 #define MAX_LABEL_SIZE    64
@@ -39,9 +50,10 @@ typedef struct _metadata_plain {
 
 #define PATH_MAX_SIZE (260 + 512)
 
-// these are all defined as relative to node size, so we can decrease node size in tests
-// and have deeper tree
-#define MD_USER_DATA_SIZE (PF_NODE_SIZE * 3 / 4) // 3072
+// the metadata node has a fixed size, regardless of the size of data and MHT nodes
+#define METADATA_NODE_SIZE PF_NODE_SIZE
+
+#define MD_USER_DATA_SIZE (METADATA_NODE_SIZE * 3 / 4) // 3072
 static_assert(MD_USER_DATA_SIZE == 3072, "bad struct size");
 
 typedef struct _metadata_encrypted {
@@ -54,64 +66,56 @@ typedef struct _metadata_encrypted {
 
 typedef uint8_t metadata_encrypted_blob_t[sizeof(metadata_encrypted_t)];
 
-#define METADATA_NODE_SIZE PF_NODE_SIZE
-
 typedef uint8_t metadata_padding_t[METADATA_NODE_SIZE -
-                                   (sizeof(metadata_plain_t) + sizeof(metadata_encrypted_blob_t))];
+                                   (sizeof(metadata_plain_t) + sizeof(metadata_encrypted_blob_t)
+                                    + 2 * sizeof(uint32_t))];
 
 typedef struct _metadata_node {
     metadata_plain_t          plain_part;
     metadata_encrypted_blob_t encrypted_part;
+    // size of data and MHT nodes and PF_FLAG_* flags: authenticated as additional data of the
+    // encrypted part, the node size since version 1.1 and both since version 1.2; in older files
+    // they're part of the (zeroed) padding
+    uint32_t                  node_size;
+    uint32_t                  flags;
     metadata_padding_t        padding;
 } metadata_node_t;
 
-static_assert(sizeof(metadata_node_t) == PF_NODE_SIZE, "sizeof(metadata_node_t)");
+static_assert(sizeof(metadata_node_t) == METADATA_NODE_SIZE, "sizeof(metadata_node_t)");
 
 typedef struct _data_node_crypto {
     pf_key_t key;
     pf_mac_t gmac;
 } gcm_crypto_data_t;
 
-// for PF_NODE_SIZE == 4096, we have 96 attached data nodes and 32 mht child nodes
-// for PF_NODE_SIZE == 2048, we have 48 attached data nodes and 16 mht child nodes
-// for PF_NODE_SIZE == 1024, we have 24 attached data nodes and 8 mht child nodes
+// for node size 4096, we have 96 attached data nodes and 32 mht child nodes
+// for node size 65536, we have 1536 attached data nodes and 512 mht child nodes
 // 3/4 of the node size is dedicated to data nodes
-#define ATTACHED_DATA_NODES_COUNT ((PF_NODE_SIZE / sizeof(gcm_crypto_data_t)) * 3 / 4)
-static_assert(ATTACHED_DATA_NODES_COUNT == 96, "ATTACHED_DATA_NODES_COUNT");
+#define ATTACHED_DATA_NODES_COUNT(node_size) (((node_size) / sizeof(gcm_crypto_data_t)) * 3 / 4)
+static_assert(ATTACHED_DATA_NODES_COUNT(PF_NODE_SIZE) == 96, "ATTACHED_DATA_NODES_COUNT");
 // 1/4 of the node size is dedicated to child mht nodes
-#define CHILD_MHT_NODES_COUNT ((PF_NODE_SIZE / sizeof(gcm_crypto_data_t)) * 1 / 4)
-static_assert(CHILD_MHT_NODES_COUNT == 32, "CHILD_MHT_NODES_COUNT");
-
-typedef struct _mht_node {
-    gcm_crypto_data_t data_nodes_crypto[ATTACHED_DATA_NODES_COUNT];
-    gcm_crypto_data_t mht_nodes_crypto[CHILD_MHT_NODES_COUNT];
-} mht_node_t;
+#define CHILD_MHT_NODES_COUNT(node_size) (((node_size) / sizeof(gcm_crypto_data_t)) * 1 / 4)
+static_assert(CHILD_MHT_NODES_COUNT(PF_NODE_SIZE) == 32, "CHILD_MHT_NODES_COUNT");
 
-static_assert(sizeof(mht_node_t) == PF_NODE_SIZE, "sizeof(mht_node_t)");
-
-typedef struct _data_node {
-    uint8_t data[PF_NODE_SIZE];
-} data_node_t;
-
-static_assert(sizeof(data_node_t) == PF_NODE_SIZE, "sizeof(data_node_t)");
-
-typedef struct _encrypted_node {
-    uint8_t cipher[PF_NODE_SIZE];
-} encrypted_node_t;
-
-static_assert(sizeof(encrypted_node_t) == PF_NODE_SIZE, "sizeof(encrypted_node_t)");
+// an MHT node is an array of ATTACHED_DATA_NODES_COUNT(node_size) gcm_crypto_data_t entries for
+// data nodes, followed by CHILD_MHT_NODES_COUNT(node_size) entries for child mht nodes
 
+// the cache holds MAX_PAGES_IN_CACHE nodes of the default size, or nodes taking the same amount of
+// memory if they're bigger (but at least MIN_PAGES_IN_CACHE of them)
 #define MAX_PAGES_IN_CACHE 48
+#define MIN_PAGES_IN_CACHE 8U
+
+// whole data nodes written in a single pf_write() bypass the cache; adjacent ones are encrypted
+// into a buffer of up to MAX_WRITE_RUN_SIZE bytes (but no more than MAX_NODES_IN_WRITE_RUN nodes)
+// and written with a single callback
+#define MAX_WRITE_RUN_SIZE     (256 * 1024U)
+#define MAX_NODES_IN_WRITE_RUN 64U
 
 typedef enum {
     FILE_MHT_NODE_TYPE  = 1,
     FILE_DATA_NODE_TYPE = 2,
 } mht_node_type_e;
 
-// make sure these are the same size
-static_assert(sizeof(mht_node_t) == sizeof(data_node_t),
-              "sizeof(mht_node_t) == sizeof(data_node_t)");
-
 DEFINE_LIST(_file_node);
 typedef struct _file_node {
     LIST_TYPE(_file_node) list;
@@ -120,14 +124,10 @@ typedef struct _file_node {
     struct _file_node* parent;
     bool need_writing;
     bool new_node;
-    struct {
-        uint64_t physical_node_number;
-        encrypted_node_t encrypted; // the actual data from the disk
-    };
-    union { // decrypted data
-        mht_node_t mht;
-        data_node_t data;
-    } decrypted;
+    uint64_t physical_node_number;
+    uint8_t* encrypted; // the actual data from the disk (node size bytes, follows the struct)
+    uint8_t* decrypted; // decrypted data or gcm_crypto_data_t entries (node size bytes, follows
+                        // the encrypted data)
 } file_node_t;
 DEFINE_LISTP(_file_node);
 
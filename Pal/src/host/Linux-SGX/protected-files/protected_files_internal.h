@@ -13,12 +13,20 @@
 #include "lru_cache.h"
 #include "protected_files.h"
 #include "protected_files_format.h"
+#include "rwlock.h"
 
 struct pf_context {
+    rwlock_t lock; // taken by the public API; shared for queries, exclusive for file operations
     metadata_node_t file_metadata; // actual data from disk's meta data node
     pf_status_t last_error;
     metadata_encrypted_t encrypted_part_plain; // encrypted part of metadata node, decrypted
-    file_node_t root_mht; // the root of the mht is always needed (for files bigger than 3KB)
+    uint32_t node_size; // size of data and mht nodes
+    bool integrity_only; // data nodes are stored in plaintext, only authenticated
+    uint64_t attached_data_nodes_count; // per mht node
+    uint64_t child_mht_nodes_count; // per mht node
+    size_t max_nodes_in_cache;
+    size_t max_nodes_in_write_run; // whole data nodes written with a single callback
+    file_node_t* root_mht; // the root of the mht is always needed (for files bigger than 3KB)
     pf_handle_t file;
     pf_file_mode_t mode;
     uint64_t offset; // current file position (user's view)
@@ -29,6 +37,9 @@ struct pf_context {
     pf_key_t user_kdk_key;
     pf_key_t cur_key;
     lruc_context_t* cache;
+    uint8_t* node_buffer; // ciphertext of data nodes that bypass the cache
+    uint8_t* write_run_buffer; // ciphertext of adjacent data nodes that bypass the cache (lazily
+                               // allocated, max_nodes_in_write_run nodes)
 #ifdef DEBUG
     char* debug_buffer; // buffer for debug output
 #endif
@@ -36,8 +47,10 @@ struct pf_context {
 
 /* ipf prefix means "Intel protected files", these are functions from the SGX SDK implementation */
 static bool ipf_init_fields(pf_context_t* pf);
+static bool ipf_init_node_size(pf_context_t* pf, uint32_t node_size);
 static bool ipf_init_existing_file(pf_context_t* pf, const char* path);
-static bool ipf_init_new_file(pf_context_t* pf, const char* path);
+static bool ipf_init_new_file(pf_context_t* pf, const char* path, uint32_t node_size,
+                              bool integrity_only);
 
 static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_number, void* buffer,
                           uint32_t node_size);
@@ -48,24 +61,46 @@ static bool ipf_import_metadata_key(pf_context_t* pf, bool restore, pf_key_t* ou
 static bool ipf_generate_random_key(pf_context_t* pf, pf_key_t* output);
 static bool ipf_restore_current_metadata_key(pf_context_t* pf, pf_key_t* output);
 
+static file_node_t* ipf_alloc_node(pf_context_t* pf, uint8_t type);
+static void ipf_free_node(pf_context_t* pf, file_node_t* file_node);
+static gcm_crypto_data_t* ipf_data_nodes_crypto(file_node_t* file_mht_node);
+static gcm_crypto_data_t* ipf_mht_nodes_crypto(pf_context_t* pf, file_node_t* file_mht_node);
+static bool ipf_protect_data_node(pf_context_t* pf, const void* input, void* output,
+                                  gcm_crypto_data_t* gcm_crypto_data);
+static bool ipf_unprotect_data_node(pf_context_t* pf, const void* input, void* output,
+                                    const gcm_crypto_data_t* gcm_crypto_data);
+static size_t ipf_metadata_aad_size(pf_context_t* pf);
+
 static file_node_t* ipf_get_data_node(pf_context_t* pf);
 static file_node_t* ipf_read_data_node(pf_context_t* pf);
 static file_node_t* ipf_append_data_node(pf_context_t* pf);
 static file_node_t* ipf_get_mht_node(pf_context_t* pf);
 static file_node_t* ipf_read_mht_node(pf_context_t* pf, uint64_t mht_node_number);
 static file_node_t* ipf_append_mht_node(pf_context_t* pf, uint64_t mht_node_number);
+static void ipf_bump_mht_nodes(pf_context_t* pf, file_node_t* file_mht_node);
+static bool ipf_trim_cache(pf_context_t* pf);
+static void ipf_set_mht_nodes_need_writing(pf_context_t* pf, file_node_t* file_mht_node);
+
+static bool ipf_can_bypass_cache(pf_context_t* pf);
+static bool ipf_read_data_node_direct(pf_context_t* pf, void* output);
+static size_t ipf_write_data_nodes_direct(pf_context_t* pf, const uint8_t* input,
+                                          size_t nodes_count);
 
 static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf);
 static bool ipf_update_metadata_node(pf_context_t* pf);
+static bool ipf_write_nodes(pf_context_t* pf, file_node_t** file_nodes, size_t nodes_count);
 static bool ipf_write_all_changes_to_disk(pf_context_t* pf);
 static bool ipf_internal_flush(pf_context_t* pf);
 
 static pf_context_t* ipf_open(const char* path, pf_file_mode_t mode, bool create, pf_handle_t file,
-                              size_t real_size, const pf_key_t* kdk_key, pf_status_t* status);
+                              size_t real_size, uint32_t node_size, bool integrity_only,
+                              const pf_key_t* kdk_key, pf_status_t* status);
 static bool ipf_close(pf_context_t* pf);
 static size_t ipf_read(pf_context_t* pf, void* ptr, size_t size);
 static size_t ipf_write(pf_context_t* pf, const void* ptr, size_t size);
 static bool ipf_seek(pf_context_t* pf, uint64_t new_offset);
+static bool ipf_set_size(pf_context_t* pf, uint64_t new_size);
+static bool ipf_shrink(pf_context_t* pf, uint64_t new_size);
 static void ipf_try_clear_error(pf_context_t* pf);
 
 #endif /* PROTECTED_FILES_INTERNAL_H_ */
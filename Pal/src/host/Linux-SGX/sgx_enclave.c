@@ -91,9 +91,7 @@ static long sgx_ocall_munmap_untrusted(void* pms) {
     return 0;
 }
 
-static long sgx_ocall_cpuid(void* pms) {
-    ms_ocall_cpuid_t* ms = (ms_ocall_cpuid_t*)pms;
-    ODEBUG(OCALL_CPUID, ms);
+static void do_cpuid(ms_ocall_cpuid_t* ms) {
     __asm__ volatile("cpuid"
                      : "=a"(ms->ms_values[0]),
                        "=b"(ms->ms_values[1]),
@@ -101,6 +99,20 @@ static long sgx_ocall_cpuid(void* pms) {
                        "=d"(ms->ms_values[3])
                      : "a"(ms->ms_leaf), "c"(ms->ms_subleaf)
                      : "memory");
+}
+
+static long sgx_ocall_cpuid(void* pms) {
+    ms_ocall_cpuid_t* ms = (ms_ocall_cpuid_t*)pms;
+    ODEBUG(OCALL_CPUID, ms);
+    do_cpuid(ms);
+    return 0;
+}
+
+static long sgx_ocall_cpuid_batch(void* pms) {
+    ms_ocall_cpuid_batch_t* ms = (ms_ocall_cpuid_batch_t*)pms;
+    ODEBUG(OCALL_CPUID_BATCH, ms);
+    for (size_t i = 0; i < ms->ms_count; i++)
+        do_cpuid(&ms->ms_cpuids[i]);
     return 0;
 }
 
@@ -680,6 +692,7 @@ sgx_ocall_fn_t ocall_table[OCALL_NR] = {
     [OCALL_MMAP_UNTRUSTED]           = sgx_ocall_mmap_untrusted,
     [OCALL_MUNMAP_UNTRUSTED]         = sgx_ocall_munmap_untrusted,
     [OCALL_CPUID]                    = sgx_ocall_cpuid,
+    [OCALL_CPUID_BATCH]              = sgx_ocall_cpuid_batch,
     [OCALL_OPEN]                     = sgx_ocall_open,
     [OCALL_CLOSE]                    = sgx_ocall_close,
     [OCALL_READ]                     = sgx_ocall_read,
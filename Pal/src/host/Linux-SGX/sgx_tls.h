@@ -5,15 +5,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "buf_pool.h"
 #include "pal.h"
 #include "sgx_arch.h"
 
-struct untrusted_area {
-    void* addr;
-    size_t size;
-    uint64_t in_use; /* must be uint64_t, because SET_ENCLAVE_TLS() currently supports only 8-byte
-                      * types. TODO: fix this. */
-    bool valid;
+struct untrusted_area_cache {
+    uint64_t in_use; /* `pool` is being modified; must be uint64_t, because SET_ENCLAVE_TLS()
+                      * currently supports only 8-byte types. TODO: fix this. */
+    struct buf_pool pool;
 };
 
 /*
@@ -48,7 +47,7 @@ struct enclave_tls {
     void*     heap_min;
     void*     heap_max;
     int*      clear_child_tid;
-    struct untrusted_area untrusted_area_cache;
+    struct untrusted_area_cache untrusted_area_cache;
 };
 
 #ifndef DEBUG
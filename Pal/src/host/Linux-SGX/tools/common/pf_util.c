@@ -14,6 +14,7 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <mbedtls/cmac.h>
@@ -28,6 +29,10 @@
 
 /* High-level protected files helper functions. */
 
+/* Size of chunks in which files are converted. Whole PF data nodes in a chunk are encrypted from
+   (or decrypted into) the chunk buffer directly, without going through the PF node cache. */
+#define PF_CHUNK_SIZE (1024 * 1024)
+
 /* PF callbacks usable in a standard Linux environment.
    Assume that pf handle is a pointer to file's fd. */
 
@@ -95,6 +100,45 @@ static pf_status_t linux_write(pf_handle_t handle, const void* buffer, uint64_t
     return PF_STATUS_SUCCESS;
 }
 
+static pf_status_t linux_writev(pf_handle_t handle, const pf_iovec_t* iov, size_t iov_count,
+                                uint64_t offset) {
+    int fd = *(int*)handle;
+    DBG("linux_writev: fd %d, iov %p, iov_count %zu, offset %zu\n", fd, iov, iov_count, offset);
+
+    struct iovec vec[PF_IOV_MAX];
+    assert(iov_count <= PF_IOV_MAX);
+    for (size_t i = 0; i < iov_count; i++) {
+        vec[i].iov_base = (void*)iov[i].buffer;
+        vec[i].iov_len = iov[i].size;
+    }
+
+    ssize_t written;
+    do {
+        written = pwritev64(fd, vec, iov_count, offset);
+    } while (written < 0 && errno == EINTR);
+
+    if (written < 0) {
+        ERROR("pwritev64 failed: %s\n", strerror(errno));
+        return PF_STATUS_CALLBACK_FAILED;
+    }
+
+    /* short write, write the rest buffer by buffer */
+    size_t to_skip = written;
+    for (size_t i = 0; i < iov_count; i++) {
+        if (to_skip < iov[i].size) {
+            pf_status_t status = linux_write(handle, (const uint8_t*)iov[i].buffer + to_skip,
+                                             offset + to_skip, iov[i].size - to_skip);
+            if (PF_FAILURE(status))
+                return status;
+            to_skip = 0;
+        } else {
+            to_skip -= iov[i].size;
+        }
+        offset += iov[i].size;
+    }
+    return PF_STATUS_SUCCESS;
+}
+
 static pf_status_t linux_truncate(pf_handle_t handle, uint64_t size) {
     int fd = *(int*)handle;
     DBG("linux_truncate: fd %d, size %zu\n", fd, size);
@@ -206,7 +250,7 @@ static int pf_set_linux_callbacks(pf_debug_f debug_f) {
         return -1;
     }
 
-    pf_set_callbacks(linux_read, linux_write, linux_truncate, mbedtls_aes_cmac,
+    pf_set_callbacks(linux_read, linux_write, linux_writev, linux_truncate, mbedtls_aes_cmac,
                      mbedtls_aes_gcm_encrypt, mbedtls_aes_gcm_decrypt, mbedtls_random, debug_f);
     return 0;
 }
@@ -264,12 +308,13 @@ out:
 }
 
 /* Convert a single file to the protected format */
-int pf_encrypt_file(const char* input_path, const char* output_path, const pf_key_t* wrap_key) {
+int pf_encrypt_file(const char* input_path, const char* output_path, const pf_key_t* wrap_key,
+                    uint32_t node_size, bool integrity_only) {
     int ret = -1;
     int input = -1;
     int output = -1;
     pf_context_t* pf = NULL;
-    void* chunk = malloc(PF_NODE_SIZE);
+    void* chunk = malloc(PF_CHUNK_SIZE);
     if (!chunk) {
         ERROR("Out of memory\n");
         goto out;
@@ -293,7 +338,7 @@ int pf_encrypt_file(const char* input_path, const char* output_path, const pf_ke
 
     pf_handle_t handle = (pf_handle_t)&output;
     pf_status_t pfs = pf_open(handle, output_path, /*size=*/0, PF_FILE_MODE_WRITE, /*create=*/true,
-                              wrap_key, &pf);
+                              node_size, integrity_only, wrap_key, &pf);
     if (PF_FAILURE(pfs)) {
         ERROR("Failed to open output PF: %s\n", pf_strerror(pfs));
         goto out;
@@ -309,7 +354,7 @@ int pf_encrypt_file(const char* input_path, const char* output_path, const pf_ke
     uint64_t input_offset = 0;
 
     while (true) {
-        ssize_t chunk_size = read(input, chunk, PF_NODE_SIZE);
+        ssize_t chunk_size = read(input, chunk, PF_CHUNK_SIZE);
         if (chunk_size == 0) // EOF
             break;
 
@@ -355,7 +400,7 @@ int pf_decrypt_file(const char* input_path, const char* output_path, bool verify
     int input = -1;
     int output = -1;
     pf_context_t* pf = NULL;
-    void* chunk = malloc(PF_NODE_SIZE);
+    void* chunk = malloc(PF_CHUNK_SIZE);
     if (!chunk) {
         ERROR("Out of memory\n");
         goto out;
@@ -384,7 +429,8 @@ int pf_decrypt_file(const char* input_path, const char* output_path, bool verify
 
     const char* path = verify_path ? input_path : NULL;
     pf_status_t pfs = pf_open((pf_handle_t)&input, path, input_size, PF_FILE_MODE_READ,
-                              /*create=*/false, wrap_key, &pf);
+                              /*create=*/false, /*node_size=*/0, /*integrity_only=*/false,
+                              wrap_key, &pf);
     if (PF_FAILURE(pfs)) {
         ERROR("Opening protected input file failed: %s\n", pf_strerror(pfs));
         goto out;
@@ -407,7 +453,7 @@ int pf_decrypt_file(const char* input_path, const char* output_path, bool verify
 
     while (true) {
         assert(input_offset <= data_size);
-        uint64_t chunk_size = MIN(data_size - input_offset, PF_NODE_SIZE);
+        uint64_t chunk_size = MIN(data_size - input_offset, PF_CHUNK_SIZE);
         if (chunk_size == 0)
             break;
 
@@ -454,7 +500,8 @@ enum processing_mode_t {
 };
 
 static int process_files(const char* input_dir, const char* output_dir, const char* wrap_key_path,
-                         enum processing_mode_t mode, bool verify_path) {
+                         enum processing_mode_t mode, bool verify_path, uint32_t node_size,
+                         bool integrity_only) {
     int ret = -1;
     pf_key_t wrap_key;
     struct stat st;
@@ -483,7 +530,7 @@ static int process_files(const char* input_dir, const char* output_dir, const ch
     /* single file? */
     if (S_ISREG(st.st_mode)) {
         if (mode == MODE_ENCRYPT)
-            return pf_encrypt_file(input_dir, output_dir, &wrap_key);
+            return pf_encrypt_file(input_dir, output_dir, &wrap_key, node_size, integrity_only);
         else
             return pf_decrypt_file(input_dir, output_dir, verify_path, &wrap_key);
     }
@@ -534,7 +581,8 @@ static int process_files(const char* input_dir, const char* output_dir, const ch
 
         if (S_ISREG(st.st_mode)) {
             if (mode == MODE_ENCRYPT)
-                ret = pf_encrypt_file(input_path, output_path, &wrap_key);
+                ret = pf_encrypt_file(input_path, output_path, &wrap_key, node_size,
+                                      integrity_only);
             else
                 ret = pf_decrypt_file(input_path, output_path, verify_path, &wrap_key);
 
@@ -542,7 +590,8 @@ static int process_files(const char* input_dir, const char* output_dir, const ch
                 goto out;
         } else if (S_ISDIR(st.st_mode)) {
             /* process directory recursively */
-            ret = process_files(input_path, output_path, wrap_key_path, mode, verify_path);
+            ret = process_files(input_path, output_path, wrap_key_path, mode, verify_path,
+                                node_size, integrity_only);
             if (ret != 0)
                 goto out;
         } else {
@@ -563,12 +612,16 @@ out:
 }
 
 /* Convert a file or directory (recursively) to the protected format */
-int pf_encrypt_files(const char* input_dir, const char* output_dir, const char* wrap_key_path) {
-    return process_files(input_dir, output_dir, wrap_key_path, MODE_ENCRYPT, false);
+int pf_encrypt_files(const char* input_dir, const char* output_dir, const char* wrap_key_path,
+                     uint32_t node_size, bool integrity_only) {
+    return process_files(input_dir, output_dir, wrap_key_path, MODE_ENCRYPT, false, node_size,
+                         integrity_only);
 }
 
 /* Convert a file or directory (recursively) from the protected format */
 int pf_decrypt_files(const char* input_dir, const char* output_dir, bool verify_path,
                      const char* wrap_key_path) {
-    return process_files(input_dir, output_dir, wrap_key_path, MODE_DECRYPT, verify_path);
+    /* node size of existing files is read from their metadata */
+    return process_files(input_dir, output_dir, wrap_key_path, MODE_DECRYPT, verify_path,
+                         /*node_size=*/0, /*integrity_only=*/false);
 }
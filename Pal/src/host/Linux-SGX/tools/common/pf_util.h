@@ -16,15 +16,19 @@ int pf_init(void);
 /*! Generate random PF key and save it to file */
 int pf_generate_wrap_key(const char* wrap_key_path);
 
-/*! Convert a single file to the protected format */
-int pf_encrypt_file(const char* input_path, const char* output_path, const pf_key_t* wrap_key);
+/*! Convert a single file to the protected format, using nodes of \p node_size bytes (only
+ *  authenticated, not encrypted, if \p integrity_only is set) */
+int pf_encrypt_file(const char* input_path, const char* output_path, const pf_key_t* wrap_key,
+                    uint32_t node_size, bool integrity_only);
 
 /*! Convert a single file from the protected format */
 int pf_decrypt_file(const char* input_path, const char* output_path, bool verify_path,
                     const pf_key_t* wrap_key);
 
-/*! Convert a file or directory (recursively) to the protected format */
-int pf_encrypt_files(const char* input_dir, const char* output_dir, const char* wrap_key_path);
+/*! Convert a file or directory (recursively) to the protected format, using nodes of \p node_size
+ *  bytes (only authenticated, not encrypted, if \p integrity_only is set) */
+int pf_encrypt_files(const char* input_dir, const char* output_dir, const char* wrap_key_path,
+                     uint32_t node_size, bool integrity_only);
 
 /*! Convert a file or directory (recursively) from the protected format */
 int pf_decrypt_files(const char* input_dir, const char* output_dir, bool verify_path,
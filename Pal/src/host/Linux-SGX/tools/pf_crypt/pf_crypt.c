@@ -18,6 +18,8 @@ struct option g_options[] = {
     { "output", required_argument, 0, 'o' },
     { "wrap-key", required_argument, 0, 'w' },
     { "verify", no_argument, 0, 'V' },
+    { "node-size", required_argument, 0, 'n' },
+    { "integrity-only", no_argument, 0, 'I' },
     { "verbose", no_argument, 0, 'v' },
     { "help", no_argument, 0, 'h' },
     { 0, 0, 0, 0 }
@@ -38,6 +40,10 @@ static void usage(void) {
     INFO("  --input, -i PATH        Single file or directory with input files to convert\n");
     INFO("  --output, -o PATH       Single file or directory to write output files to\n");
     INFO("  --wrap-key, -w PATH     Path to wrap key file, must exist\n");
+    INFO("  --node-size, -n SIZE    (optional) Size of data nodes in bytes, a power of two between\n");
+    INFO("                          %u and %u (default: %u)\n", PF_NODE_SIZE, PF_NODE_SIZE_MAX,
+         PF_NODE_SIZE);
+    INFO("  --integrity-only, -I    (optional) Only authenticate file data, don't encrypt it\n");
     INFO("\nAvailable decrypt options:\n");
     INFO("  --input, -i PATH        Single file or directory with input files to convert\n");
     INFO("  --output, -o PATH       Single file or directory to write output files to\n");
@@ -57,9 +63,12 @@ int main(int argc, char* argv[]) {
     char* wrap_key_path = NULL;
     char* mode = NULL;
     bool verify = false;
+    uint32_t node_size = PF_NODE_SIZE;
+    bool integrity_only = false;
+    char* endptr;
 
     while (true) {
-        this_option = getopt_long(argc, argv, "i:o:p:w:Vvh", g_options, NULL);
+        this_option = getopt_long(argc, argv, "i:o:p:w:n:IVvh", g_options, NULL);
         if (this_option == -1)
             break;
 
@@ -79,6 +88,18 @@ int main(int argc, char* argv[]) {
             case 'V':
                 verify = true;
                 break;
+            case 'n':
+                node_size = strtoul(optarg, &endptr, 10);
+                if (*endptr != '\0' || node_size < PF_NODE_SIZE || node_size > PF_NODE_SIZE_MAX
+                        || (node_size & (node_size - 1)) != 0) {
+                    ERROR("Invalid node size: %s\n", optarg);
+                    usage();
+                    goto out;
+                }
+                break;
+            case 'I':
+                integrity_only = true;
+                break;
             case 'h':
                 usage();
                 exit(0);
@@ -117,7 +138,8 @@ int main(int argc, char* argv[]) {
                 usage();
                 goto out;
             }
-            ret = pf_encrypt_files(input_path, output_path, wrap_key_path);
+            ret = pf_encrypt_files(input_path, output_path, wrap_key_path, node_size,
+                                   integrity_only);
             break;
 
         case 'd': /* decrypt */
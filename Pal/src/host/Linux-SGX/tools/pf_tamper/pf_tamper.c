@@ -55,6 +55,8 @@ char* g_output_path = NULL;
 size_t g_output_path_size = 0;
 pf_key_t g_wrap_key;
 pf_key_t g_meta_key;
+uint32_t g_node_size = PF_NODE_SIZE; /* size of data and MHT nodes, read from the input PF */
+uint32_t g_flags = 0; /* PF_FLAG_* flags, read from the input PF */
 
 static pf_iv_t g_empty_iv = {0};
 
@@ -77,17 +79,23 @@ static void make_output_path(const char* suffix) {
     INFO("[*] %s\n", g_output_path);
 }
 
-/* PF layout (node size is PF_NODE_SIZE):
- * - Node 0: metadata (metadata_node_t)
+/* PF layout (for the default node size, PF_NODE_SIZE):
+ * - Node 0: metadata (metadata_node_t, always METADATA_NODE_SIZE bytes)
  *   - metadata_plain_t
  *   - metadata_encrypted_t (may include MD_USER_DATA_SIZE bytes of data)
+ *   - node size (since version 1.1)
+ *   - flags (since version 1.2)
  *   - metadata_padding_t
- * - Node 1: MHT (mht_node_t)
- * - Node 2-97: data (ATTACHED_DATA_NODES_COUNT == 96)
+ * - Node 1: MHT (array of gcm_crypto_data_t: data nodes, then child MHT nodes)
+ * - Node 2-97: data (ATTACHED_DATA_NODES_COUNT(PF_NODE_SIZE) == 96)
  * - Node 98: MHT
  * - Node 99-195: data
  * - ...
+ * All nodes after the metadata node are g_node_size bytes. Data nodes of integrity-only PFs are
+ * stored in plaintext (their MHT entries hold a GMAC instead of a GCM tag).
  */
+#define NODE_OFFSET(node_number) (METADATA_NODE_SIZE + ((node_number) - 1) * (size_t)g_node_size)
+
 static void truncate_file(const char* suffix, size_t output_size) {
     int ret;
 
@@ -108,7 +116,7 @@ out:
 
 #define FIELD_SIZEOF(t, f) (sizeof(((t*)0)->f))
 #define FIELD_TRUNCATED(t, f) (offsetof(t, f) + (FIELD_SIZEOF(t, f) / 2))
-#define DATA_CRYPTO_SIZE (FIELD_SIZEOF(mht_node_t, data_nodes_crypto))
+#define DATA_CRYPTO_SIZE (ATTACHED_DATA_NODES_COUNT(g_node_size) * sizeof(gcm_crypto_data_t))
 
 static void tamper_truncate(void) {
     size_t mdps = sizeof(metadata_plain_t);
@@ -141,9 +149,14 @@ static void tamper_truncate(void) {
     DBG("metadata_encrypted_t.data          : 0x%04lx (0x%04lx)\n",
         mdps + offsetof(metadata_encrypted_t, data), FIELD_SIZEOF(metadata_encrypted_t, data));
 
+    DBG("metadata_node_t.node_size          : 0x%04lx (0x%04lx)\n",
+        offsetof(metadata_node_t, node_size), FIELD_SIZEOF(metadata_node_t, node_size));
+    DBG("metadata_node_t.flags              : 0x%04lx (0x%04lx)\n",
+        offsetof(metadata_node_t, flags), FIELD_SIZEOF(metadata_node_t, flags));
+
     DBG("size(metadata_padding_t)           = 0x%04lx\n", sizeof(metadata_padding_t));
     DBG("metadata_padding_t                 : 0x%04lx (0x%04lx)\n",
-        mdps + sizeof(metadata_encrypted_t), sizeof(metadata_padding_t));
+        offsetof(metadata_node_t, padding), sizeof(metadata_padding_t));
 
     /* node 0: metadata + 3k of user data */
     /* plain metadata */
@@ -168,48 +181,56 @@ static void tamper_truncate(void) {
     truncate_file("trunc_meta_enc_8", mdps + offsetof(metadata_encrypted_t, data));
     truncate_file("trunc_meta_enc_9", mdps + FIELD_TRUNCATED(metadata_encrypted_t, data));
 
+    /* node size */
+    truncate_file("trunc_meta_node_size_0", offsetof(metadata_node_t, node_size));
+    truncate_file("trunc_meta_node_size_1", FIELD_TRUNCATED(metadata_node_t, node_size));
+
+    /* flags */
+    truncate_file("trunc_meta_flags_0", offsetof(metadata_node_t, flags));
+    truncate_file("trunc_meta_flags_1", FIELD_TRUNCATED(metadata_node_t, flags));
+
     /* padding */
-    truncate_file("trunc_meta_pad_0", mdps + sizeof(metadata_encrypted_t));
-    truncate_file("trunc_meta_pad_1", mdps + sizeof(metadata_encrypted_t)
+    truncate_file("trunc_meta_pad_0", offsetof(metadata_node_t, padding));
+    truncate_file("trunc_meta_pad_1", offsetof(metadata_node_t, padding)
                   + sizeof(metadata_padding_t) / 2);
 
     /* node 1: mht root */
     /* after node 0 */
-    truncate_file("trunc_mht_0", PF_NODE_SIZE);
+    truncate_file("trunc_mht_0", NODE_OFFSET(1));
     /* middle of data_nodes_crypto[0].key */
-    truncate_file("trunc_mht_1", PF_NODE_SIZE + PF_KEY_SIZE / 2);
+    truncate_file("trunc_mht_1", NODE_OFFSET(1) + PF_KEY_SIZE / 2);
     /* after data_nodes_crypto[0].key */
-    truncate_file("trunc_mht_2", PF_NODE_SIZE + PF_KEY_SIZE);
+    truncate_file("trunc_mht_2", NODE_OFFSET(1) + PF_KEY_SIZE);
     /* middle of data_nodes_crypto[0].gmac */
-    truncate_file("trunc_mht_3", PF_NODE_SIZE + PF_KEY_SIZE + PF_MAC_SIZE / 2);
+    truncate_file("trunc_mht_3", NODE_OFFSET(1) + PF_KEY_SIZE + PF_MAC_SIZE / 2);
     /* after data_nodes_crypto[0].gmac */
-    truncate_file("trunc_mht_4", PF_NODE_SIZE + PF_KEY_SIZE + PF_MAC_SIZE);
+    truncate_file("trunc_mht_4", NODE_OFFSET(1) + PF_KEY_SIZE + PF_MAC_SIZE);
     /* after data_nodes_crypto */
-    truncate_file("trunc_mht_5", PF_NODE_SIZE + DATA_CRYPTO_SIZE);
+    truncate_file("trunc_mht_5", NODE_OFFSET(1) + DATA_CRYPTO_SIZE);
     /* middle of mht_nodes_crypto[0].key */
-    truncate_file("trunc_mht_6", PF_NODE_SIZE + DATA_CRYPTO_SIZE + PF_KEY_SIZE / 2);
+    truncate_file("trunc_mht_6", NODE_OFFSET(1) + DATA_CRYPTO_SIZE + PF_KEY_SIZE / 2);
     /* after mht_nodes_crypto[0].key */
-    truncate_file("trunc_mht_7", PF_NODE_SIZE + DATA_CRYPTO_SIZE + PF_KEY_SIZE);
+    truncate_file("trunc_mht_7", NODE_OFFSET(1) + DATA_CRYPTO_SIZE + PF_KEY_SIZE);
     /* middle of mht_nodes_crypto[0].gmac */
-    truncate_file("trunc_mht_8", PF_NODE_SIZE + DATA_CRYPTO_SIZE + PF_KEY_SIZE + PF_MAC_SIZE / 2);
+    truncate_file("trunc_mht_8", NODE_OFFSET(1) + DATA_CRYPTO_SIZE + PF_KEY_SIZE + PF_MAC_SIZE / 2);
     /* after mht_nodes_crypto[0].gmac */
-    truncate_file("trunc_mht_9", PF_NODE_SIZE + DATA_CRYPTO_SIZE + PF_KEY_SIZE + PF_MAC_SIZE);
+    truncate_file("trunc_mht_9", NODE_OFFSET(1) + DATA_CRYPTO_SIZE + PF_KEY_SIZE + PF_MAC_SIZE);
 
     /* node 2-3: data #0, #1 */
     /* after mht root */
-    truncate_file("trunc_data_0", 2 * PF_NODE_SIZE);
+    truncate_file("trunc_data_0", NODE_OFFSET(2));
     /* middle of data #0 */
-    truncate_file("trunc_data_1", 2 * PF_NODE_SIZE + PF_NODE_SIZE / 2);
+    truncate_file("trunc_data_1", NODE_OFFSET(2) + g_node_size / 2);
     /* after data #0 */
-    truncate_file("trunc_data_2", 3 * PF_NODE_SIZE);
+    truncate_file("trunc_data_2", NODE_OFFSET(3));
     /* middle of data #1 */
-    truncate_file("trunc_data_3", 3 * PF_NODE_SIZE + PF_NODE_SIZE / 2);
+    truncate_file("trunc_data_3", NODE_OFFSET(3) + g_node_size / 2);
 
     /* extend */
     truncate_file("extend_0", g_input_size + 1);
-    truncate_file("extend_1", g_input_size + PF_NODE_SIZE / 2);
-    truncate_file("extend_2", g_input_size + PF_NODE_SIZE);
-    truncate_file("extend_3", g_input_size + PF_NODE_SIZE + PF_NODE_SIZE / 2);
+    truncate_file("extend_1", g_input_size + g_node_size / 2);
+    truncate_file("extend_2", g_input_size + g_node_size);
+    truncate_file("extend_3", g_input_size + g_node_size + g_node_size / 2);
 }
 
 /* returns mmap'd output contents */
@@ -232,33 +253,42 @@ static void* create_output(const char* path) {
     return mem;
 }
 
-static void pf_decrypt(const void* encrypted, size_t size, const pf_key_t* key, const pf_mac_t* mac,
-                       void* decrypted, const char* msg) {
-    pf_status_t status = mbedtls_aes_gcm_decrypt(key, &g_empty_iv, NULL, 0,
+static void pf_decrypt(const void* encrypted, size_t size, const void* aad, size_t aad_size,
+                       const pf_key_t* key, const pf_mac_t* mac, void* decrypted, const char* msg) {
+    pf_status_t status = mbedtls_aes_gcm_decrypt(key, &g_empty_iv, aad, aad_size,
                                                  encrypted, size,
                                                  decrypted, mac);
     if (PF_FAILURE(status))
         FATAL("decrypting %s failed\n", msg);
 }
 
-static void pf_encrypt(const void* decrypted, size_t size, const pf_key_t* key, pf_mac_t* mac,
-                       void* encrypted, const char* msg) {
-    pf_status_t status = mbedtls_aes_gcm_encrypt(key, &g_empty_iv, NULL, 0,
+static void pf_encrypt(const void* decrypted, size_t size, const void* aad, size_t aad_size,
+                       const pf_key_t* key, pf_mac_t* mac, void* encrypted, const char* msg) {
+    pf_status_t status = mbedtls_aes_gcm_encrypt(key, &g_empty_iv, aad, aad_size,
                                                  decrypted, size,
                                                  encrypted, mac);
     if (PF_FAILURE(status))
         FATAL("encrypting %s failed\n", msg);
 }
 
+/* node size is authenticated as additional data of the metadata since version 1.1, flags since
+ * version 1.2 (they directly follow the node size) */
+#define META_AAD_SIZE(meta) \
+    ((meta)->plain_part.minor_version == PF_MINOR_VERSION_DEFAULT_NODE_SIZE ? 0 \
+     : (meta)->plain_part.minor_version == PF_MINOR_VERSION_NODE_SIZE ? sizeof((meta)->node_size) \
+     : sizeof((meta)->node_size) + sizeof((meta)->flags))
+#define META_AAD(meta) (META_AAD_SIZE(meta) ? &(meta)->node_size : NULL)
+
 /* copy input PF and apply some modifications */
 #define __BREAK_PF(suffix, ...) do { \
     make_output_path(suffix); \
     meta = create_output(g_output_path); \
     out = (uint8_t*)meta; \
-    pf_decrypt(&meta->encrypted_part, sizeof(meta->encrypted_part), &g_meta_key, \
-               &meta->plain_part.metadata_gmac, meta_dec, "metadata"); \
-    mht_enc = (mht_node_t*)(out + PF_NODE_SIZE); \
-    pf_decrypt(mht_enc, sizeof(*mht_enc), &meta_dec->mht_key, &meta_dec->mht_gmac, mht_dec, \
+    pf_decrypt(&meta->encrypted_part, sizeof(meta->encrypted_part), META_AAD(meta), \
+               META_AAD_SIZE(meta), &g_meta_key, &meta->plain_part.metadata_gmac, meta_dec, \
+               "metadata"); \
+    mht_enc = out + NODE_OFFSET(1); \
+    pf_decrypt(mht_enc, g_node_size, NULL, 0, &meta_dec->mht_key, &meta_dec->mht_gmac, mht_dec, \
                "mht"); \
     __VA_ARGS__ \
     munmap(meta, g_input_size); \
@@ -269,7 +299,8 @@ static void pf_encrypt(const void* decrypted, size_t size, const pf_key_t* key,
     __BREAK_PF(suffix, __VA_ARGS__); \
     if (update) { \
         __BREAK_PF(suffix "_fixed", __VA_ARGS__ { \
-                       pf_encrypt(meta_dec, sizeof(*meta_dec), &g_meta_key, \
+                       pf_encrypt(meta_dec, sizeof(*meta_dec), META_AAD(meta), \
+                                  META_AAD_SIZE(meta), &g_meta_key, \
                                   &meta->plain_part.metadata_gmac, meta->encrypted_part, \
                                   "metadata"); \
                    } ); \
@@ -278,8 +309,8 @@ static void pf_encrypt(const void* decrypted, size_t size, const pf_key_t* key,
 
 #define BREAK_MHT(suffix, ...) do { \
     __BREAK_PF(suffix, __VA_ARGS__ { \
-                   pf_encrypt(mht_dec, sizeof(*mht_dec), &meta_dec->mht_key, &meta_dec->mht_gmac, \
-                              mht_enc, "mht"); \
+                   pf_encrypt(mht_dec, g_node_size, NULL, 0, &meta_dec->mht_key, \
+                              &meta_dec->mht_gmac, mht_enc, "mht"); \
                } ); \
 } while (0)
 
@@ -291,10 +322,15 @@ static void tamper_modify(void) {
     metadata_encrypted_t* meta_dec = malloc(sizeof(*meta_dec));
     if (!meta_dec)
         FATAL("Out of memory\n");
-    mht_node_t* mht_enc = NULL;
-    mht_node_t* mht_dec = malloc(sizeof(*mht_dec));
+    uint8_t* mht_enc = NULL;
+    gcm_crypto_data_t* mht_dec = malloc(g_node_size);
     if (!mht_dec)
         FATAL("Out of memory\n");
+    /* an MHT node contains crypto data of its data nodes, followed by that of its child MHTs */
+    size_t data_nodes_count = ATTACHED_DATA_NODES_COUNT(g_node_size);
+    size_t mht_nodes_count = CHILD_MHT_NODES_COUNT(g_node_size);
+    gcm_crypto_data_t* data_nodes_crypto = mht_dec;
+    gcm_crypto_data_t* mht_nodes_crypto = mht_dec + data_nodes_count;
 
     /* plain part of the metadata isn't covered by the MAC so no point updating it */
     BREAK_PF("meta_plain_id_0", /*update=*/false,
@@ -346,44 +382,74 @@ static void tamper_modify(void) {
     BREAK_PF("meta_enc_data_1", /*update=*/true,
              { LAST_BYTE(meta_dec->data) ^= 1; });
 
+    /* node size is covered by the metadata MAC only since version 1.1; a wrong node size must be
+     * detected even if the MAC is updated */
+    if (g_node_size != PF_NODE_SIZE) {
+        BREAK_PF("meta_node_size_0", /*update=*/true,
+                 { meta->node_size = g_node_size * 2; });
+        BREAK_PF("meta_node_size_1", /*update=*/true,
+                 { meta->node_size = g_node_size / 2; });
+        BREAK_PF("meta_node_size_2", /*update=*/false,
+                 { meta->node_size = 0; });
+        BREAK_PF("meta_node_size_3", /*update=*/false,
+                 { meta->plain_part.minor_version = PF_MINOR_VERSION_DEFAULT_NODE_SIZE; });
+    }
+
+    /* flags are covered by the metadata MAC since version 1.2; unknown flags must be rejected and
+     * a changed integrity-only flag must be detected when reading data nodes */
+    if (((metadata_node_t*)g_input_data)->plain_part.minor_version > PF_MINOR_VERSION_NODE_SIZE) {
+        BREAK_PF("meta_flags_0", /*update=*/true,
+                 { meta->flags ^= PF_FLAG_INTEGRITY_ONLY; });
+        BREAK_PF("meta_flags_1", /*update=*/true,
+                 { meta->flags |= 0x80000000U; });
+    }
+
     /* padding is ignored */
     BREAK_PF("meta_padding_0", /*update=*/false,
              { meta->padding[0] ^= 1; });
     BREAK_PF("meta_padding_1", /*update=*/false,
              { LAST_BYTE(meta->padding) ^= 0xfe; });
 
-    BREAK_MHT("mht_0", { mht_dec->data_nodes_crypto[0].key[0] ^= 1; });
-    BREAK_MHT("mht_1", { mht_dec->data_nodes_crypto[0].gmac[0] ^= 1; });
-    BREAK_MHT("mht_2", { mht_dec->mht_nodes_crypto[0].key[0] ^= 1; });
-    BREAK_MHT("mht_3", { mht_dec->mht_nodes_crypto[0].gmac[0] ^= 1; });
-    BREAK_MHT("mht_4", { mht_dec->data_nodes_crypto[ATTACHED_DATA_NODES_COUNT - 1].key[0] ^= 1; });
-    BREAK_MHT("mht_5", { mht_dec->data_nodes_crypto[ATTACHED_DATA_NODES_COUNT - 1].gmac[0] ^= 1; });
-    BREAK_MHT("mht_6", { mht_dec->mht_nodes_crypto[CHILD_MHT_NODES_COUNT - 1].key[0] ^= 1; });
-    BREAK_MHT("mht_7", { mht_dec->mht_nodes_crypto[CHILD_MHT_NODES_COUNT - 1].gmac[0] ^= 1; });
+    BREAK_MHT("mht_0", { data_nodes_crypto[0].key[0] ^= 1; });
+    BREAK_MHT("mht_1", { data_nodes_crypto[0].gmac[0] ^= 1; });
+    BREAK_MHT("mht_2", { mht_nodes_crypto[0].key[0] ^= 1; });
+    BREAK_MHT("mht_3", { mht_nodes_crypto[0].gmac[0] ^= 1; });
+    BREAK_MHT("mht_4", { data_nodes_crypto[data_nodes_count - 1].key[0] ^= 1; });
+    BREAK_MHT("mht_5", { data_nodes_crypto[data_nodes_count - 1].gmac[0] ^= 1; });
+    BREAK_MHT("mht_6", { mht_nodes_crypto[mht_nodes_count - 1].key[0] ^= 1; });
+    BREAK_MHT("mht_7", { mht_nodes_crypto[mht_nodes_count - 1].gmac[0] ^= 1; });
     BREAK_MHT("mht_8", {
         gcm_crypto_data_t crypto;
-        memcpy(&crypto, &mht_dec->data_nodes_crypto[0], sizeof(crypto));
-        memcpy(&mht_dec->data_nodes_crypto[0], &mht_dec->data_nodes_crypto[1], sizeof(crypto));
-        memcpy(&mht_dec->data_nodes_crypto[1], &crypto, sizeof(crypto));
+        memcpy(&crypto, &data_nodes_crypto[0], sizeof(crypto));
+        memcpy(&data_nodes_crypto[0], &data_nodes_crypto[1], sizeof(crypto));
+        memcpy(&data_nodes_crypto[1], &crypto, sizeof(crypto));
     });
     BREAK_MHT("mht_9", {
         gcm_crypto_data_t crypto;
-        memcpy(&crypto, &mht_dec->mht_nodes_crypto[0], sizeof(crypto));
-        memcpy(&mht_dec->mht_nodes_crypto[0], &mht_dec->mht_nodes_crypto[1], sizeof(crypto));
-        memcpy(&mht_dec->mht_nodes_crypto[1], &crypto, sizeof(crypto));
+        memcpy(&crypto, &mht_nodes_crypto[0], sizeof(crypto));
+        memcpy(&mht_nodes_crypto[0], &mht_nodes_crypto[1], sizeof(crypto));
+        memcpy(&mht_nodes_crypto[1], &crypto, sizeof(crypto));
     });
 
     /* data nodes start from node #2 */
     BREAK_PF("data_0", /*update=*/false,
-             { *(out + 2 * PF_NODE_SIZE) ^= 1; });
+             { *(out + NODE_OFFSET(2)) ^= 1; });
     BREAK_PF("data_1", /*update=*/false,
-             { *(out + 3 * PF_NODE_SIZE - 1) ^= 1; });
+             { *(out + NODE_OFFSET(3) - 1) ^= 1; });
     BREAK_PF("data_2", /*update=*/false, {
         /* swap data nodes */
-        memcpy(out + 2 * PF_NODE_SIZE, g_input_data + 3 * PF_NODE_SIZE, PF_NODE_SIZE);
-        memcpy(out + 3 * PF_NODE_SIZE, g_input_data + 2 * PF_NODE_SIZE, PF_NODE_SIZE);
+        memcpy(out + NODE_OFFSET(2), g_input_data + NODE_OFFSET(3), g_node_size);
+        memcpy(out + NODE_OFFSET(3), g_input_data + NODE_OFFSET(2), g_node_size);
     });
 
+    if (g_flags & PF_FLAG_INTEGRITY_ONLY) {
+        /* plaintext data nodes can be modified in a meaningful way without knowing any key */
+        BREAK_PF("data_plain_0", /*update=*/false,
+                 { *(out + NODE_OFFSET(2) + g_node_size / 2) ^= 1; });
+        BREAK_PF("data_plain_1", /*update=*/false,
+                 { memcpy(out + NODE_OFFSET(3), g_input_data + NODE_OFFSET(2), g_node_size); });
+    }
+
     free(mht_dec);
     free(meta_dec);
 }
@@ -460,6 +526,23 @@ int main(int argc, char* argv[]) {
         goto out;
     }
 
+    if (g_input_size < METADATA_NODE_SIZE) {
+        ERROR("Input file '%s' is too small\n", input_path);
+        goto out;
+    }
+
+    const metadata_node_t* input_meta = g_input_data;
+    if (input_meta->plain_part.minor_version != PF_MINOR_VERSION_DEFAULT_NODE_SIZE) {
+        g_node_size = input_meta->node_size;
+        if (g_node_size < PF_NODE_SIZE || g_node_size > PF_NODE_SIZE_MAX
+                || !IS_POWER_OF_2(g_node_size)) {
+            ERROR("Invalid node size of input file '%s': %u\n", input_path, g_node_size);
+            goto out;
+        }
+    }
+    if (input_meta->plain_part.minor_version > PF_MINOR_VERSION_NODE_SIZE)
+        g_flags = input_meta->flags;
+
     load_wrap_key(wrap_key_path, &g_wrap_key);
     derive_main_key(&g_wrap_key, &((metadata_plain_t*)g_input_data)->metadata_key_id,
                     &g_meta_key);
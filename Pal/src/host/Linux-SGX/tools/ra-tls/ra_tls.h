@@ -24,13 +24,25 @@
 #define RA_TLS_CERT_TIMESTAMP_NOT_BEFORE "RA_TLS_CERT_TIMESTAMP_NOT_BEFORE"
 #define RA_TLS_CERT_TIMESTAMP_NOT_AFTER  "RA_TLS_CERT_TIMESTAMP_NOT_AFTER"
 
+#define RA_TLS_KEY_TYPE          "RA_TLS_KEY_TYPE"
+#define RA_TLS_KEY_TYPE_EC_P256  "ecdsa-p256"
+#define RA_TLS_KEY_TYPE_RSA_3072 "rsa-3072"
+
+#define RA_TLS_VERIFY_CACHE_SIZE "RA_TLS_VERIFY_CACHE_SIZE"
+#define RA_TLS_VERIFY_CACHE_TTL  "RA_TLS_VERIFY_CACHE_TTL"
+
 #define SHA256_DIGEST_SIZE       32
 #define RSA_PUB_3072_KEY_LEN     3072
 #define RSA_PUB_3072_KEY_DER_LEN 422
+#define EC_PUB_P256_KEY_DER_LEN  91
 #define RSA_PUB_EXPONENT         65537
 #define PUB_KEY_SIZE_MAX         512
 #define IAS_REQUEST_NONCE_LEN    32
 
+#define VERIFY_CACHE_SIZE_MAX    4096
+#define VERIFY_CACHE_TTL_DEFAULT 60    /* seconds */
+#define VERIFY_CACHE_TTL_MAX     86400 /* seconds */
+
 #define OID(N) \
     { 0x06, 0x09, 0x2A, 0x86, 0x48, 0x86, 0xF8, 0x4D, 0x8A, 0x39, (N) }
 static const uint8_t quote_oid[] = OID(0x06);
@@ -56,13 +68,35 @@ int cmp_crt_pk_against_quote_report_data(mbedtls_x509_crt* crt, sgx_quote_t* quo
 __attribute__ ((visibility("hidden")))
 int verify_quote_body_against_envvar_measurements(const sgx_quote_body_t* quote_body);
 
+/* looks up `crt` among recently verified certificates (if the cache is enabled via
+ * RA_TLS_VERIFY_CACHE_SIZE envvar); returns 1 if found, 0 if not found (then `crt_hash` and
+ * `out_generation` are set for a later verify_cache_add()) or a negative mbedTLS error code on
+ * invalid cache settings */
+__attribute__ ((visibility("hidden")))
+int verify_cache_lookup(const mbedtls_x509_crt* crt, uint8_t* crt_hash, uint64_t* out_generation);
+
+/* remembers the certificate with `crt_hash` (set by verify_cache_lookup()) as successfully
+ * verified; does nothing if the cache is disabled or was reset since the lookup (`generation`) */
+__attribute__ ((visibility("hidden")))
+void verify_cache_add(const uint8_t* crt_hash, uint64_t generation);
+
+/* empties the cache of verified certificates; its settings are re-read from envvars on next use */
+__attribute__ ((visibility("hidden")))
+void verify_cache_reset(void);
+
+/* writes `report_data` and reads the resulting SGX quote (at most `quote_size` bytes) into `quote`,
+ * returns the size of the quote or a negative mbedTLS error code */
+__attribute__ ((visibility("hidden")))
+int ra_tls_get_quote(const sgx_report_data_t* report_data, uint8_t* quote, size_t quote_size);
+
 /*!
  * \brief Callback for user-specific verification of measurements in SGX quote.
  *
  * If this callback is registered before RA-TLS session, then RA-TLS verification will invoke this
  * callback to allow for user-specific checks on SGX measurements reported in the SGX quote. If no
  * callback is registered (or registered as NULL), then RA-TLS defaults to verifying SGX
- * measurements against `RA_TLS_*` environment variables (if any).
+ * measurements against `RA_TLS_*` environment variables (if any). Registering a callback empties
+ * the cache of verified certificates (see `RA_TLS_VERIFY_CACHE_SIZE` environment variable).
  *
  * \param[in] f_cb  Callback for user-specific verification; RA-TLS passes pointers to MRENCLAVE,
  *                  MRSIGNER, ISV_PROD_ID, ISV_SVN measurements in SGX quote. Use NULL to revert to
@@ -111,12 +145,14 @@ int ra_tls_verify_callback_der(uint8_t* der_crt, size_t der_crt_size);
 /*!
  * \brief mbedTLS-suitable function to generate a key and a corresponding RA-TLS certificate.
  *
- * The function first generates a random RSA keypair with PKCS#1 v1.5 encoding. Then it calculates
- * the SHA256 hash over the generated public key and retrieves an SGX quote with report_data equal
- * to the calculated hash (this ties the generated certificate key to the SGX quote). Finally, it
- * generates the X.509 self-signed certificate with this key and the SGX quote embedded.
+ * The function first generates a random keypair: ECDSA on NIST P-256 curve by default, or RSA-3072
+ * with PKCS#1 v1.5 encoding if `RA_TLS_KEY_TYPE` environment variable is set to "rsa-3072". Then
+ * it calculates the SHA256 hash over the generated public key (in DER format) and retrieves an SGX
+ * quote with report_data equal to the calculated hash (this ties the generated certificate key to
+ * the SGX quote). Finally, it generates the X.509 self-signed certificate with this key and the
+ * SGX quote embedded.
  *
- * \param[out] key   Populated with a generated RSA keypair.
+ * \param[out] key   Populated with a generated keypair.
  * \param[out] crt   Populated with a self-signed RA-TLS certificate with SGX quote embedded.
  *
  * \return           0 on success, specific mbedTLS error code (negative int) otherwise.
@@ -131,8 +167,8 @@ int ra_tls_create_key_and_crt(mbedtls_pk_context* key, mbedtls_x509_crt* crt);
  * in the DER format. The function allocates memory for key and certificate; user is expected to
  * free them after use.
  *
- * \param[out] der_key       Pointer to buffer populated with generated RSA keypair in DER format.
- * \param[out] der_key_size  Pointer to size of generated RSA keypair.
+ * \param[out] der_key       Pointer to buffer populated with generated keypair in DER format.
+ * \param[out] der_key_size  Pointer to size of generated keypair.
  * \param[out] der_crt       Pointer to buffer populated with self-signed RA-TLS certificate.
  * \param[out] der_crt_size  Pointer to size of self-signed RA-TLS certificate.
  *
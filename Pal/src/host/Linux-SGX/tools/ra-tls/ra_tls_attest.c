@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecp.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/pk.h>
 #include <mbedtls/rsa.h>
@@ -151,9 +152,23 @@ out:
 static int sha256_over_pk(mbedtls_pk_context* pk, uint8_t* sha) {
     uint8_t pk_der[PUB_KEY_SIZE_MAX] = {0};
 
+    int expected_der_size;
+    switch (mbedtls_pk_get_type(pk)) {
+        case MBEDTLS_PK_ECKEY:
+            if (mbedtls_pk_ec(*pk)->grp.id != MBEDTLS_ECP_DP_SECP256R1)
+                return MBEDTLS_ERR_PK_INVALID_PUBKEY;
+            expected_der_size = EC_PUB_P256_KEY_DER_LEN;
+            break;
+        case MBEDTLS_PK_RSA:
+            expected_der_size = RSA_PUB_3072_KEY_DER_LEN;
+            break;
+        default:
+            return MBEDTLS_ERR_PK_INVALID_PUBKEY;
+    }
+
     /* below function writes data at the end of the buffer */
     int pk_der_size_byte = mbedtls_pk_write_pubkey_der(pk, pk_der, PUB_KEY_SIZE_MAX);
-    if (pk_der_size_byte != RSA_PUB_3072_KEY_DER_LEN)
+    if (pk_der_size_byte != expected_der_size)
         return MBEDTLS_ERR_PK_INVALID_PUBKEY;
 
     /* move the data to the beginning of the buffer, to avoid pointer arithmetic later */
@@ -162,6 +177,21 @@ static int sha256_over_pk(mbedtls_pk_context* pk, uint8_t* sha) {
     return mbedtls_sha256_ret(pk_der, pk_der_size_byte, sha, /*is224=*/0);
 }
 
+/* weak, so that it can be replaced by a stand-in in tests running outside of SGX enclaves */
+__attribute__((weak))
+int ra_tls_get_quote(const sgx_report_data_t* report_data, uint8_t* quote, size_t quote_size) {
+    ssize_t written = rw_file("/dev/attestation/user_report_data", (uint8_t*)report_data->d,
+                              sizeof(report_data->d), /*do_write=*/true);
+    if (written != sizeof(*report_data))
+        return MBEDTLS_ERR_X509_FILE_IO_ERROR;
+
+    ssize_t bytes = rw_file("/dev/attestation/quote", quote, quote_size, /*do_write=*/false);
+    if (bytes < 0)
+        return MBEDTLS_ERR_X509_FILE_IO_ERROR;
+
+    return bytes;
+}
+
 /*! given public key \p pk, generate an RA-TLS certificate \p writecrt */
 static int create_x509(mbedtls_pk_context* pk, mbedtls_x509write_cert* writecrt) {
     sgx_report_data_t user_report_data = {0};
@@ -169,20 +199,14 @@ static int create_x509(mbedtls_pk_context* pk, mbedtls_x509write_cert* writecrt)
     if (ret < 0)
         return ret;
 
-    ssize_t written = rw_file("/dev/attestation/user_report_data", user_report_data.d,
-                              sizeof(user_report_data.d), /*do_write=*/true);
-    if (written != sizeof(user_report_data))
-        return MBEDTLS_ERR_X509_FILE_IO_ERROR;
-
     uint8_t* quote = malloc(SGX_QUOTE_MAX_SIZE);
     if (!quote)
         return MBEDTLS_ERR_X509_ALLOC_FAILED;
 
-    ssize_t quote_size = rw_file("/dev/attestation/quote", quote, SGX_QUOTE_MAX_SIZE,
-                                 /*do_write=*/false);
+    int quote_size = ra_tls_get_quote(&user_report_data, quote, SGX_QUOTE_MAX_SIZE);
     if (quote_size < 0) {
         free(quote);
-        return MBEDTLS_ERR_X509_FILE_IO_ERROR;
+        return quote_size;
     }
 
     ret = generate_x509(pk, quote, quote_size, writecrt);
@@ -191,6 +215,40 @@ static int create_x509(mbedtls_pk_context* pk, mbedtls_x509write_cert* writecrt)
     return ret;
 }
 
+static int get_key_type(mbedtls_pk_type_t* out_type) {
+    const char* str = getenv(RA_TLS_KEY_TYPE);
+    if (!str || !strcmp(str, RA_TLS_KEY_TYPE_EC_P256)) {
+        *out_type = MBEDTLS_PK_ECKEY;
+    } else if (!strcmp(str, RA_TLS_KEY_TYPE_RSA_3072)) {
+        *out_type = MBEDTLS_PK_RSA;
+    } else {
+        return MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE;
+    }
+    return 0;
+}
+
+/*! generate a random keypair \p key of the type selected by RA_TLS_KEY_TYPE envvar */
+static int generate_key(mbedtls_pk_context* key, mbedtls_ctr_drbg_context* ctr_drbg) {
+    mbedtls_pk_type_t type;
+    int ret = get_key_type(&type);
+    if (ret < 0)
+        return ret;
+
+    ret = mbedtls_pk_setup(key, mbedtls_pk_info_from_type(type));
+    if (ret < 0)
+        return ret;
+
+    if (type == MBEDTLS_PK_ECKEY) {
+        return mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(*key),
+                                   mbedtls_ctr_drbg_random, ctr_drbg);
+    }
+
+    mbedtls_rsa_init(mbedtls_pk_rsa(*key), MBEDTLS_RSA_PKCS_V15, /*hash_id=*/0);
+
+    return mbedtls_rsa_gen_key(mbedtls_pk_rsa(*key), mbedtls_ctr_drbg_random, ctr_drbg,
+                               RSA_PUB_3072_KEY_LEN, RSA_PUB_EXPONENT);
+}
+
 static int create_key_and_crt(mbedtls_pk_context* key, mbedtls_x509_crt* crt, uint8_t** crt_der,
                               size_t* crt_der_size) {
     int ret;
@@ -225,14 +283,7 @@ static int create_key_and_crt(mbedtls_pk_context* key, mbedtls_x509_crt* crt, ui
     if (ret < 0)
         goto out;
 
-    ret = mbedtls_pk_setup(key, mbedtls_pk_info_from_type(MBEDTLS_PK_RSA));
-    if (ret < 0)
-        goto out;
-
-    mbedtls_rsa_init((mbedtls_rsa_context*)key->pk_ctx, MBEDTLS_RSA_PKCS_V15, /*hash_id=*/0);
-
-    ret = mbedtls_rsa_gen_key((mbedtls_rsa_context*)key->pk_ctx, mbedtls_ctr_drbg_random, &ctr_drbg,
-                              RSA_PUB_3072_KEY_LEN, RSA_PUB_EXPONENT);
+    ret = generate_key(key, &ctr_drbg);
     if (ret < 0)
         goto out;
 
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test and benchmark of RA-TLS key types (ra_tls_attest.c and the quote binding check in
+ * ra_tls_verify_common.c), runnable on a plain Linux host: the SGX quote is replaced by a stand-in
+ * that only carries the report data, and the verification callback checks only the binding of the
+ * certificate key to the quote. For each key type, prints average times of creating a key and
+ * a certificate (done by an enclave at startup), of verifying the binding between the certificate
+ * key and the quote (done by the verifier) and of signing and verifying a handshake message with
+ * the key (done in every TLS handshake).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/config.h"
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/x509_crt.h"
+
+#include "ra_tls.h"
+#include "ra_tls_test_utils.h"
+
+/* stand-in for the verification callbacks in ra_tls_verify_{epid,dcap}.c */
+int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    (void)data;
+    (void)flags;
+
+    if (depth != 0)
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+
+    return verify_quote_binding(crt);
+}
+
+static int verify_crt(uint8_t* der_crt, size_t der_crt_size) {
+    return ra_tls_verify_callback_der(der_crt, der_crt_size);
+}
+
+/* signs a message with the private key and verifies it with the certificate, as done during TLS
+ * handshake (CertificateVerify or ServerKeyExchange message) */
+static void sign_and_verify(mbedtls_ctr_drbg_context* ctr_drbg, const uint8_t* der_key,
+                            size_t der_key_size, const uint8_t* der_crt, size_t der_crt_size,
+                            size_t iterations, uint64_t* out_time_us) {
+    mbedtls_pk_context key;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_init(&key);
+    mbedtls_x509_crt_init(&crt);
+
+    if (mbedtls_pk_parse_key(&key, der_key, der_key_size, /*pwd=*/NULL, 0) < 0
+            || mbedtls_x509_crt_parse_der(&crt, der_crt, der_crt_size) < 0)
+        FAIL("cannot parse generated key or certificate");
+
+    uint8_t hash[32];
+    uint8_t sig[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
+    size_t sig_size;
+    memset(hash, 0xab, sizeof(hash));
+
+    uint64_t start_time = time_us();
+    for (size_t i = 0; i < iterations; i++) {
+        hash[0] = i;
+        if (mbedtls_pk_sign(&key, MBEDTLS_MD_SHA256, hash, sizeof(hash), sig, &sig_size,
+                            mbedtls_ctr_drbg_random, ctr_drbg) < 0)
+            FAIL("mbedtls_pk_sign() failed");
+        if (mbedtls_pk_verify(&crt.pk, MBEDTLS_MD_SHA256, hash, sizeof(hash), sig, sig_size) < 0)
+            FAIL("mbedtls_pk_verify() failed");
+    }
+    *out_time_us = time_us() - start_time;
+
+    mbedtls_x509_crt_free(&crt);
+    mbedtls_pk_free(&key);
+}
+
+static void test_key_type(mbedtls_ctr_drbg_context* ctr_drbg, const char* key_type,
+                          mbedtls_pk_type_t expected_pk_type, size_t iterations) {
+    int ret;
+
+    if (key_type) {
+        if (setenv(RA_TLS_KEY_TYPE, key_type, /*overwrite=*/1) < 0)
+            FAIL("setenv() failed");
+    } else {
+        unsetenv(RA_TLS_KEY_TYPE);
+    }
+
+    uint8_t* der_key = NULL;
+    uint8_t* der_crt = NULL;
+    size_t der_key_size;
+    size_t der_crt_size;
+
+    uint64_t create_time = 0;
+    uint64_t verify_time = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        free(der_key);
+        free(der_crt);
+
+        uint64_t start_time = time_us();
+        ret = ra_tls_create_key_and_crt_der(&der_key, &der_key_size, &der_crt, &der_crt_size);
+        if (ret < 0)
+            FAIL("ra_tls_create_key_and_crt_der() failed: %d", ret);
+        uint64_t mid_time = time_us();
+        ret = verify_crt(der_crt, der_crt_size);
+        if (ret < 0)
+            FAIL("verification of the generated certificate failed: %d", ret);
+        uint64_t end_time = time_us();
+
+        create_time += mid_time - start_time;
+        verify_time += end_time - mid_time;
+    }
+
+    mbedtls_x509_crt crt;
+    mbedtls_x509_crt_init(&crt);
+    if (mbedtls_x509_crt_parse_der(&crt, der_crt, der_crt_size) < 0)
+        FAIL("cannot parse generated certificate");
+    if (mbedtls_pk_get_type(&crt.pk) != expected_pk_type)
+        FAIL("generated key has type %d, expected %d", mbedtls_pk_get_type(&crt.pk),
+             expected_pk_type);
+    mbedtls_x509_crt_free(&crt);
+
+    uint64_t sign_time;
+    sign_and_verify(ctr_drbg, der_key, der_key_size, der_crt, der_crt_size, iterations,
+                    &sign_time);
+
+    /* a quote that doesn't match the key must be detected */
+    g_tamper_quote = true;
+    free(der_key);
+    free(der_crt);
+    ret = ra_tls_create_key_and_crt_der(&der_key, &der_key_size, &der_crt, &der_crt_size);
+    if (ret < 0)
+        FAIL("ra_tls_create_key_and_crt_der() failed: %d", ret);
+    if (verify_crt(der_crt, der_crt_size) != MBEDTLS_ERR_X509_SIG_MISMATCH)
+        FAIL("certificate with a tampered quote was accepted");
+    g_tamper_quote = false;
+
+    free(der_key);
+    free(der_crt);
+
+    printf("RA-TLS key benchmark (%s): key and certificate creation %lu us, quote binding "
+           "verification %lu us, handshake sign+verify %lu us (average of %lu)\n",
+           key_type ?: "default", create_time / iterations, verify_time / iterations,
+           sign_time / iterations, iterations);
+}
+
+/* keys of other types or sizes than RA-TLS generates must be rejected by the verifier */
+static void test_unsupported_key(mbedtls_ctr_drbg_context* ctr_drbg, mbedtls_pk_type_t type,
+                                 int param) {
+    mbedtls_pk_context key;
+    mbedtls_pk_init(&key);
+    if (mbedtls_pk_setup(&key, mbedtls_pk_info_from_type(type)) < 0)
+        FAIL("mbedtls_pk_setup() failed");
+    if (type == MBEDTLS_PK_ECKEY) {
+        if (mbedtls_ecp_gen_key(param, mbedtls_pk_ec(key), mbedtls_ctr_drbg_random, ctr_drbg) < 0)
+            FAIL("mbedtls_ecp_gen_key() failed");
+    } else {
+        if (mbedtls_rsa_gen_key(mbedtls_pk_rsa(key), mbedtls_ctr_drbg_random, ctr_drbg, param,
+                                RSA_PUB_EXPONENT) < 0)
+            FAIL("mbedtls_rsa_gen_key() failed");
+    }
+
+    mbedtls_x509write_cert writecrt;
+    mbedtls_x509write_crt_init(&writecrt);
+    mbedtls_mpi serial;
+    mbedtls_mpi_init(&serial);
+
+    sgx_quote_t quote = {0};
+    uint8_t buf[4096];
+    if (mbedtls_mpi_lset(&serial, 1) < 0
+            || mbedtls_x509write_crt_set_serial(&writecrt, &serial) < 0
+            || mbedtls_x509write_crt_set_subject_name(&writecrt, "CN=RATLS") < 0
+            || mbedtls_x509write_crt_set_issuer_name(&writecrt, "CN=RATLS") < 0
+            || mbedtls_x509write_crt_set_validity(&writecrt, "20010101000000",
+                                                  "20301231235959") < 0
+            || mbedtls_x509write_crt_set_extension(&writecrt, (const char*)quote_oid,
+                                                   quote_oid_len, /*critical=*/0,
+                                                   (const uint8_t*)&quote, sizeof(quote)) < 0)
+        FAIL("cannot set up certificate");
+    mbedtls_x509write_crt_set_md_alg(&writecrt, MBEDTLS_MD_SHA256);
+    mbedtls_x509write_crt_set_subject_key(&writecrt, &key);
+    mbedtls_x509write_crt_set_issuer_key(&writecrt, &key);
+
+    int size = mbedtls_x509write_crt_der(&writecrt, buf, sizeof(buf), mbedtls_ctr_drbg_random,
+                                         ctr_drbg);
+    if (size < 0)
+        FAIL("mbedtls_x509write_crt_der() failed: %d", size);
+
+    int ret = verify_crt(buf + sizeof(buf) - size, size);
+    if (ret != MBEDTLS_ERR_PK_INVALID_PUBKEY)
+        FAIL("certificate with unsupported key (type %d, %d) returned %d", type, param, ret);
+
+    mbedtls_mpi_free(&serial);
+    mbedtls_x509write_crt_free(&writecrt);
+    mbedtls_pk_free(&key);
+}
+
+int main(void) {
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, /*custom=*/NULL, 0) < 0)
+        FAIL("mbedtls_ctr_drbg_seed() failed");
+
+    test_key_type(&ctr_drbg, /*key_type=*/NULL, MBEDTLS_PK_ECKEY, /*iterations=*/64);
+    test_key_type(&ctr_drbg, RA_TLS_KEY_TYPE_EC_P256, MBEDTLS_PK_ECKEY, /*iterations=*/64);
+    test_key_type(&ctr_drbg, RA_TLS_KEY_TYPE_RSA_3072, MBEDTLS_PK_RSA, /*iterations=*/4);
+
+    setenv(RA_TLS_KEY_TYPE, "dsa", /*overwrite=*/1);
+    uint8_t* der_key;
+    uint8_t* der_crt;
+    size_t der_key_size;
+    size_t der_crt_size;
+    if (ra_tls_create_key_and_crt_der(&der_key, &der_key_size, &der_crt, &der_crt_size) == 0)
+        FAIL("unknown key type was accepted");
+
+    test_unsupported_key(&ctr_drbg, MBEDTLS_PK_ECKEY, MBEDTLS_ECP_DP_SECP384R1);
+    test_unsupported_key(&ctr_drbg, MBEDTLS_PK_RSA, 2048);
+
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+
+    printf("TEST OK\n");
+    return 0;
+}
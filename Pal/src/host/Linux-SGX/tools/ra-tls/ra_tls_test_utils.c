@@ -0,0 +1,110 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ra_tls.h"
+#include "ra_tls_test_utils.h"
+
+bool g_tamper_quote;
+atomic_int g_quotes;
+
+static pthread_mutex_t g_bound_port_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_bound_port_cond = PTHREAD_COND_INITIALIZER;
+static uint16_t g_bound_port;
+
+/* stand-in for the quote retrieval via /dev/attestation in ra_tls_attest.c: the quote only carries
+ * the report data */
+int ra_tls_get_quote(const sgx_report_data_t* report_data, uint8_t* quote, size_t quote_size) {
+    if (quote_size < sizeof(sgx_quote_t))
+        return MBEDTLS_ERR_X509_BUFFER_TOO_SMALL;
+
+    atomic_fetch_add(&g_quotes, 1);
+
+    sgx_quote_t* q = (sgx_quote_t*)quote;
+    memset(q, 0, sizeof(*q));
+    q->body.version = 3;
+    memcpy(&q->body.report_body.report_data, report_data, sizeof(*report_data));
+    if (g_tamper_quote)
+        q->body.report_body.report_data.d[0] ^= 1;
+    return sizeof(*q);
+}
+
+int verify_quote_binding(mbedtls_x509_crt* crt) {
+    sgx_quote_t* quote;
+    size_t quote_size;
+    int ret = find_oid(crt->v3_ext.p, crt->v3_ext.len, quote_oid, quote_oid_len,
+                       (uint8_t**)&quote, &quote_size);
+    if (ret < 0)
+        return ret;
+
+    if (quote_size < sizeof(*quote))
+        return MBEDTLS_ERR_X509_INVALID_EXTENSIONS;
+
+    return cmp_crt_pk_against_quote_report_data(crt, quote);
+}
+
+uint64_t time_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000UL;
+}
+
+void write_file(const char* path, const char* data) {
+    FILE* f = fopen(path, "w");
+    if (!f)
+        FAIL("cannot open %s", path);
+    if (fwrite(data, strlen(data), 1, f) != 1)
+        FAIL("cannot write %s", path);
+    fclose(f);
+}
+
+/* Overrides bind() of libc for the whole test, including mbedtls_net_bind() called by the servers,
+ * to report the port chosen by the kernel to `start_test_server()`. */
+int bind(int fd, const struct sockaddr* addr, socklen_t addrlen) {
+    if (syscall(SYS_bind, fd, addr, addrlen) < 0)
+        return -1;
+
+    struct sockaddr_storage bound_addr;
+    socklen_t bound_addrlen = sizeof(bound_addr);
+    if (getsockname(fd, (struct sockaddr*)&bound_addr, &bound_addrlen) < 0)
+        return -1;
+
+    uint16_t port;
+    if (bound_addr.ss_family == AF_INET) {
+        port = ntohs(((struct sockaddr_in*)&bound_addr)->sin_port);
+    } else if (bound_addr.ss_family == AF_INET6) {
+        port = ntohs(((struct sockaddr_in6*)&bound_addr)->sin6_port);
+    } else {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_bound_port_lock);
+    g_bound_port = port;
+    pthread_cond_broadcast(&g_bound_port_cond);
+    pthread_mutex_unlock(&g_bound_port_lock);
+    return 0;
+}
+
+void start_test_server(void* (*server_main)(void*), void* arg, char* port, size_t port_size) {
+    pthread_mutex_lock(&g_bound_port_lock);
+    g_bound_port = 0;
+
+    pthread_t tid;
+    int ret = pthread_create(&tid, NULL, server_main, arg);
+    if (ret)
+        FAIL("pthread_create() failed: %d", ret);
+
+    while (!g_bound_port)
+        pthread_cond_wait(&g_bound_port_cond, &g_bound_port_lock);
+    snprintf(port, port_size, "%hu", g_bound_port);
+    pthread_mutex_unlock(&g_bound_port_lock);
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/* Helpers shared by the RA-TLS and secret provisioning tests, which run on a plain Linux host. */
+
+#ifndef RA_TLS_TEST_UTILS_H
+#define RA_TLS_TEST_UTILS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mbedtls/x509_crt.h"
+
+#define FAIL(fmt, ...) ({                                       \
+    fprintf(stderr, "[error] " fmt "\n", ##__VA_ARGS__);        \
+    exit(1);                                                    \
+})
+
+/* If set, the stand-in `ra_tls_get_quote()` creates quotes whose report data does not match the
+ * certificate key. */
+extern bool g_tamper_quote;
+/* Number of quotes created by the stand-in `ra_tls_get_quote()`. */
+extern atomic_int g_quotes;
+
+/* Checks only the binding of the certificate key to the (stand-in) quote; stand-ins for the
+ * verification callbacks in ra_tls_verify_{epid,dcap}.c call this, real callbacks then verify the
+ * quote remotely. */
+int verify_quote_binding(mbedtls_x509_crt* crt);
+
+/* monotonic time in microseconds */
+uint64_t time_us(void);
+
+void write_file(const char* path, const char* data);
+
+/*!
+ * \brief Start a server thread and get the port it listens on.
+ *
+ * \param      server_main  Thread function which runs the server; it must listen on port "0", i.e.
+ *                          on a port chosen by the kernel.
+ * \param      arg          Argument of \p server_main.
+ * \param[out] port         Buffer for the port number (as a string).
+ * \param      port_size    Size of \p port.
+ *
+ * Returns once the server bound its port (it may not accept connections yet). The port is learned
+ * from the server's own bind(), so unlike picking a free port beforehand, no other process can take
+ * it in the meantime. Only one server may be starting at a time.
+ */
+void start_test_server(void* (*server_main)(void*), void* arg, char* port, size_t port_size);
+
+#endif /* RA_TLS_TEST_UTILS_H */
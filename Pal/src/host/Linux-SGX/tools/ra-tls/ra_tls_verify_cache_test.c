@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test of the cache of verified RA-TLS certificates (ra_tls_verify_common.c), runnable on a plain
+ * Linux host: certificates are created with a stand-in SGX quote, and the verification callback is
+ * a stand-in that uses the cache in the same way as the EPID and DCAP callbacks, but instead of
+ * verifying the quote only counts its invocations. Also prints the time of a verification served
+ * from the cache.
+ */
+
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mbedtls/config.h"
+
+#include "mbedtls/x509_crt.h"
+
+#include "ra_tls.h"
+#include "ra_tls_test_utils.h"
+
+#define CHECK_VERIFICATIONS(crt, expected_ret, expected_count) ({                               \
+    int _ret = ra_tls_verify_callback_der((crt)->der, (crt)->der_size);                         \
+    if (_ret != (expected_ret))                                                                 \
+        FAIL("line %d: verification returned %d, expected %d", __LINE__, _ret, (expected_ret)); \
+    if (g_verifications != (expected_count))                                                    \
+        FAIL("line %d: %lu full verifications, expected %lu", __LINE__, g_verifications,       \
+             (size_t)(expected_count));                                                         \
+})
+
+struct test_crt {
+    uint8_t* der;
+    size_t der_size;
+};
+
+static size_t g_verifications;
+static bool g_reject;
+static bool g_reset_during_verification;
+
+/* stand-in for the verification callbacks in ra_tls_verify_{epid,dcap}.c */
+int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    (void)data;
+    (void)depth;
+    (void)flags;
+
+    uint8_t crt_hash[SHA256_DIGEST_SIZE];
+    uint64_t cache_generation;
+    int ret = verify_cache_lookup(crt, crt_hash, &cache_generation);
+    if (ret < 0)
+        return ret;
+    if (ret > 0)
+        return 0;
+
+    g_verifications++;
+    if (g_reject)
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    if (g_reset_during_verification)
+        verify_cache_reset();
+
+    verify_cache_add(crt_hash, cache_generation);
+    return 0;
+}
+
+static void create_crt(struct test_crt* crt) {
+    uint8_t* der_key;
+    size_t der_key_size;
+    int ret = ra_tls_create_key_and_crt_der(&der_key, &der_key_size, &crt->der, &crt->der_size);
+    if (ret < 0)
+        FAIL("ra_tls_create_key_and_crt_der() failed: %d", ret);
+    free(der_key);
+}
+
+/* sets cache settings (NULL unsets the envvar) and empties the cache */
+static void set_cache(const char* size, const char* ttl) {
+    if (size) {
+        setenv(RA_TLS_VERIFY_CACHE_SIZE, size, /*overwrite=*/1);
+    } else {
+        unsetenv(RA_TLS_VERIFY_CACHE_SIZE);
+    }
+    if (ttl) {
+        setenv(RA_TLS_VERIFY_CACHE_TTL, ttl, /*overwrite=*/1);
+    } else {
+        unsetenv(RA_TLS_VERIFY_CACHE_TTL);
+    }
+    verify_cache_reset();
+    g_verifications = 0;
+}
+
+int main(void) {
+    struct test_crt a, b, c;
+    create_crt(&a);
+    create_crt(&b);
+    create_crt(&c);
+
+    /* disabled by default */
+    set_cache(/*size=*/NULL, /*ttl=*/NULL);
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&a, 0, 2);
+
+    set_cache("0", "60");
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&a, 0, 2);
+
+    set_cache("4", "0");
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&a, 0, 2);
+
+    /* invalid settings fail verification */
+    set_cache("many", NULL);
+    CHECK_VERIFICATIONS(&a, MBEDTLS_ERR_X509_BAD_INPUT_DATA, 0);
+    set_cache("100000", NULL);
+    CHECK_VERIFICATIONS(&a, MBEDTLS_ERR_X509_BAD_INPUT_DATA, 0);
+    set_cache("4", "1s");
+    CHECK_VERIFICATIONS(&a, MBEDTLS_ERR_X509_BAD_INPUT_DATA, 0);
+
+    /* hits, and eviction of the oldest entry from a full cache */
+    set_cache("2", NULL);
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&b, 0, 2);
+    CHECK_VERIFICATIONS(&a, 0, 2);
+    CHECK_VERIFICATIONS(&b, 0, 2);
+    CHECK_VERIFICATIONS(&c, 0, 3); /* replaces `a` */
+    CHECK_VERIFICATIONS(&b, 0, 3);
+    CHECK_VERIFICATIONS(&c, 0, 3);
+    CHECK_VERIFICATIONS(&a, 0, 4); /* replaces `b` */
+    CHECK_VERIFICATIONS(&b, 0, 5); /* replaces `c` */
+    CHECK_VERIFICATIONS(&a, 0, 5);
+
+    /* failed verifications are not cached */
+    set_cache("2", NULL);
+    g_reject = true;
+    CHECK_VERIFICATIONS(&a, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED, 1);
+    CHECK_VERIFICATIONS(&a, MBEDTLS_ERR_X509_CERT_VERIFY_FAILED, 2);
+    g_reject = false;
+    CHECK_VERIFICATIONS(&a, 0, 3);
+    CHECK_VERIFICATIONS(&a, 0, 3);
+
+    /* changing the measurement callback empties the cache */
+    ra_tls_set_measurement_callback(NULL);
+    CHECK_VERIFICATIONS(&a, 0, 4);
+    CHECK_VERIFICATIONS(&a, 0, 4);
+
+    /* a certificate verified while the cache was reset (e.g. by another thread changing the
+     * measurement callback) is not added to the new cache */
+    set_cache("2", NULL);
+    g_reset_during_verification = true;
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    g_reset_during_verification = false;
+    CHECK_VERIFICATIONS(&a, 0, 2);
+    CHECK_VERIFICATIONS(&a, 0, 2);
+
+    /* entries expire after TTL, even if they were hit in the meantime */
+    set_cache("2", "1");
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    usleep(600 * 1000);
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    CHECK_VERIFICATIONS(&b, 0, 2);
+    usleep(600 * 1000);
+    CHECK_VERIFICATIONS(&a, 0, 3);
+    CHECK_VERIFICATIONS(&b, 0, 3);
+    CHECK_VERIFICATIONS(&c, 0, 4); /* replaces `b`, the oldest one */
+    CHECK_VERIFICATIONS(&a, 0, 4);
+
+    set_cache("4", NULL);
+    CHECK_VERIFICATIONS(&a, 0, 1);
+    size_t iterations = 1000;
+    uint64_t start_time = time_us();
+    for (size_t i = 0; i < iterations; i++)
+        CHECK_VERIFICATIONS(&a, 0, 1);
+    uint64_t cached_time = time_us() - start_time;
+
+    printf("RA-TLS verification cache: verification of a cached certificate took %lu us (average "
+           "of %lu, including certificate parsing)\n", cached_time / iterations, iterations);
+
+    free(a.der);
+    free(b.der);
+    free(c.der);
+    set_cache(/*size=*/NULL, /*ttl=*/NULL);
+
+    printf("TEST OK\n");
+    return 0;
+}
@@ -9,9 +9,11 @@
  */
 
 #define _GNU_SOURCE
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <mbedtls/pk.h>
 #include <mbedtls/sha256.h>
@@ -23,6 +25,30 @@
 
 verify_measurements_cb_t g_verify_measurements_cb = NULL;
 
+/* Cache of recently verified RA-TLS certificates, keyed by SHA256 over the whole certificate (so it
+ * covers both the public key and the embedded SGX quote). The cache is disabled unless
+ * RA_TLS_VERIFY_CACHE_SIZE envvar sets its number of entries. An entry expires
+ * RA_TLS_VERIFY_CACHE_TTL seconds after the full verification (cache hits do not extend it), which
+ * bounds how long e.g. a revoked platform may still be accepted. The cache is small, so it is
+ * a plain array searched linearly; when it is full, the least recently verified entry is replaced.
+ * Entries are never freed one by one, so used entries are always at the beginning of the array. */
+struct verify_cache_entry {
+    uint8_t crt_hash[SHA256_DIGEST_SIZE];
+    uint64_t verified_time_ms;
+    uint64_t seq; /* order of verifications (time in ms may be the same for several entries) */
+    bool used;
+};
+
+static pthread_mutex_t g_verify_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool g_verify_cache_initialized = false;
+static struct verify_cache_entry* g_verify_cache = NULL;
+static size_t g_verify_cache_size = 0;
+static uint64_t g_verify_cache_seq = 0;
+static uint64_t g_verify_cache_ttl_ms = 0;
+/* incremented by `verify_cache_reset()`, so that a verification which started before the reset
+ * (e.g. with the previous measurement callback) does not add its certificate to the new cache */
+static uint64_t g_verify_cache_generation = 0;
+
 static int getenv_enclave_measurements(sgx_measurement_t* mrsigner, bool* validate_mrsigner,
                                        sgx_measurement_t* mrenclave, bool* validate_mrenclave,
                                        sgx_prod_id_t* isv_prod_id, bool* validate_isv_prod_id,
@@ -73,6 +99,127 @@ static int getenv_enclave_measurements(sgx_measurement_t* mrsigner, bool* valida
     return 0;
 }
 
+static int getenv_ulong(const char* name, unsigned long max_value, unsigned long* value) {
+    const char* str = getenv(name);
+    if (!str)
+        return 0;
+
+    char* end;
+    errno = 0;
+    unsigned long parsed = strtoul(str, &end, 10);
+    if (errno || end == str || *end != '\0' || parsed > max_value)
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+
+    *value = parsed;
+    return 0;
+}
+
+static uint64_t time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
+}
+
+/* must be called with g_verify_cache_lock held */
+static int init_verify_cache(void) {
+    if (g_verify_cache_initialized)
+        return 0;
+
+    unsigned long size = 0;
+    int ret = getenv_ulong(RA_TLS_VERIFY_CACHE_SIZE, VERIFY_CACHE_SIZE_MAX, &size);
+    if (ret < 0)
+        return ret;
+
+    unsigned long ttl = VERIFY_CACHE_TTL_DEFAULT;
+    ret = getenv_ulong(RA_TLS_VERIFY_CACHE_TTL, VERIFY_CACHE_TTL_MAX, &ttl);
+    if (ret < 0)
+        return ret;
+
+    if (size && ttl) {
+        g_verify_cache = calloc(size, sizeof(*g_verify_cache));
+        if (!g_verify_cache)
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        g_verify_cache_size = size;
+    }
+    g_verify_cache_ttl_ms = ttl * 1000;
+    g_verify_cache_initialized = true;
+    return 0;
+}
+
+int verify_cache_lookup(const mbedtls_x509_crt* crt, uint8_t* crt_hash,
+                        uint64_t* out_generation) {
+    pthread_mutex_lock(&g_verify_cache_lock);
+    int ret = init_verify_cache();
+    bool enabled = g_verify_cache_size > 0;
+    *out_generation = g_verify_cache_generation;
+    pthread_mutex_unlock(&g_verify_cache_lock);
+
+    if (ret < 0 || !enabled)
+        return ret;
+
+    ret = mbedtls_sha256_ret(crt->raw.p, crt->raw.len, crt_hash, /*is224=*/0);
+    if (ret < 0)
+        return ret;
+
+    uint64_t now = time_ms();
+
+    pthread_mutex_lock(&g_verify_cache_lock);
+    for (size_t i = 0; i < g_verify_cache_size; i++) {
+        struct verify_cache_entry* entry = &g_verify_cache[i];
+        if (!entry->used)
+            break;
+        if (now - entry->verified_time_ms < g_verify_cache_ttl_ms
+                && !memcmp(entry->crt_hash, crt_hash, SHA256_DIGEST_SIZE)) {
+            ret = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_verify_cache_lock);
+    return ret;
+}
+
+void verify_cache_add(const uint8_t* crt_hash, uint64_t generation) {
+    pthread_mutex_lock(&g_verify_cache_lock);
+
+    if (generation != g_verify_cache_generation) {
+        /* the cache was reset during the verification */
+        pthread_mutex_unlock(&g_verify_cache_lock);
+        return;
+    }
+
+    /* take the entry of the same certificate (e.g. verified concurrently by another thread or
+     * expired), a free entry or the least recently verified one */
+    struct verify_cache_entry* slot = NULL;
+    for (size_t i = 0; i < g_verify_cache_size; i++) {
+        struct verify_cache_entry* entry = &g_verify_cache[i];
+        if (!entry->used || !memcmp(entry->crt_hash, crt_hash, SHA256_DIGEST_SIZE)) {
+            slot = entry;
+            break;
+        }
+        if (!slot || entry->seq < slot->seq)
+            slot = entry;
+    }
+
+    if (slot) {
+        memcpy(slot->crt_hash, crt_hash, SHA256_DIGEST_SIZE);
+        slot->verified_time_ms = time_ms();
+        slot->seq = g_verify_cache_seq++;
+        slot->used = true;
+    }
+
+    pthread_mutex_unlock(&g_verify_cache_lock);
+}
+
+void verify_cache_reset(void) {
+    pthread_mutex_lock(&g_verify_cache_lock);
+    free(g_verify_cache);
+    g_verify_cache = NULL;
+    g_verify_cache_size = 0;
+    g_verify_cache_initialized = false;
+    g_verify_cache_generation++;
+    pthread_mutex_unlock(&g_verify_cache_lock);
+}
+
 bool getenv_allow_outdated_tcb(void) {
     char* str = getenv(RA_TLS_ALLOW_OUTDATED_TCB_INSECURE);
     return (str && !strcmp(str, "1"));
@@ -141,13 +288,28 @@ int find_oid(const uint8_t* exts, size_t exts_len, const uint8_t* oid, size_t oi
     return 0;
 }
 
-/*! calculate sha256 over public key from \p crt and copy it into \p sha */
+/*! calculate sha256 over public key from \p crt and copy it into \p sha; only the key types
+ * generated by RA-TLS (ECDSA P-256 and RSA-3072) are accepted */
 static int sha256_over_crt_pk(mbedtls_x509_crt* crt, uint8_t* sha) {
     uint8_t pk_der[PUB_KEY_SIZE_MAX] = {0};
 
+    int expected_der_size;
+    switch (mbedtls_pk_get_type(&crt->pk)) {
+        case MBEDTLS_PK_ECKEY:
+            if (mbedtls_pk_ec(crt->pk)->grp.id != MBEDTLS_ECP_DP_SECP256R1)
+                return MBEDTLS_ERR_PK_INVALID_PUBKEY;
+            expected_der_size = EC_PUB_P256_KEY_DER_LEN;
+            break;
+        case MBEDTLS_PK_RSA:
+            expected_der_size = RSA_PUB_3072_KEY_DER_LEN;
+            break;
+        default:
+            return MBEDTLS_ERR_PK_INVALID_PUBKEY;
+    }
+
     /* below function writes data at the end of the buffer */
     int pk_der_size_byte = mbedtls_pk_write_pubkey_der(&crt->pk, pk_der, PUB_KEY_SIZE_MAX);
-    if (pk_der_size_byte != RSA_PUB_3072_KEY_DER_LEN)
+    if (pk_der_size_byte != expected_der_size)
         return MBEDTLS_ERR_PK_INVALID_PUBKEY;
 
     /* move the data to the beginning of the buffer, to avoid pointer arithmetic later */
@@ -175,6 +337,8 @@ int cmp_crt_pk_against_quote_report_data(mbedtls_x509_crt* crt, sgx_quote_t* quo
 void ra_tls_set_measurement_callback(int (*f_cb)(const char* mrenclave, const char* mrsigner,
                                                  const char* isv_prod_id, const char* isv_svn)) {
     g_verify_measurements_cb = f_cb;
+    /* cached certificates were verified with the previous callback */
+    verify_cache_reset();
 }
 
 int ra_tls_verify_callback_der(uint8_t* der_crt, size_t der_crt_size) {
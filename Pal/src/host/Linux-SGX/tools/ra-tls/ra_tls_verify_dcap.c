@@ -11,7 +11,8 @@
  * ra_tls_verify_callback_der() should be used for other TLS libraries.
  *
  * This file is part of the RA-TLS verification library which is typically linked into client
- * applications. This library is *not* thread-safe.
+ * applications. The verification callbacks are thread-safe (e.g., can be used by a multi-threaded
+ * TLS server), if ra_tls_set_measurement_callback() is called before any verification starts.
  */
 
 #define _GNU_SOURCE
@@ -91,6 +92,18 @@ int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_
         *flags = 0;
     }
 
+    /* skip verification of a certificate that was successfully verified recently (only if the
+     * cache of verified certificates is enabled) */
+    uint8_t crt_hash[SHA256_DIGEST_SIZE];
+    uint64_t cache_generation;
+    ret = verify_cache_lookup(crt, crt_hash, &cache_generation);
+    if (ret < 0)
+        goto out;
+    if (ret > 0) {
+        ret = 0;
+        goto out;
+    }
+
     /* extract SGX quote from "quote" OID extension from crt */
     sgx_quote_t* quote;
     size_t quote_size;
@@ -188,6 +201,7 @@ int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_
         goto out;
     }
 
+    verify_cache_add(crt_hash, cache_generation);
     ret = 0;
 out:
     free(supplemental_data);
@@ -11,11 +11,13 @@
  * a more generic version ra_tls_verify_callback_der() should be used for other TLS libraries.
  *
  * This file is part of the RA-TLS verification library which is typically linked into client
- * applications. This library is *not* thread-safe.
+ * applications. The verification callbacks are thread-safe (e.g., can be used by a multi-threaded
+ * TLS server), if ra_tls_set_measurement_callback() is called before any verification starts.
  */
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,6 +46,11 @@ static char* g_api_key    = NULL;
 static char* g_report_url = NULL;
 static char* g_sigrl_url  = NULL;
 
+/* protects lazy initialization of the above (they are not modified afterwards) and global cURL
+ * initialization and cleanup done in ias_init() and ias_cleanup(), which are not thread-safe in
+ * older cURL versions */
+static pthread_mutex_t g_ias_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static int init_from_env(char** ptr, const char* env_name, const char* default_val) {
     assert(ptr == &g_api_key || ptr == &g_report_url || ptr == &g_sigrl_url);
 
@@ -74,6 +81,24 @@ static int init_from_env(char** ptr, const char* env_name, const char* default_v
 
 }
 
+static int init_ias_params(void) {
+    int ret;
+
+    pthread_mutex_lock(&g_ias_lock);
+    ret = init_from_env(&g_api_key, RA_TLS_EPID_API_KEY, /*default_val=*/NULL);
+    if (ret < 0)
+        goto out;
+
+    ret = init_from_env(&g_report_url, RA_TLS_IAS_REPORT_URL, IAS_URL_REPORT);
+    if (ret < 0)
+        goto out;
+
+    ret = init_from_env(&g_sigrl_url, RA_TLS_IAS_SIGRL_URL, IAS_URL_SIGRL);
+out:
+    pthread_mutex_unlock(&g_ias_lock);
+    return ret;
+}
+
 static int generate_nonce(char* buf, size_t size) {
     if (size != IAS_REQUEST_NONCE_LEN + 1) {
         return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
@@ -147,15 +172,19 @@ int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_
         *flags = 0;
     }
 
-    ret = init_from_env(&g_api_key, RA_TLS_EPID_API_KEY, /*default_val=*/NULL);
+    /* skip verification of a certificate that was successfully verified recently (only if the
+     * cache of verified certificates is enabled) */
+    uint8_t crt_hash[SHA256_DIGEST_SIZE];
+    uint64_t cache_generation;
+    ret = verify_cache_lookup(crt, crt_hash, &cache_generation);
     if (ret < 0)
         goto out;
-
-    ret = init_from_env(&g_report_url, RA_TLS_IAS_REPORT_URL, IAS_URL_REPORT);
-    if (ret < 0)
+    if (ret > 0) {
+        ret = 0;
         goto out;
+    }
 
-    ret = init_from_env(&g_sigrl_url, RA_TLS_IAS_SIGRL_URL, IAS_URL_SIGRL);
+    ret = init_ias_params();
     if (ret < 0)
         goto out;
 
@@ -178,7 +207,9 @@ int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_
         goto out;
 
     /* initialize the IAS context, send the quote to the IAS and receive IAS attestation report */
+    pthread_mutex_lock(&g_ias_lock);
     ias = ias_init(g_api_key, g_report_url, g_sigrl_url);
+    pthread_mutex_unlock(&g_ias_lock);
     if (!ias) {
         ret = MBEDTLS_ERR_X509_FATAL_ERROR;
         goto out;
@@ -261,10 +292,14 @@ int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_
         goto out;
     }
 
+    verify_cache_add(crt_hash, cache_generation);
     ret = 0;
 out:
-    if (ias)
+    if (ias) {
+        pthread_mutex_lock(&g_ias_lock);
         ias_cleanup(ias);
+        pthread_mutex_unlock(&g_ias_lock);
+    }
 
     free(ias_pub_key_pem);
     free(quote_from_ias);
@@ -19,6 +19,8 @@
 
 /* envvars for server (verifier) */
 #define SECRET_PROVISION_LISTENING_PORT "SECRET_PROVISION_LISTENING_PORT"
+#define SECRET_PROVISION_SERVER_THREADS "SECRET_PROVISION_SERVER_THREADS"
+#define SECRET_PROVISION_TICKET_LIFETIME "SECRET_PROVISION_TICKET_LIFETIME"
 
 /* internal secret-provisioning protocol message format */
 #define SECRET_PROVISION_REQUEST  "SECRET_PROVISION_RA_TLS_REQUEST_V1"
@@ -115,7 +117,9 @@ void secret_provision_destroy(void);
  * continue this secure session with the server via secret_provision_read(),
  * secret_provision_write(), and the final secret_provision_close(). The first secret can be
  * retrieved via secret_provision_get() and later destroyed via secret_provision_destroy().
- * Not thread-safe.
+ * The RA-TLS key and certificate are created on the first call and reused by later calls. If the
+ * previous successful call connected to the same server with the same CA chain, its TLS session is
+ * resumed (if the server supports it), skipping the attestation. Not thread-safe.
  *
  * \param[in] in_servers        List of servers (in format "server1:port1;server2:port2;..."). If
  *                              not specified, environment variable `SECRET_PROVISION_SERVERS` is
@@ -139,14 +143,21 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
  * \brief Start a secret provisioning service (server-side).
  *
  * This function starts a multi-threaded secret provisioning server. It listens to client
- * connections on \a port. For each new client, it spawns a new thread in which the RA-TLS
- * mutually-attested session is established. The server provides a normal X.509 certificate to the
- * client (initialized with \a cert_path and \a key_path). The server expects a self-signed RA-TLS
- * certificate from the client. During TLS handshake, the server invokes a user-supplied callback
- * m_cb() for user-specific verification of measurements in client's SGX quote (if user supplied
- * it). After successfuly establishing the RA-TLS session and sending the first secret \a secret,
- * the server invokes a user-supplied callback f_cb() for user-specific communication with the
- * client (if user supplied it). This function is thread-safe and requires pthread library.
+ * connections on \a port and hands each new client to one of a fixed pool of worker threads (16 by
+ * default, can be changed via `SECRET_PROVISION_SERVER_THREADS` environment variable), in which the
+ * RA-TLS mutually-attested session is established. Handshakes of different clients, including
+ * verification of their SGX quotes, run in parallel. The server provides a normal X.509
+ * certificate to the client (initialized with \a cert_path and \a key_path). The server expects a
+ * self-signed RA-TLS certificate from the client. During TLS handshake, the server invokes a
+ * user-supplied callback m_cb() for user-specific verification of measurements in client's SGX
+ * quote (if user supplied it). After successfuly establishing the RA-TLS session and sending the
+ * first secret \a secret, the server invokes a user-supplied callback f_cb() for user-specific
+ * communication with the client (if user supplied it). Both callbacks may be called concurrently
+ * from different worker threads, and f_cb() occupies its worker until it returns. If
+ * `SECRET_PROVISION_TICKET_LIFETIME` environment variable is set to a non-zero number of seconds,
+ * the server issues TLS session tickets, and clients resuming their sessions within this time
+ * (counted from their attestation) are not verified again; f_cb() then gets the client certificate
+ * verified in the original handshake. This function is thread-safe and requires pthread library.
  *
  * \param[in] secret      First secret (arbitrary binary blob) to send to client after
  *                        establishing RA-TLS session.
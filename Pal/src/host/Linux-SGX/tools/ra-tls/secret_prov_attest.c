@@ -7,7 +7,10 @@
  * This file contains the implementation of secret provisioning library based on RA-TLS for
  * enclavized application. It contains functions to create a self-signed RA-TLS certificate
  * with an SGX quote embedded in it (using ra_tls_create_key_and_crt()), send it to one of
- * the verifier/secret provisioning servers, and receive secrets in response.
+ * the verifier/secret provisioning servers, and receive secrets in response. The RA-TLS key and
+ * certificate are created once and reused by later connections (also in forked children), and the
+ * last TLS session is kept so that the next connection to the same server can resume it with an
+ * abbreviated handshake (if the server issues session tickets), skipping the attestation.
  *
  * This file is part of the secret-provisioning client-side library which is typically linked
  * into the SGX application that needs to receive secrets. This library is *not* thread-safe.
@@ -19,9 +22,13 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include "mbedtls/ctr_drbg.h"
@@ -43,9 +50,51 @@ static mbedtls_ssl_context g_ssl;
 static mbedtls_pk_context g_my_ratls_key;
 static mbedtls_x509_crt g_my_ratls_cert;
 
+/* creating the RA-TLS key and certificate requires an SGX quote, so they are created on first use
+ * and kept for the lifetime of the process */
+static bool g_my_ratls_cert_created = false;
+
+/* session (with session ticket, if any) of the last successful connection, which the next
+ * secret_provision_start() may resume; it is only offered to the same server and only if the
+ * server is verified against the same CA chain as in the original handshake */
+static mbedtls_ssl_session g_saved_session;
+static char* g_saved_session_addr = NULL;
+static char* g_saved_session_port = NULL;
+static char* g_saved_session_ca_chain_path = NULL;
+
 static uint8_t* provisioned_secret = NULL;
 static size_t provisioned_secret_size = 0;
 
+static void forget_saved_session(void) {
+    mbedtls_ssl_session_free(&g_saved_session);
+    free(g_saved_session_addr);
+    free(g_saved_session_port);
+    free(g_saved_session_ca_chain_path);
+    g_saved_session_addr = NULL;
+    g_saved_session_port = NULL;
+    g_saved_session_ca_chain_path = NULL;
+}
+
+static bool has_saved_session(const char* addr, const char* port, const char* ca_chain_path) {
+    return g_saved_session_addr && !strcmp(g_saved_session_addr, addr)
+               && !strcmp(g_saved_session_port, port)
+               && !strcmp(g_saved_session_ca_chain_path, ca_chain_path);
+}
+
+/* failure to save the session is not fatal, the next connection will do a full handshake */
+static void save_session(const char* addr, const char* port, const char* ca_chain_path) {
+    forget_saved_session();
+
+    if (mbedtls_ssl_get_session(&g_ssl, &g_saved_session) < 0)
+        return;
+
+    g_saved_session_addr = strdup(addr);
+    g_saved_session_port = strdup(port);
+    g_saved_session_ca_chain_path = strdup(ca_chain_path);
+    if (!g_saved_session_addr || !g_saved_session_port || !g_saved_session_ca_chain_path)
+        forget_saved_session();
+}
+
 int secret_provision_get(uint8_t** out_secret, size_t* out_secret_size) {
     if (!out_secret || !out_secret_size)
         return -EINVAL;
@@ -81,8 +130,10 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
     mbedtls_entropy_init(&g_entropy);
     mbedtls_x509_crt_init(&g_verifier_ca_chain);
 
-    mbedtls_pk_init(&g_my_ratls_key);
-    mbedtls_x509_crt_init(&g_my_ratls_cert);
+    if (!g_my_ratls_cert_created) {
+        mbedtls_pk_init(&g_my_ratls_key);
+        mbedtls_x509_crt_init(&g_my_ratls_cert);
+    }
 
     mbedtls_net_init(&g_verifier_fd);
     mbedtls_ssl_config_init(&g_conf);
@@ -146,6 +197,11 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
         goto out;
     }
 
+    /* TLS handshake and the protocol consist of small messages; don't let Nagle's algorithm hold
+     * them back until the server's (delayed) ACK arrives, failure only affects latency */
+    int nodelay = 1;
+    setsockopt(g_verifier_fd.fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
     ret = mbedtls_ssl_config_defaults(&g_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
                                       MBEDTLS_SSL_PRESET_DEFAULT);
     if (ret < 0) {
@@ -168,9 +224,14 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
     mbedtls_ssl_conf_authmode(&g_conf, MBEDTLS_SSL_VERIFY_REQUIRED);
     mbedtls_ssl_conf_ca_chain(&g_conf, &g_verifier_ca_chain, NULL);
 
-    ret = ra_tls_create_key_and_crt(&g_my_ratls_key, &g_my_ratls_cert);
-    if (ret < 0) {
-        goto out;
+    if (!g_my_ratls_cert_created) {
+        ret = ra_tls_create_key_and_crt(&g_my_ratls_key, &g_my_ratls_cert);
+        if (ret < 0) {
+            mbedtls_x509_crt_free(&g_my_ratls_cert);
+            mbedtls_pk_free(&g_my_ratls_key);
+            goto out;
+        }
+        g_my_ratls_cert_created = true;
     }
 
     mbedtls_ssl_conf_rng(&g_conf, mbedtls_ctr_drbg_random, &g_ctr_drbg);
@@ -190,6 +251,13 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
         goto out;
     }
 
+    if (has_saved_session(connected_addr, connected_port, ca_chain_path)) {
+        ret = mbedtls_ssl_set_session(&g_ssl, &g_saved_session);
+        if (ret < 0) {
+            goto out;
+        }
+    }
+
     mbedtls_ssl_set_bio(&g_ssl, &g_verifier_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
 
     ret = -1;
@@ -209,6 +277,8 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
         goto out;
     }
 
+    save_session(connected_addr, connected_port, ca_chain_path);
+
     struct ra_tls_ctx ctx = {.ssl = &g_ssl};
     uint8_t buf[128] = {0};
     size_t size;
@@ -271,11 +341,11 @@ int secret_provision_start(const char* in_servers, const char* in_ca_chain_path,
 out:
     if (ret < 0) {
         secret_provision_destroy();
+        /* don't offer the saved session again, the next call starts from scratch */
+        forget_saved_session();
     }
 
     if (ret < 0 || !out_ctx) {
-        mbedtls_x509_crt_free(&g_my_ratls_cert);
-        mbedtls_pk_free(&g_my_ratls_key);
         mbedtls_net_free(&g_verifier_fd);
         mbedtls_ssl_free(&g_ssl);
         mbedtls_ssl_config_free(&g_conf);
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Test of TLS session resumption in secret provisioning (secret_prov_attest.c and
+ * secret_prov_verify.c), runnable on a plain Linux host: the SGX quote is replaced by a stand-in
+ * that only carries the report data, and the RA-TLS verification callback by a stand-in that checks
+ * only the binding of the certificate key to the quote. The client repeatedly gets the secret from
+ * a server that issues session tickets and from one that does not; only full handshakes may create
+ * quotes and verify them, every session (also a resumed one) must carry the certificate verified
+ * in its full handshake, and tickets must expire after their lifetime counted from the full
+ * handshake. Also prints average times of secret provisioning with a full and with a resumed
+ * handshake.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mbedtls/config.h"
+
+#include "mbedtls/certs.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+
+#include "ra_tls.h"
+#include "ra_tls_test_utils.h"
+#include "secret_prov.h"
+
+#define TICKET_LIFETIME  2 /* seconds */
+#define ITERATIONS       16
+#define CONNECT_RETRIES  500
+
+#define SECRET "secret-provisioning-resumption-test"
+
+struct server_params {
+    char port[16];
+};
+
+static char g_cert_path[64];
+static char g_key_path[64];
+static char g_ca_path[64];
+
+static atomic_int g_verifications;
+static atomic_int g_served;
+
+/* DER of the client certificate verified in the last full handshake */
+static pthread_mutex_t g_verified_crt_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t g_verified_crt[16 * 1024];
+static size_t g_verified_crt_size;
+
+/* stand-in for the verification callbacks in ra_tls_verify_{epid,dcap}.c, which also remembers the
+ * verified certificate */
+int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    (void)data;
+
+    if (depth != 0)
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+
+    if (flags)
+        *flags = 0;
+
+    atomic_fetch_add(&g_verifications, 1);
+
+    int ret = verify_quote_binding(crt);
+    if (ret < 0)
+        return ret;
+
+    if (crt->raw.len > sizeof(g_verified_crt))
+        FAIL("client certificate is too large");
+
+    pthread_mutex_lock(&g_verified_crt_lock);
+    memcpy(g_verified_crt, crt->raw.p, crt->raw.len);
+    g_verified_crt_size = crt->raw.len;
+    pthread_mutex_unlock(&g_verified_crt_lock);
+    return 0;
+}
+
+/* the session must carry the certificate verified in the full handshake, also when resumed */
+static int check_client(struct ra_tls_ctx* ctx) {
+    const mbedtls_x509_crt* crt = mbedtls_ssl_get_peer_cert(ctx->ssl);
+    if (!crt)
+        FAIL("session has no client certificate");
+
+    pthread_mutex_lock(&g_verified_crt_lock);
+    if (crt->raw.len != g_verified_crt_size || memcmp(crt->raw.p, g_verified_crt, crt->raw.len))
+        FAIL("session has a different client certificate than the verified one");
+    pthread_mutex_unlock(&g_verified_crt_lock);
+
+    atomic_fetch_add(&g_served, 1);
+    return secret_provision_close(ctx);
+}
+
+static void* server_main(void* arg) {
+    (void)arg;
+    int ret = secret_provision_start_server((uint8_t*)SECRET, sizeof(SECRET), /*port=*/"0",
+                                            g_cert_path, g_key_path, /*m_cb=*/NULL,
+                                            check_client);
+    FAIL("secret_provision_start_server() returned %d", ret);
+}
+
+/* starts a server with session tickets of `ticket_lifetime` (NULL disables tickets) and waits
+ * until it accepts connections */
+static void start_server(struct server_params* params, const char* ticket_lifetime) {
+    int ret;
+
+    if (ticket_lifetime) {
+        setenv(SECRET_PROVISION_TICKET_LIFETIME, ticket_lifetime, /*overwrite=*/1);
+    } else {
+        unsetenv(SECRET_PROVISION_TICKET_LIFETIME);
+    }
+
+    start_test_server(server_main, /*arg=*/NULL, params->port, sizeof(params->port));
+
+    mbedtls_net_context fd;
+    mbedtls_net_init(&fd);
+    for (size_t i = 0; i < CONNECT_RETRIES; i++) {
+        ret = mbedtls_net_connect(&fd, "localhost", params->port, MBEDTLS_NET_PROTO_TCP);
+        if (ret == 0)
+            break;
+        usleep(10000);
+    }
+    if (ret < 0)
+        FAIL("cannot connect to server: %d", ret);
+    mbedtls_net_free(&fd);
+}
+
+/* gets the secret from the server and checks whether it did a full handshake; returns the time it
+ * took */
+static uint64_t provision(struct server_params* params, bool expect_full_handshake, int line) {
+    char servers[32];
+    snprintf(servers, sizeof(servers), "localhost:%s", params->port);
+
+    int verifications = atomic_load(&g_verifications);
+    int served = atomic_load(&g_served);
+
+    uint64_t start_time = time_us();
+    int ret = secret_provision_start(servers, g_ca_path, /*out_ctx=*/NULL);
+    uint64_t end_time = time_us();
+    if (ret < 0)
+        FAIL("line %d: secret_provision_start() failed: %d", line, ret);
+
+    uint8_t* secret;
+    size_t secret_size;
+    ret = secret_provision_get(&secret, &secret_size);
+    if (ret < 0 || secret_size != sizeof(SECRET) || memcmp(secret, SECRET, sizeof(SECRET)))
+        FAIL("line %d: client received a wrong secret", line);
+    secret_provision_destroy();
+
+    /* the server finishes the session only after the client got the secret */
+    for (size_t i = 0; i < CONNECT_RETRIES && atomic_load(&g_served) == served; i++)
+        usleep(1000);
+    if (atomic_load(&g_served) != served + 1)
+        FAIL("line %d: server did not finish the session", line);
+
+    bool full_handshake = atomic_load(&g_verifications) != verifications;
+    if (full_handshake != expect_full_handshake)
+        FAIL("line %d: %s handshake, expected %s", line, full_handshake ? "full" : "resumed",
+             expect_full_handshake ? "full" : "resumed");
+    if (atomic_load(&g_quotes) != 1)
+        FAIL("line %d: client created %d quotes, expected 1", line, atomic_load(&g_quotes));
+
+    return end_time - start_time;
+}
+
+int main(void) {
+    setbuf(stdout, NULL);
+
+    char dir[] = "/tmp/secret_prov_resume_test.XXXXXX";
+    if (!mkdtemp(dir))
+        FAIL("mkdtemp() failed: %d", errno);
+    snprintf(g_cert_path, sizeof(g_cert_path), "%s/server.crt", dir);
+    snprintf(g_key_path, sizeof(g_key_path), "%s/server.key", dir);
+    snprintf(g_ca_path, sizeof(g_ca_path), "%s/ca.crt", dir);
+    write_file(g_cert_path, mbedtls_test_srv_crt);
+    write_file(g_key_path, mbedtls_test_srv_key);
+    write_file(g_ca_path, mbedtls_test_cas_pem);
+
+    char ticket_lifetime[16];
+    snprintf(ticket_lifetime, sizeof(ticket_lifetime), "%d", TICKET_LIFETIME);
+
+    struct server_params tickets_server;
+    struct server_params plain_server;
+    start_server(&tickets_server, ticket_lifetime);
+    start_server(&plain_server, /*ticket_lifetime=*/NULL);
+
+    /* the first session is resumed as long as its ticket is valid */
+    provision(&tickets_server, /*expect_full_handshake=*/true, __LINE__);
+    uint64_t resumed_time = 0;
+    for (size_t i = 0; i < ITERATIONS; i++)
+        resumed_time += provision(&tickets_server, /*expect_full_handshake=*/false, __LINE__);
+
+    /* without tickets, each handshake is full (but the client reuses its RA-TLS certificate) */
+    uint64_t full_time = 0;
+    for (size_t i = 0; i < ITERATIONS; i++)
+        full_time += provision(&plain_server, /*expect_full_handshake=*/true, __LINE__);
+
+    /* the session of another server is not offered */
+    provision(&tickets_server, /*expect_full_handshake=*/true, __LINE__);
+
+    /* the ticket lifetime counts from the full handshake, resumptions do not extend it (mbedTLS
+     * compares whole seconds, so wait for one more second) */
+    usleep((TICKET_LIFETIME * 1000 - 500) * 1000);
+    provision(&tickets_server, /*expect_full_handshake=*/false, __LINE__);
+    usleep(1600 * 1000);
+    provision(&tickets_server, /*expect_full_handshake=*/true, __LINE__);
+    provision(&tickets_server, /*expect_full_handshake=*/false, __LINE__);
+
+    printf("Secret provisioning resumption benchmark: full handshake %lu us, resumed handshake %lu "
+           "us (average of %d, including connection and secret transfer)\n",
+           full_time / ITERATIONS, resumed_time / ITERATIONS, ITERATIONS);
+
+    unlink(g_cert_path);
+    unlink(g_key_path);
+    unlink(g_ca_path);
+    rmdir(dir);
+
+    /* the servers run forever; exiting the process stops them */
+    printf("TEST OK\n");
+    return 0;
+}
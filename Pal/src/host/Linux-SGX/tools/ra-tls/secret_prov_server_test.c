@@ -0,0 +1,256 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Load test of the secret provisioning server (secret_prov_verify.c), runnable on a plain Linux
+ * host: the RA-TLS verification callback is replaced by a local stand-in that accepts only a known
+ * client certificate and sleeps to model the latency of quote verification (a round trip to IAS or
+ * PCCS). Many clients connect at once; all of them must get the secret, their verifications must
+ * overlap (but no more of them than there are server workers), and a client with an unknown
+ * certificate must be rejected. Also prints how long serving all clients took.
+ */
+
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mbedtls/config.h"
+
+#include "mbedtls/certs.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+
+#include "ra_tls.h"
+#include "ra_tls_test_utils.h"
+#include "secret_prov.h"
+
+#define SERVER_THREADS     8
+#define CLIENTS            64
+#define VERIFY_LATENCY_US  50000
+#define CONNECT_RETRIES    500
+
+#define SECRET "secret-provisioning-load-test"
+
+static char g_port[16];
+static char g_cert_path[64];
+static char g_key_path[64];
+static mbedtls_x509_crt g_client_crt;
+
+static atomic_int g_verifications;
+static atomic_int g_verifications_in_flight;
+static atomic_int g_verifications_max_in_flight;
+
+/* stand-in for the verification callbacks in ra_tls_verify_{epid,dcap}.c */
+int ra_tls_verify_callback(void* data, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+    (void)data;
+
+    if (depth != 0)
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+
+    if (flags)
+        *flags = 0;
+
+    int in_flight = atomic_fetch_add(&g_verifications_in_flight, 1) + 1;
+    int max = atomic_load(&g_verifications_max_in_flight);
+    while (in_flight > max
+               && !atomic_compare_exchange_weak(&g_verifications_max_in_flight, &max, in_flight))
+        ;
+    atomic_fetch_add(&g_verifications, 1);
+
+    usleep(VERIFY_LATENCY_US);
+
+    atomic_fetch_sub(&g_verifications_in_flight, 1);
+
+    if (crt->raw.len != g_client_crt.raw.len
+            || memcmp(crt->raw.p, g_client_crt.raw.p, crt->raw.len))
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    return 0;
+}
+
+static void* server_main(void* arg) {
+    (void)arg;
+    int ret = secret_provision_start_server((uint8_t*)SECRET, sizeof(SECRET), /*port=*/"0",
+                                            g_cert_path, g_key_path, /*m_cb=*/NULL,
+                                            /*f_cb=*/NULL);
+    FAIL("secret_provision_start_server() returned %d", ret);
+}
+
+/* returns 0 if the secret was received, negative error code if the server refused the client */
+static int run_client(const char* crt_pem, const char* key_pem) {
+    int ret;
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt cacert;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context key;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context fd;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_x509_crt_init(&cacert);
+    mbedtls_x509_crt_init(&crt);
+    mbedtls_pk_init(&key);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_init(&ssl);
+    mbedtls_net_init(&fd);
+
+    const char* pers = "secret-provisioning-test-client";
+    if (mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy, (const uint8_t*)pers,
+                              strlen(pers)) < 0
+            || mbedtls_x509_crt_parse(&cacert, (const uint8_t*)mbedtls_test_cas_pem,
+                                      mbedtls_test_cas_pem_len) < 0
+            || mbedtls_x509_crt_parse(&crt, (const uint8_t*)crt_pem, strlen(crt_pem) + 1) < 0
+            || mbedtls_pk_parse_key(&key, (const uint8_t*)key_pem, strlen(key_pem) + 1,
+                                    /*pwd=*/NULL, 0) < 0
+            || mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT) < 0)
+        FAIL("cannot initialize client");
+
+    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&conf, &cacert, NULL);
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    if (mbedtls_ssl_conf_own_cert(&conf, &crt, &key) < 0
+            || mbedtls_ssl_setup(&ssl, &conf) < 0
+            || mbedtls_ssl_set_hostname(&ssl, "localhost") < 0)
+        FAIL("cannot initialize client");
+
+    /* the server may still be starting up */
+    for (size_t i = 0; i < CONNECT_RETRIES; i++) {
+        ret = mbedtls_net_connect(&fd, "localhost", g_port, MBEDTLS_NET_PROTO_TCP);
+        if (ret == 0)
+            break;
+        usleep(10000);
+    }
+    if (ret < 0)
+        FAIL("cannot connect to server: %d", ret);
+
+    mbedtls_ssl_set_bio(&ssl, &fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    while ((ret = mbedtls_ssl_handshake(&ssl)) < 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)
+            goto out;
+    }
+
+    struct ra_tls_ctx ctx = {.ssl = &ssl};
+    ret = secret_provision_write(&ctx, (const uint8_t*)SECRET_PROVISION_REQUEST,
+                                 sizeof(SECRET_PROVISION_REQUEST));
+    if (ret < 0)
+        goto out;
+
+    uint8_t buf[sizeof(SECRET_PROVISION_RESPONSE) + sizeof(uint32_t) + sizeof(SECRET)];
+    ret = secret_provision_read(&ctx, buf, sizeof(buf));
+    if (ret < 0)
+        goto out;
+
+    uint32_t secret_size;
+    memcpy(&secret_size, buf + sizeof(SECRET_PROVISION_RESPONSE), sizeof(secret_size));
+    if (memcmp(buf, SECRET_PROVISION_RESPONSE, sizeof(SECRET_PROVISION_RESPONSE))
+            || ntohl(secret_size) != sizeof(SECRET)
+            || memcmp(buf + sizeof(SECRET_PROVISION_RESPONSE) + sizeof(secret_size), SECRET,
+                      sizeof(SECRET)))
+        FAIL("client received a wrong secret");
+
+    secret_provision_close(&ctx);
+    ret = 0;
+out:
+    mbedtls_net_free(&fd);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_pk_free(&key);
+    mbedtls_x509_crt_free(&crt);
+    mbedtls_x509_crt_free(&cacert);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    return ret;
+}
+
+static void* client_main(void* arg) {
+    (void)arg;
+    int ret = run_client(mbedtls_test_cli_crt, mbedtls_test_cli_key);
+    if (ret < 0)
+        FAIL("client did not get the secret: %d", ret);
+    return NULL;
+}
+
+int main(void) {
+    int ret;
+
+    setbuf(stdout, NULL);
+
+    char dir[] = "/tmp/secret_prov_server_test.XXXXXX";
+    if (!mkdtemp(dir))
+        FAIL("mkdtemp() failed: %d", errno);
+    snprintf(g_cert_path, sizeof(g_cert_path), "%s/server.crt", dir);
+    snprintf(g_key_path, sizeof(g_key_path), "%s/server.key", dir);
+    write_file(g_cert_path, mbedtls_test_srv_crt);
+    write_file(g_key_path, mbedtls_test_srv_key);
+
+    mbedtls_x509_crt_init(&g_client_crt);
+    if (mbedtls_x509_crt_parse(&g_client_crt, (const uint8_t*)mbedtls_test_cli_crt,
+                               strlen(mbedtls_test_cli_crt) + 1) < 0)
+        FAIL("cannot parse client certificate");
+
+    char threads_str[16];
+    snprintf(threads_str, sizeof(threads_str), "%d", SERVER_THREADS);
+    if (setenv(SECRET_PROVISION_SERVER_THREADS, threads_str, /*overwrite=*/1) < 0)
+        FAIL("setenv() failed: %d", errno);
+
+    start_test_server(server_main, /*arg=*/NULL, g_port, sizeof(g_port));
+
+    /* client with an unknown certificate (the server's one) is refused */
+    ret = run_client(mbedtls_test_srv_crt, mbedtls_test_srv_key);
+    if (ret == 0)
+        FAIL("client with unknown certificate got the secret");
+    atomic_store(&g_verifications, 0);
+    atomic_store(&g_verifications_max_in_flight, 0);
+
+    uint64_t start_time = time_us();
+
+    pthread_t client_tids[CLIENTS];
+    for (size_t i = 0; i < CLIENTS; i++) {
+        ret = pthread_create(&client_tids[i], NULL, client_main, NULL);
+        if (ret)
+            FAIL("pthread_create() failed: %d", ret);
+    }
+    for (size_t i = 0; i < CLIENTS; i++)
+        pthread_join(client_tids[i], NULL);
+
+    uint64_t end_time = time_us();
+
+    if (atomic_load(&g_verifications) != CLIENTS)
+        FAIL("server verified %d clients, expected %d", atomic_load(&g_verifications), CLIENTS);
+
+    int max_in_flight = atomic_load(&g_verifications_max_in_flight);
+    if (max_in_flight < 2)
+        FAIL("verifications of clients did not run in parallel");
+    if (max_in_flight > SERVER_THREADS)
+        FAIL("%d verifications ran in parallel, but the server has %d workers", max_in_flight,
+             SERVER_THREADS);
+
+    printf("Secret provisioning load test: %d clients served in %lu ms by %d workers (max "
+           "concurrent verifications: %d, serialized verification alone would take %d ms)\n",
+           CLIENTS, (end_time - start_time) / 1000, SERVER_THREADS, max_in_flight,
+           CLIENTS * VERIFY_LATENCY_US / 1000);
+
+    unlink(g_cert_path);
+    unlink(g_key_path);
+    rmdir(dir);
+    mbedtls_x509_crt_free(&g_client_crt);
+
+    /* the server runs forever; exiting the process stops it */
+    printf("TEST OK\n");
+    return 0;
+}
@@ -10,16 +10,24 @@
  * using ra_tls_verify_callback(), and send (provision) the secret to the enclavized application.
  *
  * This file is part of the secret-provisioning verifier-side library which is typically linked
- * into the secret provisioning server. This library is *not* thread-safe.
+ * into the secret provisioning server. The server serves clients concurrently in a fixed pool of
+ * worker threads, each with its own mbedTLS contexts; RA-TLS verification callbacks are
+ * thread-safe, so handshakes (including quote verification) of different clients run in parallel.
+ * Optionally, the server issues TLS session tickets, so that clients can resume their sessions
+ * without repeating the attestation.
  */
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 
 #include "mbedtls/config.h"
 
@@ -29,42 +37,128 @@
 #include "mbedtls/error.h"
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/ssl.h"
+#include "mbedtls/ssl_ticket.h"
 
 #include "ra_tls.h"
 #include "secret_prov.h"
 
-struct thread_info {
-    mbedtls_net_context client_fd;
-    mbedtls_ssl_config* conf;
+/* number of worker threads that serve clients, if not set in SECRET_PROVISION_SERVER_THREADS;
+ * handshakes spend most of their time waiting for quote verification (e.g. for IAS or PCCS
+ * responses), so there are more workers than typical number of CPUs */
+#define DEFAULT_SERVER_THREADS 16
+#define MAX_SERVER_THREADS     1024
+
+/* accepted connections waiting for a free worker; when the queue is full, the server stops
+ * accepting and new clients wait in the listen backlog of the kernel */
+#define MAX_PENDING_CLIENTS 128
+
+/* how long a worker waits for a client during the handshake and the secret request, so that
+ * stalled clients cannot occupy the workers forever */
+#define CLIENT_READ_TIMEOUT_MS 30000
+
+/* limit of SECRET_PROVISION_TICKET_LIFETIME; a resumed session skips RA-TLS verification, so the
+ * lifetime bounds how long a client is trusted after its attestation */
+#define MAX_TICKET_LIFETIME (24 * 60 * 60)
+
+struct server {
+    pthread_mutex_t lock;
+    pthread_cond_t pending_not_empty;
+    pthread_cond_t pending_not_full;
+    /* ring buffer of accepted clients, protected by `lock` */
+    mbedtls_net_context pending[MAX_PENDING_CLIENTS];
+    size_t pending_start;
+    size_t pending_count;
+    bool stopping;
+
     uint8_t* secret;
     size_t secret_size;
     secret_provision_cb_t f_cb;
+
+    /* session tickets (disabled if `ticket_lifetime` is 0); the ticket context and its RNG are
+     * shared by all workers (so that any worker can resume any session) and protected by
+     * `ticket_lock` */
+    uint32_t ticket_lifetime;
+    pthread_mutex_t ticket_lock;
+    mbedtls_ssl_ticket_context ticket_ctx;
+    mbedtls_ctr_drbg_context ticket_ctr_drbg;
+    mbedtls_entropy_context ticket_entropy;
+};
+
+/* mbedTLS is built without MBEDTLS_THREADING_C, so RNG and private key contexts (the latter
+ * mutates on RSA blinding) cannot be shared by concurrent handshakes; each worker has its own
+ * copies and its own SSL config referencing them (the server certificate is only read during
+ * handshakes and is shared) */
+struct worker {
+    struct server* server;
+    pthread_t tid;
+    mbedtls_ssl_config conf;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_entropy_context entropy;
+    mbedtls_pk_context srvkey;
 };
 
-/* SSL/TLS + RA-TLS handshake is not thread-safe, use coarse-grained lock */
-static pthread_mutex_t g_handshake_lock;
+static int ticket_write(void* p_ticket, const mbedtls_ssl_session* session, unsigned char* start,
+                        const unsigned char* end, size_t* tlen, uint32_t* lifetime) {
+    struct server* server = p_ticket;
+
+    pthread_mutex_lock(&server->ticket_lock);
+    int ret = mbedtls_ssl_ticket_write(&server->ticket_ctx, session, start, end, tlen, lifetime);
+    pthread_mutex_unlock(&server->ticket_lock);
+    return ret;
+}
+
+static int ticket_parse(void* p_ticket, mbedtls_ssl_session* session, unsigned char* buf,
+                        size_t len) {
+    struct server* server = p_ticket;
+
+    pthread_mutex_lock(&server->ticket_lock);
+    int ret = mbedtls_ssl_ticket_parse(&server->ticket_ctx, session, buf, len);
+    pthread_mutex_unlock(&server->ticket_lock);
+    return ret;
+}
+
+/* Session tickets are encrypted and authenticated with a key known only to this server process,
+ * and carry the session with the client's RA-TLS certificate verified in the original (full)
+ * handshake, so a resumed session stays bound to the attested client. mbedTLS rejects tickets
+ * older than `ticket_lifetime` (counted from the original handshake, not from the last
+ * resumption) and replaces the ticket key with a fresh random one every `ticket_lifetime`
+ * seconds. */
+static int setup_tickets(struct server* server) {
+    const char* pers = "secret-provisioning-tickets";
+    int ret = mbedtls_ctr_drbg_seed(&server->ticket_ctr_drbg, mbedtls_entropy_func,
+                                    &server->ticket_entropy, (const uint8_t*)pers, strlen(pers));
+    if (ret < 0) {
+        return ret;
+    }
+
+    return mbedtls_ssl_ticket_setup(&server->ticket_ctx, mbedtls_ctr_drbg_random,
+                                    &server->ticket_ctr_drbg, MBEDTLS_CIPHER_AES_256_GCM,
+                                    server->ticket_lifetime);
+}
 
-static void* client_connection(void* data) {
+static void serve_client(struct worker* worker, mbedtls_net_context* client_fd) {
     int ret;
-    struct thread_info* ti = (struct thread_info*)data;
+    struct server* server = worker->server;
 
     mbedtls_ssl_context ssl;
     mbedtls_ssl_init(&ssl);
 
-    ret = mbedtls_ssl_setup(&ssl, ti->conf);
+    /* TLS handshake and the protocol consist of small messages; don't let Nagle's algorithm hold
+     * them back until the client's (delayed) ACK arrives, failure only affects latency */
+    int nodelay = 1;
+    setsockopt(client_fd->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    ret = mbedtls_ssl_setup(&ssl, &worker->conf);
     if (ret < 0) {
         goto out;
     }
 
-    mbedtls_ssl_set_bio(&ssl, &ti->client_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+    mbedtls_ssl_set_bio(&ssl, client_fd, mbedtls_net_send, /*f_recv=*/NULL,
+                        mbedtls_net_recv_timeout);
 
     ret = -1;
     while (ret < 0) {
-        /* FIXME: this coarse-grained locking is less than optimal; need to switch to thread-safe
-         *        mbedTLS configuration and thread-safe RA-TLS in the future */
-        pthread_mutex_lock(&g_handshake_lock);
         ret = mbedtls_ssl_handshake(&ssl);
-        pthread_mutex_unlock(&g_handshake_lock);
         if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
             continue;
         }
@@ -94,12 +188,12 @@ static void* client_connection(void* data) {
     }
 
     /* remote attester receives 32-bit integer over network; we need to hton it */
-    if (ti->secret_size > INT_MAX) {
+    if (server->secret_size > INT_MAX) {
         ret = -EINVAL;
         goto out;
     }
 
-    uint32_t send_secret_size = htonl((uint32_t)ti->secret_size);
+    uint32_t send_secret_size = htonl((uint32_t)server->secret_size);
     static_assert(sizeof(buf) >= sizeof(SECRET_PROVISION_RESPONSE) + sizeof(send_secret_size),
                   "buffer must be sufficiently large to hold SECRET_PROVISION_RESPONSE + int32");
 
@@ -113,26 +207,155 @@ static void* client_connection(void* data) {
         goto out;
     }
 
-    ret = secret_provision_write(&ctx, ti->secret, ti->secret_size);
+    ret = secret_provision_write(&ctx, server->secret, server->secret_size);
     if (ret < 0) {
         goto out;
     }
 
-    if (ti->f_cb) {
+    if (server->f_cb) {
+        /* user-specific communication may legitimately wait for the client, so disable the read
+         * timeout */
+        mbedtls_ssl_set_bio(&ssl, client_fd, mbedtls_net_send, mbedtls_net_recv,
+                            /*f_recv_timeout=*/NULL);
+
         /* pass ownership of SSL session with client to the caller; it is caller's responsibility
          * to gracefuly terminate the session using secret_provision_close() */
-        ti->f_cb(&ctx);
+        server->f_cb(&ctx);
     } else {
         secret_provision_close(&ctx);
     }
 
 out:
     mbedtls_ssl_free(&ssl);
-    mbedtls_net_free(&ti->client_fd);
-    free(ti);
+    mbedtls_net_free(client_fd);
+}
+
+static void* worker_main(void* arg) {
+    struct worker* worker = arg;
+    struct server* server = worker->server;
+
+    while (true) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->pending_count && !server->stopping)
+            pthread_cond_wait(&server->pending_not_empty, &server->lock);
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+
+        mbedtls_net_context client_fd = server->pending[server->pending_start];
+        server->pending_start = (server->pending_start + 1) % MAX_PENDING_CLIENTS;
+        server->pending_count--;
+        pthread_cond_signal(&server->pending_not_full);
+        pthread_mutex_unlock(&server->lock);
+
+        serve_client(worker, &client_fd);
+    }
+
     return NULL;
 }
 
+static void add_pending_client(struct server* server, mbedtls_net_context* client_fd) {
+    pthread_mutex_lock(&server->lock);
+    while (server->pending_count == MAX_PENDING_CLIENTS)
+        pthread_cond_wait(&server->pending_not_full, &server->lock);
+
+    size_t idx = (server->pending_start + server->pending_count) % MAX_PENDING_CLIENTS;
+    server->pending[idx] = *client_fd;
+    server->pending_count++;
+    pthread_cond_signal(&server->pending_not_empty);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void init_worker(struct worker* worker, struct server* server) {
+    worker->server = server;
+    mbedtls_ssl_config_init(&worker->conf);
+    mbedtls_ctr_drbg_init(&worker->ctr_drbg);
+    mbedtls_entropy_init(&worker->entropy);
+    mbedtls_pk_init(&worker->srvkey);
+}
+
+static void free_worker(struct worker* worker) {
+    mbedtls_pk_free(&worker->srvkey);
+    mbedtls_ssl_config_free(&worker->conf);
+    mbedtls_ctr_drbg_free(&worker->ctr_drbg);
+    mbedtls_entropy_free(&worker->entropy);
+}
+
+static int setup_worker(struct worker* worker, mbedtls_x509_crt* srvcert, const char* key_path) {
+    int ret;
+
+    const char* pers = "secret-provisioning-server";
+    ret = mbedtls_ctr_drbg_seed(&worker->ctr_drbg, mbedtls_entropy_func, &worker->entropy,
+                                (const uint8_t*)pers, strlen(pers));
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = mbedtls_pk_parse_keyfile(&worker->srvkey, key_path, /*password=*/NULL);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = mbedtls_ssl_config_defaults(&worker->conf, MBEDTLS_SSL_IS_SERVER,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret < 0) {
+        return ret;
+    }
+
+    mbedtls_ssl_conf_rng(&worker->conf, mbedtls_ctr_drbg_random, &worker->ctr_drbg);
+
+    mbedtls_ssl_conf_authmode(&worker->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+
+    mbedtls_ssl_conf_read_timeout(&worker->conf, CLIENT_READ_TIMEOUT_MS);
+
+    /* the below CA chain is a dummy (RA-TLS verify callback ignores it) but required by mbedTLS */
+    mbedtls_ssl_conf_ca_chain(&worker->conf, srvcert, NULL);
+
+    mbedtls_ssl_conf_verify(&worker->conf, ra_tls_verify_callback, NULL);
+
+    if (worker->server->ticket_lifetime) {
+        mbedtls_ssl_conf_session_tickets_cb(&worker->conf, ticket_write, ticket_parse,
+                                            worker->server);
+    }
+
+    return mbedtls_ssl_conf_own_cert(&worker->conf, srvcert, &worker->srvkey);
+}
+
+static int get_ticket_lifetime(uint32_t* out_lifetime) {
+    char* str = getenv(SECRET_PROVISION_TICKET_LIFETIME);
+    if (!str) {
+        *out_lifetime = 0;
+        return 0;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long lifetime = strtoul(str, &end, 10);
+    if (errno || end == str || *end != '\0' || lifetime > MAX_TICKET_LIFETIME)
+        return -EINVAL;
+
+    *out_lifetime = lifetime;
+    return 0;
+}
+
+static int get_server_threads(size_t* out_threads) {
+    char* str = getenv(SECRET_PROVISION_SERVER_THREADS);
+    if (!str) {
+        *out_threads = DEFAULT_SERVER_THREADS;
+        return 0;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long threads = strtoul(str, &end, 10);
+    if (errno || end == str || *end != '\0' || !threads || threads > MAX_SERVER_THREADS)
+        return -EINVAL;
+
+    *out_threads = threads;
+    return 0;
+}
+
 int secret_provision_start_server(uint8_t* secret, size_t secret_size, const char* port,
                                   const char* cert_path, const char* key_path,
                                   verify_measurements_cb_t m_cb, secret_provision_cb_t f_cb) {
@@ -141,32 +364,58 @@ int secret_provision_start_server(uint8_t* secret, size_t secret_size, const cha
     if (!secret || !secret_size || !cert_path || !key_path)
         return -EINVAL;
 
-    ret = pthread_mutex_init(&g_handshake_lock, NULL);
+    size_t workers_cnt;
+    ret = get_server_threads(&workers_cnt);
     if (ret < 0)
         return ret;
 
-    mbedtls_ssl_config conf;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_entropy_context entropy;
-    mbedtls_pk_context srvkey;
+    uint32_t ticket_lifetime;
+    ret = get_ticket_lifetime(&ticket_lifetime);
+    if (ret < 0)
+        return ret;
+
+    struct server server = {
+        .secret          = secret,
+        .secret_size     = secret_size,
+        .f_cb            = f_cb,
+        .ticket_lifetime = ticket_lifetime,
+        .ticket_lock     = PTHREAD_MUTEX_INITIALIZER,
+    };
+
+    ret = pthread_mutex_init(&server.lock, NULL);
+    if (ret)
+        return -ret;
+    ret = pthread_cond_init(&server.pending_not_empty, NULL);
+    if (ret) {
+        pthread_mutex_destroy(&server.lock);
+        return -ret;
+    }
+    ret = pthread_cond_init(&server.pending_not_full, NULL);
+    if (ret) {
+        pthread_cond_destroy(&server.pending_not_empty);
+        pthread_mutex_destroy(&server.lock);
+        return -ret;
+    }
+
     mbedtls_x509_crt srvcert;
     mbedtls_net_context client_fd;
     mbedtls_net_context listen_fd;
 
-    mbedtls_ssl_config_init(&conf);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_entropy_init(&entropy);
-    mbedtls_pk_init(&srvkey);
     mbedtls_x509_crt_init(&srvcert);
     mbedtls_net_init(&client_fd);
     mbedtls_net_init(&listen_fd);
-
-    const char* pers = "secret-provisioning-server";
-    ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
-                                (const uint8_t*)pers, strlen(pers));
-    if (ret < 0) {
+    mbedtls_ssl_ticket_init(&server.ticket_ctx);
+    mbedtls_ctr_drbg_init(&server.ticket_ctr_drbg);
+    mbedtls_entropy_init(&server.ticket_entropy);
+
+    size_t workers_started = 0;
+    struct worker* workers = calloc(workers_cnt, sizeof(*workers));
+    if (!workers) {
+        ret = -ENOMEM;
         goto out;
     }
+    for (size_t i = 0; i < workers_cnt; i++)
+        init_worker(&workers[i], &server);
 
     ret = mbedtls_x509_crt_parse_file(&srvcert, cert_path);
     if (ret != 0) {
@@ -181,38 +430,37 @@ int secret_provision_start_server(uint8_t* secret, size_t secret_size, const cha
     if (strstr(crt_issuer, "PolarSSL Test CA"))
         printf("%s", SECRET_PROVISION_WARNING_TEST_CERTS);
 
-    ret = mbedtls_pk_parse_keyfile(&srvkey, key_path, /*password=*/NULL);
-    if (ret < 0) {
-        goto out;
-    }
-
     ret = mbedtls_net_bind(&listen_fd, NULL, port ?: "4433", MBEDTLS_NET_PROTO_TCP);
     if (ret < 0) {
         goto out;
     }
 
-    ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
-                                      MBEDTLS_SSL_PRESET_DEFAULT);
-    if (ret < 0) {
-        goto out;
+    if (server.ticket_lifetime) {
+        ret = setup_tickets(&server);
+        if (ret < 0) {
+            goto out;
+        }
     }
 
-    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
-
-    mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-
-    /* the below CA chain is a dummy (RA-TLS verify callback ignores it) but required by mbedTLS */
-    mbedtls_ssl_conf_ca_chain(&conf, &srvcert, NULL);
+    for (size_t i = 0; i < workers_cnt; i++) {
+        ret = setup_worker(&workers[i], &srvcert, key_path);
+        if (ret < 0) {
+            goto out;
+        }
+    }
 
     ra_tls_set_measurement_callback(m_cb);
-    mbedtls_ssl_conf_verify(&conf, ra_tls_verify_callback, NULL);
 
-    ret = mbedtls_ssl_conf_own_cert(&conf, &srvcert, &srvkey);
-    if (ret < 0) {
-        goto out;
+    for (; workers_started < workers_cnt; workers_started++) {
+        ret = pthread_create(&workers[workers_started].tid, NULL, worker_main,
+                             &workers[workers_started]);
+        if (ret) {
+            ret = -ret;
+            goto out;
+        }
     }
 
-    /* wait for new clients */
+    /* wait for new clients and pass them to the workers */
     while (true) {
         ret = mbedtls_net_accept(&listen_fd, &client_fd, NULL, 0, NULL);
         if (ret < 0) {
@@ -220,54 +468,36 @@ int secret_provision_start_server(uint8_t* secret, size_t secret_size, const cha
             continue;
         }
 
-        struct thread_info* ti = calloc(1, sizeof(*ti));
-        if (!ti) {
-            mbedtls_net_free(&client_fd);
-            continue;
-        }
-
-        /* client_fd is reused for multiple threads, so pass ownership of its copy to new thread */
-        memcpy(&ti->client_fd, &client_fd, sizeof(client_fd));
-        ti->conf        = &conf;
-        ti->secret      = secret;
-        ti->secret_size = secret_size;
-        ti->f_cb        = f_cb;
-
-        pthread_attr_t tattr;
-        ret = pthread_attr_init(&tattr);
-        if (ret < 0) {
-            free(ti);
-            mbedtls_net_free(&client_fd);
-            continue;
-        }
-
-        ret = pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
-        if (ret < 0) {
-            free(ti);
-            pthread_attr_destroy(&tattr);
-            mbedtls_net_free(&client_fd);
-            continue;
-        }
-
-        pthread_t tid;
-        ret = pthread_create(&tid, &tattr, client_connection, ti);
-        if (ret < 0) {
-            free(ti);
-            mbedtls_net_free(&client_fd);
-        }
-
-        pthread_attr_destroy(&tattr);
+        /* ownership of the accepted socket goes to the worker that picks it up */
+        add_pending_client(&server, &client_fd);
+        mbedtls_net_init(&client_fd);
     }
 
 out:
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    pthread_cond_broadcast(&server.pending_not_empty);
+    pthread_mutex_unlock(&server.lock);
+
+    for (size_t i = 0; i < workers_started; i++)
+        pthread_join(workers[i].tid, NULL);
+
+    if (workers) {
+        for (size_t i = 0; i < workers_cnt; i++)
+            free_worker(&workers[i]);
+        free(workers);
+    }
+
     mbedtls_x509_crt_free(&srvcert);
-    mbedtls_pk_free(&srvkey);
     mbedtls_net_free(&listen_fd);
     mbedtls_net_free(&client_fd);
-    mbedtls_ssl_config_free(&conf);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_entropy_free(&entropy);
-
-    pthread_mutex_destroy(&g_handshake_lock);
+    mbedtls_ssl_ticket_free(&server.ticket_ctx);
+    mbedtls_ctr_drbg_free(&server.ticket_ctr_drbg);
+    mbedtls_entropy_free(&server.ticket_entropy);
+
+    pthread_cond_destroy(&server.pending_not_full);
+    pthread_cond_destroy(&server.pending_not_empty);
+    pthread_mutex_destroy(&server.ticket_lock);
+    pthread_mutex_destroy(&server.lock);
     return ret;
 }
@@ -89,6 +89,71 @@ int _DkVirtualMemoryProtect(void* addr, size_t size, pal_prot_flags_t prot) {
     return ret < 0 ? unix_to_pal_error(ret) : 0;
 }
 
+/* See Documentation/admin-guide/mm/pagemap.rst in Linux sources */
+#define PAGEMAP_ENTRY_SWAPPED (1UL << 62)
+#define PAGEMAP_ENTRY_PRESENT (1UL << 63)
+
+/* LibOS queries a checkpointed VMA in batches, so keep pagemap open instead of reopening it for each
+ * call. New processes are created with execve, so the fd always refers to our own pagemap. */
+static int g_pagemap_fd = -1;
+
+static int get_pagemap_fd(void) {
+    int fd = __atomic_load_n(&g_pagemap_fd, __ATOMIC_ACQUIRE);
+    if (fd >= 0)
+        return fd;
+
+    fd = DO_SYSCALL(open, "/proc/self/pagemap", O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return fd;
+
+    int expected = -1;
+    if (!__atomic_compare_exchange_n(&g_pagemap_fd, &expected, fd, /*weak=*/false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* another thread opened it concurrently */
+        DO_SYSCALL(close, fd);
+        fd = expected;
+    }
+    return fd;
+}
+
+int _DkVirtualMemoryQueryPopulated(void* addr, size_t size, uint8_t* vec) {
+    /* Unlike mincore(), pagemap reports swapped-out anonymous pages, so a page which is neither
+     * present nor swapped was never touched and reads as zeros. PFNs are hidden from unprivileged
+     * readers, but we only need the flags. */
+    int fd = get_pagemap_fd();
+    if (fd < 0)
+        return unix_to_pal_error(fd);
+
+    uint64_t entries[256];
+    size_t pages_cnt = size / g_page_size;
+    uint64_t first_page = (uintptr_t)addr / g_page_size;
+
+    int ret = 0;
+    size_t done = 0;
+    while (done < pages_cnt) {
+        size_t cnt = MIN(pages_cnt - done, ARRAY_SIZE(entries));
+        ssize_t bytes = DO_SYSCALL(pread64, fd, entries, cnt * sizeof(entries[0]),
+                                   (first_page + done) * sizeof(entries[0]));
+        if (bytes < 0) {
+            if (bytes == -EINTR)
+                continue;
+            ret = unix_to_pal_error(bytes);
+            break;
+        }
+        if ((size_t)bytes < sizeof(entries[0])) {
+            ret = -PAL_ERROR_DENIED;
+            break;
+        }
+
+        cnt = (size_t)bytes / sizeof(entries[0]);
+        for (size_t i = 0; i < cnt; i++)
+            vec[done + i] = !!(entries[i] & (PAGEMAP_ENTRY_PRESENT | PAGEMAP_ENTRY_SWAPPED));
+        done += cnt;
+    }
+
+    return ret;
+}
+
 static int read_proc_meminfo(const char* key, unsigned long* val) {
     int fd = DO_SYSCALL(open, "/proc/meminfo", O_RDONLY, 0);
 
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This file contains operations to handle streams with URIs that have "shm:".
+ *
+ * Such streams are shared memory objects: anonymous ones are backed by a host memfd, named ones by
+ * a file in the host's /dev/shm. The handle can be sent to other processes (the fd is passed via
+ * SCM_RIGHTS), named objects can also be opened by name from any process of this Gramine instance.
+ * All mappings of one object map the very same host memory, so they see each other's writes.
+ */
+
+#include <linux/memfd.h>
+
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_flags_conv.h"
+#include "pal_internal.h"
+#include "pal_linux.h"
+#include "pal_linux_error.h"
+#include "stat.h"
+
+/* Named objects are created in this host directory, prefixed with "gramine.<instance_id>." */
+#define SHM_HOST_DIR "/dev/shm/"
+
+/* `type` must be shm, `uri` is either empty (a new anonymous object is created) or a name of the
+ * object (shared by all processes of this Gramine instance), `create` and `share` are only used for
+ * named objects, `access` and `options` are unused */
+static int shm_open(PAL_HANDLE* handle, const char* type, const char* uri, enum pal_access access,
+                    pal_share_flags_t share, enum pal_create_mode create,
+                    pal_stream_options_t options) {
+    __UNUSED(access);
+    __UNUSED(options);
+
+    if (strcmp(type, URI_TYPE_SHM) != 0)
+        return -PAL_ERROR_INVAL;
+
+    int fd;
+    char path[URI_MAX];
+    size_t path_size = 0;
+    if (*uri) {
+        if (strchr(uri, '/'))
+            return -PAL_ERROR_INVAL;
+
+        int len = snprintf(path, sizeof(path), SHM_HOST_DIR "gramine.%lx.%s",
+                           g_pal_common_state.instance_id, uri);
+        if (len < 0 || (size_t)len >= sizeof(path))
+            return -PAL_ERROR_TOOLONG;
+        path_size = len + 1;
+
+        fd = DO_SYSCALL(open, path, O_RDWR | O_CLOEXEC | PAL_CREATE_TO_LINUX_OPEN(create),
+                        share);
+    } else {
+        fd = DO_SYSCALL(memfd_create, "gramine-shm", MFD_CLOEXEC);
+    }
+    if (fd < 0)
+        return unix_to_pal_error(fd);
+
+    PAL_HANDLE hdl = calloc(1, HANDLE_SIZE(shm) + path_size);
+    if (!hdl) {
+        DO_SYSCALL(close, fd);
+        return -PAL_ERROR_NOMEM;
+    }
+    init_handle_hdr(hdl, PAL_TYPE_SHM);
+
+    hdl->flags = PAL_HANDLE_FD_READABLE | PAL_HANDLE_FD_WRITABLE;
+    hdl->shm.fd = fd;
+    if (path_size) {
+        char* realpath = (char*)hdl + HANDLE_SIZE(shm);
+        memcpy(realpath, path, path_size);
+        hdl->shm.realpath = realpath;
+    }
+    *handle = hdl;
+    return 0;
+}
+
+/* Removes the name of a named object, the object itself lives until the last handle/mapping of it
+ * is gone */
+static int shm_delete(PAL_HANDLE handle, enum pal_delete_mode delete_mode) {
+    if (delete_mode != PAL_DELETE_ALL)
+        return -PAL_ERROR_INVAL;
+
+    if (!handle->shm.realpath)
+        return 0;
+
+    int ret = DO_SYSCALL(unlink, handle->shm.realpath);
+    return ret < 0 ? unix_to_pal_error(ret) : 0;
+}
+
+static int shm_map(PAL_HANDLE handle, void** addr, pal_prot_flags_t prot, uint64_t offset,
+                   uint64_t size) {
+    assert(*addr);
+
+    /* always map as shared, copy-on-write mappings of shared memory objects make no sense */
+    void* mem = (void*)DO_SYSCALL(mmap, *addr, size, PAL_PROT_TO_LINUX(prot),
+                                  MAP_SHARED | MAP_FIXED, handle->shm.fd, offset);
+    if (IS_PTR_ERR(mem))
+        return unix_to_pal_error(PTR_TO_ERR(mem));
+
+    *addr = mem;
+    return 0;
+}
+
+static int64_t shm_setlength(PAL_HANDLE handle, uint64_t length) {
+    int ret = DO_SYSCALL(ftruncate, handle->shm.fd, length);
+    if (ret < 0)
+        return unix_to_pal_error(ret);
+
+    return (int64_t)length;
+}
+
+static int shm_attrquerybyhdl(PAL_HANDLE handle, PAL_STREAM_ATTR* attr) {
+    struct stat stat_buf;
+    int ret = DO_SYSCALL(fstat, handle->shm.fd, &stat_buf);
+    if (ret < 0)
+        return unix_to_pal_error(ret);
+
+    attr->handle_type  = HANDLE_HDR(handle)->type;
+    attr->nonblocking  = false;
+    attr->disconnected = false;
+    attr->readable     = true;
+    attr->writable     = true;
+    attr->pending_size = stat_buf.st_size;
+    attr->share_flags  = stat_buf.st_mode & PAL_SHARE_MASK;
+    return 0;
+}
+
+static int shm_close(PAL_HANDLE handle) {
+    if (handle->shm.fd != PAL_IDX_POISON) {
+        DO_SYSCALL(close, handle->shm.fd);
+        handle->shm.fd = PAL_IDX_POISON;
+    }
+    return 0;
+}
+
+struct handle_ops g_shm_ops = {
+    .open           = &shm_open,
+    .map            = &shm_map,
+    .setlength      = &shm_setlength,
+    .close          = &shm_close,
+    .delete         = &shm_delete,
+    .attrquerybyhdl = &shm_attrquerybyhdl,
+};
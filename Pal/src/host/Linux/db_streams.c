@@ -121,6 +121,12 @@ int handle_serialize(PAL_HANDLE handle, void** data) {
                 dsz2 = addr_size(handle->sock.conn);
             }
             break;
+        case PAL_TYPE_SHM:
+            if (handle->shm.realpath) {
+                d1   = handle->shm.realpath;
+                dsz1 = strlen(handle->shm.realpath) + 1;
+            }
+            break;
         case PAL_TYPE_PROCESS:
         case PAL_TYPE_EVENTFD:
             break;
@@ -178,6 +184,9 @@ int handle_deserialize(PAL_HANDLE* handle, const void* data, size_t size) {
                 hdl->sock.conn = (struct sockaddr*)((uint8_t*)hdl + hdlsz + s2);
             break;
         }
+        case PAL_TYPE_SHM:
+            hdl->shm.realpath = (hdl->shm.realpath ? (const char*)hdl + hdlsz : NULL);
+            break;
         case PAL_TYPE_PROCESS:
         case PAL_TYPE_EVENTFD:
             break;
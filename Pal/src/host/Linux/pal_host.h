@@ -66,6 +66,11 @@ typedef struct {
             bool nonblocking;
         } dev;
 
+        struct {
+            PAL_IDX fd;
+            const char* realpath; /* host path of a named object, NULL for anonymous objects */
+        } shm;
+
         struct {
             PAL_IDX fd;
             const char* realpath;
@@ -27,6 +27,10 @@ int _DkVirtualMemoryProtect(void* addr, uint64_t size, pal_prot_flags_t prot) {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
 
+int _DkVirtualMemoryQueryPopulated(void* addr, uint64_t size, uint8_t* vec) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
 unsigned long _DkMemoryQuota(void) {
     return 0;
 }
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * This file contains operations to handle streams with URIs that have "shm:".
+ */
+
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_internal.h"
+
+static int shm_open(PAL_HANDLE* handle, const char* type, const char* uri, enum pal_access access,
+                    pal_share_flags_t share, enum pal_create_mode create,
+                    pal_stream_options_t options) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+static int shm_map(PAL_HANDLE handle, void** addr, pal_prot_flags_t prot, uint64_t offset,
+                   uint64_t size) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+static int64_t shm_setlength(PAL_HANDLE handle, uint64_t length) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+static int shm_close(PAL_HANDLE handle) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+struct handle_ops g_shm_ops = {
+    .open      = &shm_open,
+    .map       = &shm_map,
+    .setlength = &shm_setlength,
+    .close     = &shm_close,
+};
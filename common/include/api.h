@@ -388,6 +388,7 @@ int parse_size_str(const char* str, uint64_t* out_val);
 #define URI_TYPE_DEV      "dev"
 #define URI_TYPE_EVENTFD  "eventfd"
 #define URI_TYPE_FILE     "file"
+#define URI_TYPE_SHM      "shm"
 
 #define URI_PREFIX_DIR      URI_TYPE_DIR URI_PREFIX_SEPARATOR
 #define URI_PREFIX_TCP      URI_TYPE_TCP URI_PREFIX_SEPARATOR
@@ -399,6 +400,7 @@ int parse_size_str(const char* str, uint64_t* out_val);
 #define URI_PREFIX_DEV      URI_TYPE_DEV URI_PREFIX_SEPARATOR
 #define URI_PREFIX_EVENTFD  URI_TYPE_EVENTFD URI_PREFIX_SEPARATOR
 #define URI_PREFIX_FILE     URI_TYPE_FILE URI_PREFIX_SEPARATOR
+#define URI_PREFIX_SHM      URI_TYPE_SHM URI_PREFIX_SEPARATOR
 
 #define URI_PREFIX_FILE_LEN (static_strlen(URI_PREFIX_FILE))
 
@@ -51,11 +51,19 @@ struct avl_tree {
     /* This should be a total order (<=) on tree nodes. If two elements compare equal, the newer
      * will be on the left (side of smaller elements) from the older one. */
     bool (*cmp)(struct avl_tree_node*, struct avl_tree_node*);
+    /* Optional (may be NULL), used for augmented trees: recomputes data that a node keeps about its
+     * whole subtree from the node itself and its children (whose data is already up to date). The
+     * tree calls it on every node whose subtree changed on insert, delete and rebalancing. */
+    void (*update)(struct avl_tree_node*);
 };
 
 void avl_tree_insert(struct avl_tree* tree, struct avl_tree_node* node);
 void avl_tree_delete(struct avl_tree* tree, struct avl_tree_node* node);
 
+/* Calls `tree->update` on `node` and all its ancestors. Must be called after changing data of
+ * `node` that its augmented data depends on (but not its position in the order). */
+void avl_tree_update(struct avl_tree* tree, struct avl_tree_node* node);
+
 /*
  * This function swaps `new_node` in place of `old_node`. `new_node` must not be in any tree (i.e.
  * it should really be a new node) and they both should compare equal with respect to `tree.cmp` or
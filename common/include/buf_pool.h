@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Cache of free buffers sorted into power-of-two size classes, with a bounded number of buffers
+ * per class and a bounded total size. The pool only keeps track of buffer addresses (it never
+ * touches the buffers themselves, so it can cache e.g. untrusted memory), allocating and freeing
+ * buffers that miss the pool is up to the caller. No locking is done, the caller must serialize
+ * access to a pool.
+ *
+ * A zero-initialized pool caches nothing; use buf_pool_init() to set its limits.
+ */
+
+#ifndef BUF_POOL_H
+#define BUF_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUF_POOL_MIN_SIZE  (64 * 1024UL)
+#define BUF_POOL_CLASSES   9 /* 64KiB, 128KiB, ..., 16MiB */
+#define BUF_POOL_MAX_SLOTS 8
+
+struct buf_pool {
+    void* bufs[BUF_POOL_CLASSES][BUF_POOL_MAX_SLOTS];
+    uint8_t count[BUF_POOL_CLASSES];
+    uint8_t slots;   /* max number of buffers cached per class */
+    size_t size;     /* total size of cached buffers */
+    size_t max_size; /* limit of `size` */
+};
+
+void buf_pool_init(struct buf_pool* pool, size_t slots, size_t max_size);
+
+/* Returns the size class for buffers of `size` bytes, or -1 if they are too large to be cached. */
+int buf_pool_class(size_t size);
+
+/* Returns the size of buffers of class `cls` (at least the size they were requested with). */
+size_t buf_pool_class_size(int cls);
+
+/* Takes a cached buffer of class `cls` out of the pool. Returns NULL if there is none. */
+void* buf_pool_get(struct buf_pool* pool, int cls);
+
+/* Puts buffer `buf` of class `cls` into the pool. Returns false if the pool is full, the caller
+ * keeps the buffer in that case. */
+bool buf_pool_put(struct buf_pool* pool, int cls, void* buf);
+
+#endif // BUF_POOL_H
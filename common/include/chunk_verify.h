@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Copying of file contents from untrusted memory, verified against known hashes of fixed-size
+ * chunks of the file (used for SGX trusted files). Every chunk overlapping the requested range is
+ * hashed as a whole, but only from copies (never directly from untrusted memory, to prevent TOCTOU
+ * attacks): the requested part is copied straight into the destination buffer, the rest of the
+ * chunk goes through a small bounce buffer on stack. Data is hashed slice by slice right after
+ * being copied, while it is still in cache.
+ *
+ * The hash algorithm is provided by the caller. Functions here keep no state of their own, so they
+ * can be called concurrently on different ranges of the same file (each caller with its own hash
+ * context).
+ *
+ * Linux-SGX PAL verifies the whole range on the calling thread, also for large file mappings. The
+ * only threads available inside the enclave are backed by TCS slots (`sgx.thread_num`) that are
+ * shared with the application, so helper threads for hashing could make the application's own
+ * thread creation fail.
+ */
+
+#ifndef CHUNK_VERIFY_H
+#define CHUNK_VERIFY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CHUNK_HASH_SIZE 16
+
+struct chunk_hash_ops {
+    int (*init)(void* ctx);
+    int (*update)(void* ctx, const void* data, size_t size);
+    /* writes the (possibly truncated) hash of the chunk to `hash` */
+    int (*final)(void* ctx, uint8_t hash[CHUNK_HASH_SIZE]);
+};
+
+struct chunked_file {
+    const uint8_t* umem;         /* untrusted memory with contents of the whole file */
+    uint64_t size;               /* size of the file; only the last chunk may be shorter */
+    size_t chunk_size;
+    const uint8_t* chunk_hashes; /* CHUNK_HASH_SIZE bytes for each chunk of the file */
+    const struct chunk_hash_ops* hash_ops;
+};
+
+/*!
+ * \brief Copy file contents `[offset, end)` into `buf` and verify all chunks they overlap with.
+ *
+ * \param      file           File to copy from.
+ * \param      hash_ctx       Context for `file->hash_ops`, must not be used concurrently.
+ * \param      buf            Buffer of at least `end - offset` bytes.
+ * \param      offset         Start of the range to copy, may be unaligned.
+ * \param      end            End of the range to copy, may be unaligned, at most the file size.
+ * \param[out] out_bad_chunk  On -PAL_ERROR_DENIED, offset of the chunk with a wrong hash.
+ *
+ * \returns 0 on success, -PAL_ERROR_DENIED if a chunk doesn't match its hash, or an error returned
+ *          by `file->hash_ops`. On failure, `buf` is zeroed.
+ */
+int chunked_file_copy_and_verify(const struct chunked_file* file, void* hash_ctx, uint8_t* buf,
+                                 uint64_t offset, uint64_t end, uint64_t* out_bad_chunk);
+
+#endif // CHUNK_VERIFY_H
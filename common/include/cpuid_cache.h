@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Cache of CPUID results (used e.g. in Linux-SGX PAL, where CPUID needs an OCALL), keyed by leaf
+ * and subleaf. It is an open-addressing hash table that starts small and doubles as it fills, up to
+ * a given number of entries; after that, new results are not cached. Memory for the table comes
+ * from callbacks provided by the caller. No locking is done, the caller must serialize access to a
+ * cache.
+ *
+ * A zero-initialized cache caches nothing; use cpuid_cache_init() to set its limit.
+ */
+
+#ifndef CPUID_CACHE_H
+#define CPUID_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CPUID_CACHE_INIT_CAPACITY 64
+
+struct cpuid_cache_entry {
+    uint32_t leaf;
+    uint32_t subleaf;
+    uint32_t values[4];
+    bool used;
+};
+
+struct cpuid_cache {
+    struct cpuid_cache_entry* entries;
+    size_t capacity;  /* number of slots, a power of two (or 0 before the first entry is added) */
+    size_t count;     /* number of used slots, at most half of `capacity` */
+    size_t max_count; /* limit of `count` */
+    void* (*alloc_mem)(size_t size);
+    void (*free_mem)(void* ptr);
+};
+
+/* Sets the limit of cached entries and the memory allocation callbacks; the cache must be empty. */
+void cpuid_cache_init(struct cpuid_cache* cache, size_t max_count,
+                      void* (*alloc_mem)(size_t size), void (*free_mem)(void* ptr));
+
+/* Frees the memory of the cache and empties it, keeping the limit. */
+void cpuid_cache_clear(struct cpuid_cache* cache);
+
+/* Looks up results of CPUID for `leaf` and `subleaf`. Returns false if they are not cached. */
+bool cpuid_cache_get(const struct cpuid_cache* cache, uint32_t leaf, uint32_t subleaf,
+                     uint32_t values[4]);
+
+/* Caches results of CPUID for `leaf` and `subleaf` (replacing already cached ones). Returns
+ * -PAL_ERROR_NOMEM if the cache is full or cannot grow, leaving the cache unchanged. */
+int cpuid_cache_add(struct cpuid_cache* cache, uint32_t leaf, uint32_t subleaf,
+                    const uint32_t values[4]);
+
+#endif // CPUID_CACHE_H
@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/*
+ * Set of disjoint address ranges, kept in an AVL tree augmented with the largest free gap between
+ * the ranges of each subtree. Lookups, insertions and removals are O(log(n)) (plus the number of
+ * merged/removed ranges), and so is finding the highest free area of a given size.
+ *
+ * Every range has a type. Ranges of the same type that overlap or touch are merged into one, ranges
+ * of different types are never merged and must not overlap.
+ *
+ * The module does no locking and no memory allocation on its own: nodes are taken from
+ * `alloc_node` and given back via `free_node`, both called with the caller's locks held. Each
+ * operation needs at most one new node, and a failed operation leaves the tree unchanged.
+ */
+
+#ifndef RANGE_TREE_H
+#define RANGE_TREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "avl_tree.h"
+
+struct range_tree_node {
+    struct avl_tree_node node;
+    uintptr_t start;
+    uintptr_t end;
+    unsigned int type;
+    /* augmented data, describes the subtree rooted at this node */
+    uintptr_t subtree_start;
+    uintptr_t subtree_end;
+    size_t max_gap; /* largest free area between two ranges of the subtree */
+};
+
+struct range_tree {
+    struct avl_tree tree;
+    size_t nodes_count;
+    struct range_tree_node* (*alloc_node)(void);
+    void (*free_node)(struct range_tree_node* node);
+};
+
+void range_tree_init(struct range_tree* rt, struct range_tree_node* (*alloc_node)(void),
+                     void (*free_node)(struct range_tree_node* node));
+
+/*!
+ * \brief Add range [start, end) of type `type`.
+ *
+ * The range is merged with all overlapping and adjacent ranges of the same type (similar to
+ * `mmap(MAP_FIXED)` over existing mappings).
+ *
+ * \param      rt         The tree.
+ * \param      start      Start of the range.
+ * \param      end        End of the range (exclusive), must be greater than `start`.
+ * \param      type       Type of the range.
+ * \param[out] out_added  On success, the number of bytes that were not covered by any range before.
+ *
+ * \returns 0 on success, -PAL_ERROR_INVAL if the range overlaps a range of another type,
+ *          -PAL_ERROR_NOMEM if a new node was needed and `alloc_node` failed.
+ */
+int range_tree_add(struct range_tree* rt, uintptr_t start, uintptr_t end, unsigned int type,
+                   size_t* out_added);
+
+/*!
+ * \brief Remove [start, end) from the ranges in the tree.
+ *
+ * Parts of [start, end) not covered by any range are ignored; a range containing [start, end)
+ * strictly inside is split in two.
+ *
+ * \param      rt           The tree.
+ * \param      start        Start of the area to remove.
+ * \param      end          End of the area to remove (exclusive), must be greater than `start`.
+ * \param[out] out_removed  On success, the number of bytes that were covered by ranges.
+ *
+ * \returns 0 on success, -PAL_ERROR_INVAL if the area overlaps ranges of different types,
+ *          -PAL_ERROR_NOMEM if a range had to be split and `alloc_node` failed.
+ */
+int range_tree_remove(struct range_tree* rt, uintptr_t start, uintptr_t end, size_t* out_removed);
+
+/*!
+ * \brief Find the highest free area of `size` bytes in [lower, upper).
+ *
+ * All ranges in the tree must lie within [lower, upper). This is a first-fit search from the top:
+ * the returned area ends at `upper` or at the start of a range.
+ *
+ * \returns true and sets `*out_addr` to the start of the area if found, false otherwise.
+ */
+bool range_tree_find_free(struct range_tree* rt, uintptr_t lower, uintptr_t upper, size_t size,
+                          uintptr_t* out_addr);
+
+/* Returns the range containing `addr` or NULL if there is none. */
+struct range_tree_node* range_tree_find(struct range_tree* rt, uintptr_t addr);
+
+/* Checks all invariants: order, disjointness, merging of same-type ranges, augmented data and
+ * AVL balance. O(n), meant for tests. */
+bool debug_range_tree_is_valid(struct range_tree* rt);
+
+#endif // RANGE_TREE_H
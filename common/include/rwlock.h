@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+/* NOTE: This reader/writer lock implementation follows the spinlock one; see spinlock.h for
+ *       details.
+ *
+ * Reader/writer spinning lock: any number of readers can hold the lock at the same time, writers
+ * hold it exclusively. A waiting writer stops new readers from taking the lock, so writers are not
+ * starved by a continuous stream of readers (but readers may be starved by writers).
+ *
+ * Unlike seqlocks, readers may dereference pointers and call functions that are not safe to run
+ * concurrently with writers. Readers must not mutate any shared state protected by the lock.
+ */
+
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include "api.h"
+#include "cpu.h"
+
+typedef struct {
+    uint32_t state;
+} rwlock_t;
+
+/* held by a writer, the remaining bits are unused */
+#define RWLOCK_WRITER         0x80000000U
+/* a writer waits for the readers to leave, no new readers are let in */
+#define RWLOCK_WRITER_WAITING 0x40000000U
+/* number of readers holding the lock */
+#define RWLOCK_READERS_MASK   (~(RWLOCK_WRITER | RWLOCK_WRITER_WAITING))
+
+/*!
+ * \brief Initialize rwlock with *static* storage duration.
+ */
+#define INIT_RWLOCK_UNLOCKED { .state = 0 }
+
+/*!
+ * \brief Initialize rwlock with *dynamic* storage duration.
+ */
+static inline void rwlock_init(rwlock_t* lock) {
+    __atomic_store_n(&lock->state, 0, __ATOMIC_RELAXED);
+}
+
+/*!
+ * \brief Acquire rwlock for reading (shared with other readers).
+ */
+static inline void rwlock_read_lock(rwlock_t* lock) {
+    uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+    while (true) {
+        if (state & (RWLOCK_WRITER | RWLOCK_WRITER_WAITING)) {
+            CPU_RELAX();
+            state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+            continue;
+        }
+        assert((state & RWLOCK_READERS_MASK) != RWLOCK_READERS_MASK);
+        if (__atomic_compare_exchange_n(&lock->state, &state, state + 1, /*weak=*/false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
+/*!
+ * \brief Release rwlock held for reading.
+ */
+static inline void rwlock_read_unlock(rwlock_t* lock) {
+    __atomic_sub_fetch(&lock->state, 1, __ATOMIC_RELEASE);
+}
+
+/*!
+ * \brief Acquire rwlock for writing (exclusively).
+ */
+static inline void rwlock_write_lock(rwlock_t* lock) {
+    uint32_t state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+    while (true) {
+        if (!(state & (RWLOCK_WRITER | RWLOCK_READERS_MASK))) {
+            /* free (possibly with waiting writers, which will set the waiting flag again) */
+            if (__atomic_compare_exchange_n(&lock->state, &state, RWLOCK_WRITER, /*weak=*/false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                break;
+            continue;
+        }
+        if (!(state & RWLOCK_WRITER_WAITING)) {
+            /* don't let new readers in; failure only means that the state changed */
+            if (!__atomic_compare_exchange_n(&lock->state, &state, state | RWLOCK_WRITER_WAITING,
+                                             /*weak=*/false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                continue;
+        }
+        CPU_RELAX();
+        state = __atomic_load_n(&lock->state, __ATOMIC_RELAXED);
+    }
+}
+
+/*!
+ * \brief Release rwlock held for writing.
+ */
+static inline void rwlock_write_unlock(rwlock_t* lock) {
+    __atomic_store_n(&lock->state, 0, __ATOMIC_RELEASE);
+}
+
+#endif // _RWLOCK_H
@@ -204,10 +204,26 @@ static void rot2LR(struct avl_tree_node* r, struct avl_tree_node* q, struct avl_
     r->balance = 0;
 }
 
+/* Recomputes augmented data of nodes moved by a rotation: `a` and `b` (may be NULL) are children of
+ * `top`, the new root of the rotated subtree. The subtree as a whole contains the same nodes as
+ * before, so nodes above it need no update. */
+static void avl_tree_update_rotated(struct avl_tree* tree, struct avl_tree_node* a,
+                                    struct avl_tree_node* b, struct avl_tree_node* top) {
+    if (!tree->update) {
+        return;
+    }
+    tree->update(a);
+    if (b) {
+        tree->update(b);
+    }
+    tree->update(top);
+}
+
 /* Does appropriate rotation of node, which mush have disturbed balance (i.e. +2/-2).
  * Returns whether height might have changed and sets `new_root_ptr` to root of this subtree after
  * rotation. */
-static bool avl_tree_do_balance(struct avl_tree_node* node, struct avl_tree_node** new_root_ptr) {
+static bool avl_tree_do_balance(struct avl_tree* tree, struct avl_tree_node* node,
+                                struct avl_tree_node** new_root_ptr) {
     assert(node->balance == -2 || node->balance == 2);
 
     struct avl_tree_node* child = NULL;
@@ -219,11 +235,13 @@ static bool avl_tree_do_balance(struct avl_tree_node* node, struct avl_tree_node
             assert(child->right);
             *new_root_ptr = child->right;
             rot2LR(child->right, child, node);
+            avl_tree_update_rotated(tree, child, node, *new_root_ptr);
             return true;
         } else { // child->balance <= 0
             *new_root_ptr = child;
             ret = child->balance != 0;
             rot1R(child, node);
+            avl_tree_update_rotated(tree, node, NULL, child);
             return ret;
         }
     } else { // node->balance == 2
@@ -232,11 +250,13 @@ static bool avl_tree_do_balance(struct avl_tree_node* node, struct avl_tree_node
             *new_root_ptr = child;
             ret = child->balance != 0;
             rot1L(child, node);
+            avl_tree_update_rotated(tree, node, NULL, child);
             return ret;
         } else { // child->balance == -1
             assert(child->left);
             *new_root_ptr = child->left;
             rot2RL(child->left, child, node);
+            avl_tree_update_rotated(tree, node, child, *new_root_ptr);
             return true;
         }
     }
@@ -255,8 +275,8 @@ enum side {
  *
  * Returns the root of the subtree that balancing stopped at.
  */
-static struct avl_tree_node* avl_tree_balance(struct avl_tree_node* node, enum side side,
-                                              bool height_increased) {
+static struct avl_tree_node* avl_tree_balance(struct avl_tree* tree, struct avl_tree_node* node,
+                                              enum side side, bool height_increased) {
     assert(node);
 
     while (1) {
@@ -283,7 +303,7 @@ static struct avl_tree_node* avl_tree_balance(struct avl_tree_node* node, enum s
 
         assert(-2 <= node->balance && node->balance <= 2);
         if (node->balance == -2 || node->balance == 2) {
-            height_changed = avl_tree_do_balance(node, &node);
+            height_changed = avl_tree_do_balance(tree, node, &node);
             /* On inserting height never changes. */
             height_changed = height_increased ? false : height_changed;
         }
@@ -303,12 +323,23 @@ static struct avl_tree_node* avl_tree_balance(struct avl_tree_node* node, enum s
     }
 }
 
+void avl_tree_update(struct avl_tree* tree, struct avl_tree_node* node) {
+    if (!tree->update) {
+        return;
+    }
+    while (node) {
+        tree->update(node);
+        node = node->parent;
+    }
+}
+
 void avl_tree_insert(struct avl_tree* tree, struct avl_tree_node* node) {
     avl_tree_init_node(node);
 
     /* Inserting into an empty tree. */
     if (!tree->root) {
         tree->root = node;
+        avl_tree_update(tree, node);
         return;
     }
 
@@ -316,13 +347,16 @@ void avl_tree_insert(struct avl_tree* tree, struct avl_tree_node* node) {
 
     assert(node->parent);
 
+    /* Rotations keep augmented data up to date, as long as it was correct before balancing. */
+    avl_tree_update(tree, node);
+
     struct avl_tree_node* new_root;
 
     if (node->parent->left == node) {
-        new_root = avl_tree_balance(node->parent, LEFT, /*height_increased=*/true);
+        new_root = avl_tree_balance(tree, node->parent, LEFT, /*height_increased=*/true);
     } else {
         assert(node->parent->right == node);
-        new_root = avl_tree_balance(node->parent, RIGHT, /*height_increased=*/true);
+        new_root = avl_tree_balance(tree, node->parent, RIGHT, /*height_increased=*/true);
     }
 
     if (!new_root->parent) {
@@ -352,6 +386,8 @@ void avl_tree_swap_node(struct avl_tree* tree, struct avl_tree_node* old_node,
     if (tree->root == old_node) {
         tree->root = new_node;
     }
+
+    avl_tree_update(tree, new_node);
 }
 
 struct avl_tree_node* avl_tree_prev(struct avl_tree_node* node) {
@@ -479,9 +515,11 @@ void avl_tree_delete(struct avl_tree* tree, struct avl_tree_node* node) {
         fixup_link(/*old_node=*/node, /*new_node=*/node->right, /*parent=*/node->parent);
     }
 
+    avl_tree_update(tree, node->parent);
+
     /* After removal the tree might need balancing. */
     if (node->parent) {
-        new_root = avl_tree_balance(node->parent, side, /*height_increased=*/false);
+        new_root = avl_tree_balance(tree, node->parent, side, /*height_increased=*/false);
     }
 
     if ((new_root && !new_root->parent) || !node->parent) {
@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+#include "buf_pool.h"
+
+#include "api.h"
+#include "assert.h"
+
+void buf_pool_init(struct buf_pool* pool, size_t slots, size_t max_size) {
+    assert(slots <= BUF_POOL_MAX_SLOTS);
+
+    memset(pool, 0, sizeof(*pool));
+    pool->slots    = slots;
+    pool->max_size = max_size;
+}
+
+int buf_pool_class(size_t size) {
+    size_t class_size = BUF_POOL_MIN_SIZE;
+    for (int cls = 0; cls < BUF_POOL_CLASSES; cls++) {
+        if (size <= class_size)
+            return cls;
+        class_size *= 2;
+    }
+    return -1;
+}
+
+size_t buf_pool_class_size(int cls) {
+    assert(0 <= cls && cls < BUF_POOL_CLASSES);
+    return BUF_POOL_MIN_SIZE << cls;
+}
+
+void* buf_pool_get(struct buf_pool* pool, int cls) {
+    assert(0 <= cls && cls < BUF_POOL_CLASSES);
+
+    if (!pool->count[cls])
+        return NULL;
+
+    pool->count[cls]--;
+    pool->size -= buf_pool_class_size(cls);
+    return pool->bufs[cls][pool->count[cls]];
+}
+
+bool buf_pool_put(struct buf_pool* pool, int cls, void* buf) {
+    assert(0 <= cls && cls < BUF_POOL_CLASSES);
+    assert(buf);
+
+    size_t class_size = buf_pool_class_size(cls);
+    if (pool->count[cls] >= pool->slots || pool->max_size - pool->size < class_size)
+        return false;
+
+    pool->bufs[cls][pool->count[cls]] = buf;
+    pool->count[cls]++;
+    pool->size += class_size;
+    return true;
+}
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+#include "chunk_verify.h"
+
+#include "api.h"
+#include "assert.h"
+#include "pal_error.h"
+
+/* granularity of interleaving copies with hashing; small enough for the copied data to stay in L1
+ * cache until it's hashed */
+#define COPY_SLICE_SIZE   4096UL
+/* size of the on-stack buffer for parts of chunks that the caller didn't ask for */
+#define BOUNCE_SLICE_SIZE 1024UL
+
+/* copies `size` bytes from `src` to `dst` and hashes the copy */
+static int copy_and_hash(const struct chunk_hash_ops* ops, void* ctx, uint8_t* dst,
+                         const uint8_t* src, size_t size) {
+    while (size) {
+        size_t slice = MIN(size, COPY_SLICE_SIZE);
+        memcpy(dst, src, slice);
+        int ret = ops->update(ctx, dst, slice);
+        if (ret < 0)
+            return ret;
+        dst  += slice;
+        src  += slice;
+        size -= slice;
+    }
+    return 0;
+}
+
+/* hashes `size` bytes of untrusted memory at `src` (through a copy, without keeping it) */
+static int hash_untrusted(const struct chunk_hash_ops* ops, void* ctx, const uint8_t* src,
+                          size_t size) {
+    uint8_t bounce[BOUNCE_SLICE_SIZE];
+    while (size) {
+        size_t slice = MIN(size, sizeof(bounce));
+        memcpy(bounce, src, slice);
+        int ret = ops->update(ctx, bounce, slice);
+        if (ret < 0)
+            return ret;
+        src  += slice;
+        size -= slice;
+    }
+    return 0;
+}
+
+int chunked_file_copy_and_verify(const struct chunked_file* file, void* hash_ctx, uint8_t* buf,
+                                 uint64_t offset, uint64_t end, uint64_t* out_bad_chunk) {
+    assert(offset <= end && end <= file->size);
+    assert(file->chunk_size);
+
+    if (offset == end)
+        return 0;
+
+    const struct chunk_hash_ops* ops = file->hash_ops;
+    int ret;
+
+    uint8_t* buf_pos = buf;
+    uint64_t chunk_offset = ALIGN_DOWN(offset, file->chunk_size);
+    for (; chunk_offset < end; chunk_offset += file->chunk_size) {
+        uint64_t chunk_end  = MIN(chunk_offset + file->chunk_size, file->size);
+        uint64_t copy_start = MAX(chunk_offset, offset);
+        uint64_t copy_end   = MIN(chunk_end, end);
+
+        ret = ops->init(hash_ctx);
+        if (ret < 0)
+            goto fail;
+
+        /* the chunk is hashed in order: its head that the caller didn't ask for (only in the first
+         * chunk), the requested part (copied straight into `buf`), its tail (only in the last) */
+        ret = hash_untrusted(ops, hash_ctx, file->umem + chunk_offset, copy_start - chunk_offset);
+        if (ret < 0)
+            goto fail;
+
+        ret = copy_and_hash(ops, hash_ctx, buf_pos, file->umem + copy_start,
+                            copy_end - copy_start);
+        if (ret < 0)
+            goto fail;
+        buf_pos += copy_end - copy_start;
+
+        ret = hash_untrusted(ops, hash_ctx, file->umem + copy_end, chunk_end - copy_end);
+        if (ret < 0)
+            goto fail;
+
+        uint8_t hash[CHUNK_HASH_SIZE];
+        ret = ops->final(hash_ctx, hash);
+        if (ret < 0)
+            goto fail;
+
+        const uint8_t* expected_hash = file->chunk_hashes
+                                       + chunk_offset / file->chunk_size * CHUNK_HASH_SIZE;
+        if (memcmp(hash, expected_hash, sizeof(hash))) {
+            *out_bad_chunk = chunk_offset;
+            ret = -PAL_ERROR_DENIED;
+            goto fail;
+        }
+    }
+
+    return 0;
+
+fail:
+    memset(buf, 0, end - offset);
+    return ret;
+}
@@ -0,0 +1,105 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+#include "cpuid_cache.h"
+
+#include "api.h"
+#include "assert.h"
+#include "pal_error.h"
+
+void cpuid_cache_init(struct cpuid_cache* cache, size_t max_count,
+                      void* (*alloc_mem)(size_t size), void (*free_mem)(void* ptr)) {
+    assert(!cache->count);
+
+    memset(cache, 0, sizeof(*cache));
+    cache->max_count = max_count;
+    cache->alloc_mem = alloc_mem;
+    cache->free_mem  = free_mem;
+}
+
+void cpuid_cache_clear(struct cpuid_cache* cache) {
+    if (cache->entries)
+        cache->free_mem(cache->entries);
+    cache->entries  = NULL;
+    cache->capacity = 0;
+    cache->count    = 0;
+}
+
+static size_t hash_slot(size_t capacity, uint32_t leaf, uint32_t subleaf) {
+    /* leaves are small numbers or 0x8000000x, subleaves are small numbers; spread them over the
+     * whole table (multiplicative hashing with the golden ratio, taking the top bits) */
+    uint64_t key = ((uint64_t)leaf << 32) | subleaf;
+    return (key * 0x9e3779b97f4a7c15UL) >> (64 - __builtin_ctzl(capacity));
+}
+
+static struct cpuid_cache_entry* find_slot(struct cpuid_cache_entry* entries, size_t capacity,
+                                           uint32_t leaf, uint32_t subleaf) {
+    /* linear probing; the table is never more than half full, so there is always a free slot */
+    size_t slot = hash_slot(capacity, leaf, subleaf);
+    while (entries[slot].used && (entries[slot].leaf != leaf || entries[slot].subleaf != subleaf))
+        slot = (slot + 1) & (capacity - 1);
+    return &entries[slot];
+}
+
+bool cpuid_cache_get(const struct cpuid_cache* cache, uint32_t leaf, uint32_t subleaf,
+                     uint32_t values[4]) {
+    if (!cache->count)
+        return false;
+
+    struct cpuid_cache_entry* entry = find_slot(cache->entries, cache->capacity, leaf, subleaf);
+    if (!entry->used)
+        return false;
+
+    memcpy(values, entry->values, sizeof(entry->values));
+    return true;
+}
+
+static int grow(struct cpuid_cache* cache) {
+    size_t new_capacity = cache->capacity ? cache->capacity * 2 : CPUID_CACHE_INIT_CAPACITY;
+    struct cpuid_cache_entry* new_entries = cache->alloc_mem(new_capacity * sizeof(*new_entries));
+    if (!new_entries)
+        return -PAL_ERROR_NOMEM;
+    memset(new_entries, 0, new_capacity * sizeof(*new_entries));
+
+    for (size_t i = 0; i < cache->capacity; i++) {
+        struct cpuid_cache_entry* entry = &cache->entries[i];
+        if (entry->used)
+            *find_slot(new_entries, new_capacity, entry->leaf, entry->subleaf) = *entry;
+    }
+
+    if (cache->entries)
+        cache->free_mem(cache->entries);
+    cache->entries  = new_entries;
+    cache->capacity = new_capacity;
+    return 0;
+}
+
+int cpuid_cache_add(struct cpuid_cache* cache, uint32_t leaf, uint32_t subleaf,
+                    const uint32_t values[4]) {
+    struct cpuid_cache_entry* entry;
+    if (cache->count) {
+        entry = find_slot(cache->entries, cache->capacity, leaf, subleaf);
+        if (entry->used) {
+            memcpy(entry->values, values, sizeof(entry->values));
+            return 0;
+        }
+    }
+
+    if (cache->count >= cache->max_count)
+        return -PAL_ERROR_NOMEM;
+
+    if ((cache->count + 1) * 2 > cache->capacity) {
+        int ret = grow(cache);
+        if (ret < 0)
+            return ret;
+    }
+
+    entry = find_slot(cache->entries, cache->capacity, leaf, subleaf);
+    assert(!entry->used);
+    entry->leaf    = leaf;
+    entry->subleaf = subleaf;
+    memcpy(entry->values, values, sizeof(entry->values));
+    entry->used    = true;
+    cache->count++;
+    return 0;
+}
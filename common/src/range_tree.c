@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+/* Copyright (C) 2022 Intel Corporation */
+
+#include "range_tree.h"
+
+#include "api.h"
+#include "assert.h"
+#include "pal_error.h"
+
+static struct range_tree_node* node2range(struct avl_tree_node* node) {
+    return container_of(node, struct range_tree_node, node);
+}
+
+static bool range_tree_cmp(struct avl_tree_node* a, struct avl_tree_node* b) {
+    return node2range(a)->start <= node2range(b)->start;
+}
+
+/* Ranges are disjoint, so they are ordered by their ends as well as by their starts. */
+static bool range_end_ge(void* addr, struct avl_tree_node* node) {
+    return *(uintptr_t*)addr <= node2range(node)->end;
+}
+
+static bool range_end_gt(void* addr, struct avl_tree_node* node) {
+    return *(uintptr_t*)addr < node2range(node)->end;
+}
+
+static void range_tree_update_node(struct avl_tree_node* avl_node) {
+    struct range_tree_node* node = node2range(avl_node);
+
+    node->subtree_start = node->start;
+    node->subtree_end   = node->end;
+    node->max_gap       = 0;
+
+    if (avl_node->left) {
+        struct range_tree_node* left = node2range(avl_node->left);
+        node->subtree_start = left->subtree_start;
+        node->max_gap = MAX(left->max_gap, node->start - left->subtree_end);
+    }
+    if (avl_node->right) {
+        struct range_tree_node* right = node2range(avl_node->right);
+        node->subtree_end = right->subtree_end;
+        node->max_gap = MAX(node->max_gap, MAX(right->max_gap, right->subtree_start - node->end));
+    }
+}
+
+static size_t overlap_size(struct range_tree_node* node, uintptr_t start, uintptr_t end) {
+    uintptr_t overlap_start = MAX(node->start, start);
+    uintptr_t overlap_end   = MIN(node->end, end);
+    return overlap_end > overlap_start ? overlap_end - overlap_start : 0;
+}
+
+void range_tree_init(struct range_tree* rt, struct range_tree_node* (*alloc_node)(void),
+                     void (*free_node)(struct range_tree_node* node)) {
+    rt->tree.root   = NULL;
+    rt->tree.cmp    = range_tree_cmp;
+    rt->tree.update = range_tree_update_node;
+    rt->nodes_count = 0;
+    rt->alloc_node  = alloc_node;
+    rt->free_node   = free_node;
+}
+
+int range_tree_add(struct range_tree* rt, uintptr_t start, uintptr_t end, unsigned int type,
+                   size_t* out_added) {
+    assert(start < end);
+
+    /* first range that overlaps or touches [start, end) */
+    struct avl_tree_node* first = avl_tree_lower_bound_fn(&rt->tree, &start, range_end_ge);
+
+    /* check for overlaps with ranges of other types and find the first range to merge with; ranges
+     * of other types can only touch [start, end) at its ends, so they cannot separate two ranges
+     * that are merged */
+    struct range_tree_node* merged = NULL;
+    for (struct avl_tree_node* avl_node = first; avl_node; avl_node = avl_tree_next(avl_node)) {
+        struct range_tree_node* node = node2range(avl_node);
+        if (node->start > end)
+            break;
+        if (node->type == type) {
+            if (!merged)
+                merged = node;
+        } else if (overlap_size(node, start, end)) {
+            return -PAL_ERROR_INVAL;
+        }
+    }
+
+    if (!merged) {
+        struct range_tree_node* node = rt->alloc_node();
+        if (!node)
+            return -PAL_ERROR_NOMEM;
+        node->start = start;
+        node->end   = end;
+        node->type  = type;
+        avl_tree_insert(&rt->tree, &node->node);
+        rt->nodes_count++;
+        *out_added = end - start;
+        return 0;
+    }
+
+    /* extend the first range over [start, end) and the following ranges of the same type */
+    size_t covered = overlap_size(merged, start, end);
+    uintptr_t new_start = MIN(merged->start, start);
+    uintptr_t new_end   = MAX(merged->end, end);
+
+    struct avl_tree_node* avl_node = avl_tree_next(&merged->node);
+    while (avl_node) {
+        struct range_tree_node* node = node2range(avl_node);
+        if (node->start > end)
+            break;
+        avl_node = avl_tree_next(avl_node);
+
+        if (node->type != type)
+            continue;
+        covered += overlap_size(node, start, end);
+        new_end = MAX(new_end, node->end);
+        avl_tree_delete(&rt->tree, &node->node);
+        rt->nodes_count--;
+        rt->free_node(node);
+    }
+
+    /* this does not change the order: only ranges of other types touching `start` may precede
+     * `merged` in [new_start, new_end) */
+    merged->start = new_start;
+    merged->end   = new_end;
+    avl_tree_update(&rt->tree, &merged->node);
+
+    *out_added = end - start - covered;
+    return 0;
+}
+
+int range_tree_remove(struct range_tree* rt, uintptr_t start, uintptr_t end, size_t* out_removed) {
+    assert(start < end);
+
+    /* first range that overlaps [start, end) */
+    struct avl_tree_node* first = avl_tree_lower_bound_fn(&rt->tree, &start, range_end_gt);
+
+    bool need_split = false;
+    for (struct avl_tree_node* avl_node = first; avl_node; avl_node = avl_tree_next(avl_node)) {
+        struct range_tree_node* node = node2range(avl_node);
+        if (node->start >= end)
+            break;
+        if (node->type != node2range(first)->type)
+            return -PAL_ERROR_INVAL;
+        if (node->start < start && node->end > end)
+            need_split = true;
+    }
+
+    struct range_tree_node* split = NULL;
+    if (need_split) {
+        split = rt->alloc_node();
+        if (!split)
+            return -PAL_ERROR_NOMEM;
+    }
+
+    size_t removed = 0;
+    struct avl_tree_node* avl_node = first;
+    while (avl_node) {
+        struct range_tree_node* node = node2range(avl_node);
+        if (node->start >= end)
+            break;
+        avl_node = avl_tree_next(avl_node);
+
+        removed += overlap_size(node, start, end);
+
+        if (node->start < start && node->end > end) {
+            /* [start, end) is strictly inside the range, leave [node->start, start) in `node` and
+             * put [end, node->end) in a new one */
+            split->start = end;
+            split->end   = node->end;
+            split->type  = node->type;
+            node->end = start;
+            avl_tree_update(&rt->tree, &node->node);
+            avl_tree_insert(&rt->tree, &split->node);
+            rt->nodes_count++;
+        } else if (node->start < start) {
+            node->end = start;
+            avl_tree_update(&rt->tree, &node->node);
+        } else if (node->end > end) {
+            node->start = end;
+            avl_tree_update(&rt->tree, &node->node);
+        } else {
+            avl_tree_delete(&rt->tree, &node->node);
+            rt->nodes_count--;
+            rt->free_node(node);
+        }
+    }
+
+    *out_removed = removed;
+    return 0;
+}
+
+bool range_tree_find_free(struct range_tree* rt, uintptr_t lower, uintptr_t upper, size_t size,
+                          uintptr_t* out_addr) {
+    assert(lower <= upper);
+
+    if (upper - lower < size)
+        return false;
+
+    if (!rt->tree.root) {
+        *out_addr = upper - size;
+        return true;
+    }
+
+    struct range_tree_node* root = node2range(rt->tree.root);
+    assert(lower <= root->subtree_start && root->subtree_end <= upper);
+
+    /* gaps are checked from the highest one: above all ranges, between ranges, below all ranges */
+    if (upper - root->subtree_end >= size) {
+        *out_addr = upper - size;
+        return true;
+    }
+
+    if (root->max_gap >= size) {
+        /* there is a fitting gap in the subtree of `node`, find the highest one */
+        struct range_tree_node* node = root;
+        while (true) {
+            struct range_tree_node* left = node->node.left ? node2range(node->node.left) : NULL;
+            struct range_tree_node* right = node->node.right ? node2range(node->node.right) : NULL;
+
+            if (right && right->max_gap >= size) {
+                node = right;
+                continue;
+            }
+            if (right && right->subtree_start - node->end >= size) {
+                *out_addr = right->subtree_start - size;
+                return true;
+            }
+            if (left && node->start - left->subtree_end >= size) {
+                *out_addr = node->start - size;
+                return true;
+            }
+            assert(left && left->max_gap >= size);
+            node = left;
+        }
+    }
+
+    if (root->subtree_start - lower >= size) {
+        *out_addr = root->subtree_start - size;
+        return true;
+    }
+
+    return false;
+}
+
+struct range_tree_node* range_tree_find(struct range_tree* rt, uintptr_t addr) {
+    struct avl_tree_node* avl_node = avl_tree_lower_bound_fn(&rt->tree, &addr, range_end_gt);
+    if (!avl_node || node2range(avl_node)->start > addr)
+        return NULL;
+    return node2range(avl_node);
+}
+
+/* Checks augmented data of the subtree rooted at `avl_node` by recomputing it bottom-up. */
+static bool debug_range_subtree_is_valid(struct avl_tree_node* avl_node) {
+    if (!avl_node)
+        return true;
+
+    if (!debug_range_subtree_is_valid(avl_node->left)
+            || !debug_range_subtree_is_valid(avl_node->right))
+        return false;
+
+    struct range_tree_node* node = node2range(avl_node);
+    struct range_tree_node expected = *node;
+    range_tree_update_node(&expected.node);
+    return node->subtree_start == expected.subtree_start
+           && node->subtree_end == expected.subtree_end
+           && node->max_gap == expected.max_gap;
+}
+
+bool debug_range_tree_is_valid(struct range_tree* rt) {
+    size_t count = 0;
+    struct range_tree_node* prev = NULL;
+    for (struct avl_tree_node* avl_node = avl_tree_first(&rt->tree); avl_node;
+             avl_node = avl_tree_next(avl_node)) {
+        struct range_tree_node* node = node2range(avl_node);
+        if (node->start >= node->end)
+            return false;
+        if (prev && (prev->end > node->start
+                     || (prev->end == node->start && prev->type == node->type)))
+            return false;
+        prev = node;
+        count++;
+    }
+
+    return count == rt->nodes_count && debug_range_subtree_is_valid(rt->tree.root)
+           && debug_avl_tree_is_balanced(&rt->tree);
+}